@@ -19,20 +19,28 @@
 
 #include "util/Config.hh"
 
+#include "drive/CommonUri.hh"
+#include "drive/Daemon.hh"
 #include "drive/Drive.hh"
 
+#include "http/BatchAgent.hh"
+#include "http/CacheAgent.hh"
 #include "http/CurlAgent.hh"
+#include "http/CurlPool.hh"
 #include "protocol/AuthAgent.hh"
 #include "protocol/OAuth2.hh"
 #include "protocol/Json.hh"
 
 #include "bfd/Backtrace.hh"
 #include "util/Exception.hh"
+#include "util/File.hh"
+#include "util/Stats.hh"
 #include "util/log/Log.hh"
 #include "util/log/CompositeLog.hh"
 #include "util/log/DefaultLog.hh"
 
 // boost header
+#include <boost/cstdint.hpp>
 #include <boost/exception/all.hpp>
 #include <boost/program_options.hpp>
 
@@ -99,6 +107,28 @@ void InitLog( const po::variables_map& vm )
 	LogBase::Inst( std::auto_ptr<LogBase>(comp_log.release()) ) ;
 }
 
+/// The access token from the last run is cached in the config file, so that
+/// short runs don't need to refresh it.
+void LoadAccessToken( const Config& config, OAuth2& token )
+{
+	try
+	{
+		token.AccessToken(
+			config.Get("access_token").Str(),
+			DateTime( config.Get("access_token_expiry").As<boost::int64_t>() ) ) ;
+	}
+	catch ( Exception& )
+	{
+		Log( "no cached access token", log::verbose ) ;
+	}
+}
+
+void SaveAccessToken( Config& config, const OAuth2& token )
+{
+	config.Set( "access_token",			Json( token.AccessToken() ) ) ;
+	config.Set( "access_token_expiry",	Json( static_cast<boost::int64_t>(token.Expiry().Sec()) ) ) ;
+}
+
 int Main( int argc, char **argv )
 {
 	InitGCrypt() ;
@@ -119,6 +149,32 @@ int Main( int argc, char **argv )
 						"instead of uploading it." )
 		( "dry-run",	"Only detect which files need to be uploaded/downloaded, "
 						"without actually performing them." )
+		( "http2",		po::value<unsigned>()->implicit_value(16),
+						"Use HTTP/2 if the server supports it, and send up to N "
+						"requests at the same time over one connection (default 16)." )
+		( "batch",		po::value<unsigned>()->implicit_value(50),
+						"Delete up to N files in remote with one request to the batch "
+						"feed (default 50)." )
+		( "upload-threshold",	po::value<unsigned>()->default_value(65536),
+						"Upload files smaller than N bytes in a single request instead of "
+						"a resumable upload session. 0 disables it." )
+		( "no-cache",	"Don't keep the file lists in .grive_cache, which are only "
+						"downloaded again if they have changed." )
+		( "seed",		po::value<std::vector<std::string> >()->composing(),
+						"Copy files from this directory instead of downloading them, "
+						"if they have the same content. Can be given more than once." )
+		( "dump-state",	"Print the state file in JSON for debugging, and exit." )
+		( "daemon",		"Keep running, and sync whenever something changes in local "
+						"or in remote." )
+		( "poll",		po::value<unsigned>()->default_value(60),
+						"In daemon mode, check for changes in remote every N seconds." )
+		( "remote-dir,s",	po::value<std::string>(),
+						"Sync with this folder in Google Drive, e.g. \"Projects/Foo\", "
+						"instead of the whole drive. It is remembered for the next runs." )
+		( "stats",		"Print the counters and timers of the run, e.g. the bytes hashed "
+						"and the HTTP requests, as a table at the end." )
+		( "stats-json",	po::value<std::string>(),
+						"Write the counters and timers of the run to this file in JSON." )
 	;
 	
 	po::variables_map vm;
@@ -144,6 +200,15 @@ int Main( int argc, char **argv )
 	Config config(vm) ;
 	
 	Log( "config file name %1%", config.Filename(), log::verbose );
+	
+	if ( vm.count( "remote-dir" ) )
+		config.Set( "remote-dir", Json( vm["remote-dir"].as<std::string>() ) ) ;
+	
+	if ( vm.count( "dump-state" ) )
+	{
+		std::cout << Drive::DumpState( config.GetAll() ) << std::endl ;
+		return 0 ;
+	}
 
 	if ( vm.count( "auth" ) )
 	{
@@ -164,6 +229,7 @@ int Main( int argc, char **argv )
 		
 		// save to config
 		config.Set( "refresh_token", Json( token.RefreshToken() ) ) ;
+		SaveAccessToken( config, token ) ;
 		config.Save() ;
 	}
 	
@@ -182,21 +248,61 @@ int Main( int argc, char **argv )
 		return -1;
 	}
 	
+	if ( vm.count( "http2" ) && vm["http2"].as<unsigned>() > 0 &&
+		!http::CurlPool::Inst().EnableHttp2( vm["http2"].as<unsigned>() ) )
+		Log( "HTTP/2 is not supported by libcurl. using HTTP/1.1", log::warning ) ;
+	
 	OAuth2 token( refresh_token, client_id, client_secret ) ;
-	AuthAgent agent( token, std::auto_ptr<http::Agent>( new http::CurlAgent ) ) ;
-
-	Drive drive( &agent, config.GetAll() ) ;
-	drive.DetectChanges() ;
+	LoadAccessToken( config, token ) ;
+	std::auto_ptr<http::Agent> real_agent( new http::CurlAgent ) ;
+	if ( vm.count( "batch" ) )
+		real_agent.reset( new http::BatchAgent( real_agent, feed_base, vm["batch"].as<unsigned>() ) ) ;
+	
+	// the feeds, not the file contents, up to 4MB each
+	if ( vm.count( "no-cache" ) == 0 )
+		real_agent.reset( new http::CacheAgent( real_agent,
+			fs::path( config.Get( "path" ).Str() ) / ".grive_cache", feed_root, 4 << 20 ) ) ;
+	
+	AuthAgent agent( token, real_agent ) ;
 
-	if ( vm.count( "dry-run" ) == 0 )
+	if ( vm.count( "daemon" ) && vm.count( "dry-run" ) == 0 )
+		Daemon( &agent, config.GetAll() ).Run() ;
+	else
 	{
-		drive.Update() ;
-		drive.SaveState() ;
+		Drive drive( &agent, config.GetAll() ) ;
+		if ( drive.NothingChanged() )
+			Log( "nothing changed since the last sync", log::info ) ;
+		
+		else
+		{
+			drive.DetectChanges( vm.count( "dry-run" ) == 0 ) ;
+			
+			if ( vm.count( "dry-run" ) == 0 )
+			{
+				drive.Update() ;
+				drive.SaveState() ;
+			}
+			else
+				drive.DryRun() ;
+		}
 	}
-	else
-		drive.DryRun() ;
 	
+	SaveAccessToken( config, agent.Auth() ) ;
 	config.Save() ;
+	
+	const http::CurlPool::Stats& hs = http::CurlPool::Inst().GetStats() ;
+	Log( "%1% HTTP requests, %2% new connections, %3% seconds in connection setup",
+		hs.requests, hs.connects, hs.setup_time, log::verbose ) ;
+	
+	if ( vm.count( "stats" ) )
+		Stats::Inst().Print( std::cout ) ;
+	
+	if ( vm.count( "stats-json" ) )
+	{
+		gr::File file( vm["stats-json"].as<std::string>(), 0600 ) ;
+		Stats::Inst().ToJson().Write( &file ) ;
+	}
+	
 	Log( "Finished!", log::info ) ;
 	return 0 ;
 }
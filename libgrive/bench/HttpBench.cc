@@ -0,0 +1,106 @@
+/*
+	grive: an GPL program to sync a local directory with Google Drive
+	Copyright (C) 2012  Wan Wai Ho
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation version 2
+	of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+/*
+	Compare the request rate of HTTP/1.1, one request at a time, with HTTP/2
+	multiplexing. Run it against a local h2 server, e.g.
+
+		nghttpd -d /tmp/www 8443 server.key server.crt
+		httpbench https://localhost:8443/small.json 1000 16
+*/
+
+#include "http/CurlAgent.hh"
+#include "http/CurlPool.hh"
+#include "http/Header.hh"
+#include "http/StringResponse.hh"
+#include "util/DateTime.hh"
+#include "util/Stats.hh"
+
+#include <boost/lexical_cast.hpp>
+
+#include <algorithm>
+#include <iostream>
+#include <string>
+#include <vector>
+
+using namespace gr ;
+using namespace gr::http ;
+
+namespace
+{
+	void Report( const std::string& name, unsigned count, double sec, const CurlPool::Stats& before )
+	{
+		const CurlPool::Stats& after = CurlPool::Inst().GetStats() ;
+		std::cout
+			<< name << ": " << count << " requests in " << sec << " s, "
+			<< count / sec << " requests/s, "
+			<< after.connects - before.connects << " new connections" << std::endl ;
+	}
+}
+
+int main( int argc, char **argv )
+{
+	if ( argc < 2 )
+	{
+		std::cerr << "usage: " << argv[0] << " url [count] [streams]" << std::endl ;
+		return -1 ;
+	}
+	
+	std::string	url		= argv[1] ;
+	unsigned	count	= argc > 2 ? boost::lexical_cast<unsigned>( argv[2] ) : 1000 ;
+	unsigned	streams	= argc > 3 ? boost::lexical_cast<unsigned>( argv[3] ) : 16 ;
+	
+	CurlAgent agent ;
+	
+	// HTTP/1.1, one by one over a kept-alive connection
+	CurlPool::Stats before = CurlPool::Inst().GetStats() ;
+	DateTime start = DateTime::Now() ;
+	for ( unsigned i = 0 ; i < count ; i++ )
+	{
+		StringResponse str ;
+		agent.Get( url, &str, Header() ) ;
+	}
+	Report( "HTTP/1.1", count, Stats::Elapsed( start ), before ) ;
+	
+	if ( !CurlPool::Inst().EnableHttp2( streams ) )
+	{
+		std::cerr << "libcurl does not support HTTP/2" << std::endl ;
+		return -1 ;
+	}
+	
+	// HTTP/2, up to "streams" requests at the same time
+	before	= CurlPool::Inst().GetStats() ;
+	start	= DateTime::Now() ;
+	for ( unsigned done = 0 ; done < count ; )
+	{
+		unsigned n = std::min( streams, count - done ) ;
+		
+		std::vector<StringResponse>	str( n ) ;
+		std::vector<Request>		reqs ;
+		for ( unsigned i = 0 ; i < n ; i++ )
+			reqs.push_back( Request( "GET", url, &str[i] ) ) ;
+		
+		agent.Perform( reqs ) ;
+		done += n ;
+	}
+	Report( "HTTP/2", count, Stats::Elapsed( start ), before ) ;
+	
+	return 0 ;
+}
@@ -0,0 +1,245 @@
+/*
+	grive: an GPL program to sync a local directory with Google Drive
+	Copyright (C) 2012  Wan Wai Ho
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation version 2
+	of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+/*
+	Measure the time from start to the first transfer, and to the end of the
+	sync, with and without transferring the files while the remote file list
+	is read. The remote is a fake server that answers every page of the file
+	list after a delay. One in ten of its files are new, and are downloaded.
+	The others are created in the given directory if it is empty, e.g.
+
+		scanbench /tmp/scan 100000 200
+*/
+
+#include "drive/CommonUri.hh"
+#include "drive/Drive.hh"
+#include "drive/Feed.hh"
+#include "drive/State.hh"
+#include "http/Agent.hh"
+#include "protocol/Json.hh"
+#include "util/Crypt.hh"
+#include "util/DataStream.hh"
+#include "util/DateTime.hh"
+#include "util/FileSystem.hh"
+#include "util/Stats.hh"
+
+#include <boost/format.hpp>
+#include <boost/lexical_cast.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <algorithm>
+#include <fstream>
+#include <iostream>
+#include <string>
+
+using namespace gr ;
+using namespace gr::v1 ;
+
+namespace
+{
+	const unsigned page_size = 500 ;
+
+	/// The names of the files. The content of a file is its name.
+	std::string Name( unsigned i )
+	{
+		return ( boost::format( i % 10 == 0 ? "new%1%" : "file%1%" ) % i ).str() ;
+	}
+
+	std::string MD5( const std::string& content )
+	{
+		crypt::MD5 md5 ;
+		md5.Write( content.c_str(), content.size() ) ;
+		return md5.Get() ;
+	}
+
+	/// Answers the file list of "count" files in the root folder, one page
+	/// at a time, "latency" milliseconds after each request. The contents
+	/// are answered right away.
+	class FeedAgent : public http::Agent
+	{
+	public :
+		FeedAgent( unsigned count, unsigned latency ) :
+			m_count( count ), m_latency( latency )
+		{
+		}
+
+		/// When the first content was requested since the last Reset().
+		DateTime FirstTransfer() const
+		{
+			return m_first ;
+		}
+
+		void Reset()
+		{
+			m_first = DateTime() ;
+		}
+
+		long Put( const std::string&, const std::string&, DataStream *, const http::Header& )
+		{
+			return 200 ;
+		}
+
+		long Put( const std::string&, File *, DataStream *, const http::Header& )
+		{
+			return 200 ;
+		}
+
+		long Get( const std::string& url, DataStream *dest, const http::Header& )
+		{
+			std::size_t content = url.find( "/content" ) ;
+			if ( content != std::string::npos )
+			{
+				if ( m_first == DateTime() )
+					m_first = DateTime::Now() ;
+
+				std::size_t id = url.find( "%3A" ) + 3 ;
+				std::string name = Name( boost::lexical_cast<unsigned>( url.substr( id, content - id ) ) ) ;
+				dest->Write( name.c_str(), name.size() ) ;
+				return 200 ;
+			}
+
+			boost::this_thread::sleep( boost::posix_time::milliseconds( m_latency ) ) ;
+
+			std::string page = url.find( "/-/folder" ) != std::string::npos ?
+				Page( 0, 0 ) : Page( Start( url ), m_count ) ;
+
+			dest->Write( page.c_str(), page.size() ) ;
+			return 200 ;
+		}
+
+		long Post( const std::string&, const std::string&, DataStream *, const http::Header& )
+		{
+			return 200 ;
+		}
+
+		long Custom( const std::string&, const std::string&, DataStream *, const http::Header& )
+		{
+			return 200 ;
+		}
+
+		std::string RedirLocation() const			{ return "" ; }
+		std::string ResponseHeader( const std::string& ) const	{ return "" ; }
+		std::string ErrorResponse() const			{ return "" ; }
+		std::string Escape( const std::string& str )	{ return str ; }
+		std::string Unescape( const std::string& str )	{ return str ; }
+
+	private :
+		static unsigned Start( const std::string& url )
+		{
+			std::size_t pos = url.find( "start-index=" ) ;
+			return pos == std::string::npos ? 0 :
+				boost::lexical_cast<unsigned>( url.substr( pos + 12 ) ) ;
+		}
+
+		static std::string Page( unsigned start, unsigned count )
+		{
+			std::string page =
+				"<feed xmlns='http://www.w3.org/2005/Atom' "
+				"xmlns:docs='http://schemas.google.com/docs/2007' "
+				"xmlns:gd='http://schemas.google.com/g/2005'>"
+				"<docs:largestChangestamp value='1'/>" ;
+
+			unsigned end = std::min( start + page_size, count ) ;
+			if ( end < count )
+				page += ( boost::format( "<link rel='next' href='%1%?start-index=%2%'/>" )
+					% feed_base % end ).str() ;
+
+			for ( unsigned i = start ; i < end ; i++ )
+				page += ( boost::format(
+					"<entry gd:etag='e%1%'><id>file:%1%</id><title>%2%</title>"
+					"<docs:suggestedFilename>%2%</docs:suggestedFilename>"
+					"<updated>2012-05-09T16:13:22.401Z</updated>"
+					"<category scheme='http://schemas.google.com/g/2005#kind' label='file'/>"
+					"<content src='%3%/file%%3A%1%/content'/>"
+					"<link rel='http://schemas.google.com/docs/2007#parent' href='%4%'/>"
+					"<link rel='self' href='%3%/file%%3A%1%'/>"
+					"<gd:resourceId>file:%1%</gd:resourceId>"
+					"<docs:md5Checksum>%5%</docs:md5Checksum>"
+					"</entry>" ) % i % Name( i ) % feed_base % root_href % MD5( Name( i ) ) ).str() ;
+
+			return page + "</feed>" ;
+		}
+
+	private :
+		unsigned	m_count ;
+		unsigned	m_latency ;
+		DateTime	m_first ;
+	} ;
+
+	/// Sync from scratch, i.e. without the files downloaded and the state
+	/// of the last run, and print the times.
+	void Sync( FeedAgent& agent, const fs::path& root, const Json& options, unsigned count, bool pipeline )
+	{
+		for ( unsigned i = 0 ; i < count ; i += 10 )
+			fs::remove( root / Name( i ) ) ;
+		for ( fs::directory_iterator i( root ), end ; i != end ; ++i )
+			if ( i->path().filename().string().find( ".grive_state" ) == 0 )
+				fs::remove( i->path() ) ;
+
+		agent.Reset() ;
+		DateTime start = DateTime::Now() ;
+		{
+			Drive drive( &agent, options ) ;
+			drive.DetectChanges( pipeline ) ;
+			drive.Update() ;
+		}
+
+		std::cout
+			<< ( pipeline ? "pipelined" : "one after another" ) << ": "
+			<< "first transfer after " << Stats::Elapsed( start ) - Stats::Elapsed( agent.FirstTransfer() ) << " s, "
+			<< "done after " << Stats::Elapsed( start ) << " s" << std::endl ;
+	}
+}
+
+int main( int argc, char **argv )
+{
+	if ( argc < 2 )
+	{
+		std::cerr << "usage: " << argv[0] << " dir [count] [latency in ms]" << std::endl ;
+		return -1 ;
+	}
+
+	fs::path	root	= argv[1] ;
+	unsigned	count	= argc > 2 ? boost::lexical_cast<unsigned>( argv[2] ) : 100000 ;
+	unsigned	latency	= argc > 3 ? boost::lexical_cast<unsigned>( argv[3] ) : 200 ;
+
+	fs::create_directories( root ) ;
+	if ( fs::directory_iterator( root ) == fs::directory_iterator() )
+	{
+		for ( unsigned i = 0 ; i < count ; i++ )
+		{
+			if ( i % 10 == 0 )
+				continue ;
+
+			std::ofstream file( ( root / Name( i ) ).string().c_str() ) ;
+			file << Name( i ) ;
+		}
+	}
+
+	Json options ;
+	options.Add( "path", Json( root.string() ) ) ;
+	options.Add( "log-xml", Json( false ) ) ;
+
+	FeedAgent agent( count, latency ) ;
+	Sync( agent, root, options, count, false ) ;
+	Sync( agent, root, options, count, true ) ;
+
+	return 0 ;
+}
@@ -0,0 +1,194 @@
+/*
+	grive: an GPL program to sync a local directory with Google Drive
+	Copyright (C) 2012  Wan Wai Ho
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation version 2
+	of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+/*
+	Measure the time to load a state file with many records, in the binary
+	format and in the JSON format of older versions, e.g.
+	
+		statebench /tmp/state 10000000
+	
+	The JSON format is only measured up to a million records, as it does not
+	fit in memory beyond that.
+*/
+
+#include "drive/State.hh"
+#include "drive/StateFile.hh"
+#include "protocol/Json.hh"
+#include "util/DateTime.hh"
+#include "util/File.hh"
+#include "util/FileSystem.hh"
+#include "util/Stats.hh"
+
+#include <boost/format.hpp>
+#include <boost/lexical_cast.hpp>
+
+#include <cstdlib>
+#include <iostream>
+#include <memory>
+#include <sstream>
+#include <string>
+#include <vector>
+
+using namespace gr ;
+using namespace gr::v1 ;
+
+namespace
+{
+	const unsigned lookups		= 1000 ;
+	const unsigned json_max		= 1000000 ;
+	
+	std::string Name( unsigned i )
+	{
+		// short enough to be kept in the strings themselves
+		return ( boost::format( "d%1%/f%2%" ) % ( i / 100 ) % i ).str() ;
+	}
+	
+	std::string Href( unsigned i )
+	{
+		return ( boost::format( "h%1%" ) % i ).str() ;
+	}
+	
+	std::string MD5( unsigned i )
+	{
+		return ( boost::format( "%032x" ) % ( i * 2654435761u ) ).str() ;
+	}
+}
+
+int main( int argc, char **argv )
+{
+	if ( argc < 2 )
+	{
+		std::cerr << "usage: " << argv[0] << " dir [count]" << std::endl ;
+		return -1 ;
+	}
+	
+	fs::path	dir		= argv[1] ;
+	unsigned	count	= argc > 2 ? boost::lexical_cast<unsigned>( argv[2] ) : 1000000 ;
+	fs::create_directories( dir ) ;
+	
+	std::vector<StateFile::Checksum> checksums ;
+	for ( unsigned i = 0 ; i < count ; i++ )
+	{
+		StateFile::Checksum c ;
+		c.path			= Name( i ) ;
+		c.md5			= MD5( i ) ;
+		c.stat.size		= i ;
+		c.stat.mtime.Assign( 1350000000 + i, i ) ;
+		c.stat.ctime	= c.stat.mtime ;
+		c.stat.ino		= i ;
+		c.stat.dev		= 2049 ;
+		c.stat.is_dir	= false ;
+		checksums.push_back( c ) ;
+	}
+	
+	std::vector<StateFile::Inode> inodes ;
+	for ( unsigned i = 0 ; i < count ; i++ )
+	{
+		StateFile::Inode n ;
+		n.href	= Href( i ) ;
+		n.path	= Name( i ) ;
+		n.md5	= MD5( i ) ;
+		n.dev	= 2049 ;
+		n.ino	= i ;
+		n.pending	= false ;
+		inodes.push_back( n ) ;
+	}
+	
+	std::vector<StateFile::Folder> folders ;
+	for ( unsigned i = 0 ; i < count ; i += 100 )
+	{
+		StateFile::Folder f ;
+		f.path		= ( boost::format( "d%1%" ) % ( i / 100 ) ).str() ;
+		f.local		= MD5( i ) ;
+		f.remote	= MD5( i ) ;
+		folders.push_back( f ) ;
+	}
+	
+	StateFile::Info info ;
+	info.last_sync		= DateTime::Now() ;
+	info.change_stamp	= 1 ;
+	info.generation		= 1 ;
+	
+	// binary
+	DateTime start = DateTime::Now() ;
+	StateFile::Write( dir / "state", info, checksums, inodes, std::vector<StateFile::Dir>(), folders ) ;
+	double write = Stats::Elapsed( start ) ;
+	
+	// not to count them in the memory used below
+	std::vector<StateFile::Checksum>().swap( checksums ) ;
+	std::vector<StateFile::Inode>().swap( inodes ) ;
+	std::vector<StateFile::Folder>().swap( folders ) ;
+	
+	start = DateTime::Now() ;
+	StateFile file( dir / "state" ) ;
+	double open = Stats::Elapsed( start ) ;
+	
+	// as grive opens it
+	fs::create_directories( dir / "root" ) ;
+	Json options ;
+	options.Add( "path", Json( ( dir / "root" ).string() ) ) ;
+	
+	start = DateTime::Now() ;
+	std::auto_ptr<State> state( new State( dir / "state", options ) ) ;
+	double state_open = Stats::Elapsed( start ) ;
+	
+	start = DateTime::Now() ;
+	unsigned found = 0 ;
+	for ( unsigned i = 0 ; i < lookups ; i++ )
+	{
+		StateFile::Checksum c ;
+		found += file.FindChecksum( Name( std::rand() % count ), c ) ;
+		found += file.FindByMD5( MD5( std::rand() % count ), c ) ;
+		
+		StateFile::Inode n ;
+		found += file.FindInode( Href( std::rand() % count ), n ) ;
+	}
+	double lookup = Stats::Elapsed( start ) ;
+	
+	std::cout
+		<< "binary: write " << write << " s, open " << open << " s, "
+		<< "open state " << state_open << " s, "
+		<< lookups * 3 << " lookups " << lookup << " s (" << found << " found), "
+		<< fs::file_size( dir / "state" ) << " bytes" << std::endl ;
+	
+	if ( count > json_max )
+		return 0 ;
+	
+	// JSON, as older versions
+	{
+		std::ostringstream ss ;
+		ss << file.Dump() ;
+		
+		File json( dir / "state.json", 0600 ) ;
+		json.Write( ss.str().c_str(), ss.str().size() ) ;
+	}
+	
+	start = DateTime::Now() ;
+	File json( dir / "state.json" ) ;
+	Json dump = Json::Parse( &json ) ;
+	Json::Object obj = dump["checksum"].AsObject() ;
+	double parse = Stats::Elapsed( start ) ;
+	
+	std::cout
+		<< "JSON: open " << parse << " s, "
+		<< fs::file_size( dir / "state.json" ) << " bytes" << std::endl ;
+	
+	return 0 ;
+}
@@ -0,0 +1,273 @@
+/*
+	grive: an GPL program to sync a local directory with Google Drive
+	Copyright (C) 2012  Wan Wai Ho
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation version 2
+	of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#include "ChecksumCache.hh"
+
+#include "protocol/Json.hh"
+#include "util/Crypt.hh"
+#include "util/Stats.hh"
+#include "util/log/Log.hh"
+
+#include <boost/cstdint.hpp>
+
+namespace gr { namespace v1 {
+
+ChecksumCache::ChecksumCache( ) :
+	m_base( 0 )
+{
+}
+
+std::string ChecksumCache::MD5( const fs::path& file )
+{
+	return MD5( file, os::Stat( file ) ) ;
+}
+
+/// Return the checksum of a file. The file is only read when the cached
+/// record does not match its current stat.
+std::string ChecksumCache::MD5( const fs::path& file, const os::FileStat& st )
+{
+	Map::iterator i = Lookup( file.string() ) ;
+	if ( i != m_map.end() && IsSame( i->second.stat, st ) )
+	{
+		i->second.used = true ;
+		return i->second.md5 ;
+	}
+	
+	Trace( "calculating checksum of %1%", file ) ;
+	Stats::Inst().Add( "local.md5", 1, st.size ) ;
+	
+	Record_ r ;
+	r.md5	= crypt::MD5::Get( file ) ;
+	r.stat	= st ;
+	r.used	= true ;
+	
+	// don't remember failures, e.g. the file cannot be read
+	if ( !r.md5.empty() )
+	{
+		m_map[file.string()]	= r ;
+		m_file[r.md5]			= file.string() ;
+	}
+	
+	return r.md5 ;
+}
+
+/// Return the checksum of a file if it is known without reading the file, or
+/// an empty string otherwise.
+std::string ChecksumCache::Cached( const fs::path& file, const os::FileStat& st )
+{
+	Map::iterator i = Lookup( file.string() ) ;
+	return ( i != m_map.end() && IsSame( i->second.stat, st ) ) ? i->second.md5 : "" ;
+}
+
+/// Remember a checksum that is already known to be correct, e.g. verified
+/// during download. The file must have been written completely.
+void ChecksumCache::Record( const fs::path& file, const std::string& md5 )
+{
+	Record_ r ;
+	r.md5	= md5 ;
+	r.stat	= os::Stat( file ) ;
+	r.used	= true ;
+	
+	m_map[file.string()]	= r ;
+	m_file[md5]				= file.string() ;
+}
+
+/// Find a local file with the checksum. The file is only returned if it has
+/// not changed since its checksum was calculated. Returns an empty path if
+/// there is none.
+fs::path ChecksumCache::Find( const std::string& md5 ) const
+{
+	std::map<std::string, std::string>::const_iterator i = m_file.find( md5 ) ;
+	if ( i != m_file.end() )
+	{
+		Map::const_iterator r = m_map.find( i->second ) ;
+		try
+		{
+			if ( r != m_map.end() && r->second.md5 == md5 && IsSame( r->second.stat, os::Stat( i->second ) ) )
+				return i->second ;
+		}
+		catch ( os::Error& )
+		{
+			// deleted
+		}
+	}
+	
+	// the records of the last run, unless the file has been hashed again
+	StateFile::Checksum c ;
+	if ( m_base != 0 && m_base->FindByMD5( md5, c ) && m_map.find( c.path ) == m_map.end() )
+	{
+		try
+		{
+			if ( IsSame( c.stat, os::Stat( c.path ) ) )
+				return c.path ;
+		}
+		catch ( os::Error& )
+		{
+		}
+	}
+	return fs::path() ;
+}
+
+/// Add the files in a directory, which is not synced, to the sources of Find().
+/// Their checksums are remembered like the other files, so they are only
+/// calculated again when they are changed.
+void ChecksumCache::Seed( const fs::path& dir )
+{
+	Log( "adding files in %1% as local sources", dir, log::verbose ) ;
+	
+	for ( fs::recursive_directory_iterator i( dir ), end ; i != end ; ++i )
+	{
+		if ( fs::is_regular_file( i->status() ) )
+			MD5( i->path() ) ;
+	}
+}
+
+bool ChecksumCache::IsSame( const os::FileStat& s1, const os::FileStat& s2 )
+{
+	return
+		s1.size		== s2.size	&&
+		s1.mtime	== s2.mtime	&&
+		s1.ctime	== s2.ctime	&&
+		s1.ino		== s2.ino	&&
+		s1.dev		== s2.dev ;
+}
+
+void ChecksumCache::Read( const Json& json )
+{
+	m_map.clear() ;
+	m_file.clear() ;
+	m_base = 0 ;
+	
+	Json::Object obj = json.AsObject() ;
+	for ( Json::Object::iterator i = obj.begin() ; i != obj.end() ; ++i )
+	{
+		Record_ r = FromJson( i->second ) ;
+		m_map[i->first]	= r ;
+		m_file[r.md5]	= i->first ;
+	}
+}
+
+/// Use the records in a binary state file. They are looked up in the file
+/// when needed, so it must be kept open as long as the cache is used.
+void ChecksumCache::Read( const StateFile *base )
+{
+	m_map.clear() ;
+	m_file.clear() ;
+	m_base = base ;
+}
+
+/// Get the records that are looked up or recorded in this run.
+void ChecksumCache::Write( std::vector<StateFile::Checksum>& out ) const
+{
+	for ( Map::const_iterator i = m_map.begin() ; i != m_map.end() ; ++i )
+	{
+		if ( i->second.used )
+		{
+			StateFile::Checksum c ;
+			c.path	= i->first ;
+			c.md5	= i->second.md5 ;
+			c.stat	= i->second.stat ;
+			out.push_back( c ) ;
+		}
+	}
+}
+
+/// Add the record of one file, e.g. from the journal. It is written back
+/// with the others by Write().
+void ChecksumCache::Read( const fs::path& file, const Json& rec )
+{
+	Record_ r	= FromJson( rec ) ;
+	r.used		= true ;
+	
+	m_map[file.string()]	= r ;
+	m_file[r.md5]			= file.string() ;
+}
+
+/// Get the record of one file. Returns false if there is none.
+bool ChecksumCache::Write( const fs::path& file, Json& rec ) const
+{
+	Map::const_iterator i = m_map.find( file.string() ) ;
+	if ( i != m_map.end() )
+	{
+		rec = ToJson( i->second ) ;
+		return true ;
+	}
+	
+	StateFile::Checksum c ;
+	if ( m_base != 0 && m_base->FindChecksum( file.string(), c ) )
+	{
+		Record_ r ;
+		r.md5	= c.md5 ;
+		r.stat	= c.stat ;
+		rec = ToJson( r ) ;
+		return true ;
+	}
+	return false ;
+}
+
+/// Find the record of a file, copying it from the state file if it is not
+/// looked up yet.
+ChecksumCache::Map::iterator ChecksumCache::Lookup( const std::string& file )
+{
+	Map::iterator i = m_map.find( file ) ;
+	
+	StateFile::Checksum c ;
+	if ( i == m_map.end() && m_base != 0 && m_base->FindChecksum( file, c ) )
+	{
+		Record_ r ;
+		r.md5	= c.md5 ;
+		r.stat	= c.stat ;
+		r.used	= false ;
+		
+		i = m_map.insert( std::make_pair( file, r ) ).first ;
+		m_file.insert( std::make_pair( r.md5, file ) ) ;
+	}
+	return i ;
+}
+
+ChecksumCache::Record_ ChecksumCache::FromJson( const Json& rec )
+{
+	Record_ r ;
+	r.md5			= rec["md5"].Str() ;
+	r.stat.size		= rec["size"].As<boost::uint64_t>() ;
+	r.stat.mtime.Assign( rec["mtime_sec"].As<boost::int64_t>(), rec["mtime_nsec"].Int() ) ;
+	r.stat.ctime.Assign( rec["ctime_sec"].As<boost::int64_t>(), rec["ctime_nsec"].Int() ) ;
+	r.stat.ino		= rec["ino"].As<boost::uint64_t>() ;
+	r.stat.dev		= rec["dev"].As<boost::uint64_t>() ;
+	r.stat.is_dir	= false ;
+	r.used			= false ;
+	return r ;
+}
+
+Json ChecksumCache::ToJson( const Record_& r )
+{
+	Json rec ;
+	rec.Add( "md5",			Json( r.md5 ) ) ;
+	rec.Add( "size",		Json( static_cast<boost::uint64_t>(r.stat.size) ) ) ;
+	rec.Add( "mtime_sec",	Json( static_cast<boost::int64_t>(r.stat.mtime.Sec()) ) ) ;
+	rec.Add( "mtime_nsec",	Json( static_cast<boost::int64_t>(r.stat.mtime.NanoSec()) ) ) ;
+	rec.Add( "ctime_sec",	Json( static_cast<boost::int64_t>(r.stat.ctime.Sec()) ) ) ;
+	rec.Add( "ctime_nsec",	Json( static_cast<boost::int64_t>(r.stat.ctime.NanoSec()) ) ) ;
+	rec.Add( "ino",			Json( static_cast<boost::uint64_t>(r.stat.ino) ) ) ;
+	rec.Add( "dev",			Json( static_cast<boost::uint64_t>(r.stat.dev) ) ) ;
+	return rec ;
+}
+
+} } // end of namespace gr::v1
@@ -0,0 +1,97 @@
+/*
+	grive: an GPL program to sync a local directory with Google Drive
+	Copyright (C) 2012  Wan Wai Ho
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation version 2
+	of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#pragma once
+
+#include "StateFile.hh"
+
+#include "util/FileSystem.hh"
+#include "util/OS.hh"
+
+#include <map>
+#include <string>
+#include <vector>
+
+namespace gr {
+
+class Json ;
+
+namespace v1 {
+
+/*!	\brief	MD5 checksums of local files remembered between runs
+
+	A checksum is only trusted when the size, mtime, ctime and inode of the
+	file are the same as when it was recorded. Otherwise the file is hashed
+	again. Only the records that are looked up or recorded in this run are
+	written back, so deleted files drop out of the cache by themselves.
+	
+	It also works the other way round: it finds a local file with a given
+	checksum, so that a download can be done by copying it.
+	
+	The records read from a binary state file stay in the mapped file, and
+	are only copied out when they are looked up.
+*/
+class ChecksumCache
+{
+public :
+	ChecksumCache( ) ;
+	
+	std::string MD5( const fs::path& file ) ;
+	std::string MD5( const fs::path& file, const os::FileStat& st ) ;
+	std::string Cached( const fs::path& file, const os::FileStat& st ) ;
+	
+	void Record( const fs::path& file, const std::string& md5 ) ;
+	
+	fs::path Find( const std::string& md5 ) const ;
+	void Seed( const fs::path& dir ) ;
+	
+	void Read( const Json& json ) ;
+	void Read( const StateFile *base ) ;
+	void Write( std::vector<StateFile::Checksum>& out ) const ;
+	
+	void Read( const fs::path& file, const Json& rec ) ;
+	bool Write( const fs::path& file, Json& rec ) const ;
+
+private :
+	struct Record_
+	{
+		std::string		md5 ;
+		os::FileStat	stat ;
+		bool			used ;
+	} ;
+	typedef std::map<std::string, Record_> Map ;
+	
+	Map::iterator Lookup( const std::string& file ) ;
+	
+	static bool IsSame( const os::FileStat& s1, const os::FileStat& s2 ) ;
+	static Record_ FromJson( const Json& rec ) ;
+	static Json ToJson( const Record_& r ) ;
+	
+private :
+	Map		m_map ;
+	
+	// records of the last run not copied to m_map yet, may be null
+	const StateFile	*m_base ;
+	
+	// checksum to file, for Find()
+	std::map<std::string, std::string>	m_file ;
+} ;
+
+} } // end of namespace gr::v1
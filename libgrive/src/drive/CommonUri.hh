@@ -23,6 +23,7 @@
 
 namespace gr { namespace v1
 {
+	const std::string feed_root		= "https://docs.google.com/feeds/" ;
 	const std::string feed_base		= "https://docs.google.com/feeds/default/private/full" ;
 	const std::string feed_changes	= "https://docs.google.com/feeds/default/private/changes" ;
 	const std::string feed_metadata	= "https://docs.google.com/feeds/metadata/default" ;
@@ -0,0 +1,319 @@
+/*
+	grive: an GPL program to sync a local directory with Google Drive
+	Copyright (C) 2012  Wan Wai Ho
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation version 2
+	of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "Daemon.hh"
+
+#include "CommonUri.hh"
+#include "Drive.hh"
+#include "Entry.hh"
+#include "Feed.hh"
+#include "Resource.hh"
+
+#include "util/Crypt.hh"
+#include "util/DateTime.hh"
+#include "util/SignalHandler.hh"
+#include "util/Watcher.hh"
+#include "util/log/Log.hh"
+
+#include <boost/bind.hpp>
+#include <boost/exception/diagnostic_information.hpp>
+#include <boost/functional/hash.hpp>
+
+#include <algorithm>
+#include <csignal>
+#include <iterator>
+
+namespace gr { namespace v1 {
+
+namespace
+{
+	// wait for the local changes to stop for this long before syncing them
+	const unsigned long quiet = 1000 ;
+	
+	// poll the changes feed every 60 seconds by default
+	const unsigned long default_interval = 60 ;
+	
+	volatile std::sig_atomic_t stop = 0 ;
+}
+
+Daemon::Daemon( http::Agent *http, const Json& options ) :
+	m_http		( http ),
+	m_options	( options ),
+	m_root		( options["path"].Str() ),
+	m_interval	( ( options.Has( "poll" ) ? options["poll"].As<boost::uint32_t>() : default_interval ) * 1000 ),
+	m_cstamp	( -1 )
+{
+	m_ignore.Read( m_root ) ;
+}
+
+Daemon::~Daemon( )
+{
+}
+
+/// Sync until SIGINT or SIGTERM. The sync in progress is finished first,
+/// unless the signal comes again.
+void Daemon::Run( )
+{
+	SignalHandler::GetInstance().RegisterSignal( SIGINT,	&Daemon::Stop ) ;
+	SignalHandler::GetInstance().RegisterSignal( SIGTERM,	&Daemon::Stop ) ;
+	
+	Watcher watcher(
+		boost::bind( &IgnoreRules::IsIgnored, &m_ignore, _1, _2 ),
+		boost::bind( &Daemon::IsOwnChange, this, _1, _2 ) ) ;
+	watcher.Add( m_root ) ;
+	
+	std::set<fs::path> unwatched ;
+	UnwatchedChanged( watcher, unwatched ) ;
+	
+	Log( "watching %1%, checking remote changes every %2% seconds",
+		m_root, m_interval / 1000, log::info ) ;
+	Sync( std::set<fs::path>(), std::vector<Entry>() ) ;
+	
+	DateTime polled = DateTime::Now() ;
+	while ( !stop )
+	{
+		std::set<fs::path> dirty ;
+		for ( unsigned long t ; !stop && dirty.empty() && ( t = MilliSec( polled ) ) < m_interval ; )
+			watcher.Wait( m_interval - t, quiet, dirty ) ;
+		
+		// the changes made by the last sync have been read by now
+		m_written.clear() ;
+		m_deleted.clear() ;
+		
+		if ( stop )
+			break ;
+		
+		if ( !dirty.empty() )
+			Log( "%1% changed in local", *dirty.begin(), log::info ) ;
+		
+		// the remote and the directories not watched are checked every
+		// interval, even if the local directory keeps changing
+		std::vector<Entry> changes ;
+		bool poll = MilliSec( polled ) >= m_interval ;
+		if ( poll )
+		{
+			UnwatchedChanged( watcher, dirty ) ;
+			RemoteChanges( changes ) ;
+			polled = DateTime::Now() ;
+		}
+		
+		// the last sync failed, try again
+		if ( !dirty.empty() || !changes.empty() || ( poll && m_drive.get() == 0 ) )
+			Sync( dirty, changes ) ;
+	}
+	
+	Log( "stopped", log::info ) ;
+	SignalHandler::GetInstance().UnregisterSignal( SIGINT ) ;
+	SignalHandler::GetInstance().UnregisterSignal( SIGTERM ) ;
+}
+
+void Daemon::Stop( int sig )
+{
+	stop = 1 ;
+	
+	// the second one stops right away
+	std::signal( sig, SIG_DFL ) ;
+}
+
+/// Sync the local directories \a dirs and the remote \a changes with the tree
+/// of the last sync. The whole tree is only compared again if that can't be
+/// done, or the last sync failed. The errors are logged and it will be tried
+/// again later, e.g. when the network is down.
+void Daemon::Sync( const std::set<fs::path>& dirs, const std::vector<Entry>& changes )
+{
+	try
+	{
+		if ( m_drive.get() != 0 && m_drive->SyncChanges( dirs, changes ) )
+		{
+			for ( std::vector<Entry>::const_iterator i = changes.begin() ; i != changes.end() ; ++i )
+				m_cstamp = std::max( m_cstamp, static_cast<long>( i->ChangeStamp() ) ) ;
+			return ;
+		}
+		
+		// the old tree goes before the new one is built
+		m_drive.reset() ;
+		m_drive.reset( new Drive( m_http, m_options ) ) ;
+		m_drive->OnSynced( boost::bind( &Daemon::Synced, this, _1 ) ) ;
+		
+		m_drive->DetectChanges() ;
+		m_drive->Update() ;
+		m_drive->SaveState() ;
+		m_cstamp = m_drive->ChangeStamp() ;
+	}
+	catch ( Exception& e )
+	{
+		Log( "sync failed: %1%", boost::diagnostic_information(e), log::error ) ;
+		m_drive.reset() ;
+	}
+	catch ( fs::filesystem_error& e )
+	{
+		Log( "sync failed: %1%", e.what(), log::error ) ;
+		m_drive.reset() ;
+	}
+}
+
+/// Read the changes feed after the last change synced into \a changes.
+/// Returns false if it can't be read. Without the tree of the last sync,
+/// everything is compared anyway.
+bool Daemon::RemoteChanges( std::vector<Entry>& changes )
+{
+	if ( m_drive.get() == 0 )
+		return false ;
+	
+	try
+	{
+		Feed feed ;
+		feed.Start( m_http, ChangesFeed( m_cstamp + 1 ) ) ;
+		do
+		{
+			std::copy( feed.begin(), feed.end(), std::back_inserter( changes ) ) ;
+			
+		} while ( feed.GetNext( m_http ) ) ;
+		
+		if ( !changes.empty() )
+			Log( "%1% changes in remote", changes.size(), log::verbose ) ;
+		return true ;
+	}
+	catch ( Exception& e )
+	{
+		Log( "cannot check remote changes", log::warning ) ;
+		Trace( "Exception %1%", boost::diagnostic_information(e) ) ;
+		changes.clear() ;
+		return false ;
+	}
+}
+
+/// Scan the directories that are not watched, and add the ones in which
+/// anything has changed since the last time to \a dirty, along with all the
+/// directories under them.
+void Daemon::UnwatchedChanged( const Watcher& watcher, std::set<fs::path>& dirty )
+{
+	const std::set<fs::path>& top = watcher.Unwatched() ;
+	for ( std::set<fs::path>::const_iterator i = top.begin() ; i != top.end() ; ++i )
+	{
+		std::set<fs::path> dirs ;
+		std::size_t digest = Digest( *i, dirs ) ;
+		
+		std::map<fs::path, std::size_t>::iterator d = m_digest.find( *i ) ;
+		if ( d != m_digest.end() && d->second != digest )
+		{
+			Log( "%1% changed in local", *i, log::info ) ;
+			dirty.insert( *i ) ;
+			dirty.insert( dirs.begin(), dirs.end() ) ;
+		}
+		m_digest[*i] = digest ;
+	}
+}
+
+/// The digest of the names, sizes and times of the files under \a dir. The
+/// directories under it are put in \a dirs.
+std::size_t Daemon::Digest( const fs::path& dir, std::set<fs::path>& dirs ) const
+{
+	std::size_t digest = 0 ;
+	try
+	{
+		for ( fs::recursive_directory_iterator i( dir ), end ; i != end ; ++i )
+		{
+			bool is_dir = fs::is_directory( i->status() ) ;
+			if ( m_ignore.IsIgnored( i->path(), is_dir ) )
+			{
+				if ( is_dir )
+					i.no_push() ;
+				continue ;
+			}
+			
+			if ( is_dir )
+				dirs.insert( i->path() ) ;
+			
+			os::FileStat st = os::Stat( i->path() ) ;
+			boost::hash_combine( digest, i->path().string() ) ;
+			boost::hash_combine( digest, st.size ) ;
+			boost::hash_combine( digest, st.mtime.Sec() ) ;
+			boost::hash_combine( digest, st.mtime.NanoSec() ) ;
+		}
+	}
+	catch ( Exception& )
+	{
+		// e.g. deleted while scanning. it has changed anyway
+		boost::hash_combine( digest, -1 ) ;
+	}
+	catch ( fs::filesystem_error& )
+	{
+		boost::hash_combine( digest, -1 ) ;
+	}
+	return digest ;
+}
+
+/// Remember how the sync has left the local copy of \a res, to tell the
+/// changes it has made from the others.
+void Daemon::Synced( const Resource *res )
+{
+	const fs::path path = res->Path() ;
+	try
+	{
+		if ( !fs::exists( path ) )
+			m_deleted.insert( path ) ;
+		else
+		{
+			Written& w	= m_written[path] ;
+			w.st		= os::Stat( path ) ;
+			w.md5		= res->MD5() ;
+		}
+	}
+	catch ( Exception& )
+	{
+		// not known to be ours then
+		m_written.erase( path ) ;
+	}
+}
+
+/// Whether a change reported by the watcher was made by the last sync, i.e.
+/// the file is still as the sync has left it. An uploaded file may have been
+/// written again while it was uploaded, with the same size and times, so its
+/// content is checked as well, once.
+bool Daemon::IsOwnChange( const fs::path& path, bool is_dir )
+{
+	std::map<fs::path, Written>::iterator i = m_written.find( path ) ;
+	if ( i == m_written.end() )
+		return m_deleted.count( path ) > 0 && !fs::exists( path ) ;
+	
+	try
+	{
+		const Written& w = i->second ;
+		os::FileStat st = os::Stat( path ) ;
+		if ( st.dev != w.st.dev || st.ino != w.st.ino )
+			return false ;
+		
+		if ( is_dir )
+			return true ;
+		
+		if ( st.size != w.st.size || st.mtime != w.st.mtime ||
+			( !w.md5.empty() && crypt::MD5::Get( path ) != w.md5 ) )
+			return false ;
+		
+		i->second.md5.clear() ;
+		return true ;
+	}
+	catch ( Exception& )
+	{
+		return false ;
+	}
+}
+
+} } // end of namespace gr::v1
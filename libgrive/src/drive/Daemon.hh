@@ -0,0 +1,112 @@
+/*
+	grive: an GPL program to sync a local directory with Google Drive
+	Copyright (C) 2012  Wan Wai Ho
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation version 2
+	of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#pragma once
+
+#include "IgnoreRules.hh"
+
+#include "protocol/Json.hh"
+#include "util/FileSystem.hh"
+#include "util/OS.hh"
+
+#include <cstddef>
+#include <map>
+#include <memory>
+#include <set>
+#include <vector>
+
+namespace gr {
+
+namespace http
+{
+	class Agent ;
+}
+
+class Watcher ;
+
+namespace v1 {
+
+class Drive ;
+class Entry ;
+class Resource ;
+
+/*!	\brief	Keeps the local directory in sync until it is stopped
+
+	The local directory is watched for changes, and the changes feed is
+	checked every "poll" seconds. The config and the access token are loaded
+	once, and nothing is done while nothing changes.
+	
+	The tree of the resources is kept from one sync to the next, so only the
+	local directories that have changed are read again, and only the changes
+	feed is read from remote. The whole tree is only compared again, with the
+	whole local directory and the whole remote file list, when the changes
+	can't be found out this way, e.g. a file is moved, or the last sync
+	failed.
+	
+	The changes made by the sync itself are neither reported by the watcher
+	nor synced again from the changes feed.
+*/
+class Daemon
+{
+public :
+	Daemon( http::Agent *http, const Json& options ) ;
+	~Daemon( ) ;
+	
+	void Run( ) ;
+	static void Stop( int sig ) ;
+	
+private :
+	void Sync( const std::set<fs::path>& dirs, const std::vector<Entry>& changes ) ;
+	bool RemoteChanges( std::vector<Entry>& changes ) ;
+	void UnwatchedChanged( const Watcher& watcher, std::set<fs::path>& dirty ) ;
+	std::size_t Digest( const fs::path& dir, std::set<fs::path>& dirs ) const ;
+	void Synced( const Resource *res ) ;
+	bool IsOwnChange( const fs::path& path, bool is_dir ) ;
+	
+private :
+	/// A local file as the sync has left it.
+	struct Written
+	{
+		os::FileStat	st ;
+		std::string		md5 ;
+	} ;
+	
+	http::Agent		*m_http ;
+	Json			m_options ;
+	fs::path		m_root ;
+	unsigned long	m_interval ;
+	long			m_cstamp ;
+	
+	/// The tree of the last sync, unless it failed
+	std::auto_ptr<Drive>	m_drive ;
+	
+	/// The files excluded from the sync are not watched either.
+	IgnoreRules		m_ignore ;
+	
+	/// The digests of the directories that cannot be watched, to find out
+	/// if anything in them has changed.
+	std::map<fs::path, std::size_t>	m_digest ;
+	
+	/// The local files written and deleted by the last sync, until the
+	/// watcher has reported them.
+	std::map<fs::path, Written>		m_written ;
+	std::set<fs::path>				m_deleted ;
+} ;
+
+} } // end of namespace gr::v1
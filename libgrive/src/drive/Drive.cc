@@ -24,21 +24,31 @@
 #include "Feed.hh"
 
 #include "http/Agent.hh"
+#include "http/Error.hh"
 #include "http/ResponseLog.hh"
+#include "http/StringResponse.hh"
 #include "http/XmlResponse.hh"
 #include "util/Destroy.hh"
+#include "util/Stats.hh"
 #include "util/log/Log.hh"
 #include "xml/Node.hh"
 #include "xml/NodeSet.hh"
+#include "xml/TreeBuilder.hh"
 
+#include <boost/algorithm/string/split.hpp>
+#include <boost/algorithm/string/classification.hpp>
 #include <boost/bind.hpp>
+#include <boost/exception/errinfo_file_name.hpp>
+#include <boost/thread/thread.hpp>
 
 // standard C++ library
 #include <algorithm>
 #include <cassert>
 #include <cstdlib>
 #include <fstream>
+#include <iterator>
 #include <map>
+#include <set>
 #include <sstream>
 
 // for debugging only
@@ -49,13 +59,28 @@ namespace gr { namespace v1 {
 namespace
 {
 	const std::string state_file = ".grive_state" ;
+	
+	void Prefetch( State *state, const fs::path& root, double *secs )
+	{
+		DateTime start = DateTime::Now() ;
+		state->Prefetch( root ) ;
+		*secs = Stats::Elapsed( start ) ;
+	}
 }
 
 Drive::Drive( http::Agent *agent, const Json& options ) :
 	m_http		( agent ),
 	m_root		( options["path"].Str() ),
 	m_state		( m_root / state_file, options ),
-	m_options	( options )
+	m_options	( options ),
+	m_start		( DateTime::Now() ),
+	m_root_found( false ),
+	m_stamp		( -1 ),
+	m_hasher	( 0 ),
+	m_local_time( 0 ),
+	m_transfer	( false ),
+	m_folders_done( 0 ),
+	m_files_done( 0 )
 {
 	assert( m_http != 0 ) ;
 }
@@ -87,94 +112,388 @@ void Drive::FromChange( const Entry& entry )
 		m_state.FromRemote( entry ) ;
 }
 
+/// Read the whole changes feed since \a prev_stamp, the last sync.
+void Drive::ReadChanges( long prev_stamp )
+{
+	Log( "Detecting changes from last sync", log::info ) ;
+	Feed changes ;
+	if ( m_options["log-xml"].Bool() )
+		changes.EnableLog( "/tmp/changes", ".xml" ) ;
+	
+	changes.Start( m_http, ChangesFeed(prev_stamp+1) ) ;
+	do
+	{
+		for ( Feed::iterator i = changes.begin() ; i != changes.end() ; ++i )
+			m_changes[i->AltSelf()] = *i ;
+		
+	} while ( changes.GetNext( m_http ) ) ;
+}
+
+/// Apply the changes of the files in \a hrefs that are in the tree by now, so
+/// that they are taken into account before the files are transferred.
+void Drive::ApplyChanges( const std::vector<std::string>& hrefs )
+{
+	for ( std::vector<std::string>::const_iterator i = hrefs.begin() ; i != hrefs.end() ; ++i )
+	{
+		std::map<std::string, Entry>::iterator c = m_changes.find( *i ) ;
+		if ( c != m_changes.end() && m_state.FindByHref( *i ) != 0 )
+		{
+			FromChange( c->second ) ;
+			m_changes.erase( c ) ;
+		}
+	}
+}
+
 void Drive::SaveState()
 {
-	m_state.Write( state_file ) ;
+	m_state.Write( m_root / state_file ) ;
 }
 
-void Drive::SyncFolders( )
+/// Sync only the local directories \a dirs and the remote \a changes, after
+/// the last sync of this object. Returns false if the whole tree needs to be
+/// compared again, with a new object.
+bool Drive::SyncChanges( const std::set<fs::path>& dirs, const std::vector<Entry>& changes )
 {
-	assert( m_http != 0 ) ;
+	return m_state.SyncChanges( m_http, m_options, dirs, changes ) ;
+}
 
-	Log( "Synchronizing folders", log::info ) ;
+void Drive::OnSynced( const Resource::SyncHook& hook )
+{
+	m_state.OnSynced( hook ) ;
+}
 
-	http::XmlResponse xml ;
-	m_http->Get( feed_base + "/-/folder?max-results=50&showroot=true", &xml, http::Header() ) ;
-	
-	Feed feed( xml.Response() ) ;
+long Drive::ChangeStamp() const
+{
+	return m_state.ChangeStamp() ;
+}
+
+/// The state file of the directory to sync in JSON, for debugging.
+Json Drive::DumpState( const Json& options )
+{
+	return State::Dump( fs::path( options["path"].Str() ) / state_file ) ;
+}
+
+/// List all folders in remote.
+void Drive::ListFolders( std::vector<Entry>& folders )
+{
+	assert( m_http != 0 ) ;
+
+	Feed feed ;
+	feed.Start( m_http, feed_base + "/-/folder?max-results=50&showroot=true" ) ;
 	do
 	{
-		// first, get all collections from the query result
 		for ( Feed::iterator i = feed.begin() ; i != feed.end() ; ++i )
+			folders.push_back( Entry( *i ) ) ;
+		
+	} while ( feed.GetNext( m_http ) ) ;
+}
+
+/// List the folders and files under the remote folder \a root with the contents feeds of the folders in it, instead of
+/// the file list of the whole drive. The feeds of all folders at the same
+/// depth are fetched with one Perform(), so the agent may send them at the
+/// same time or in a batch.
+void Drive::ListSubtree( const Entry& root, std::vector<Entry>& folders, std::vector<Entry>& files )
+{
+	assert( m_http != 0 ) ;
+	
+	m_state.SetRoot( root ) ;
+	
+	std::set<std::string> listed ;
+	listed.insert( root.ResourceID() ) ;
+	
+	std::vector<std::string> urls( 1, ContentsUrl( root.ResourceID() ) ) ;
+	while ( !urls.empty() )
+	{
+		std::vector<http::Request> reqs ;
+		std::vector<http::StringResponse> resp( urls.size() ) ;
+		for ( std::size_t i = 0 ; i < urls.size() ; i++ )
+			reqs.push_back( http::Request( "GET", urls[i], &resp[i] ) ) ;
+		m_http->Perform( reqs ) ;
+		
+		// the next pages, and the folders found in this round
+		urls.clear() ;
+		for ( std::size_t i = 0 ; i < reqs.size() ; i++ )
 		{
-			Entry e( *i ) ;
-			if ( e.Kind() == "folder" )
+			// a missing page would make the files in it look deleted in remote
+			if ( reqs[i].response < 200 || reqs[i].response >= 300 )
 			{
-				if ( e.ParentHrefs().size() != 1 )
-					Log( "folder \"%1%\" has multiple parents, ignored", e.Title(), log::verbose ) ;
-				
-				else if ( e.Title().find('/') != std::string::npos )
-					Log( "folder \"%1%\" contains a slash in its name, ignored", e.Title(), log::verbose ) ;
+				BOOST_THROW_EXCEPTION(
+					http::Error()
+						<< http::Url( reqs[i].url )
+						<< http::HttpResponse( reqs[i].response )
+						<< http::HttpResponseText( reqs[i].error )
+				) ;
+			}
+			
+			Feed feed( xml::TreeBuilder::Parse( resp[i].Response() ) ) ;
+			Stats::Inst().Add( "remote.page", 1, resp[i].Response().size() ) ;
+			Stats::Inst().Add( "remote.entry", feed.end() - feed.begin() ) ;
+			if ( !feed.Next().empty() )
+				urls.push_back( feed.Next() ) ;
+			
+			for ( Feed::iterator e = feed.begin() ; e != feed.end() ; ++e )
+			{
+				Entry entry = *e ;
+				files.push_back( entry ) ;
 				
-				else
-					m_state.FromRemote( e ) ;
+				// folders with more than one parent are ignored, and so are
+				// the files in them
+				if ( entry.Kind() == "folder" && entry.ParentHrefs().size() == 1 &&
+					listed.insert( entry.ResourceID() ).second )
+				{
+					folders.push_back( entry ) ;
+					urls.push_back( ContentsUrl( entry.ResourceID() ) ) ;
+				}
 			}
 		}
-	} while ( feed.GetNext( m_http ) ) ;
+		
+		Advance( folders, files, false ) ;
+	}
+	
+	Log( "%1% folders and %2% files listed in %3%", folders.size(),
+		files.size() - folders.size(), root.Title(), log::verbose ) ;
+}
+
+/// The remote folder synced: the one of the "remote-dir" option, or the root
+/// of the drive.
+const Entry& Drive::RemoteRoot( )
+{
+	if ( !m_root_found )
+	{
+		if ( m_options.Has( "remote-dir" ) && !m_options["remote-dir"].Str().empty() )
+			m_remote_root = FindFolder( m_options["remote-dir"].Str() ) ;
+		m_root_found = true ;
+	}
+	return m_remote_root ;
+}
+
+/// Find the remote folder of a path like "Projects/Foo" from the root.
+Entry Drive::FindFolder( const std::string& dir )
+{
+	std::vector<std::string> names ;
+	boost::split( names, dir, boost::is_any_of( "/" ) ) ;
+	
+	Entry folder ;
+	for ( std::vector<std::string>::const_iterator n = names.begin() ; n != names.end() ; ++n )
+	{
+		if ( n->empty() )
+			continue ;
+		
+		bool found = false ;
+		Feed feed ;
+		feed.Start( m_http, ContentsUrl( folder.ResourceID() ) ) ;
+		do
+		{
+			for ( Feed::iterator i = feed.begin() ; i != feed.end() && !found ; ++i )
+			{
+				Entry e = *i ;
+				if ( e.Kind() == "folder" && e.Title() == *n && !e.IsRemoved() )
+				{
+					folder	= e ;
+					found	= true ;
+				}
+			}
+		} while ( !found && feed.GetNext( m_http ) ) ;
+		
+		if ( !found )
+		{
+			Log( "folder %1% is not found in remote", dir, log::critical ) ;
+			BOOST_THROW_EXCEPTION( Error() << boost::errinfo_file_name( dir ) ) ;
+		}
+	}
+	return folder ;
+}
+
+std::string Drive::ContentsUrl( const std::string& id )
+{
+	return feed_base + "/" + m_http->Escape( id ) + "/contents?showfolders=true" ;
+}
+
+void Drive::SyncFolders( std::vector<Entry>::const_iterator first, std::vector<Entry>::const_iterator last )
+{
+	// first, get all collections from the query result
+	for ( std::vector<Entry>::const_iterator i = first ; i != last ; ++i )
+	{
+		const Entry& e = *i ;
+		if ( e.Kind() == "folder" )
+		{
+			if ( e.ParentHrefs().size() != 1 )
+				Log( "folder \"%1%\" has multiple parents, ignored", e.Title(), log::verbose ) ;
+			
+			else if ( e.Title().find('/') != std::string::npos )
+				Log( "folder \"%1%\" contains a slash in its name, ignored", e.Title(), log::verbose ) ;
+			
+			else
+				m_state.FromRemote( e ) ;
+		}
+	}
 
 	m_state.ResolveEntry() ;
 }
 
-void Drive::DetectChanges()
+/// Compare the folders and files listed since the last call with the local
+/// files, once these have been read, and transfer the files whose states are
+/// decided if \a m_transfer. With \a wait, wait for the local files to be
+/// read first. The folders listed are compared before the files, so the files
+/// find their parents.
+void Drive::Advance( const std::vector<Entry>& folders, const std::vector<Entry>& files, bool wait )
 {
-	Log( "Reading local directories", log::info ) ;
-	m_state.FromLocal( m_root ) ;
+	if ( m_hasher != 0 )
+	{
+		if ( wait )
+			m_hasher->join() ;
+		else if ( !m_hasher->timed_join( boost::posix_time::seconds( 0 ) ) )
+			return ;
+		
+		m_hasher = 0 ;
+		Log( "local files read in %1% seconds", m_local_time, log::verbose ) ;
+		
+		m_state.FromLocal( m_root ) ;
+		Log( "Synchronizing folders", log::info ) ;
+	}
 	
-	long prev_stamp = m_state.ChangeStamp() ;
-	Trace( "previous change stamp is %1%", prev_stamp ) ;
+	std::vector<std::string> hrefs ;
+	{
+		Stats::Timer timer( "resolve" ) ;
+		SyncFolders( folders.begin() + m_folders_done, folders.end() ) ;
+		m_folders_done = folders.size() ;
+		
+		for ( std::size_t i = m_files_done ; i < files.size() ; i++ )
+		{
+			FromRemote( files[i] ) ;
+			hrefs.push_back( files[i].SelfHref() ) ;
+		}
+		m_files_done = files.size() ;
+		
+		ApplyChanges( hrefs ) ;
+	}
 	
-	SyncFolders( ) ;
+	if ( m_transfer )
+		m_state.SyncDecided( m_http, m_options, hrefs ) ;
+}
 
-	Log( "Reading remote server file list", log::info ) ;
-	Feed feed ;
-	if ( m_options["log-xml"].Bool() )
-		feed.EnableLog( "/tmp/file", ".xml" ) ;
+/// Check if nothing has changed since the last sync, so that DetectChanges()
+/// is not needed. The remote is checked by its largest change stamp, which
+/// takes one small request, and the local directory by the stat of its files.
+bool Drive::NothingChanged()
+{
+	long prev_stamp = m_state.ChangeStamp() ;
+	if ( prev_stamp == -1 || ( m_options.Has( "force" ) && m_options["force"].Bool() ) )
+		return false ;
 	
-	feed.Start( m_http, feed_base + "?showfolders=true&showroot=true" ) ;
+	if ( !m_state.IsRoot( RemoteRoot().ResourceID() ) )
+	{
+		Log( "another remote folder is synced since the last sync", log::verbose ) ;
+		return false ;
+	}
 	
-	m_resume_link = feed.Root()["link"].
-		Find( "@rel", "http://schemas.google.com/g/2005#resumable-create-media" )["@href"] ;
-		
-	do
+	m_stamp = LargestChangeStamp() ;
+	if ( m_stamp != prev_stamp )
 	{
-		std::for_each(
-			feed.begin(), feed.end(),
-			boost::bind( &Drive::FromRemote, this, _1 ) ) ;
-			
-	} while ( feed.GetNext( m_http ) ) ;
+		Log( "changed in remote: change stamp %1% is now %2%", prev_stamp, m_stamp, log::verbose ) ;
+		return false ;
+	}
 	
-	// pull the changes feed
-	if ( prev_stamp != -1 )
+	return m_state.LocalUnchanged( m_root ) ;
+}
+
+/// The local files are read in another thread while the remote files are
+/// listed, so the time to wait for the disk and for the network overlap. Once
+/// the local files are read, the remote entries are compared with them page by
+/// page as they are listed. With \a transfer, the files whose states are
+/// decided by then, i.e. the ones changed in place on either side, are
+/// transferred right away, while the rest of the list is fetched. The others
+/// wait for Update(): the file list is not in any order, so nothing is known
+/// to be deleted, moved or copied before the end of the list.
+void Drive::DetectChanges( bool transfer )
+{
+	// before anything is compared with the state
+	m_state.UseRoot( RemoteRoot().ResourceID() ) ;
+	
+	Log( "Reading local directories", log::info ) ;
+	boost::thread hasher( boost::bind( &Prefetch, &m_state, m_root, &m_local_time ) ) ;
+	m_hasher		= &hasher ;
+	m_transfer		= transfer ;
+	m_folders_done	= 0 ;
+	m_files_done	= 0 ;
+	
+	long prev_stamp = m_state.ChangeStamp() ;
+	Trace( "previous change stamp is %1%", prev_stamp ) ;
+	
+	std::vector<Entry> folders, files ;
+	Feed feed ;
+	try
 	{
-		Log( "Detecting changes from last sync", log::info ) ;
-		Feed changes ;
-		if ( m_options["log-xml"].Bool() )
-			feed.EnableLog( "/tmp/changes", ".xml" ) ;
+		// the changes made from now on are found in the next sync
+		if ( m_stamp == -1 )
+			m_stamp = LargestChangeStamp() ;
+		
+		// the changes feed is read first, so that the files changed are known
+		// to be changed before any of them is transferred. The changes of the
+		// files outside the folder synced are not found in the tree, and are
+		// skipped.
+		m_changes.clear() ;
+		if ( prev_stamp != -1 )
+			ReadChanges( prev_stamp ) ;
+		
+		// only the folder synced and the ones under it
+		if ( m_options.Has( "remote-dir" ) && !m_options["remote-dir"].Str().empty() )
+		{
+			Log( "Reading remote folder %1%", m_options["remote-dir"].Str(), log::info ) ;
+			ListSubtree( RemoteRoot(), folders, files ) ;
+		}
+		else
+		{
+			ListFolders( folders ) ;
+			
+			Log( "Reading remote server file list", log::info ) ;
+			if ( m_options["log-xml"].Bool() )
+				feed.EnableLog( "/tmp/file", ".xml" ) ;
 			
-		feed.Start( m_http, ChangesFeed(prev_stamp+1) ) ;
+			feed.Start( m_http, feed_base + "?showfolders=true&showroot=true" ) ;
+			
+			m_resume_link = feed.Root()["link"].
+				Find( "@rel", "http://schemas.google.com/g/2005#resumable-create-media" )["@href"] ;
+				
+			do
+			{
+				std::copy( feed.begin(), feed.end(), std::back_inserter( files ) ) ;
+				Advance( folders, files, false ) ;
+				
+			} while ( feed.GetNext( m_http ) ) ;
+		}
+		Log( "remote files listed %1% seconds after start", Stats::Elapsed( m_start ), log::verbose ) ;
 		
-		std::for_each(
-			changes.begin(), changes.end(),
-			boost::bind( &Drive::FromChange, this, _1 ) ) ;
+		Advance( folders, files, true ) ;
 	}
+	catch ( ... )
+	{
+		if ( m_hasher != 0 )
+		{
+			hasher.interrupt() ;
+			hasher.join() ;
+			m_hasher = 0 ;
+		}
+		throw ;
+	}
+	
+	// the changes of the folders, and of the files found in the tree after
+	// their batches, e.g. the ones listed before their parents
+	for ( std::map<std::string, Entry>::const_iterator i = m_changes.begin() ; i != m_changes.end() ; ++i )
+		FromChange( i->second ) ;
+	m_changes.clear() ;
 }
 
 void Drive::Update()
 {
-	Log( "Synchronizing files", log::info ) ;
-	m_state.Sync( m_http, m_options ) ;
+	Log( "Synchronizing files, %1% seconds after start", Stats::Elapsed( m_start ), log::info ) ;
+	{
+		Stats::Timer timer( "sync" ) ;
+		m_state.Sync( m_http, m_options ) ;
+	}
 	
-	UpdateChangeStamp( ) ;
+	m_state.ChangeStamp( m_stamp ) ;
+	Log( "Synchronized in %1% seconds", Stats::Elapsed( m_start ), log::info ) ;
 }
 
 void Drive::DryRun()
@@ -183,18 +502,15 @@ void Drive::DryRun()
 	m_state.Sync( 0, m_options ) ;
 }
 
-void Drive::UpdateChangeStamp( )
+/// The change stamp of the last change in remote, from the metadata feed.
+long Drive::LargestChangeStamp( )
 {
 	assert( m_http != 0 ) ;
-
-	// get changed feed
+	
 	http::XmlResponse xrsp ;
-	m_http->Get( ChangesFeed(m_state.ChangeStamp()+1), &xrsp, http::Header() ) ;
+	m_http->Get( feed_metadata, &xrsp, http::Header() ) ;
 	
-	// we should go through the changes to see if it was really Grive to made that change
-	// maybe by recording the updated timestamp and compare it?
-	m_state.ChangeStamp( 
-		std::atoi(xrsp.Response()["docs:largestChangestamp"]["@value"].front().Value().c_str()) ) ;
+	return std::atol( xrsp.Response()["docs:largestChangestamp"]["@value"].front().Value().c_str() ) ;
 }
 
 } } // end of namespace gr::v1
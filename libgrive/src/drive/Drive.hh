@@ -19,15 +19,24 @@
 
 #pragma once
 
+#include "Entry.hh"
 #include "State.hh"
 
 #include "http/Header.hh"
 #include "protocol/Json.hh"
+#include "util/DateTime.hh"
 #include "util/Exception.hh"
 
+#include <map>
+#include <set>
 #include <string>
 #include <vector>
 
+namespace boost
+{
+	class thread ;
+}
+
 namespace gr {
 
 namespace http
@@ -37,26 +46,38 @@ namespace http
 
 namespace v1 {
 
-class Entry ;
-
 class Drive
 {
 public :
 	Drive( http::Agent *agent, const Json& options ) ;
 
-	void DetectChanges() ;
+	bool NothingChanged() ;
+	void DetectChanges( bool transfer = false ) ;
 	void Update() ;
 	void DryRun() ;
 	void SaveState() ;
+	bool SyncChanges( const std::set<fs::path>& dirs, const std::vector<Entry>& changes ) ;
+	void OnSynced( const Resource::SyncHook& hook ) ;
+	long ChangeStamp() const ;
+	
+	static Json DumpState( const Json& options ) ;
 	
 	struct Error : virtual Exception {} ;
 	
 private :
-	void SyncFolders( ) ;
+	void ListFolders( std::vector<Entry>& folders ) ;
+	void ListSubtree( const Entry& root, std::vector<Entry>& folders, std::vector<Entry>& files ) ;
+	const Entry& RemoteRoot( ) ;
+	Entry FindFolder( const std::string& dir ) ;
+	std::string ContentsUrl( const std::string& id ) ;
+	void SyncFolders( std::vector<Entry>::const_iterator first, std::vector<Entry>::const_iterator last ) ;
+	void Advance( const std::vector<Entry>& folders, const std::vector<Entry>& files, bool wait ) ;
     void file();
 	void FromRemote( const Entry& entry ) ;
 	void FromChange( const Entry& entry ) ;
-	void UpdateChangeStamp( ) ;
+	void ReadChanges( long prev_stamp ) ;
+	void ApplyChanges( const std::vector<std::string>& hrefs ) ;
+	long LargestChangeStamp( ) ;
 	
 private :
 	http::Agent 	*m_http ;
@@ -64,6 +85,34 @@ private :
 	fs::path		m_root ;
 	State			m_state ;
 	Json			m_options ;
+	DateTime		m_start ;
+	
+	/// The remote folder synced, once it has been looked up.
+	Entry			m_remote_root ;
+	bool			m_root_found ;
+	
+	/// The largest change stamp in remote before the files are listed, or -1
+	/// if it has not been read yet. It is the one saved after the sync, so
+	/// that the changes made while listing are found in the next sync.
+	long			m_stamp ;
+	
+	/// The thread reading the local files in DetectChanges(), until they are
+	/// read, and how long it took.
+	boost::thread	*m_hasher ;
+	double			m_local_time ;
+	
+	/// Whether the files whose states are decided are transferred while the
+	/// remote files are still listed.
+	bool			m_transfer ;
+	
+	/// The numbers of the listed folders and files compared with the local
+	/// files so far.
+	std::size_t		m_folders_done ;
+	std::size_t		m_files_done ;
+	
+	/// The changes feed since the last sync, the last change of each file by
+	/// its href, until the change is applied to the tree.
+	std::map<std::string, Entry>	m_changes ;
 } ;
 
 } } // end of namespace
@@ -66,6 +66,7 @@ void Entry::Update( const xml::Node& n )
 	m_kind			= n["category"].Find( "@scheme", "http://schemas.google.com/g/2005#kind" )["@label"] ;
 	m_edit_link		= n["link"].Find( "@rel", "http://schemas.google.com/g/2005#resumable-edit-media")["@href"] ;
 	m_create_link	= n["link"].Find( "@rel", "http://schemas.google.com/g/2005#resumable-create-media")["@href"] ;
+	m_edit_media	= n["link"].Find( "@rel", "edit-media" )["@href"] ;
 
 	// changestamp only appear in change feed entries
 	xml::NodeSet cs	= n["docs:changestamp"]["@value"] ;
@@ -147,6 +148,12 @@ std::string Entry::EditLink() const
 	return m_edit_link ;
 }
 
+/// Link to update the content in one request, without a resumable session.
+std::string Entry::EditMediaLink() const
+{
+	return m_edit_media ;
+}
+
 std::string Entry::CreateLink() const
 {
 	return m_create_link ;
@@ -168,6 +175,7 @@ void Entry::Swap( Entry& e )
 	m_content_src.swap( e.m_content_src ) ;
 	m_edit_link.swap( e.m_edit_link ) ;
 	m_create_link.swap( e.m_create_link ) ;
+	m_edit_media.swap( e.m_edit_media ) ;
 
 	m_mtime.Swap( e.m_mtime ) ;
 
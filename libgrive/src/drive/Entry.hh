@@ -64,6 +64,7 @@ public :
 	std::string ContentSrc() const ;
 	std::string EditLink() const ;
 	std::string CreateLink() const ;
+	std::string EditMediaLink() const ;
 	long ChangeStamp() const ;
 	
 	bool IsChange() const ;
@@ -90,6 +91,7 @@ private :
 	std::string		m_content_src ;
 	std::string		m_edit_link ;
 	std::string		m_create_link ;
+	std::string		m_edit_media ;
 
 	long			m_change_stamp ;
 	
@@ -24,6 +24,7 @@
 #include "http/ResponseLog.hh"
 #include "http/XmlResponse.hh"
 #include "xml/NodeSet.hh"
+#include "util/Stats.hh"
 
 #include <boost/format.hpp>
 
@@ -31,6 +32,38 @@
 
 namespace gr { namespace v1 {
 
+namespace
+{
+	/// Counts the bytes of a response written to another stream.
+	class CountStream : public DataStream
+	{
+	public :
+		explicit CountStream( DataStream *dest ) : m_dest( dest ), m_count( 0 )
+		{
+		}
+		
+		std::size_t Read( char *data, std::size_t size )
+		{
+			return m_dest->Read( data, size ) ;
+		}
+		
+		std::size_t Write( const char *data, std::size_t size )
+		{
+			m_count += size ;
+			return m_dest->Write( data, size ) ;
+		}
+		
+		u64_t Count() const
+		{
+			return m_count ;
+		}
+		
+	private :
+		DataStream	*m_dest ;
+		u64_t		m_count ;
+	} ;
+}
+
 Feed::Feed( )
 {
 }
@@ -74,10 +107,14 @@ void Feed::Start( http::Agent *http, const std::string& url )
 			(boost::format( "-#%1%%2%" ) % m_log->sequence++ % m_log->suffix ).str(),
 			&xrsp ) ;
 	
-	http->Get( url, &log, http::Header() ) ;
+	CountStream count( &log ) ;
+	http->Get( url, &count, http::Header() ) ;
 	
 	m_root		= xrsp.Response() ;
 	m_entries	= m_root["entry"] ;
+	
+	Stats::Inst().Add( "remote.page", 1, count.Count() ) ;
+	Stats::Inst().Add( "remote.entry", m_entries.size() ) ;
 }
 
 bool Feed::GetNext( http::Agent *http )
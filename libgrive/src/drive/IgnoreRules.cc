@@ -0,0 +1,308 @@
+/*
+	grive: an GPL program to sync a local directory with Google Drive
+	Copyright (C) 2012  Wan Wai Ho
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation version 2
+	of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "IgnoreRules.hh"
+
+#include "util/log/Log.hh"
+
+#include <cstring>
+#include <fstream>
+
+namespace gr { namespace v1 {
+
+namespace
+{
+	const std::size_t none = static_cast<std::size_t>( -1 ) ;
+	
+	bool HasWildcard( const std::string& s )
+	{
+		return s.find_first_of( "*?[\\" ) != std::string::npos ;
+	}
+	
+	/// Match one character against a bracket expression, e.g. "[a-z]". \a p
+	/// points after the "[" and is moved past the "]". Returns false if the
+	/// expression is not closed.
+	bool MatchBracket( const char *&p, char c, bool& matched )
+	{
+		bool negate = ( *p == '!' || *p == '^' ) ;
+		if ( negate )
+			p++ ;
+		
+		matched = false ;
+		for ( bool first = true ; *p != '\0' && ( first || *p != ']' ) ; first = false )
+		{
+			char lo = *p++ ;
+			char hi = lo ;
+			if ( *p == '-' && p[1] != ']' && p[1] != '\0' )
+			{
+				hi = p[1] ;
+				p += 2 ;
+			}
+			if ( c >= lo && c <= hi )
+				matched = true ;
+		}
+		
+		if ( *p != ']' )
+			return false ;
+		
+		p++ ;
+		matched = ( matched != negate ) ;
+		return true ;
+	}
+}
+
+IgnoreRules::IgnoreRules( )
+{
+}
+
+/// Add the rules in .griveignore under \a root, if it exists. The paths
+/// given to IsIgnored() afterwards are under \a root.
+void IgnoreRules::Read( const fs::path& root )
+{
+	m_root = root ;
+	
+	fs::path file = root / ".griveignore" ;
+	std::ifstream in( file.string().c_str() ) ;
+	
+	std::string line ;
+	while ( std::getline( in, line ) )
+		Add( line ) ;
+	
+	if ( !m_rules.empty() )
+		Log( "%1% rules in %2%", m_rules.size(), file, log::verbose ) ;
+}
+
+void IgnoreRules::Add( const std::string& line )
+{
+	std::string p = line ;
+	
+	// trailing spaces and CR, unless escaped
+	std::size_t end = p.find_last_not_of( " \t\r" ) ;
+	if ( end == std::string::npos || p[0] == '#' )
+		return ;
+	if ( end + 1 < p.size() && p[end] == '\\' )
+		end++ ;
+	p.erase( end + 1 ) ;
+	
+	Rule r = { "", false, false, false } ;
+	if ( p[0] == '!' )
+	{
+		r.negate = true ;
+		p.erase( 0, 1 ) ;
+	}
+	else if ( p.compare( 0, 2, "\\!" ) == 0 || p.compare( 0, 2, "\\#" ) == 0 )
+		p.erase( 0, 1 ) ;
+	
+	if ( !p.empty() && p[p.size()-1] == '/' )
+	{
+		r.dir_only = true ;
+		p.erase( p.size()-1 ) ;
+	}
+	
+	// "**/name" is the same as "name"
+	while ( p.compare( 0, 3, "**/" ) == 0 && p.find( '/', 3 ) == std::string::npos )
+		p.erase( 0, 3 ) ;
+	
+	if ( !p.empty() && p[0] == '/' )
+	{
+		r.anchored = true ;
+		p.erase( 0, 1 ) ;
+	}
+	else
+		r.anchored = ( p.find( '/' ) != std::string::npos ) ;
+	
+	if ( p.empty() )
+		return ;
+	
+	r.pattern = p ;
+	std::size_t idx = m_rules.size() ;
+	m_rules.push_back( r ) ;
+	
+	if ( r.anchored )
+		m_glob.push_back( idx ) ;
+	
+	else if ( !HasWildcard( p ) )
+		m_name[p].push_back( idx ) ;
+	
+	else if ( p[0] == '*' && !HasWildcard( p.substr( 1 ) ) )
+	{
+		m_suffix[p.substr( 1 )].push_back( idx ) ;
+		m_suffix_len.insert( p.size() - 1 ) ;
+	}
+	else
+		m_glob.push_back( idx ) ;
+}
+
+bool IgnoreRules::Empty( ) const
+{
+	return m_rules.empty() ;
+}
+
+std::size_t IgnoreRules::Size( ) const
+{
+	return m_rules.size() ;
+}
+
+/// Returns true if \a path, relative to the root, is excluded.
+bool IgnoreRules::Match( const std::string& path, bool is_dir ) const
+{
+	if ( m_rules.empty() )
+		return false ;
+	
+	std::size_t slash = path.rfind( '/' ) ;
+	const std::string name = ( slash == std::string::npos ) ? path : path.substr( slash + 1 ) ;
+	
+	// the last matching rule
+	std::size_t last = Last( m_name, name, is_dir ) ;
+	
+	for ( std::set<std::size_t>::const_iterator i = m_suffix_len.begin() ;
+		i != m_suffix_len.end() && *i <= name.size() ; ++i )
+	{
+		std::size_t idx = Last( m_suffix, name.substr( name.size() - *i ), is_dir ) ;
+		if ( idx != none && ( last == none || idx > last ) )
+			last = idx ;
+	}
+	
+	for ( std::vector<std::size_t>::const_reverse_iterator i = m_glob.rbegin() ;
+		i != m_glob.rend() && ( last == none || *i > last ) ; ++i )
+	{
+		const Rule& r = m_rules[*i] ;
+		if ( Applies( *i, is_dir ) && Glob( r.pattern.c_str(), r.anchored ? path.c_str() : name.c_str() ) )
+		{
+			last = *i ;
+			break ;
+		}
+	}
+	
+	return last != none && !m_rules[last].negate ;
+}
+
+/// Returns true if \a path under the root is excluded, either by the rules
+/// or because it is a hidden file.
+bool IgnoreRules::IsIgnored( const fs::path& path, bool is_dir ) const
+{
+	const std::string name = path.filename().string() ;
+	if ( !name.empty() && name[0] == '.' )
+		return true ;
+	
+	const std::string root = m_root.string() ;
+	const std::string full = path.string() ;
+	if ( root.empty() )
+		return Match( full, is_dir ) ;
+	
+	// the root itself and the paths outside it are never excluded
+	std::size_t start = root.size() ;
+	if ( root[start-1] != '/' )
+		start++ ;
+	
+	if ( full.size() <= start || full.compare( 0, root.size(), root ) != 0 ||
+		full[start-1] != '/' )
+		return false ;
+	
+	return Match( full.substr( start ), is_dir ) ;
+}
+
+bool IgnoreRules::Applies( std::size_t idx, bool is_dir ) const
+{
+	return is_dir || !m_rules[idx].dir_only ;
+}
+
+std::size_t IgnoreRules::Last( const Index& index, const std::string& key, bool is_dir ) const
+{
+	Index::const_iterator i = index.find( key ) ;
+	if ( i != index.end() )
+	{
+		for ( std::vector<std::size_t>::const_reverse_iterator r = i->second.rbegin() ;
+			r != i->second.rend() ; ++r )
+		{
+			if ( Applies( *r, is_dir ) )
+				return *r ;
+		}
+	}
+	return none ;
+}
+
+/// Match a string against a glob pattern. "*" doesn't match "/", but "**"
+/// does.
+bool IgnoreRules::Glob( const char *p, const char *s )
+{
+	for ( ; *p != '\0' ; s++ )
+	{
+		switch ( *p )
+		{
+		case '*' :
+			if ( p[1] == '*' )
+			{
+				// "**/" matches zero or more directories, so the rest of the
+				// pattern starts here or after a "/"
+				while ( *p == '*' )
+					p++ ;
+				bool dirs = ( *p == '/' ) ;
+				if ( dirs )
+					p++ ;
+				
+				for ( const char *from = s ; ; s++ )
+				{
+					if ( ( !dirs || s == from || s[-1] == '/' ) && Glob( p, s ) )
+						return true ;
+					if ( *s == '\0' )
+						return false ;
+				}
+			}
+			
+			for ( p++ ; ; s++ )
+			{
+				if ( Glob( p, s ) )
+					return true ;
+				if ( *s == '\0' || *s == '/' )
+					return false ;
+			}
+		
+		case '?' :
+			if ( *s == '\0' || *s == '/' )
+				return false ;
+			p++ ;
+			break ;
+		
+		case '[' :
+		{
+			bool matched ;
+			const char *q = p + 1 ;
+			if ( *s == '\0' || *s == '/' || !MatchBracket( q, *s, matched ) || !matched )
+				return false ;
+			p = q ;
+			break ;
+		}
+		
+		case '\\' :
+			if ( p[1] != '\0' )
+				p++ ;
+			// fall through
+		
+		default :
+			if ( *p != *s )
+				return false ;
+			p++ ;
+			break ;
+		}
+	}
+	return *s == '\0' ;
+}
+
+} } // end of namespace gr::v1
@@ -0,0 +1,92 @@
+/*
+	grive: an GPL program to sync a local directory with Google Drive
+	Copyright (C) 2012  Wan Wai Ho
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation version 2
+	of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#pragma once
+
+#include "util/FileSystem.hh"
+
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+namespace gr { namespace v1 {
+
+/*!	\brief	Rules of the files not to sync, like .gitignore
+
+	Each line is a glob pattern. "*" and "?" match anything but "/", and "**"
+	matches any number of directories. A pattern that starts with "!"
+	includes the files excluded by the patterns before it, a pattern that
+	ends with "/" only matches directories, and a pattern with "/" in it
+	matches the path from the root instead of the name at any level. Empty
+	lines and lines starting with "#" are skipped. The last matching pattern
+	wins. The files in an excluded directory are never looked at.
+	
+	The rules are read from ".griveignore" in the root of the local
+	directory. Files whose names start with "." are always excluded.
+	
+	The patterns are compiled when they are added: plain names are looked up
+	in a map, "*.ext" patterns are looked up by the end of the name, and
+	only the other ones are matched one by one.
+*/
+class IgnoreRules
+{
+public :
+	IgnoreRules( ) ;
+	
+	void Read( const fs::path& root ) ;
+	void Add( const std::string& line ) ;
+	
+	bool Empty( ) const ;
+	std::size_t Size( ) const ;
+	bool Match( const std::string& path, bool is_dir ) const ;
+	bool IsIgnored( const fs::path& path, bool is_dir ) const ;
+	
+	static bool Glob( const char *pattern, const char *str ) ;
+	
+private :
+	struct Rule
+	{
+		std::string	pattern ;
+		bool		negate ;
+		bool		dir_only ;
+		bool		anchored ;
+	} ;
+	
+	typedef std::map<std::string, std::vector<std::size_t> > Index ;
+	
+	bool Applies( std::size_t idx, bool is_dir ) const ;
+	std::size_t Last( const Index& index, const std::string& key, bool is_dir ) const ;
+	
+private :
+	fs::path					m_root ;
+	std::vector<Rule>			m_rules ;
+	
+	/// the rules of plain names, by the names
+	Index						m_name ;
+	
+	/// the rules of "*" followed by a plain suffix, by the suffixes
+	Index						m_suffix ;
+	std::set<std::size_t>		m_suffix_len ;
+	
+	/// the other rules
+	std::vector<std::size_t>	m_glob ;
+} ;
+
+} } // end of namespace gr::v1
@@ -0,0 +1,165 @@
+/*
+	grive: an GPL program to sync a local directory with Google Drive
+	Copyright (C) 2012  Wan Wai Ho
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation version 2
+	of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "Journal.hh"
+
+#include "protocol/Json.hh"
+#include "util/log/Log.hh"
+
+#include <boost/exception/diagnostic_information.hpp>
+
+#include <sstream>
+
+namespace gr { namespace v1 {
+
+namespace
+{
+	// write to the disk after this many records, or this many seconds
+	const std::size_t	batch_size	= 32 ;
+	const std::time_t	batch_time	= 2 ;
+}
+
+Journal::Journal( const fs::path& file ) :
+	m_path			( file ),
+	m_pending_count	( 0 ),
+	m_count			( 0 )
+{
+}
+
+Journal::~Journal( )
+{
+	try
+	{
+		Flush() ;
+	}
+	catch ( Exception& e )
+	{
+		Log( "cannot write journal %1%", m_path, log::error ) ;
+		Trace( "Exception %1%", boost::diagnostic_information(e) ) ;
+	}
+}
+
+/// The records written after the state file of \a generation. Nothing is
+/// returned if the journal belongs to another generation. The last record may
+/// be cut short by a crash. It is ignored, along with anything after it.
+std::vector<Json> Journal::Read( long generation ) const
+{
+	std::vector<Json> result ;
+	if ( !fs::exists( m_path ) )
+		return result ;
+	
+	std::string content ;
+	try
+	{
+		File file( m_path ) ;
+		char buf[4096] ;
+		std::size_t count ;
+		while ( ( count = file.Read( buf, sizeof(buf) ) ) > 0 )
+			content.append( buf, count ) ;
+	}
+	catch ( Exception& e )
+	{
+		Log( "cannot read journal %1%", m_path, log::warning ) ;
+		Trace( "Exception %1%", boost::diagnostic_information(e) ) ;
+		return result ;
+	}
+	
+	std::istringstream ss( content ) ;
+	std::string line ;
+	for ( bool header = true ; std::getline( ss, line ) && !ss.eof() ; header = false )
+	{
+		try
+		{
+			Json rec = Json::Parse( line ) ;
+			if ( !header )
+				result.push_back( rec ) ;
+			
+			else if ( rec["generation"].Int() != generation )
+			{
+				Log( "journal %1% is out of date", m_path, log::verbose ) ;
+				break ;
+			}
+		}
+		catch ( Exception& )
+		{
+			Log( "journal %1% is cut short after %2% records", m_path, result.size(), log::verbose ) ;
+			break ;
+		}
+	}
+	return result ;
+}
+
+/// Discard all records and start over for the state file of \a generation.
+void Journal::Start( long generation )
+{
+	m_pending.clear() ;
+	m_pending_count	= 0 ;
+	m_count			= 0 ;
+	
+	Json header ;
+	header.Add( "generation", Json( generation ) ) ;
+	
+	std::ostringstream ss ;
+	ss << header << '\n' ;
+	
+	m_file.OpenForWrite( m_path ) ;
+	m_file.Write( ss.str().c_str(), ss.str().size() ) ;
+	m_file.Sync() ;
+	
+	m_last_flush = DateTime::Now() ;
+}
+
+/// Add a record. It is written to the disk later, together with the others
+/// in the same batch.
+void Journal::Append( const Json& rec )
+{
+	std::ostringstream ss ;
+	ss << rec << '\n' ;
+	
+	m_pending += ss.str() ;
+	m_pending_count++ ;
+	m_count++ ;
+	
+	if ( m_pending_count >= batch_size || DateTime::Now().Sec() - m_last_flush.Sec() >= batch_time )
+		Flush() ;
+}
+
+void Journal::Flush( )
+{
+	if ( m_pending.empty() )
+		return ;
+	
+	if ( !m_file.IsOpened() )
+		m_file.OpenForAppend( m_path ) ;
+	
+	m_file.Write( m_pending.c_str(), m_pending.size() ) ;
+	m_file.Sync() ;
+	
+	m_pending.clear() ;
+	m_pending_count	= 0 ;
+	m_last_flush	= DateTime::Now() ;
+}
+
+/// Number of records since Start().
+std::size_t Journal::Size( ) const
+{
+	return m_count ;
+}
+
+} } // end of namespace gr::v1
@@ -0,0 +1,68 @@
+/*
+	grive: an GPL program to sync a local directory with Google Drive
+	Copyright (C) 2012  Wan Wai Ho
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation version 2
+	of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#pragma once
+
+#include "util/DateTime.hh"
+#include "util/File.hh"
+#include "util/FileSystem.hh"
+
+#include <string>
+#include <vector>
+
+namespace gr {
+
+class Json ;
+
+namespace v1 {
+
+/*!	\brief	Append-only log of the changes since the state file was written
+
+	Each record is a line of JSON. The records are written to the disk in
+	batches, so a sync that is interrupted only loses the last few of them.
+	The first line is the generation of the state file that the records
+	follow. When the state file is written again, it gets a new generation
+	and the journal is started over, so records that are already in the
+	state file are never replayed over it.
+*/
+class Journal
+{
+public :
+	explicit Journal( const fs::path& file ) ;
+	~Journal( ) ;
+	
+	std::vector<Json> Read( long generation ) const ;
+	
+	void Start( long generation ) ;
+	void Append( const Json& rec ) ;
+	void Flush( ) ;
+	
+	std::size_t Size( ) const ;
+	
+private :
+	fs::path		m_path ;
+	File			m_file ;
+	
+	std::string		m_pending ;
+	std::size_t		m_pending_count ;
+	std::size_t		m_count ;
+	DateTime		m_last_flush ;
+} ;
+
+} } // end of namespace gr::v1
@@ -18,6 +18,7 @@
 */
 
 #include "Resource.hh"
+#include "ChecksumCache.hh"
 #include "CommonUri.hh"
 #include "Entry.hh"
 
@@ -33,13 +34,17 @@
 #include "util/log/Log.hh"
 #include "util/OS.hh"
 #include "util/File.hh"
+#include "util/Stats.hh"
 #include "xml/Node.hh"
 #include "xml/NodeSet.hh"
 #include "xml/String.hh"
+#include "xml/TreeBuilder.hh"
 
 #include <boost/bind.hpp>
 #include <boost/exception/all.hpp>
+#include <boost/lexical_cast.hpp>
 
+#include <algorithm>
 #include <cassert>
 
 // for debugging
@@ -56,6 +61,44 @@ const std::string xml_meta =
 		"<title>%2%</title>"
 	"</entry>" ;
 
+// copying a resource needs its ID and the title of the copy
+const std::string xml_copy =
+	"<?xml version='1.0' encoding='UTF-8'?>\n"
+	"<entry xmlns=\"http://www.w3.org/2005/Atom\">"
+		"<id>%1%</id>"
+		"<title>%2%</title>"
+	"</entry>" ;
+
+// adding an existing resource to a folder only needs its ID
+const std::string xml_id =
+	"<?xml version='1.0' encoding='UTF-8'?>\n"
+	"<entry xmlns=\"http://www.w3.org/2005/Atom\">"
+		"<id>%1%</id>"
+	"</entry>" ;
+
+// number of times a download is tried before giving up on a checksum mismatch
+const int download_attempts = 3 ;
+
+// the list of the resources being moved by MoveStaged(), and their temporary
+// names. hidden, so they are not synced.
+const std::string moving_list	= ".grive-moving" ;
+const std::string moving_prefix	= ".grive-moving-" ;
+
+namespace
+{
+	/// True if \a p is \a dir or in it.
+	bool IsUnder( const fs::path& p, const fs::path& dir )
+	{
+		fs::path::iterator i = p.begin(), j = dir.begin() ;
+		for ( ; i != p.end() && j != dir.end() ; ++i, ++j )
+		{
+			if ( *i != *j )
+				return false ;
+		}
+		return j == dir.end() ;
+	}
+}
+
 
 /// default constructor creates the root folder
 Resource::Resource(const fs::path& root_folder) :
@@ -65,7 +108,8 @@ Resource::Resource(const fs::path& root_folder) :
 	m_href		( root_href ),
 	m_create	( root_create ),
 	m_parent	( 0 ),
-	m_state		( sync )
+	m_state		( sync ),
+	m_skip		( false )
 {
 }
 
@@ -73,7 +117,8 @@ Resource::Resource( const std::string& name, const std::string& kind ) :
 	m_name		( name ),
 	m_kind		( kind ),
 	m_parent	( 0 ),
-	m_state		( unknown )
+	m_state		( unknown ),
+	m_skip		( false )
 {
 }
 
@@ -148,10 +193,12 @@ void Resource::FromRemote( const Entry& remote, const DateTime& last_sync )
 		FromRemoteFile( remote, last_sync ) ;
 	
 	AssignIDs( remote ) ;
+	m_remote_md5 = remote.MD5() ;
 	
 	assert( m_state != unknown ) ;
 	
-	if ( m_state == remote_new || m_state == remote_changed )
+	// the local copy doesn't exist or is older, so the local values are useless
+	if ( m_state == remote_new || m_state == remote_changed || m_state == local_deleted )
 	{
 		m_md5	= remote.MD5() ;
 		m_mtime	= remote.MTime() ;
@@ -167,9 +214,14 @@ void Resource::AssignIDs( const Entry& remote )
 		m_href		= remote.SelfHref() ;
 		m_edit		= remote.EditLink() ;
 		m_create	= remote.CreateLink() ;
+		m_edit_media= remote.EditMediaLink() ;
 		m_content	= remote.ContentSrc() ;
 		m_etag		= remote.ETag() ;
 	}
+	
+	// but the etag is the same, and newer than the one from the full feed
+	else if ( !remote.ETag().empty() )
+		m_etag = remote.ETag() ;
 }
 
 void Resource::FromRemoteFile( const Entry& remote, const DateTime& last_sync )
@@ -193,6 +245,7 @@ void Resource::FromRemoteFile( const Entry& remote, const DateTime& last_sync )
 	// local not exists
 	else if ( !fs::exists( path ) )
 	{
+		m_local_md5.clear() ;
 		Trace( "file %1% change stamp = %2%", Path(), remote.ChangeStamp() ) ;
 		
 		if ( remote.MTime() > last_sync || remote.ChangeStamp() > 0 )
@@ -248,8 +301,9 @@ void Resource::FromRemoteFile( const Entry& remote, const DateTime& last_sync )
 }
 
 /// Update the resource with the attributes of local file or directory. This
-/// function will propulate the fields in m_entry.
-void Resource::FromLocal( const DateTime& last_sync )
+/// function will propulate the fields in m_entry. The checksum is taken from
+/// \a cache if the file is not changed since it was last hashed.
+void Resource::FromLocal( const DateTime& last_sync, ChecksumCache *cache )
 {
 	fs::path path = Path() ;
 	assert( fs::exists( path ) ) ;
@@ -257,7 +311,8 @@ void Resource::FromLocal( const DateTime& last_sync )
 	// root folder is always in sync
 	if ( !IsRoot() )
 	{
-		m_mtime = os::FileCTime( path ) ;
+		os::FileStat st = os::Stat( path ) ;
+		m_mtime = st.ctime ;
 
 		// follow parent recursively
 		if ( m_parent->m_state == local_new || m_parent->m_state == local_deleted )
@@ -270,13 +325,305 @@ void Resource::FromLocal( const DateTime& last_sync )
 			m_state = ( m_mtime > last_sync ? local_new : remote_deleted ) ;
 		
 		m_name		= path.filename().string() ;
-		m_kind		= fs::is_directory(path) ? "folder"	: "file" ;
-		m_md5		= fs::is_directory(path) ? ""		: crypt::MD5::Get( path ) ;
+		m_kind		= st.is_dir ? "folder" : "file" ;
+		
+		if ( st.is_dir )
+			m_md5.clear() ;
+		else
+			m_md5 = ( cache != 0 ? cache->MD5( path, st ) : crypt::MD5::Get( path ) ) ;
+		m_local_md5 = m_md5 ;
 	}
 	
 	assert( m_state != unknown ) ;
 }
 
+/// Compare a file in sync with its local copy again, when only what has changed
+/// since the last sync is synced. Returns true if it has changed in local.
+bool Resource::FromLocalChange( ChecksumCache *cache )
+{
+	assert( !IsFolder() ) ;
+	assert( cache != 0 ) ;
+	
+	fs::path path = Path() ;
+	os::FileStat st = os::Stat( path ) ;
+	std::string md5 = cache->MD5( path, st ) ;
+	if ( m_state != sync || md5 == m_md5 )
+		return false ;
+	
+	Log( "file %1% is changed in local", path, log::verbose ) ;
+	m_md5		= md5 ;
+	m_local_md5	= md5 ;
+	m_mtime		= st.ctime ;
+	m_state		= local_changed ;
+	return true ;
+}
+
+/// The local copy of a resource in sync, and everything in it, is deleted.
+void Resource::FromLocalDelete( )
+{
+	assert( m_state == sync ) ;
+	
+	Log( "%1% is deleted in local", Path(), log::verbose ) ;
+	SetState( local_deleted ) ;
+}
+
+/// Update a resource in sync with an entry of the changes feed, when only what
+/// has changed since the last sync is synced. Returns false if the change
+/// cannot be found out this way, i.e. the resource has been renamed or moved,
+/// and the whole tree needs to be compared again.
+bool Resource::FromRemoteChange( const Entry& change )
+{
+	assert( change.IsChange() ) ;
+	
+	if ( m_state != sync || IsRoot() )
+		return false ;
+	
+	if ( change.IsRemoved() )
+	{
+		Log( "%1% is deleted in remote", Path(), log::verbose ) ;
+		SetState( remote_deleted ) ;
+		return true ;
+	}
+	
+	const std::vector<std::string>& parents = change.ParentHrefs() ;
+	if ( change.Name() != m_name || ( !parents.empty() &&
+		std::find( parents.begin(), parents.end(), m_parent->m_href ) == parents.end() ) )
+	{
+		Log( "%1% is moved in remote", Path(), log::verbose ) ;
+		return false ;
+	}
+	
+	// as FromLocal() leaves a file that hasn't changed in local. the entries
+	// in the changes feed are always newer than the last sync.
+	if ( !IsFolder() )
+		m_state = remote_deleted ;
+	FromRemote( change, DateTime() ) ;
+	return true ;
+}
+
+/// Find the children that were moved here from somewhere else since the last
+/// sync, and take the remote resources they were moved from. \a source returns
+/// the resource in the last sync with the same inode, or null if there is none.
+/// A match is only trusted when that resource is deleted in local and nothing
+/// changed in remote. The resources replaced by the remote ones are put in
+/// \a discarded. They are no longer in the tree and should be deleted.
+///
+/// Only the moves to folders that already exist in remote are detected, so
+/// they can be done before the old folders are deleted. A new folder doesn't
+/// have an ID yet, so the files moved into it are uploaded again.
+void Resource::DetectMoves( const MoveSource& source, std::vector<Resource*>& discarded )
+{
+	assert( IsFolder() ) ;
+	
+	for ( std::size_t i = 0 ; i < m_child.size() ; i++ )
+	{
+		Resource *child = m_child[i] ;
+		Resource *old	= ( child->m_state == local_new && HasID() ) ? source( child ) : 0 ;
+		
+		if ( old != 0 && old != child && !old->IsRoot() &&
+			old->m_state == local_deleted && old->m_kind == child->m_kind )
+		{
+			Log( "%1% is moved from %2% in local", child->Path(), old->Path(), log::verbose ) ;
+			
+			old->m_old_parent	= old->m_parent->m_id ;
+			old->m_old_name		= old->m_name ;
+			
+			Children& sibling = old->m_parent->m_child ;
+			sibling.erase( std::find( sibling.begin(), sibling.end(), old ) ) ;
+			
+			// it may be one of my children, so find the new resource again
+			Children::iterator pos = std::find( m_child.begin(), m_child.end(), child ) ;
+			*pos			= old ;
+			old->m_parent	= this ;
+			i				= pos - m_child.begin() ;
+			
+			old->Adopt( child, discarded ) ;
+			old->m_state = local_moved ;
+			child = old ;
+		}
+		
+		if ( child->IsFolder() )
+			child->DetectMoves( source, discarded ) ;
+	}
+}
+
+/// Find the children that were moved here in remote since the last sync, and
+/// take their local copies from where they were. \a source returns the local
+/// copy of a resource and its path, if it was somewhere else in the last sync.
+/// Files must have the same content in both places.
+void Resource::DetectRemoteMoves( const LocalSource& source, std::vector<Resource*>& discarded )
+{
+	assert( IsFolder() ) ;
+	
+	for ( std::size_t i = 0 ; i < m_child.size() ; i++ )
+	{
+		Resource *child = m_child[i] ;
+		fs::path path ;
+		Resource *local = ( child->m_state == remote_new || child->m_state == local_deleted ) ?
+			source( child, path ) : 0 ;
+		
+		if ( local != 0 && local != child && !local->IsRoot() && !local->HasID() &&
+			local->m_state == remote_deleted && local->m_kind == child->m_kind &&
+			( child->IsFolder() || local->m_md5 == child->m_md5 ) )
+		{
+			Log( "%1% is moved from %2% in remote", child->Path(), path, log::verbose ) ;
+			
+			Children& sibling = local->m_parent->m_child ;
+			sibling.erase( std::find( sibling.begin(), sibling.end(), local ) ) ;
+			
+			// it may be one of my children
+			i = std::find( m_child.begin(), m_child.end(), child ) - m_child.begin() ;
+			
+			child->TakeLocal( local, discarded ) ;
+			child->m_old_path	= path ;
+			child->m_state		= remote_moved ;
+		}
+		
+		if ( child->IsFolder() )
+			child->DetectRemoteMoves( source, discarded ) ;
+	}
+}
+
+/// Find the new files in local that have the same content as a file in remote.
+/// They are copied in remote instead of uploaded.
+void Resource::DetectCopies( )
+{
+	std::map<std::string, std::string> sources ;
+	FindCopySources( sources ) ;
+	
+	if ( !sources.empty() )
+		FindCopies( sources ) ;
+}
+
+/// Collect the remote files with known content, by their checksums. The ones
+/// deleted in local, or changed in local, are no good: they will be deleted or
+/// overwritten.
+void Resource::FindCopySources( std::map<std::string, std::string>& sources ) const
+{
+	if ( !IsFolder() && HasID() && !m_md5.empty() &&
+		( m_state == sync || m_state == remote_new || m_state == remote_changed ) )
+		sources.insert( std::make_pair( m_md5, m_href ) ) ;
+	
+	for ( iterator i = m_child.begin() ; i != m_child.end() ; ++i )
+		(*i)->FindCopySources( sources ) ;
+}
+
+void Resource::FindCopies( const std::map<std::string, std::string>& sources )
+{
+	if ( m_state == local_new && !IsFolder() )
+	{
+		std::map<std::string, std::string>::const_iterator i = sources.find( m_md5 ) ;
+		if ( i != sources.end() )
+		{
+			Log( "%1% has the same content as %2% in remote", Path(), i->second, log::verbose ) ;
+			m_copy_of = i->second ;
+		}
+	}
+	
+	for ( iterator i = m_child.begin() ; i != m_child.end() ; ++i )
+		(*i)->FindCopies( sources ) ;
+}
+
+/// Correct the direction of a file decided from the modification times with
+/// \a action of the three-way diff, which compares both copies with the last
+/// sync instead. Only a file changed on one side the other way round, or
+/// deleted on one side and not changed on the other, is corrected. Returns
+/// true if the state is changed.
+bool Resource::Resolve( SyncPlan::Action action )
+{
+	State state = m_state ;
+	if ( action == SyncPlan::download && m_state == local_changed )
+		state = remote_changed ;
+	else if ( action == SyncPlan::download && m_state == local_deleted )
+		state = remote_new ;
+	else if ( action == SyncPlan::upload && m_state == remote_changed )
+		state = local_changed ;
+	else if ( action == SyncPlan::delete_remote && m_state == remote_new )
+		state = local_deleted ;
+	
+	if ( IsFolder() || state == m_state )
+		return false ;
+	
+	Log( "file %1% is %2% since the last sync, not %3%", Path(), state, m_state, log::verbose ) ;
+	m_state	= state ;
+	m_md5	= ( state == local_changed ? m_local_md5 : m_remote_md5 ) ;
+	return true ;
+}
+
+/// Take the local copy of this resource, which is \a local at another place.
+/// The children of both are matched by names. The ones that only exist in
+/// local keep their states, i.e. they are new in local or deleted in remote.
+void Resource::TakeLocal( Resource *local, std::vector<Resource*>& discarded )
+{
+	assert( local != 0 ) ;
+	assert( m_kind == local->m_kind ) ;
+	
+	for ( iterator i = local->m_child.begin() ; i != local->m_child.end() ; ++i )
+	{
+		Resource *remote = FindChild( (*i)->m_name ) ;
+		if ( remote != 0 && remote->m_kind == (*i)->m_kind &&
+			( remote->m_state == remote_new || remote->m_state == local_deleted ) )
+		{
+			remote->TakeLocal( *i, discarded ) ;
+			remote->m_local_md5 = (*i)->m_local_md5 ;
+			
+			if ( remote->IsFolder() || remote->m_md5 == (*i)->m_md5 )
+				remote->m_state = sync ;
+			else if ( remote->m_mtime > (*i)->m_mtime )
+				remote->m_state = remote_changed ;
+			else
+			{
+				remote->m_md5	= (*i)->m_md5 ;
+				remote->m_state	= local_changed ;
+			}
+		}
+		else
+		{
+			(*i)->m_parent = 0 ;
+			AddChild( *i ) ;
+		}
+	}
+	
+	// not to be taken again
+	local->m_child.clear() ;
+	local->m_state = unknown ;
+	discarded.push_back( local ) ;
+}
+
+/// Take the name and local attributes of \a local, which is the same resource
+/// at its new place. The children of both are matched by names. The ones that
+/// only exist in local are new, and the ones that only exist in remote are left
+/// deleted in local.
+void Resource::Adopt( Resource *local, std::vector<Resource*>& discarded )
+{
+	assert( local != 0 ) ;
+	assert( m_kind == local->m_kind ) ;
+	
+	m_name	= local->m_name ;
+	m_mtime	= local->m_mtime ;
+	
+	for ( iterator i = local->m_child.begin() ; i != local->m_child.end() ; ++i )
+	{
+		Resource *remote = FindChild( (*i)->m_name ) ;
+		if ( remote != 0 && remote->m_state == local_deleted && remote->m_kind == (*i)->m_kind )
+		{
+			bool same = remote->IsFolder() || remote->m_md5 == (*i)->m_md5 ;
+			remote->Adopt( *i, discarded ) ;
+			remote->m_md5		= (*i)->m_md5 ;
+			remote->m_local_md5	= (*i)->m_local_md5 ;
+			remote->m_state		= same ? sync : local_changed ;
+		}
+		else
+		{
+			(*i)->m_parent = 0 ;
+			AddChild( *i ) ;
+		}
+	}
+	
+	local->m_child.clear() ;
+	discarded.push_back( local ) ;
+}
+
 std::string Resource::SelfHref() const
 {
 	return m_href ;
@@ -314,11 +661,22 @@ void Resource::AddChild( Resource *child )
 	m_child.push_back( child ) ;
 }
 
+void Resource::RemoveChild( Resource *child )
+{
+	assert( child != 0 ) ;
+	assert( child->m_parent == this ) ;
+	
+	m_child.erase( std::remove( m_child.begin(), m_child.end(), child ), m_child.end() ) ;
+	child->m_parent = 0 ;
+}
+
 void Resource::Swap( Resource& coll )
 {
 	m_name.swap( coll.m_name ) ;
 	m_kind.swap( coll.m_kind ) ;
 	m_md5.swap( coll.m_md5 ) ;
+	m_local_md5.swap( coll.m_local_md5 ) ;
+	m_remote_md5.swap( coll.m_remote_md5 ) ;
 	m_etag.swap( coll.m_etag ) ;
 	m_id.swap( coll.m_id ) ;
 
@@ -326,12 +684,18 @@ void Resource::Swap( Resource& coll )
 	m_content.swap( coll.m_content ) ;	
 	m_edit.swap( coll.m_edit ) ;
 	m_create.swap( coll.m_create ) ;
+	m_edit_media.swap( coll.m_edit_media ) ;
+	m_old_parent.swap( coll.m_old_parent ) ;
+	m_old_name.swap( coll.m_old_name ) ;
+	m_old_path.swap( coll.m_old_path ) ;
+	m_copy_of.swap( coll.m_copy_of ) ;
 	
 	m_mtime.Swap( coll.m_mtime ) ;
 	
 	std::swap( m_parent, coll.m_parent ) ;
 	m_child.swap( coll.m_child ) ;
 	std::swap( m_state, coll.m_state ) ;
+	std::swap( m_skip, coll.m_skip ) ;
 }
 
 bool Resource::IsFolder() const
@@ -350,7 +714,7 @@ fs::path Resource::Path() const
 bool Resource::IsInRootTree() const
 {
 	assert( m_parent == 0 || m_parent->IsFolder() ) ;
-	return m_parent == 0 ? (SelfHref() == root_href) : m_parent->IsInRootTree() ;
+	return m_parent == 0 ? HasID() : m_parent->IsInRootTree() ;
 }
 
 Resource* Resource::FindChild( const std::string& name )
@@ -364,25 +728,104 @@ Resource* Resource::FindChild( const std::string& name )
 	return 0 ;
 }
 
-// try to change the state to "sync"
-void Resource::Sync( http::Agent *http, DateTime& sync_time, const Json& options )
+/// Try to change the state to "sync". \a synced is called after each resource
+/// is transferred or deleted.
+void Resource::Sync(
+	http::Agent		*http,
+	DateTime&		sync_time,
+	const Json&		options,
+	ChecksumCache	*cache,
+	const SyncHook&	synced )
 {
 	assert( m_state != unknown ) ;
 	assert( !IsRoot() || m_state == sync ) ;	// root folder is already synced
 	
-	SyncSelf( http, options ) ;
+	// move the resources before the folders they were in are deleted
+	if ( IsRoot() && http != 0 )
+	{
+		std::vector<Resource*> moved ;
+		SyncMoves( http, moved ) ;
+		MoveLocal( moved ) ;
+	}
+	
+	SyncSelf( http, options, cache, synced ) ;
 	
 	// we want the server sync time, so we will take the server time of the last file uploaded to store as the sync time
 	// m_mtime is updated to server modified time when the file is uploaded
 	sync_time = std::max(sync_time, m_mtime);
 	
-	// if myself is deleted, no need to do the childrens
-	if ( m_state != local_deleted && m_state != remote_deleted )
-		std::for_each( m_child.begin(), m_child.end(),
-			boost::bind( &Resource::Sync, _1, http, boost::ref(sync_time), options ) ) ;
+	// if myself is deleted, no need to do the childrens. same if the local
+	// copy cannot be moved: they are not there. nor if nothing has changed.
+	if ( !m_skip && m_state != local_deleted && m_state != remote_deleted && m_state != remote_moved )
+	{
+		if ( http != 0 )
+			SyncChildren( http, synced ) ;
+		
+		for ( iterator i = m_child.begin() ; i != m_child.end() ; ++i )
+		{
+			// deleted by SyncChildren() already
+			if ( http == 0 || (*i)->m_state != local_deleted )
+				(*i)->Sync( http, sync_time, options, cache, synced ) ;
+		}
+	}
+}
+
+/// Delete the remote copies of the children deleted in local, and create the
+/// new child folders. These requests have no content, and are sent together
+/// with Perform(), so the agent may send them at the same time, e.g. over one
+/// HTTP/2 connection. The new folders that can't be created here are left for
+/// SyncSelf() to try again one by one.
+void Resource::SyncChildren( http::Agent *http, const SyncHook& synced )
+{
+	assert( http != 0 ) ;
+	
+	std::vector<Resource*> deleted, folders ;
+	for ( iterator i = m_child.begin() ; i != m_child.end() ; ++i )
+	{
+		if ( (*i)->m_state == local_deleted )
+		{
+			Log( "sync %1% deleted in local. deleting remote", (*i)->Path(), log::info ) ;
+			deleted.push_back( *i ) ;
+		}
+		
+		// the ID of the parent is needed to create a folder in it
+		else if ( (*i)->m_state == local_new && (*i)->IsFolder() && m_state == sync )
+			folders.push_back( *i ) ;
+	}
+	
+	if ( deleted.empty() && folders.empty() )
+		return ;
+	
+	DeleteRemote( http, deleted ) ;
+	if ( synced )
+		std::for_each( deleted.begin(), deleted.end(), synced ) ;
+	
+	std::vector<http::Request> reqs ;
+	std::vector<http::StringResponse> resp( folders.size() ) ;
+	for ( std::size_t i = 0 ; i < folders.size() ; i++ )
+	{
+		Log( "sync %1% doesn't exist in server, uploading", folders[i]->Path(), log::info ) ;
+		reqs.push_back( folders[i]->CreateFolderRequest( http, &resp[i] ) ) ;
+	}
+	http->Perform( reqs ) ;
+	
+	for ( std::size_t i = 0 ; i < folders.size() ; i++ )
+	{
+		const http::Request& req = reqs[i] ;
+		if ( req.response >= 200 && req.response < 300 )
+		{
+			folders[i]->AssignIDs( Entry( xml::TreeBuilder::Parse( resp[i].Response() ) ) ) ;
+			folders[i]->m_state = sync ;
+			if ( synced )
+				synced( folders[i] ) ;
+		}
+		else
+			Log( "cannot create folder %1%: HTTP %2%. trying again",
+				folders[i]->Path(), req.response, log::warning ) ;
+	}
 }
 
-void Resource::SyncSelf( http::Agent* http, const Json& options )
+void Resource::SyncSelf( http::Agent* http, const Json& options, ChecksumCache *cache, const SyncHook& synced )
 {
 	assert( !IsRoot() || m_state == sync ) ;	// root is always sync
 	assert( IsRoot() || http == 0 || fs::is_directory( m_parent->Path() ) ) ;
@@ -390,13 +833,18 @@ void Resource::SyncSelf( http::Agent* http, const Json& options )
 	assert( IsRoot() || m_parent->m_state != local_deleted ) ;
 
 	const fs::path path = Path() ;
+	const State old_state = m_state ;
+	
+	// a count for each action, the whole pass is timed as "sync" already
+	if ( m_state != sync )
+		Stats::Inst().Add( "sync." + StateStr() ) ;
 
 	switch ( m_state )
 	{
 	case local_new :
 		Log( "sync %1% doesn't exist in server, uploading", path, log::info ) ;
 		
-		if ( http != 0 && Create( http ) )
+		if ( http != 0 && Create( http, UploadThreshold( options ) ) )
 			m_state = sync ;
 		break ;
 	
@@ -406,9 +854,14 @@ void Resource::SyncSelf( http::Agent* http, const Json& options )
 			DeleteRemote( http ) ;
 		break ;
 	
+	// moved by SyncMoves() already, except in dry-run
+	case local_moved :
+		Log( "sync %1% moved in local. moving remote", path, log::info ) ;
+		break ;
+	
 	case local_changed :
 		Log( "sync %1% changed in local. uploading", path, log::info ) ;
-		if ( http != 0 && EditContent( http, options["new-rev"].Bool() ) )
+		if ( http != 0 && EditContent( http, options["new-rev"].Bool(), UploadThreshold( options ) ) )
 			m_state = sync ;
 		break ;
 	
@@ -417,22 +870,20 @@ void Resource::SyncSelf( http::Agent* http, const Json& options )
 		if ( http != 0 )
 		{
 			if ( IsFolder() )
+			{
 				fs::create_directories( path ) ;
-			else
-				Download( http, path ) ;
-			
-			m_state = sync ;
+				m_state = sync ;
+			}
+			else if ( Download( http, path, cache ) )
+				m_state = sync ;
 		}
 		break ;
 	
 	case remote_changed :
 		assert( !IsFolder() ) ;
 		Log( "sync %1% changed in remote. downloading", path, log::info ) ;
-		if ( http != 0 )
-		{
-			Download( http, path ) ;
+		if ( http != 0 && Download( http, path, cache ) )
 			m_state = sync ;
-		}
 		break ;
 	
 	case remote_deleted :
@@ -441,6 +892,11 @@ void Resource::SyncSelf( http::Agent* http, const Json& options )
 			DeleteLocal() ;
 		break ;
 	
+	// moved by MoveLocal() already, except in dry-run
+	case remote_moved :
+		Log( "sync %1% moved in remote. moving local", path, log::info ) ;
+		break ;
+	
 	case sync :
 		Log( "sync %1% already in sync", path, log::verbose ) ;
 		break ;
@@ -453,6 +909,356 @@ void Resource::SyncSelf( http::Agent* http, const Json& options )
 	default :
 		break ;
 	}
+	
+	// a deleted resource keeps its state
+	if ( http != 0 && synced &&
+		( m_state != old_state || m_state == local_deleted || m_state == remote_deleted ) )
+		synced( this ) ;
+}
+
+/// Move the remote copies of the resources moved in local, and collect the
+/// ones moved in remote in \a moved.
+void Resource::SyncMoves( http::Agent *http, std::vector<Resource*>& moved )
+{
+	assert( http != 0 ) ;
+	
+	if ( m_state == local_moved )
+	{
+		Log( "sync %1% moved in local. moving remote", Path(), log::info ) ;
+		if ( Move( http ) )
+			m_state = sync ;
+	}
+	else if ( m_state == remote_moved )
+		moved.push_back( this ) ;
+	
+	for ( iterator i = m_child.begin() ; i != m_child.end() ; ++i )
+		(*i)->SyncMoves( http, moved ) ;
+}
+
+/// Move the local copies of the resources moved in remote. Each one is renamed
+/// to its new place directly, unless the moves overlap, e.g. a folder and a
+/// file in it are both moved, or two files swap their names.
+void Resource::MoveLocal( std::vector<Resource*> res )
+{
+	if ( res.empty() )
+		return ;
+	
+	const Resource *root = res.front() ;
+	while ( !root->IsRoot() )
+		root = root->m_parent ;
+	
+	if ( Overlap( res ) )
+		MoveStaged( root->Path(), res ) ;
+	
+	else
+	{
+		for ( std::vector<Resource*>::iterator i = res.begin() ; i != res.end() ; ++i )
+			(*i)->MoveFrom( (*i)->m_old_path ) ;
+	}
+}
+
+/// Move overlapping resources through temporary names in \a root. They are
+/// renamed to the temporary names first, children before parents, so that
+/// moving a folder will not affect the ones moved out of it. Then they are
+/// renamed to their new places, parents before children. The temporary names
+/// are written down first, so that RecoverMoves() can put them back if grive
+/// is killed in between. Otherwise the next sync would find the files missing
+/// and delete them in remote.
+void Resource::MoveStaged( const fs::path& root, std::vector<Resource*> res )
+{
+	std::sort( res.begin(), res.end(), &OlderPath ) ;
+	
+	std::vector<Json> list ;
+	for ( std::size_t i = 0 ; i < res.size() ; i++ )
+	{
+		Json entry ;
+		entry.Add( "tmp",	Json( ( root / ( moving_prefix + boost::lexical_cast<std::string>( i ) ) ).string() ) ) ;
+		entry.Add( "path",	Json( res[i]->m_old_path.string() ) ) ;
+		list.push_back( entry ) ;
+	}
+	
+	const fs::path list_file = root / moving_list ;
+	{
+		File file( list_file, 0600 ) ;
+		Json( list ).Write( &file ) ;
+		file.Sync() ;
+	}
+	
+	typedef std::pair<Resource*, fs::path> Moving ;
+	std::vector<Moving> moving ;
+	for ( std::size_t i = 0 ; i < res.size() ; i++ )
+	{
+		fs::path tmp = list[i]["tmp"].Str() ;
+		try
+		{
+			fs::rename( res[i]->m_old_path, tmp ) ;
+			moving.push_back( Moving( res[i], tmp ) ) ;
+		}
+		catch ( fs::filesystem_error& e )
+		{
+			Log( "cannot move %1%: %2%", res[i]->m_old_path, e.what(), log::warning ) ;
+		}
+	}
+	
+	std::sort( moving.begin(), moving.end(), boost::bind( &NewerPath,
+		boost::bind( &Moving::first, _1 ), boost::bind( &Moving::first, _2 ) ) ) ;
+	
+	for ( std::vector<Moving>::iterator i = moving.begin() ; i != moving.end() ; ++i )
+	{
+		Resource *r = i->first ;
+		if ( r->MoveFrom( i->second ) )
+			continue ;
+		
+		// put it back
+		boost::system::error_code ec ;
+		fs::rename( i->second, r->m_old_path, ec ) ;
+		if ( ec )
+			Log( "%1% is left in %2%", r->m_old_path, i->second, log::error ) ;
+	}
+	
+	fs::remove( list_file ) ;
+}
+
+/// Put back the local copies left in temporary names by MoveStaged() when grive
+/// was killed in the middle of moving them. They are put back to their old
+/// places, parents before children, and will be moved again in this sync.
+void Resource::RecoverMoves( const fs::path& root )
+{
+	const fs::path list_file = root / moving_list ;
+	if ( !fs::exists( list_file ) )
+		return ;
+	
+	// nothing has been moved if the list was not written completely
+	Json::Array list ;
+	try
+	{
+		File file( list_file ) ;
+		list = Json::Parse( &file ).AsArray() ;
+	}
+	catch ( Exception& e )
+	{
+		Trace( "Exception %1%", boost::diagnostic_information(e) ) ;
+	}
+	
+	for ( Json::Array::reverse_iterator i = list.rbegin() ; i != list.rend() ; ++i )
+	{
+		const fs::path tmp	= (*i)["tmp"].Str() ;
+		const fs::path path	= (*i)["path"].Str() ;
+		if ( !fs::exists( tmp ) )
+			continue ;
+		
+		boost::system::error_code ec ;
+		if ( !fs::exists( path ) )
+		{
+			fs::create_directories( path.parent_path(), ec ) ;
+			fs::rename( tmp, path, ec ) ;
+		}
+		
+		if ( ec || fs::exists( tmp ) )
+			Log( "%1% is left in %2%", path, tmp, log::error ) ;
+		else
+			Log( "%1% is put back after an interrupted move", path, log::warning ) ;
+	}
+	
+	fs::remove( list_file ) ;
+}
+
+/// True if any of the old or new paths of the resources is the same as, or
+/// in, an old or new path of another one, so that they can't be renamed one
+/// by one.
+bool Resource::Overlap( const std::vector<Resource*>& res )
+{
+	for ( std::size_t i = 0 ; i < res.size() ; i++ )
+	{
+		const fs::path pi[] = { res[i]->m_old_path, res[i]->Path() } ;
+		for ( std::size_t j = 0 ; j < res.size() ; j++ )
+		{
+			const fs::path pj[] = { res[j]->m_old_path, res[j]->Path() } ;
+			for ( int a = 0 ; a < 2 && i != j ; a++ )
+				for ( int b = 0 ; b < 2 ; b++ )
+					if ( IsUnder( pj[b], pi[a] ) )
+						return true ;
+		}
+	}
+	return false ;
+}
+
+/// Rename the local copy from \a from to its new place. It is not moved if
+/// something is already there, because rename() replaces files silently.
+bool Resource::MoveFrom( const fs::path& from )
+{
+	const fs::path path = Path() ;
+	Log( "sync %1% moved in remote. moving local from %2%", path, m_old_path, log::info ) ;
+	
+	try
+	{
+		if ( fs::exists( path ) )
+			Log( "cannot move %1%: %2% already exists", m_old_path, path, log::warning ) ;
+		else
+		{
+			fs::create_directories( path.parent_path() ) ;
+			fs::rename( from, path ) ;
+			m_state = sync ;
+			return true ;
+		}
+	}
+	catch ( fs::filesystem_error& e )
+	{
+		Log( "cannot move %1%: %2%", m_old_path, e.what(), log::warning ) ;
+	}
+	return false ;
+}
+
+/// Calculate two digests of the subtree, like a Merkle tree: one over the
+/// names and checksums of the local copies that exist, and one over the IDs and etags of
+/// the remote ones. Any change on either side changes one of them. \a each is
+/// called for every folder, the deepest ones first. Returns true if everything
+/// in the subtree is in sync.
+bool Resource::Digest( std::string& local, std::string& remote, const DigestHook& each )
+{
+	assert( IsFolder() ) ;
+	
+	// the same children in the same order every time
+	Children sorted( m_child ) ;
+	std::sort( sorted.begin(), sorted.end(), &NameLess ) ;
+	
+	crypt::MD5 lmd5, rmd5 ;
+	bool in_sync = ( m_state == sync ) ;
+	for ( iterator i = sorted.begin() ; i != sorted.end() ; ++i )
+	{
+		const Resource *c = *i ;
+		
+		std::string cl = c->m_md5, cr ;
+		if ( c->IsFolder() )
+			in_sync = (*i)->Digest( cl, cr, each ) && in_sync ;
+		else
+			in_sync = in_sync && c->m_state == sync ;
+		
+		// with the null characters so that the fields can't run into each other
+		const std::string l = c->m_name + '\0' + c->m_kind + '\0' + cl + '\0' ;
+		const std::string r = c->m_id + '\0' + c->m_etag + '\0' + cr + '\0' ;
+		if ( c->m_state != local_deleted && c->m_state != remote_new )
+			lmd5.Write( l.c_str(), l.size() ) ;
+		rmd5.Write( r.c_str(), r.size() ) ;
+	}
+	
+	local	= lmd5.Get() ;
+	remote	= rmd5.Get() ;
+	if ( each )
+		each( this, local, remote, in_sync ) ;
+	
+	return in_sync ;
+}
+
+/// Don't sync anything in the subtree, because nothing has changed since the
+/// last sync.
+void Resource::Skip( )
+{
+	m_skip	= true ;
+	m_state	= sync ;
+	std::for_each( m_child.begin(), m_child.end(), boost::bind( &Resource::Skip, _1 ) ) ;
+}
+
+bool Resource::NameLess( const Resource *r1, const Resource *r2 )
+{
+	return r1->m_name < r2->m_name ;
+}
+
+/// Sort by the new paths. Parents come before children.
+bool Resource::NewerPath( const Resource *r1, const Resource *r2 )
+{
+	return r1->Path() < r2->Path() ;
+}
+
+/// Sort by the old paths in reverse. Children come before parents.
+bool Resource::OlderPath( const Resource *r1, const Resource *r2 )
+{
+	return r2->m_old_path < r1->m_old_path ;
+}
+
+/// Move the remote copy to the folder of the parent, and rename it. Only the
+/// metadata is changed, the content is not uploaded again. Moving is adding the
+/// resource to the new folder and then removing it from the old one.
+bool Resource::Move( http::Agent *http )
+{
+	assert( http != 0 ) ;
+	assert( m_parent != 0 && m_parent->HasID() ) ;
+	
+	if ( m_edit.empty() )
+	{
+		Log( "Cannot move %1%: file read-only", Path(), log::warning ) ;
+		return false ;
+	}
+	
+	http::Header hdr ;
+	hdr.Add( "Content-Type: application/atom+xml" ) ;
+	
+	if ( m_old_parent != m_parent->m_id )
+	{
+		http::XmlResponse xml ;
+		http->Post(
+			feed_base + "/" + http->Escape(m_parent->m_id) + "/contents",
+			(boost::format( xml_id ) % xml::Escape(m_href)).str(),
+			&xml, hdr ) ;
+		AssignIDs( Entry( xml.Response() ) ) ;
+		
+		http::StringResponse str ;
+		http->Custom( "DELETE",
+			feed_base + "/" + http->Escape(m_old_parent) + "/contents/" + http->Escape(m_id),
+			&str, http::Header() + "If-Match: *" ) ;
+	}
+	
+	if ( m_old_name != m_name )
+	{
+		std::string meta = (boost::format( xml_meta )
+			% m_kind
+			% xml::Escape(m_name)
+		).str() ;
+		
+		http::XmlResponse xml ;
+		http->Put( m_href, meta, &xml, hdr + ( "If-Match: " + m_etag ) ) ;
+		
+		Entry entry( xml.Response() ) ;
+		AssignIDs( entry ) ;
+		m_mtime = entry.MTime() ;
+	}
+	
+	m_old_parent.clear() ;
+	m_old_name.clear() ;
+	return true ;
+}
+
+/// Copy the remote file with the same content, instead of uploading it. The
+/// copy is created by posting to the contents feed of the parent, so it is in
+/// the right folder in one request.
+bool Resource::Copy( http::Agent *http )
+{
+	assert( http != 0 ) ;
+	assert( !m_copy_of.empty() ) ;
+	
+	Log( "copying %1% from %2% in remote", Path(), m_copy_of, log::verbose ) ;
+	
+	http::Header hdr ;
+	hdr.Add( "Content-Type: application/atom+xml" ) ;
+	
+	http::XmlResponse xml ;
+	http->Post( m_parent->ContentsFeed( http ),
+		(boost::format( xml_copy ) % xml::Escape(m_copy_of) % xml::Escape(m_name)).str(),
+		&xml, hdr ) ;
+	
+	Entry entry( xml.Response() ) ;
+	AssignIDs( entry ) ;
+	m_mtime = entry.MTime() ;
+	m_copy_of.clear() ;
+	
+	// the source has been changed after the listing
+	if ( entry.MD5() != m_md5 )
+	{
+		Log( "copy of %1% has a different checksum. uploading", Path(), log::verbose ) ;
+		return Upload( http, m_edit, false ) ;
+	}
+	
+	return true ;
 }
 
 /// this function doesn't really remove the local file. it renames it.
@@ -479,49 +1285,172 @@ void Resource::DeleteLocal()
 }
 
 void Resource::DeleteRemote( http::Agent *http )
+{
+	DeleteRemote( http, std::vector<Resource*>( 1, this ) ) ;
+}
+
+/// Delete the remote copies of the resources with "If-Match". The etags are
+/// kept up to date from the feeds and the responses of uploads, so they are
+/// normally still valid. Only the resources that have been changed in remote
+/// since then, i.e. the server says 412 Precondition Failed, are fetched again
+/// to get the new etag before deleting again.
+void Resource::DeleteRemote( http::Agent *http, const std::vector<Resource*>& res )
 {
 	assert( http != 0 ) ;
-	http::StringResponse str ;
 	
-	try
+	std::vector<Resource*> todo( res ) ;
+	for ( int attempt = 0 ; attempt < 2 && !todo.empty() ; attempt++ )
 	{
-		http::Header hdr ;
-		hdr.Add( "If-Match: " + m_etag ) ;
+		// the resources that failed with 412 last time, and the ones we don't
+		// have an etag for
+		std::vector<Resource*> stale ;
+		for ( std::vector<Resource*>::iterator i = todo.begin() ; i != todo.end() ; ++i )
+		{
+			if ( attempt > 0 || (*i)->m_etag.empty() )
+				stale.push_back( *i ) ;
+		}
+		Refresh( http, stale ) ;
 		
-		// doesn't know why, but an update before deleting seems to work always
-		http::XmlResponse xml ;
-		http->Get( m_href, &xml, hdr ) ;
-		AssignIDs( Entry( xml.Response() ) ) ;
-	
-		http->Custom( "DELETE", m_href, &str, hdr ) ;
+		std::vector<http::StringResponse> resp( todo.size() ) ;
+		std::vector<http::Request> reqs ;
+		for ( std::size_t i = 0 ; i < todo.size() ; i++ )
+		{
+			reqs.push_back( http::Request( "DELETE", todo[i]->m_href, &resp[i],
+				http::Header() + ( "If-Match: " + todo[i]->m_etag ) ) ) ;
+		}
+		http->Perform( reqs ) ;
+		
+		stale.clear() ;
+		for ( std::size_t i = 0 ; i < todo.size() ; i++ )
+		{
+			if ( reqs[i].response == 412 )
+			{
+				Log( "%1% has been changed in remote (etag %2%). fetching it again",
+					todo[i]->Path(), todo[i]->m_etag, log::verbose ) ;
+				stale.push_back( todo[i] ) ;
+			}
+			
+			// don't throw here. there are some cases that I don't know why
+			// the delete will fail.
+			else if ( reqs[i].response >= 400 )
+				Trace( "cannot delete %1%: HTTP %2% %3%",
+					todo[i]->Path(), reqs[i].response, reqs[i].error ) ;
+		}
+		todo.swap( stale ) ;
 	}
-	catch ( Exception& e )
+	
+	for ( std::vector<Resource*>::iterator i = todo.begin() ; i != todo.end() ; ++i )
+		Log( "cannot delete %1%: it keeps changing in remote", (*i)->Path(), log::warning ) ;
+}
+
+/// Fetch the entries of the resources again to update their etags.
+void Resource::Refresh( http::Agent *http, const std::vector<Resource*>& res )
+{
+	if ( res.empty() )
+		return ;
+	
+	std::vector<http::StringResponse> entries( res.size() ) ;
+	std::vector<http::Request> reqs ;
+	for ( std::size_t i = 0 ; i < res.size() ; i++ )
+		reqs.push_back( http::Request( "GET", res[i]->m_href, &entries[i] ) ) ;
+	http->Perform( reqs ) ;
+	
+	for ( std::size_t i = 0 ; i < res.size() ; i++ )
 	{
-		// don't rethrow here. there are some cases that I don't know why
-		// the delete will fail.
-		Trace( "Exception %1% %2%",
-			boost::diagnostic_information(e),
-			str.Response() ) ;
+		try
+		{
+			if ( reqs[i].response < 400 )
+				res[i]->AssignIDs( Entry( xml::TreeBuilder::Parse( entries[i].Response() ) ) ) ;
+		}
+		catch ( Exception& e )
+		{
+			Trace( "Exception %1%", boost::diagnostic_information(e) ) ;
+		}
 	}
 }
 
 
-void Resource::Download( http::Agent* http, const fs::path& file ) const
+/// Download the file content and verify it against the checksum from remote.
+/// The content goes to a temporary file first, which is renamed to \a file only
+/// after it is verified, so a corrupted download never replaces a good file.
+/// The verified checksum is recorded in \a cache, so the file will not be read
+/// again in the next run. If \a cache knows a local file with the same
+/// checksum, the content is copied from it instead of downloaded.
+/// Returns false if it cannot be downloaded correctly. The file is then left
+/// as it was, and the resource keeps its state, so it is tried again in the
+/// next sync.
+bool Resource::Download( http::Agent* http, const fs::path& file, ChecksumCache *cache ) const
 {
 	assert( http != 0 ) ;
 	
-	http::Download dl( file.string(), http::Download::NoChecksum() ) ;
-	long r = http->Get( m_content, &dl, http::Header() ) ;
-	if ( r <= 400 )
+	// hidden files are ignored by grive, so the temporary file will not be
+	// uploaded even if grive is killed before removing it
+	const fs::path tmp = file.parent_path() / ( "." + file.filename().string() + ".grive-part" ) ;
+	
+	std::string md5 ;
+	bool ok = false ;
+	
+	// the same content may be in local already, e.g. duplicated files
+	fs::path src = ( cache != 0 && !m_md5.empty() ) ? cache->Find( m_md5 ) : fs::path() ;
+	if ( !src.empty() && src != file )
+	{
+		try
+		{
+			os::CopyFile( src, tmp ) ;
+			md5	= crypt::MD5::Get( tmp ) ;
+			ok	= ( md5 == m_md5 ) ;
+			
+			Log( "copying %1% from %2%: %3%", file, src, ok ? "OK" : "checksum mismatch", log::verbose ) ;
+		}
+		catch ( os::Error& e )
+		{
+			Log( "cannot copy %1% from %2%", file, src, log::verbose ) ;
+			Trace( "Exception %1%", boost::diagnostic_information(e) ) ;
+		}
+	}
+	
+	for ( int i = 0 ; i < download_attempts && !ok ; i++ )
 	{
-		if ( m_mtime != DateTime() )
-			os::SetFileTime( file, m_mtime ) ;
+		long r ;
+		{
+			http::Download dl( tmp.string() ) ;
+			r	= http->Get( m_content, &dl, http::Header() ) ;
+			md5	= dl.Finish() ;
+		}
+		
+		if ( r >= 400 )
+			Log( "cannot download %1%: HTTP response %2%", file, r, log::warning ) ;
+		
+		// remote checksum unknown, nothing to verify against
+		else if ( !m_md5.empty() && md5 != m_md5 )
+			Log( "checksum of %1% mismatch (expected %2%, got %3%)", file, m_md5, md5, log::warning ) ;
+		
 		else
-			Log( "encountered zero date time after downloading %1%", file, log::warning ) ;
+			ok = true ;
 	}
+	
+	if ( !ok )
+	{
+		fs::remove( tmp ) ;
+		Log( "giving up downloading %1% after %2% attempts", file, download_attempts, log::error ) ;
+		return false ;
+	}
+	
+	fs::rename( tmp, file ) ;
+	
+	if ( m_mtime != DateTime() )
+		os::SetFileTime( file, m_mtime ) ;
+	else
+		Log( "encountered zero date time after downloading %1%", file, log::warning ) ;
+	
+	// record after setting the file time, which changes the ctime
+	if ( cache != 0 )
+		cache->Record( file, md5 ) ;
+	
+	return true ;
 }
 
-bool Resource::EditContent( http::Agent* http, bool new_rev )
+bool Resource::EditContent( http::Agent* http, bool new_rev, u64_t threshold )
 {
 	assert( http != 0 ) ;
 	assert( m_parent != 0 ) ;
@@ -534,10 +1463,38 @@ bool Resource::EditContent( http::Agent* http, bool new_rev )
 		return false ;
 	}
 	
-	return Upload( http, m_edit + (new_rev ? "?new-revision=true" : ""), false ) ;
+	const std::string rev = new_rev ? "?new-revision=true" : "" ;
+	return !m_edit_media.empty() && File( Path() ).Size() < threshold ?
+		UploadSimple( http, m_edit_media + rev, m_edit + rev, false ) :
+		Upload( http, m_edit + rev, false ) ;
+}
+
+/// The feed of the resources in this folder. New resources are created by
+/// posting to it.
+std::string Resource::ContentsFeed( http::Agent *http ) const
+{
+	assert( IsFolder() ) ;
+	return m_id == "folder:root" ? feed_base : feed_base + "/" + http->Escape(m_id) + "/contents" ;
+}
+
+/// The request to create this folder in its parent.
+http::Request Resource::CreateFolderRequest( http::Agent *http, DataStream *dest ) const
+{
+	assert( IsFolder() ) ;
+	assert( m_parent != 0 ) ;
+	
+	std::string meta = (boost::format( xml_meta )
+		% "folder"
+		% xml::Escape(m_name)
+	).str() ;
+
+	http::Header hdr ;
+	hdr.Add( "Content-Type: application/atom+xml" ) ;
+	
+	return http::Request( "POST", m_parent->ContentsFeed( http ), dest, hdr, meta ) ;
 }
 
-bool Resource::Create( http::Agent* http )
+bool Resource::Create( http::Agent* http, u64_t threshold )
 {
 	assert( http != 0 ) ;
 	assert( m_parent != 0 ) ;
@@ -546,28 +1503,26 @@ bool Resource::Create( http::Agent* http )
 	
 	if ( IsFolder() )
 	{
-		std::string uri = feed_base ;
-		if ( !m_parent->IsRoot() )
-			uri += ("/" + http->Escape(m_parent->m_id) + "/contents") ;
-		
-		std::string meta = (boost::format( xml_meta )
-			% "folder"
-			% xml::Escape(m_name)
-		).str() ;
-
-		http::Header hdr ;
-		hdr.Add( "Content-Type: application/atom+xml" ) ;
-		
 		http::XmlResponse xml ;
 // 		http::ResponseLog log( "create", ".xml", &xml ) ;
-		http->Post( uri, meta, &xml, hdr ) ;
+		http::Request req = CreateFolderRequest( http, &xml ) ;
+		http->Post( req.url, req.data, &xml, req.hdr ) ;
 		AssignIDs( Entry( xml.Response() ) ) ;
 
 		return true ;
 	}
 	else if ( !m_parent->m_create.empty() )
 	{
-		return Upload( http, m_parent->m_create + "?convert=false", true ) ;
+		u64_t size = File( Path() ).Size() ;
+		
+		// a small file costs one request to upload anyway
+		if ( !m_copy_of.empty() && size >= threshold )
+			return Copy( http ) ;
+		
+		return size < threshold ?
+			UploadSimple( http, m_parent->ContentsFeed( http ) + "?convert=false",
+				m_parent->m_create + "?convert=false", true ) :
+			Upload( http, m_parent->m_create + "?convert=false", true ) ;
 	}
 	else
 	{
@@ -620,6 +1575,67 @@ bool Resource::Upload(
 	return true ;
 }
 
+/// Upload the metadata and the content in one multipart/related request. It
+/// saves the round trip to open a resumable upload session, which costs more
+/// than sending the content itself for small files. If the content happens to
+/// hold the part boundary, it is uploaded with Upload() to the \a resumable
+/// link instead.
+bool Resource::UploadSimple(
+	http::Agent* 		http,
+	const std::string&	link,
+	const std::string&	resumable,
+	bool 				post )
+{
+	assert( http != 0 ) ;
+	
+	File file( Path() ) ;
+	std::string content( static_cast<std::size_t>( file.Size() ), '\0' ) ;
+	if ( !content.empty() )
+		file.Read( &content[0], content.size() ) ;
+	
+	// the boundary must not appear in the content
+	const std::string boundary = "grive_part_" + m_md5 ;
+	if ( content.find( boundary ) != content.npos )
+		return Upload( http, resumable, post ) ;
+	
+	std::string meta = (boost::format( xml_meta )
+		% m_kind
+		% xml::Escape(m_name)
+	).str() ;
+	
+	std::string body =
+		"--" + boundary + "\r\n"
+		"Content-Type: application/atom+xml\r\n\r\n" +
+		meta + "\r\n"
+		"--" + boundary + "\r\n"
+		"Content-Type: application/octet-stream\r\n\r\n" +
+		content + "\r\n"
+		"--" + boundary + "--\r\n" ;
+	
+	http::Header hdr ;
+	hdr.Add( "Content-Type: multipart/related; boundary=" + boundary ) ;
+	hdr.Add( "If-Match: " + m_etag ) ;
+	hdr.Add( "Expect:" ) ;
+	
+	http::XmlResponse xml ;
+	if ( post )
+		http->Post( link, body, &xml, hdr ) ;
+	else
+		http->Put( link, body, &xml, hdr ) ;
+	
+	Entry entry( xml.Response() ) ;
+	AssignIDs( entry ) ;
+	m_mtime = entry.MTime() ;
+	
+	return true ;
+}
+
+/// Files smaller than this are uploaded by UploadSimple().
+u64_t Resource::UploadThreshold( const Json& options )
+{
+	return options.Has( "upload-threshold" ) ? options["upload-threshold"].Int() : 0 ;
+}
+
 Resource::iterator Resource::begin() const
 {
 	return m_child.begin() ;
@@ -639,8 +1655,8 @@ std::ostream& operator<<( std::ostream& os, Resource::State s )
 {
 	static const char *state[] =
 	{
-		"sync",	"local_new", "local_changed", "local_deleted", "remote_new",
-		"remote_changed", "remote_deleted"
+		"sync",	"local_new", "local_changed", "local_deleted", "local_moved",
+		"remote_new", "remote_changed", "remote_deleted", "remote_moved"
 	} ;
 	assert( s >= 0 && s < Count(state) ) ;
 	return os << state[s] ;
@@ -658,6 +1674,21 @@ std::string Resource::MD5() const
 	return m_md5 ;
 }
 
+std::string Resource::LocalMD5() const
+{
+	return m_local_md5 ;
+}
+
+std::string Resource::RemoteMD5() const
+{
+	return m_remote_md5 ;
+}
+
+std::string Resource::ETag() const
+{
+	return m_etag ;
+}
+
 bool Resource::IsRoot() const
 {
 	return m_parent == 0 ;
@@ -668,6 +1699,35 @@ bool Resource::HasID() const
 	return !m_href.empty() && !m_id.empty() ;
 }
 
+bool Resource::IsSync() const
+{
+	return m_state == sync ;
+}
+
+/// Whether this resource is to be deleted on one side, or has been deleted on
+/// both already.
+bool Resource::IsDeleted() const
+{
+	return m_state == local_deleted || m_state == remote_deleted ;
+}
+
+/// Whether this file still has to be downloaded after the sync, e.g. because
+/// the download failed.
+bool Resource::IsDownloadPending() const
+{
+	return !IsFolder() && ( m_state == remote_new || m_state == remote_changed ) ;
+}
+
+/// Whether this file can be transferred before the rest of the tree is known.
+/// It must be in a folder that exists on both sides, and it must be changed
+/// in place: the states of files new in local, or deleted on either side, may
+/// still turn out to be moves or copies.
+bool Resource::IsDecided() const
+{
+	return !IsFolder() && m_parent != 0 && m_parent->m_state == sync && m_copy_of.empty() &&
+		( m_state == remote_new || m_state == remote_changed || m_state == local_changed ) ;
+}
+
 } } // end of namespace
 
 namespace std
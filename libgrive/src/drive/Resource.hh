@@ -19,25 +19,35 @@
 
 #pragma once
 
+#include "SyncPlan.hh"
+
 #include "util/DateTime.hh"
 #include "util/Exception.hh"
 #include "util/FileSystem.hh"
+#include "util/Types.hh"
+
+#include <boost/function.hpp>
 
+#include <map>
 #include <string>
 #include <vector>
 #include <iosfwd>
 
 namespace gr {
 
+class DataStream ;
+
 namespace http
 {
 	class Agent ;
+	struct Request ;
 }
 
 class Json ;
 
 namespace v1 {
 
+class ChecksumCache ;
 class Entry ;
 
 /*!	\brief	A resource can be a file or a folder in the google drive
@@ -53,6 +63,19 @@ public :
 	typedef std::vector<Resource*> Children ;
 	typedef Children::const_iterator iterator ;
 	
+	/// Find the resource that a new local resource was moved from.
+	typedef boost::function<Resource* (const Resource*)> MoveSource ;
+	
+	/// Find the local copy of a resource moved in remote, and where it is.
+	typedef boost::function<Resource* (const Resource*, fs::path&)> LocalSource ;
+	
+	/// Called after a resource is transferred or deleted.
+	typedef boost::function<void (const Resource*)> SyncHook ;
+	
+	/// Called with the local and remote digests of each folder, and whether
+	/// everything in it is in sync.
+	typedef boost::function<void (Resource*, const std::string&, const std::string&, bool)> DigestHook ;
+	
 public :
 	Resource(const fs::path& root_folder) ;
 	Resource( const std::string& name, const std::string& kind ) ;
@@ -69,18 +92,41 @@ public :
 	const Resource* Parent() const ;
 	Resource* Parent() ;
 	void AddChild( Resource *child ) ;
+	void RemoveChild( Resource *child ) ;
 	Resource* FindChild( const std::string& title ) ;
 	
 	fs::path Path() const ;
 	bool IsInRootTree() const ;
 	bool IsRoot() const ;
 	bool HasID() const ;
+	bool IsSync() const ;
+	bool IsDecided() const ;
+	bool IsDeleted() const ;
+	bool IsDownloadPending() const ;
 	std::string MD5() const ;
+	std::string LocalMD5() const ;
+	std::string RemoteMD5() const ;
+	std::string ETag() const ;
 
 	void FromRemote( const Entry& remote, const DateTime& last_sync ) ;
-	void FromLocal( const DateTime& last_sync ) ;
+	void FromLocal( const DateTime& last_sync, ChecksumCache *cache = 0 ) ;
+	bool FromLocalChange( ChecksumCache *cache ) ;
+	void FromLocalDelete( ) ;
+	bool FromRemoteChange( const Entry& change ) ;
+	void DetectMoves( const MoveSource& source, std::vector<Resource*>& discarded ) ;
+	void DetectRemoteMoves( const LocalSource& source, std::vector<Resource*>& discarded ) ;
+	void DetectCopies( ) ;
+	bool Resolve( SyncPlan::Action action ) ;
+	static void RecoverMoves( const fs::path& root ) ;
+	bool Digest( std::string& local, std::string& remote, const DigestHook& each ) ;
+	void Skip( ) ;
 	
-	void Sync( http::Agent* http, DateTime& sync_time, const Json& options ) ;
+	void Sync(
+		http::Agent*	http,
+		DateTime&		sync_time,
+		const Json&		options,
+		ChecksumCache	*cache,
+		const SyncHook&	synced = SyncHook() ) ;
 
 	// children access
 	iterator begin() const ;
@@ -107,6 +153,10 @@ private :
 		/// Resource deleted from local since last time grive has checked.
 		local_deleted,
 		
+		/// Resource moved or renamed in local. We should move or rename the
+		/// remote copy the same way, instead of deleting and uploading it again.
+		local_moved,
+		
 		/// Resource created in google drive, but not exist in local.
 		/// We should download the file.
 		remote_new,
@@ -117,6 +167,10 @@ private :
 		/// Resource delete in remote, need to delete in local
 		remote_deleted,
 		
+		/// Resource moved or renamed in google drive. We should move the local
+		/// copy the same way, instead of deleting and downloading it again.
+		remote_moved,
+		
 		
 		/// invalid value
 		unknown
@@ -127,19 +181,45 @@ private :
 private :
 	void SetState( State new_state ) ;
 
-	void Download( http::Agent* http, const fs::path& file ) const ;
-	bool EditContent( http::Agent* http, bool new_rev ) ;
-	bool Create( http::Agent* http ) ;
+	bool Download( http::Agent* http, const fs::path& file, ChecksumCache *cache ) const ;
+	bool EditContent( http::Agent* http, bool new_rev, u64_t threshold ) ;
+	bool Create( http::Agent* http, u64_t threshold ) ;
+	std::string ContentsFeed( http::Agent* http ) const ;
+	http::Request CreateFolderRequest( http::Agent* http, DataStream *dest ) const ;
 	bool Upload( http::Agent* http, const std::string& link, bool post ) ;
+	bool UploadSimple(
+		http::Agent*		http,
+		const std::string&	link,
+		const std::string&	resumable,
+		bool				post ) ;
+	static u64_t UploadThreshold( const Json& options ) ;
 	
 	void FromRemoteFolder( const Entry& remote, const DateTime& last_sync ) ;
 	void FromRemoteFile( const Entry& remote, const DateTime& last_sync ) ;
 	
+	void Adopt( Resource *local, std::vector<Resource*>& discarded ) ;
+	void TakeLocal( Resource *local, std::vector<Resource*>& discarded ) ;
+	void SyncMoves( http::Agent* http, std::vector<Resource*>& moved ) ;
+	bool Move( http::Agent* http ) ;
+	bool Copy( http::Agent* http ) ;
+	void FindCopySources( std::map<std::string, std::string>& sources ) const ;
+	void FindCopies( const std::map<std::string, std::string>& sources ) ;
+	static void MoveLocal( std::vector<Resource*> res ) ;
+	static void MoveStaged( const fs::path& root, std::vector<Resource*> res ) ;
+	static bool Overlap( const std::vector<Resource*>& res ) ;
+	bool MoveFrom( const fs::path& from ) ;
+	static bool NewerPath( const Resource *r1, const Resource *r2 ) ;
+	static bool NameLess( const Resource *r1, const Resource *r2 ) ;
+	static bool OlderPath( const Resource *r1, const Resource *r2 ) ;
+	
 	void DeleteLocal() ;
 	void DeleteRemote( http::Agent* http ) ;
+	static void DeleteRemote( http::Agent* http, const std::vector<Resource*>& res ) ;
+	static void Refresh( http::Agent* http, const std::vector<Resource*>& res ) ;
 	
 	void AssignIDs( const Entry& remote ) ;
-	void SyncSelf( http::Agent* http, const Json& options ) ;
+	void SyncSelf( http::Agent* http, const Json& options, ChecksumCache *cache, const SyncHook& synced ) ;
+	void SyncChildren( http::Agent* http, const SyncHook& synced ) ;
 	
 private :
 	std::string				m_name ;
@@ -147,18 +227,37 @@ private :
 	std::string				m_md5 ;
 	DateTime				m_mtime ;
 	
+	// the checksums of the local and remote copies of a file, as they were
+	// read, while m_md5 is the one of the copy to be kept
+	std::string				m_local_md5 ;
+	std::string				m_remote_md5 ;
+	
 	std::string				m_id ;
 	std::string				m_href ;
 	std::string				m_edit ;
 	std::string				m_create ;
+	std::string				m_edit_media ;
 	std::string				m_content ;
 	std::string				m_etag ;
+	
+	// where a local_moved resource was in the last sync
+	std::string				m_old_parent ;
+	std::string				m_old_name ;
+	
+	// where the local copy of a remote_moved resource is
+	fs::path				m_old_path ;
+	
+	// a remote resource with the same content as this local_new file
+	std::string				m_copy_of ;
 
 	// not owned
 	Resource				*m_parent ;
 	std::vector<Resource*>	m_child ;
 	
 	State					m_state ;
+	
+	// nothing changed in the subtree since the last sync
+	bool					m_skip ;
 } ;
 
 } } // end of namespace gr::v1
@@ -44,7 +44,7 @@ ResourceTree::ResourceTree( const ResourceTree& fs ) :
 	for ( Set::const_iterator i = s.begin() ; i != s.end() ; ++i )
 	{
 		Resource *c = new Resource( **i ) ;
-		if ( c->SelfHref() == root_href )
+		if ( c->IsRoot() )
 			m_root = c ;
 		
 		m_set.insert( c ) ;
@@ -0,0 +1,152 @@
+/*
+	grive: an GPL program to sync a local directory with Google Drive
+	Copyright (C) 2012  Wan Wai Ho
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation version 2
+	of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "Snapshot.hh"
+
+#include <algorithm>
+
+namespace gr { namespace v1 {
+
+namespace
+{
+	struct RecordLess
+	{
+		bool operator()( const Snapshot::Record& r1, const Snapshot::Record& r2 ) const
+		{
+			return Snapshot::PathLess( r1.path, r2.path ) ;
+		}
+		bool operator()( const Snapshot::Record& r, const std::string& path ) const
+		{
+			return Snapshot::PathLess( r.path, path ) ;
+		}
+		bool operator()( const std::string& path, const Snapshot::Record& r ) const
+		{
+			return Snapshot::PathLess( path, r.path ) ;
+		}
+	} ;
+}
+
+Snapshot::Record::Record( ) :
+	is_folder( false )
+{
+}
+
+Snapshot::Record::Record(
+	const std::string&	path_,
+	const std::string&	md5_,
+	bool				is_folder_,
+	const std::string&	id_ ) :
+	path		( path_ ),
+	md5			( md5_ ),
+	is_folder	( is_folder_ ),
+	id			( id_ )
+{
+}
+
+Snapshot::Snapshot( )
+{
+}
+
+/// Records can be added in any order. Call Sort() after adding them.
+void Snapshot::Add( const Record& rec )
+{
+	m_recs.push_back( rec ) ;
+}
+
+void Snapshot::Sort( )
+{
+	std::sort( m_recs.begin(), m_recs.end(), RecordLess() ) ;
+}
+
+Snapshot::iterator Snapshot::begin() const
+{
+	return m_recs.begin() ;
+}
+
+Snapshot::iterator Snapshot::end() const
+{
+	return m_recs.end() ;
+}
+
+std::size_t Snapshot::size() const
+{
+	return m_recs.size() ;
+}
+
+const Snapshot::Record* Snapshot::Find( const std::string& path ) const
+{
+	iterator i = std::lower_bound( m_recs.begin(), m_recs.end(), path, RecordLess() ) ;
+	return i != m_recs.end() && i->path == path ? &*i : 0 ;
+}
+
+/// The record of \a path and all records inside it. The whole snapshot if
+/// \a path is empty.
+Snapshot::Range Snapshot::Subtree( const std::string& path ) const
+{
+	if ( path.empty() )
+		return Range( m_recs.begin(), m_recs.end() ) ;
+	
+	iterator first = std::lower_bound( m_recs.begin(), m_recs.end(), path, RecordLess() ) ;
+	iterator last  = first ;
+	while ( last != m_recs.end() && ( last->path == path || IsUnder( last->path, path ) ) )
+		++last ;
+	
+	return Range( first, last ) ;
+}
+
+/// Names of the files and folders in the top level folder, i.e. the subtrees
+/// that can be compared independently.
+std::vector<std::string> Snapshot::TopLevel( ) const
+{
+	std::vector<std::string> result ;
+	for ( iterator i = m_recs.begin() ; i != m_recs.end() ; ++i )
+	{
+		if ( result.empty() || !IsUnder( i->path, result.back() ) )
+			result.push_back( i->path.substr( 0, i->path.find( '/' ) ) ) ;
+	}
+	return result ;
+}
+
+/// Compare paths component by component, i.e. '/' sorts before any other
+/// character.
+bool Snapshot::PathLess( const std::string& p1, const std::string& p2 )
+{
+	std::size_t n = std::min( p1.size(), p2.size() ) ;
+	for ( std::size_t i = 0 ; i < n ; i++ )
+	{
+		if ( p1[i] != p2[i] )
+		{
+			if ( p1[i] == '/' )
+				return true ;
+			if ( p2[i] == '/' )
+				return false ;
+			return static_cast<unsigned char>(p1[i]) < static_cast<unsigned char>(p2[i]) ;
+		}
+	}
+	return p1.size() < p2.size() ;
+}
+
+bool Snapshot::IsUnder( const std::string& path, const std::string& folder )
+{
+	return path.size() > folder.size() &&
+		path[folder.size()] == '/' &&
+		path.compare( 0, folder.size(), folder ) == 0 ;
+}
+
+} } // end of namespace gr::v1
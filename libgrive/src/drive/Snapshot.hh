@@ -0,0 +1,77 @@
+/*
+	grive: an GPL program to sync a local directory with Google Drive
+	Copyright (C) 2012  Wan Wai Ho
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation version 2
+	of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#pragma once
+
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace gr { namespace v1 {
+
+/*!	\brief	The files and folders of a tree at one point of time
+
+	The records are sorted by path. The path components are compared one
+	by one, i.e. "a" < "a/b" < "a.txt", so a folder is always followed by
+	everything inside it. A subtree is then a range of records, and two
+	snapshots can be compared in one pass.
+*/
+class Snapshot
+{
+public :
+	struct Record
+	{
+		Record( ) ;
+		Record(
+			const std::string&	path,
+			const std::string&	md5,
+			bool				is_folder	= false,
+			const std::string&	id			= "" ) ;
+		
+		std::string	path ;
+		std::string	md5 ;		///< empty for folders
+		bool		is_folder ;
+		std::string	id ;		///< resource ID in remote, empty for local files
+	} ;
+	
+	typedef std::vector<Record>::const_iterator	iterator ;
+	typedef std::pair<iterator, iterator>		Range ;
+	
+public :
+	Snapshot( ) ;
+	
+	void Add( const Record& rec ) ;
+	void Sort( ) ;
+	
+	iterator begin() const ;
+	iterator end() const ;
+	std::size_t size() const ;
+	
+	const Record* Find( const std::string& path ) const ;
+	Range Subtree( const std::string& path ) const ;
+	std::vector<std::string> TopLevel( ) const ;
+	
+	static bool PathLess( const std::string& p1, const std::string& p2 ) ;
+	static bool IsUnder( const std::string& path, const std::string& folder ) ;
+
+private :
+	std::vector<Record>	m_recs ;
+} ;
+
+} } // end of namespace gr::v1
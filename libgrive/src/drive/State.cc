@@ -22,22 +22,61 @@
 #include "Entry.hh"
 #include "Resource.hh"
 #include "CommonUri.hh"
+#include "Snapshot.hh"
+#include "StateFile.hh"
+#include "SyncPlan.hh"
 
 #include "http/Agent.hh"
 #include "util/Crypt.hh"
 #include "util/File.hh"
+#include "util/OS.hh"
+#include "util/Stats.hh"
 #include "util/log/Log.hh"
 #include "protocol/Json.hh"
 
+#include <boost/bind.hpp>
+#include <boost/cstdint.hpp>
+#include <boost/exception/diagnostic_information.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <algorithm>
 #include <fstream>
 
 namespace gr { namespace v1 {
 
+namespace
+{
+	// fold the journal into the state file when it has this many records, or
+	// one for every journal_ratio inodes if there are more. Writing the state
+	// file takes time in proportion to the tree, so a fixed size would make a
+	// large sync quadratic.
+	const std::size_t journal_min	= 1000 ;
+	const std::size_t journal_ratio	= 10 ;
+}
+
 State::State( const fs::path& filename, const Json& options  ) :
     m_res		( options["path"].Str() ),
-	m_cstamp	( -1 )
+	m_cstamp	( -1 ),
+	m_other_root( false ),
+	m_filename	( filename ),
+	m_generation( 0 ),
+	m_journal	( filename.string() + "-journal" ),
+	m_journal_started( false ),
+	m_inode_all	( false ),
+	m_download_pending( false )
 {
+	Resource::RecoverMoves( options["path"].Str() ) ;
 	Read( filename ) ;
+	m_ignore.Read( options["path"].Str() ) ;
+	
+	// the last sync was interrupted. the records are written to the state
+	// file when the journal is started over.
+	std::vector<Json> recs = m_journal.Read( m_generation ) ;
+	if ( !recs.empty() )
+	{
+		Log( "resuming interrupted sync: %1% files were synced", recs.size(), log::info ) ;
+		std::for_each( recs.begin(), recs.end(), boost::bind( &State::Apply, this, _1 ) ) ;
+	}
 	
 	// the "-f" option will make grive always thinks remote is newer
 	Json force ;
@@ -45,6 +84,15 @@ State::State( const fs::path& filename, const Json& options  ) :
 		m_last_sync = DateTime() ;
 	
 	Log( "last sync time: %1%", m_last_sync, log::verbose ) ;
+	
+	// read-only directories to copy files from, instead of downloading them
+	Json seed ;
+	if ( options.Get( "seed", seed ) )
+	{
+		Json::Array dirs = seed.AsArray() ;
+		for ( Json::Array::iterator i = dirs.begin() ; i != dirs.end() ; ++i )
+			m_cache.Seed( i->Str() ) ;
+	}
 }
 
 State::~State()
@@ -55,9 +103,207 @@ State::~State()
 /// of local directory.
 void State::FromLocal( const fs::path& p )
 {
+	Stats::Timer timer( "local.scan" ) ;
 	FromLocal( p, m_res.Root() ) ;
 }
 
+/// Calculate the checksums of the local files before FromLocal(), so that it
+/// only needs to look them up. It only touches the checksum cache and the
+/// directory entries, so it can run in another thread while the remote files
+/// are listed, as long as nothing else uses this object. The files that cannot
+/// be read here are left for FromLocal() to try again.
+void State::Prefetch( const fs::path& p )
+{
+	Stats::Timer timer( "local.prefetch" ) ;
+	PrefetchDir( p ) ;
+}
+
+/// Find out if the local directory is the same as after the last sync without
+/// reading the files. Only the directories changed since they were last read
+/// are listed, and the files must have the same inodes as the ones synced,
+/// and the same stat as when their checksums, which must be the same as the
+/// ones synced, were calculated.
+bool State::LocalUnchanged( const fs::path& p )
+{
+	InodeMap all ;
+	AllInodes( all ) ;
+	if ( all.empty() )
+		return false ;
+	
+	InodeByPath synced ;
+	for ( InodeMap::const_iterator i = all.begin() ; i != all.end() ; ++i )
+	{
+		// the files whose download failed have to be downloaded again
+		if ( i->second.pending )
+		{
+			Log( "%1% is not downloaded yet", i->second.path, log::verbose ) ;
+			return false ;
+		}
+		synced[i->second.path] = &i->second ;
+	}
+	
+	try
+	{
+		// nothing is deleted if all synced files are found
+		std::size_t count = 0 ;
+		return IsSameTree( p, synced, count ) && count == synced.size() ;
+	}
+	catch ( Exception& e )
+	{
+		Trace( "Exception %1%", boost::diagnostic_information(e) ) ;
+	}
+	catch ( fs::filesystem_error& e )
+	{
+		Trace( "cannot read %1%: %2%", p, e.what() ) ;
+	}
+	return false ;
+}
+
+bool State::IsSameTree( const fs::path& dir, const InodeByPath& synced, std::size_t& count )
+{
+	std::vector<StateFile::DirEntry> entries ;
+	List( dir, entries ) ;
+	
+	for ( std::vector<StateFile::DirEntry>::const_iterator i = entries.begin() ; i != entries.end() ; ++i )
+	{
+		fs::path path = dir / i->name ;
+		if ( m_ignore.IsIgnored( path, i->is_dir ) )
+			continue ;
+		
+		InodeByPath::const_iterator s = synced.find( path.string() ) ;
+		if ( s == synced.end() )
+		{
+			Log( "%1% is not synced yet", path, log::verbose ) ;
+			return false ;
+		}
+		
+		os::FileStat st = os::Stat( path ) ;
+		if ( st.dev != s->second->dev || st.ino != s->second->ino )
+		{
+			Log( "%1% is replaced", path, log::verbose ) ;
+			return false ;
+		}
+		count++ ;
+		
+		if ( i->is_dir )
+		{
+			if ( !IsSameTree( path, synced, count ) )
+				return false ;
+		}
+		else if ( m_cache.Cached( path, st ) != s->second->md5 )
+		{
+			Log( "%1% is changed", path, log::verbose ) ;
+			return false ;
+		}
+	}
+	return true ;
+}
+
+void State::PrefetchDir( const fs::path& dir )
+{
+	std::vector<StateFile::DirEntry> entries ;
+	try
+	{
+		List( dir, entries ) ;
+	}
+	catch ( Exception& e )
+	{
+		Log( "cannot read %1%", dir, log::verbose ) ;
+		Trace( "Exception %1%", boost::diagnostic_information(e) ) ;
+		return ;
+	}
+	catch ( fs::filesystem_error& e )
+	{
+		Log( "cannot read %1%: %2%", dir, e.what(), log::verbose ) ;
+		return ;
+	}
+	
+	for ( std::vector<StateFile::DirEntry>::const_iterator i = entries.begin() ; i != entries.end() ; ++i )
+	{
+		boost::this_thread::interruption_point() ;
+		
+		fs::path path = dir / i->name ;
+		if ( m_ignore.IsIgnored( path, i->is_dir ) )
+			continue ;
+		
+		// don't follow the links to directories, which may loop
+		else if ( i->is_dir )
+		{
+			if ( !fs::is_symlink( path ) )
+				PrefetchDir( path ) ;
+		}
+		else try
+		{
+			if ( fs::is_regular_file( path ) )
+				m_cache.MD5( path ) ;
+		}
+		catch ( Exception& e )
+		{
+			Log( "cannot calculate checksum of %1%", path, log::verbose ) ;
+			Trace( "Exception %1%", boost::diagnostic_information(e) ) ;
+		}
+		catch ( fs::filesystem_error& e )
+		{
+			Log( "cannot calculate checksum of %1%: %2%", path, e.what(), log::verbose ) ;
+		}
+	}
+}
+
+/// Get the entries in a directory. They are only read from the disk if the
+/// directory has changed since they were last read, which is known by the
+/// mtime and ctime of the directory. A directory changed within a second
+/// before it is read may be changed again with the same mtime, so its
+/// entries are not remembered.
+void State::List( const fs::path& dir, std::vector<StateFile::DirEntry>& entries )
+{
+	os::FileStat st = os::Stat( dir ) ;
+	
+	DirMap::iterator i = m_dir.find( dir.string() ) ;
+	if ( i == m_dir.end() && m_file.get() != 0 )
+	{
+		StateFile::Dir d ;
+		if ( m_file->FindDir( dir.string(), d ) )
+			i = m_dir.insert( std::make_pair( d.path, d ) ).first ;
+	}
+	
+	if ( i != m_dir.end() && IsSameDir( i->second.stat, st ) )
+	{
+		Stats::Inst().Add( "local.dir_cached" ) ;
+		entries = i->second.entries ;
+		return ;
+	}
+	
+	Stats::Inst().Add( "local.dir_read" ) ;
+	entries.clear() ;
+	for ( fs::directory_iterator d( dir ), end ; d != end ; ++d )
+	{
+		StateFile::DirEntry e ;
+		e.name		= d->path().filename().string() ;
+		e.is_dir	= fs::is_directory( d->status() ) ;
+		entries.push_back( e ) ;
+	}
+	
+	DateTime now = DateTime::Now() ;
+	if ( st.mtime.Sec() + 1 < now.Sec() && st.ctime.Sec() + 1 < now.Sec() )
+	{
+		StateFile::Dir& d	= m_dir[dir.string()] ;
+		d.path				= dir.string() ;
+		d.stat				= st ;
+		d.entries			= entries ;
+	}
+	else if ( i != m_dir.end() )
+		m_dir.erase( i ) ;
+}
+
+bool State::IsSameDir( const os::FileStat& s1, const os::FileStat& s2 )
+{
+	return
+		s1.mtime	== s2.mtime	&&
+		s1.ctime	== s2.ctime	&&
+		s1.ino		== s2.ino	&&
+		s1.dev		== s2.dev ;
+}
+
 bool State::IsIgnore( const std::string& filename )
 {
 	return filename[0] == '.' ;
@@ -69,18 +315,23 @@ void State::FromLocal( const fs::path& p, Resource* folder )
 	assert( folder->IsFolder() ) ;
 	
 	// sync the folder itself
-	folder->FromLocal( m_last_sync ) ;
+	folder->FromLocal( m_last_sync, &m_cache ) ;
 
-	for ( fs::directory_iterator i( p ) ; i != fs::directory_iterator() ; ++i )
-	{
-		std::string fname = i->path().filename().string() ;
+	std::vector<StateFile::DirEntry> entries ;
+	List( p, entries ) ;
 	
-		if ( IsIgnore(fname) )
-			Log( "file %1% is ignored by grive", fname, log::verbose ) ;
+	for ( std::vector<StateFile::DirEntry>::const_iterator i = entries.begin() ; i != entries.end() ; ++i )
+	{
+		const std::string& fname = i->name ;
+		fs::path path = p / fname ;
+		
+		// the excluded directories are not read at all
+		if ( m_ignore.IsIgnored( path, i->is_dir ) )
+			Log( "file %1% is ignored by grive", path, log::verbose ) ;
 		
 		// check for broken symblic links
-		else if ( !fs::exists( i->path() ) )
-			Log( "file %1% doesn't exist (broken link?), ignored", i->path(), log::verbose ) ;
+		else if ( !fs::exists( path ) )
+			Log( "file %1% doesn't exist (broken link?), ignored", path, log::verbose ) ;
 		
 		else
 		{
@@ -89,15 +340,15 @@ void State::FromLocal( const fs::path& p, Resource* folder )
 			Resource *c = folder->FindChild( fname ) ;
 			if ( c == 0 )
 			{
-				c = new Resource( fname, fs::is_directory(i->path()) ? "folder" : "file" ) ;
+				c = new Resource( fname, i->is_dir ? "folder" : "file" ) ;
 				folder->AddChild( c ) ;
 				m_res.Insert( c ) ;
 			}
 			
-			c->FromLocal( m_last_sync ) ;			
+			c->FromLocal( m_last_sync, &m_cache ) ;
 			
-			if ( fs::is_directory( i->path() ) )
-				FromLocal( *i, c ) ;
+			if ( i->is_dir )
+				FromLocal( path, c ) ;
 		}
 	}
 }
@@ -128,6 +379,39 @@ void State::FromRemote( const Entry& e )
 	}
 }
 
+/// Sync the local directory with \a folder in remote instead of the root of
+/// the drive.
+void State::SetRoot( const Entry& folder )
+{
+	assert( folder.Kind() == "folder" ) ;
+	m_res.Update( m_res.Root(), folder, m_last_sync ) ;
+}
+
+/// Whether the state is for the remote folder \a id. The state of older
+/// versions, which don't know, is assumed to be.
+bool State::IsRoot( const std::string& id ) const
+{
+	return m_root_id.empty() || m_root_id == id ;
+}
+
+/// Sync the remote folder \a id, e.g. the one of the "remote-dir" option. If
+/// the state is for another folder, it is reset as if nothing had been synced
+/// before: otherwise the files that are not in the new folder would look
+/// deleted in remote, and be deleted in local.
+void State::UseRoot( const std::string& id )
+{
+	if ( !IsRoot( id ) )
+	{
+		Log( "the last sync was of another remote folder, syncing from scratch", log::warning ) ;
+		m_last_sync.Assign( 0 ) ;
+		m_cstamp		= -1 ;
+		m_inode.clear() ;
+		m_inode_all		= true ;
+		m_other_root	= true ;
+	}
+	m_root_id = id ;
+}
+
 void State::ResolveEntry()
 {
 	while ( !m_unresolved.empty() )
@@ -175,20 +459,28 @@ bool State::Update( const Entry& e )
 
 	if ( Resource *res = m_res.FindByHref( e.SelfHref() ) )
 	{
-		m_res.Update( res, e, m_last_sync ) ;
+		m_res.Update( res, e, LastSync( e ) ) ;
 		return true ;
 	}
 	else if ( Resource *parent = m_res.FindByHref( e.ParentHref() ) )
 	{
 		assert( parent->IsFolder() ) ;
 
-		// see if the entry already exist in local
+		// the entries in an excluded folder are never resolved, as the
+		// folder is not in the tree
 		std::string name = e.Name() ;
+		if ( m_ignore.IsIgnored( parent->Path() / name, e.Kind() == "folder" ) )
+		{
+			Log( "%1% %2% is ignored by grive", e.Kind(), parent->Path() / name, log::verbose ) ;
+			return true ;
+		}
+		
+		// see if the entry already exist in local
 		Resource *child = parent->FindChild( name ) ;
 		if ( child != 0 )
 		{
 			// since we are updating the ID and Href, we need to remove it and re-add it.
-			m_res.Update( child, e, m_last_sync ) ;
+			m_res.Update( child, e, LastSync( e ) ) ;
 		}
 		
 		// folder entry exist in google drive, but not local. we should create
@@ -201,7 +493,7 @@ bool State::Update( const Entry& e )
 			m_res.Insert( child ) ;
 			
 			// update the state of the resource
-			m_res.Update( child, e, m_last_sync ) ;
+			m_res.Update( child, e, LastSync( e ) ) ;
 		}
 		
 		return true ;
@@ -210,6 +502,15 @@ bool State::Update( const Entry& e )
 		return false ;
 }
 
+/// The last sync time to compare \a e with. A file whose download failed in
+/// the last sync is compared as if it was never synced, so it is downloaded
+/// again instead of being taken as deleted in local.
+DateTime State::LastSync( const Entry& e ) const
+{
+	Inode inode ;
+	return FindInode( e.SelfHref(), inode ) && inode.pending ? DateTime() : m_last_sync ;
+}
+
 Resource* State::FindByHref( const std::string& href )
 {
 	return m_res.FindByHref( href ) ;
@@ -225,10 +526,29 @@ State::iterator State::end()
 	return m_res.end() ;
 }
 
+/// Read the state file. The JSON state file of older versions is still read,
+/// and written back in the binary format.
 void State::Read( const fs::path& filename )
 {
 	try
 	{
+		if ( StateFile::Is( filename ) )
+		{
+			m_file.reset( new StateFile( filename ) ) ;
+			
+			const StateFile::Info& info = m_file->GetInfo() ;
+			m_last_sync		= info.last_sync ;
+			m_cstamp		= info.change_stamp ;
+			m_generation	= info.generation ;
+			m_root_id		= info.root_id ;
+			
+			// the inodes and the folders are looked up when needed
+			m_cache.Read( m_file.get() ) ;
+			m_inode.clear() ;
+			m_inode_all = false ;
+			return ;
+		}
+		
 		File file( filename ) ;
 		Json json = Json::Parse( &file ) ;
 		
@@ -238,6 +558,15 @@ void State::Read( const fs::path& filename )
 			last_sync["nsec"].Int() ) ;
 		
 		m_cstamp = json["change_stamp"].Int() ;
+		m_generation = json.Has( "generation" ) ? json["generation"].Int() : 0 ;
+		
+		Json checksum ;
+		if ( json.Get( "checksum", checksum ) )
+			m_cache.Read( checksum ) ;
+		
+		Json inode ;
+		if ( json.Get( "inode", inode ) )
+			ReadInodes( inode ) ;
 	}
 	catch ( Exception& )
 	{
@@ -245,18 +574,326 @@ void State::Read( const fs::path& filename )
 	}
 }
 
-void State::Write( const fs::path& filename ) const
+/// Write the state file and start the journal over. The state file is written
+/// to a temporary file first, so a crash leaves either the old or the new one.
+/// The old file stays mapped until this object is destroyed, since the
+/// checksums that are not looked up yet are still read from it.
+void State::Write( const fs::path& filename )
+{
+	StateFile::Info info ;
+	info.last_sync		= m_last_sync ;
+	info.change_stamp	= m_cstamp ;
+	info.generation		= m_generation + 1 ;
+	info.root_id		= m_root_id ;
+	
+	std::vector<StateFile::Checksum> checksums ;
+	m_cache.Write( checksums ) ;
+	
+	std::vector<StateFile::Inode> inodes ;
+	WriteInodes( inodes ) ;
+	
+	std::vector<StateFile::Dir> dirs ;
+	for ( DirMap::const_iterator i = m_dir.begin() ; i != m_dir.end() ; ++i )
+		dirs.push_back( i->second ) ;
+	
+	std::vector<StateFile::Folder> folders ;
+	std::string local, remote ;
+	m_res.Root()->Digest( local, remote,
+		boost::bind( &State::RecordDigest, _1, _2, _3, _4, boost::ref( folders ) ) ) ;
+	
+	fs::path tmp = filename.string() + ".tmp" ;
+	StateFile::Write( tmp, info, checksums, inodes, dirs, folders ) ;
+	fs::rename( tmp, filename ) ;
+	
+	m_journal.Start( ++m_generation ) ;
+}
+
+/// The content of a state file in JSON, for debugging.
+Json State::Dump( const fs::path& filename )
+{
+	if ( StateFile::Is( filename ) )
+		return StateFile( filename ).Dump() ;
+	
+	File file( filename ) ;
+	return Json::Parse( &file ) ;
+}
+
+/// Sync only what has changed since the last sync in this run: the entries of
+/// the local directories in \a dirs, but not the directories under them, and
+/// the \a changes in remote. The tree of the last sync is updated with them,
+/// so neither the whole local directory nor the whole remote file list is read
+/// again. The state file must have been written after the last sync, so the
+/// journal has been started over already.
+///
+/// Returns false if the changes can't be found out this way, e.g. something
+/// is new or moved in remote, whose parent is not known from the changes feed.
+/// The tree may have been changed already then, and it should be built again
+/// from scratch to compare everything.
+bool State::SyncChanges( http::Agent *http, const Json& options,
+	const std::set<fs::path>& dirs, const std::vector<Entry>& changes )
+{
+	assert( http != 0 ) ;
+	
+	// only the full sync downloads the files whose download failed again
+	if ( m_download_pending )
+	{
+		Log( "some files are not downloaded yet", log::verbose ) ;
+		return false ;
+	}
+	
+	// the local changes first, so that a file changed on both sides is not
+	// taken as changed in remote only
+	std::vector<Resource*> changed ;
+	for ( std::set<fs::path>::const_iterator i = dirs.begin() ; i != dirs.end() ; ++i )
+	{
+		// gone already, or new or deleted along with its parent above
+		Resource *folder = FindByPath( *i ) ;
+		if ( folder == 0 || ( folder->IsFolder() && !folder->IsSync() ) )
+			continue ;
+		
+		if ( !folder->IsFolder() || !FromLocalChange( *i, folder, changed ) )
+			return false ;
+	}
+	
+	// only the full sync finds out the moves
+	bool added = false, deleted = false ;
+	for ( std::vector<Resource*>::const_iterator i = changed.begin() ; i != changed.end() ; ++i )
+	{
+		added	= added || !(*i)->HasID() ;
+		deleted	= deleted || (*i)->IsDeleted() ;
+	}
+	if ( added && deleted )
+	{
+		Log( "files may have been moved in local", log::verbose ) ;
+		return false ;
+	}
+	
+	for ( std::vector<Entry>::const_iterator i = changes.begin() ; i != changes.end() ; ++i )
+	{
+		if ( !FromRemoteChange( *i, changed ) )
+			return false ;
+	}
+	
+	if ( changed.empty() )
+		return true ;
+	
+	Log( "Synchronizing %1% changes", changed.size(), log::info ) ;
+	std::set<Resource*> parents ;
+	for ( std::vector<Resource*>::const_iterator i = changed.begin() ; i != changed.end() ; ++i )
+	{
+		DateTime sync_time = m_last_sync ;
+		(*i)->Sync( http, sync_time, options, &m_cache, boost::bind( &State::Synced, this, _1 ) ) ;
+		parents.insert( (*i)->Parent() ) ;
+	}
+	
+	// the folders deleted are pruned along with their parents
+	for ( std::set<Resource*>::const_iterator i = parents.begin() ; i != parents.end() ; ++i )
+	{
+		if ( !(*i)->IsDeleted() )
+			Prune( *i, false ) ;
+	}
+	return true ;
+}
+
+/// Call \a hook after each resource is transferred or deleted, e.g. to tell
+/// the changes made by the sync from the others.
+void State::OnSynced( const Resource::SyncHook& hook )
+{
+	m_on_synced = hook ;
+}
+
+/// Find the resource of a local path in the tree.
+Resource* State::FindByPath( const fs::path& path )
+{
+	Resource *res = m_res.Root() ;
+	const fs::path root = res->Path() ;
+	
+	// "." is the end of a path with a trailing slash
+	fs::path::iterator p = path.begin() ;
+	for ( fs::path::iterator r = root.begin() ; r != root.end() ; ++r )
+	{
+		if ( *r == "." )
+			continue ;
+		if ( p == path.end() || *p != *r )
+			return 0 ;
+		++p ;
+	}
+	
+	for ( ; p != path.end() && res != 0 ; ++p )
+	{
+		if ( *p != "." )
+			res = res->FindChild( p->string() ) ;
+	}
+	return res ;
+}
+
+/// Compare the entries of the local directory \a dir with the children of
+/// \a folder, which is in sync, and put the ones changed in local in
+/// \a changed. The directories under it are only read if they are new.
+/// Returns false if they can't be compared this way, e.g. a file has been
+/// replaced with a directory.
+bool State::FromLocalChange( const fs::path& dir, Resource *folder, std::vector<Resource*>& changed )
 {
-	Json last_sync ;
-	last_sync.Add( "sec",	Json(m_last_sync.Sec() ) );
-	last_sync.Add( "nsec",	Json(m_last_sync.NanoSec() ) );
+	assert( folder->IsSync() ) ;
+	
+	// the ones deleted in the last sync are no longer there
+	Prune( folder, false ) ;
 	
-	Json result ;
-	result.Add( "last_sync", last_sync ) ;
-	result.Add( "change_stamp", Json(m_cstamp) ) ;
+	std::vector<StateFile::DirEntry> entries ;
+	List( dir, entries ) ;
 	
-	std::ofstream fs( filename.string().c_str() ) ;
-	fs << result ;
+	std::set<std::string> names ;
+	for ( std::vector<StateFile::DirEntry>::const_iterator i = entries.begin() ; i != entries.end() ; ++i )
+	{
+		fs::path path = dir / i->name ;
+		if ( m_ignore.IsIgnored( path, i->is_dir ) || !fs::exists( path ) )
+			continue ;
+		names.insert( i->name ) ;
+		
+		Resource *c = folder->FindChild( i->name ) ;
+		if ( c == 0 )
+			changed.push_back( AddLocal( path, i->is_dir, folder ) ) ;
+		
+		else if ( c->IsFolder() != i->is_dir )
+			return false ;
+		
+		else if ( !c->IsFolder() && c->FromLocalChange( &m_cache ) )
+			changed.push_back( c ) ;
+	}
+	
+	for ( Resource::iterator i = folder->begin() ; i != folder->end() ; ++i )
+	{
+		if ( names.count( (*i)->Name() ) == 0 && (*i)->IsSync() )
+		{
+			(*i)->FromLocalDelete() ;
+			changed.push_back( *i ) ;
+		}
+	}
+	return true ;
+}
+
+/// Apply an entry of the changes feed to the tree of the last sync, and put
+/// the resource in \a changed if it needs to be synced. Returns false if it
+/// can't be applied.
+bool State::FromRemoteChange( const Entry& e, std::vector<Resource*>& changed )
+{
+	assert( e.IsChange() ) ;
+	
+	Resource *res = m_res.FindByHref( e.AltSelf() ) ;
+	if ( res == 0 )
+	{
+		// deleted already, or never synced
+		if ( e.IsRemoved() || IsIgnore( e.Name() ) ||
+			( e.Kind() != "folder" && ( e.Filename().empty() || e.ContentSrc().empty() ) ) )
+			return true ;
+		
+		Log( "%1% %2% is new in remote", e.Kind(), e.Name(), log::verbose ) ;
+		return false ;
+	}
+	
+	// changed by the last sync itself, or deleted by it
+	if ( e.ETag() == res->ETag() || ( e.IsRemoved() && res->IsDeleted() ) )
+		return true ;
+	
+	if ( !res->FromRemoteChange( e ) )
+		return false ;
+	
+	if ( !res->IsSync() )
+		changed.push_back( res ) ;
+	return true ;
+}
+
+/// Add a file or directory created in local since the last sync to the tree,
+/// along with everything in it.
+Resource* State::AddLocal( const fs::path& path, bool is_dir, Resource *parent )
+{
+	Resource *res = new Resource( path.filename().string(), is_dir ? "folder" : "file" ) ;
+	parent->AddChild( res ) ;
+	m_res.Insert( res ) ;
+	
+	// everything is newer than that, so it's new in local
+	res->FromLocal( DateTime(), &m_cache ) ;
+	
+	if ( is_dir )
+	{
+		std::vector<StateFile::DirEntry> entries ;
+		List( path, entries ) ;
+		
+		for ( std::vector<StateFile::DirEntry>::const_iterator i = entries.begin() ; i != entries.end() ; ++i )
+		{
+			fs::path child = path / i->name ;
+			if ( !m_ignore.IsIgnored( child, i->is_dir ) && fs::exists( child ) )
+				AddLocal( child, i->is_dir, res ) ;
+		}
+	}
+	return res ;
+}
+
+/// Remove the resources deleted on both sides from the tree: the children of
+/// \a folder, and the ones under them too if \a all.
+void State::Prune( Resource *folder, bool all )
+{
+	std::vector<Resource*> gone ;
+	for ( Resource::iterator i = folder->begin() ; i != folder->end() ; ++i )
+	{
+		if ( (*i)->IsDeleted() )
+			gone.push_back( *i ) ;
+		else if ( all && (*i)->IsFolder() )
+			Prune( *i, true ) ;
+	}
+	
+	for ( std::vector<Resource*>::const_iterator i = gone.begin() ; i != gone.end() ; ++i )
+	{
+		folder->RemoveChild( *i ) ;
+		Erase( *i ) ;
+	}
+}
+
+void State::Erase( Resource *res )
+{
+	std::for_each( res->begin(), res->end(), boost::bind( &State::Erase, this, _1 ) ) ;
+	m_res.Erase( res ) ;
+	delete res ;
+}
+
+/// Transfer the files of \a hrefs whose states are already decided, before the
+/// rest of the remote files are listed, so that the transfers start early.
+/// Files that may be moved since the last sync are left for Sync(), which
+/// finds out the moves with the whole tree.
+void State::SyncDecided( http::Agent *http, const Json& options, const std::vector<std::string>& hrefs )
+{
+	assert( http != 0 ) ;
+	
+	for ( std::vector<std::string>::const_iterator i = hrefs.begin() ; i != hrefs.end() ; ++i )
+	{
+		Resource *res = m_res.FindByHref( *i ) ;
+		if ( res == 0 || !res->IsDecided() )
+			continue ;
+		
+		Inode inode ;
+		bool found = FindInode( *i, inode ) ;
+		if ( found && inode.path != res->Path().string() )
+			continue ;
+		
+		// the same three-way diff as Sync(), with the file alone
+		InodeMap base ;
+		Snapshot last, local, remote ;
+		if ( found && !inode.pending && !inode.md5.empty() )
+		{
+			base[*i] = inode ;
+			last.Add( Snapshot::Record( inode.path, inode.md5 ) ) ;
+		}
+		AddCopies( res, local, remote ) ;
+		if ( Resolve( SyncPlan( last, local, remote ), base ) > 0 && !res->IsDecided() )
+			continue ;
+		
+		StartJournal() ;
+		
+		DateTime sync_time = m_last_sync ;
+		res->Sync( http, sync_time, options, &m_cache, boost::bind( &State::Synced, this, _1 ) ) ;
+		m_decided_sync = std::max( m_decided_sync, sync_time ) ;
+		Stats::Inst().Add( "sync.decided" ) ;
+	}
 }
 
 void State::Sync( http::Agent *http, const Json& options )
@@ -268,8 +905,33 @@ void State::Sync( http::Agent *http, const Json& options )
 	// the last sync time would always be a server time rather than a client time
 	// TODO - WARNING - do we use the last sync time to compare to client file times
 	// need to check if this introduces a new problem
- 	DateTime last_sync_time = m_last_sync;
-	m_res.Root()->Sync( http, last_sync_time, options ) ;
+	{
+		Stats::Timer timer( "diff" ) ;
+		SkipUnchanged() ;
+		
+		InodeMap all ;
+		AllInodes( all ) ;
+		DetectMoves( all ) ;
+		m_res.Root()->DetectCopies() ;
+		ResolveChanges( all ) ;
+	}
+	
+ 	DateTime last_sync_time = std::max( m_last_sync, m_decided_sync ) ;
+	Resource::SyncHook synced ;
+	if ( http != 0 )
+	{
+		StartJournal() ;
+		synced = boost::bind( &State::Synced, this, _1 ) ;
+	}
+	
+	m_res.Root()->Sync( http, last_sync_time, options, &m_cache, synced ) ;
+	
+	if ( http != 0 )
+	{
+		RecordInodes() ;
+		Prune( m_res.Root(), true ) ;
+	}
+	m_journal_started = false ;
 	
   	if ( last_sync_time == m_last_sync )
   	{
@@ -283,6 +945,383 @@ void State::Sync( http::Agent *http, const Json& options )
   	}
 }
 
+/// Find the resources that have been moved or renamed since the last sync,
+/// in local or in remote, so that they are moved in the other side instead of
+/// being transferred again. \a all are the inodes in the last sync.
+void State::DetectMoves( const InodeMap& all )
+{
+	if ( all.empty() )
+		return ;
+	
+	// the resources that are not in the same place as in the last sync. Their
+	// local copies are found before any resource is moved in the tree.
+	LocalCopies copies ;
+	std::map<std::string, Resource*> by_path ;
+	HrefByInode hrefs ;
+	for ( InodeMap::const_iterator i = all.begin() ; i != all.end() ; ++i )
+	{
+		if ( i->second.pending )
+			continue ;
+		
+		hrefs[std::make_pair( i->second.dev, i->second.ino )] = i->first ;
+		
+		Resource *res = m_res.FindByHref( i->first ) ;
+		if ( res == 0 || res->Path().string() == i->second.path )
+			continue ;
+		
+		if ( by_path.empty() )
+		{
+			for ( iterator j = m_res.begin() ; j != m_res.end() ; ++j )
+				by_path[(*j)->Path().string()] = *j ;
+		}
+		
+		std::map<std::string, Resource*>::iterator local = by_path.find( i->second.path ) ;
+		if ( local == by_path.end() || !fs::exists( local->second->Path() ) )
+			continue ;
+		
+		os::FileStat st = os::Stat( local->second->Path() ) ;
+		if ( st.dev == i->second.dev && st.ino == i->second.ino )
+			copies[res] = std::make_pair( local->second, local->second->Path() ) ;
+	}
+	
+	std::vector<Resource*> discarded ;
+	m_res.Root()->DetectMoves( boost::bind( &State::FindMoved, this, boost::cref(hrefs), _1 ), discarded ) ;
+	m_res.Root()->DetectRemoteMoves( boost::bind( &State::FindLocal, boost::cref(copies), _1, _2 ), discarded ) ;
+	
+	for ( std::vector<Resource*>::iterator i = discarded.begin() ; i != discarded.end() ; ++i )
+	{
+		m_res.Erase( *i ) ;
+		delete *i ;
+	}
+}
+
+/// The states of the files are decided by comparing their modification times
+/// with the last sync, so a file changed in local only can be overwritten if
+/// the remote copy is touched later. Correct them with the three-way diff of
+/// the checksums in the last sync, in local and in remote.
+void State::ResolveChanges( const InodeMap& all )
+{
+	if ( all.empty() )
+		return ;
+	
+	Snapshot base, local, remote ;
+	for ( InodeMap::const_iterator i = all.begin() ; i != all.end() ; ++i )
+	{
+		if ( !i->second.pending && !i->second.md5.empty() )
+			base.Add( Snapshot::Record( i->second.path, i->second.md5 ) ) ;
+	}
+	for ( iterator i = m_res.begin() ; i != m_res.end() ; ++i )
+		AddCopies( *i, local, remote ) ;
+	
+	base.Sort() ;
+	local.Sort() ;
+	remote.Sort() ;
+	
+	std::size_t count = Resolve( SyncPlan( base, local, remote ), all ) ;
+	if ( count > 0 )
+		Log( "%1% files are synced the other way by the three-way diff", count, log::verbose ) ;
+}
+
+/// Apply the operations of \a plan to the files that are in the same place as
+/// in the last sync, i.e. in \a base. The moved ones are left as they are.
+std::size_t State::Resolve( const SyncPlan& plan, const InodeMap& base )
+{
+	std::size_t count = 0 ;
+	for ( SyncPlan::iterator i = plan.begin() ; i != plan.end() ; ++i )
+	{
+		Resource *res = i->is_folder ? 0 : FindByPath( i->path ) ;
+		if ( res == 0 || res->IsFolder() )
+			continue ;
+		
+		InodeMap::const_iterator inode = base.find( res->SelfHref() ) ;
+		if ( inode == base.end() || inode->second.path != res->Path().string() )
+			continue ;
+		
+		if ( res->Resolve( i->action ) )
+			count++ ;
+	}
+	return count ;
+}
+
+/// Add the local and remote copies of the file \a res to the snapshots.
+void State::AddCopies( const Resource *res, Snapshot& local, Snapshot& remote )
+{
+	if ( res->IsFolder() )
+		return ;
+	
+	const std::string path = res->Path().string() ;
+	if ( !res->LocalMD5().empty() )
+		local.Add( Snapshot::Record( path, res->LocalMD5() ) ) ;
+	if ( !res->RemoteMD5().empty() )
+		remote.Add( Snapshot::Record( path, res->RemoteMD5(), false, res->ResourceID() ) ) ;
+}
+
+/// The resource in the last sync that has the same inode as \a res. Files must
+/// also have the same content.
+Resource* State::FindMoved( const HrefByInode& hrefs, const Resource *res )
+{
+	os::FileStat st = os::Stat( res->Path() ) ;
+	
+	HrefByInode::const_iterator i = hrefs.find( std::make_pair( st.dev, st.ino ) ) ;
+	Inode inode ;
+	if ( i == hrefs.end() || !FindInode( i->second, inode ) || ( !st.is_dir && inode.md5 != res->MD5() ) )
+		return 0 ;
+	
+	return m_res.FindByHref( i->second ) ;
+}
+
+/// The local copy of \a res, which was moved in remote, and where it is.
+Resource* State::FindLocal( const LocalCopies& copies, const Resource *res, fs::path& path )
+{
+	LocalCopies::const_iterator i = copies.find( res ) ;
+	if ( i == copies.end() )
+		return 0 ;
+	
+	path = i->second.second ;
+	return i->second.first ;
+}
+
+/// Skip the folders that have not changed, neither in local nor in remote,
+/// since the last sync.
+void State::SkipUnchanged()
+{
+	if ( m_file.get() == 0 || m_other_root || m_file->FolderCount() == 0 )
+		return ;
+	
+	std::size_t count = 0 ;
+	std::string local, remote ;
+	m_res.Root()->Digest( local, remote,
+		boost::bind( &State::SkipIfSame, this, _1, _2, _3, boost::ref( count ) ) ) ;
+	
+	Log( "%1% folders are not changed since the last sync", count, log::verbose ) ;
+}
+
+void State::SkipIfSame( Resource *folder, const std::string& local, const std::string& remote, std::size_t& count )
+{
+	StateFile::Folder f ;
+	if ( m_file->FindFolder( folder->Path().string(), f ) && f.local == local && f.remote == remote )
+	{
+		Trace( "folder %1% is not changed", folder->Path() ) ;
+		folder->Skip() ;
+		count++ ;
+	}
+}
+
+/// Remember the digests of the folders in sync for the next time.
+void State::RecordDigest( Resource *folder, const std::string& local, const std::string& remote,
+	bool in_sync, std::vector<StateFile::Folder>& folders )
+{
+	if ( in_sync )
+	{
+		StateFile::Folder f ;
+		f.path		= folder->Path().string() ;
+		f.local		= local ;
+		f.remote	= remote ;
+		folders.push_back( f ) ;
+	}
+}
+
+/// Start the journal, with the records replayed from the last one if any.
+void State::StartJournal()
+{
+	if ( !m_journal_started )
+	{
+		Write( m_filename ) ;
+		m_journal_started = true ;
+	}
+}
+
+/// Record a resource that has just been transferred or deleted in the journal.
+/// Everything needed to find out that it is in sync, i.e. its inode and
+/// checksum, is written down.
+void State::Synced( const Resource *res )
+{
+	if ( m_on_synced )
+		m_on_synced( res ) ;
+	
+	if ( !res->HasID() )
+		return ;
+	
+	Json rec ;
+	rec.Add( "href",	Json( res->SelfHref() ) ) ;
+	rec.Add( "id",		Json( res->ResourceID() ) ) ;
+	
+	if ( res->IsSync() && fs::exists( res->Path() ) )
+	{
+		os::FileStat st = os::Stat( res->Path() ) ;
+		rec.Add( "dev",		Json( static_cast<boost::uint64_t>(st.dev) ) ) ;
+		rec.Add( "ino",		Json( static_cast<boost::uint64_t>(st.ino) ) ) ;
+		rec.Add( "md5",		Json( res->MD5() ) ) ;
+		rec.Add( "path",	Json( res->Path().string() ) ) ;
+		
+		Json checksum ;
+		if ( !st.is_dir && m_cache.Write( res->Path(), checksum ) )
+			rec.Add( "checksum", checksum ) ;
+	}
+	else
+		rec.Add( "deleted", Json( true ) ) ;
+	
+	Apply( rec ) ;
+	m_journal.Append( rec ) ;
+	
+	if ( m_journal.Size() >= std::max( journal_min, InodeCount() / journal_ratio ) )
+		Write( m_filename ) ;
+}
+
+/// About how many inodes are recorded, in the state file and since.
+std::size_t State::InodeCount() const
+{
+	std::size_t count = m_inode.size() ;
+	if ( !m_inode_all && m_file.get() != 0 )
+		count += m_file->InodeCount() ;
+	return count ;
+}
+
+/// Apply a record of the journal.
+void State::Apply( const Json& rec )
+{
+	std::string href = rec["href"].Str() ;
+	Inode& inode = m_inode[href] ;
+	inode.deleted = rec.Has( "deleted" ) ;
+	inode.pending = false ;
+	if ( inode.deleted )
+		return ;
+	
+	inode.dev	= rec["dev"].As<boost::uint64_t>() ;
+	inode.ino	= rec["ino"].As<boost::uint64_t>() ;
+	inode.md5	= rec["md5"].Str() ;
+	inode.path	= rec["path"].Str() ;
+	
+	Json checksum ;
+	if ( rec.Get( "checksum", checksum ) )
+		m_cache.Read( inode.path, checksum ) ;
+}
+
+/// Remember the inodes of the resources in sync for the next time, and the
+/// files whose download failed, so that they are not taken as deleted in local.
+void State::RecordInodes()
+{
+	m_inode.clear() ;
+	m_inode_all = true ;
+	m_download_pending = false ;
+	for ( iterator i = m_res.begin() ; i != m_res.end() ; ++i )
+	{
+		const Resource *r = *i ;
+		if ( r->IsRoot() || !r->HasID() )
+			continue ;
+		
+		bool pending = r->IsDownloadPending() ;
+		bool exists = fs::exists( r->Path() ) ;
+		if ( !pending && ( !r->IsSync() || !exists ) )
+			continue ;
+		
+		os::FileStat st ;
+		if ( exists )
+			st = os::Stat( r->Path() ) ;
+		
+		Inode& inode = m_inode[r->SelfHref()] ;
+		inode.dev		= exists ? st.dev : 0 ;
+		inode.ino		= exists ? st.ino : 0 ;
+		inode.md5		= pending ? "" : r->MD5() ;
+		inode.path		= r->Path().string() ;
+		inode.deleted	= false ;
+		inode.pending	= pending ;
+		m_download_pending = m_download_pending || pending ;
+	}
+}
+
+void State::ReadInodes( const Json& json )
+{
+	m_inode.clear() ;
+	m_inode_all = true ;
+	
+	Json::Object obj = json.AsObject() ;
+	for ( Json::Object::iterator i = obj.begin() ; i != obj.end() ; ++i )
+	{
+		const Json& rec = i->second ;
+		
+		Inode& inode = m_inode[i->first] ;
+		inode.dev	= rec["dev"].As<boost::uint64_t>() ;
+		inode.ino	= rec["ino"].As<boost::uint64_t>() ;
+		inode.md5	= rec["md5"].Str() ;
+		inode.path	= rec.Has( "path" ) ? rec["path"].Str() : "" ;
+		inode.deleted = false ;
+		inode.pending = false ;
+	}
+}
+
+/// Look up the inode of a resource in the last sync, in the ones changed since
+/// the state file was read first.
+bool State::FindInode( const std::string& href, Inode& inode ) const
+{
+	InodeMap::const_iterator i = m_inode.find( href ) ;
+	if ( i != m_inode.end() )
+	{
+		inode = i->second ;
+		return !inode.deleted ;
+	}
+	
+	StateFile::Inode rec ;
+	if ( m_inode_all || m_file.get() == 0 || !m_file->FindInode( href, rec ) )
+		return false ;
+	
+	inode.dev		= rec.dev ;
+	inode.ino		= rec.ino ;
+	inode.md5		= rec.md5 ;
+	inode.path		= rec.path ;
+	inode.deleted	= false ;
+	inode.pending	= rec.pending ;
+	return true ;
+}
+
+/// All the inodes in the last sync, for finding out what has changed in the
+/// whole tree. Reading them takes time, so they are not kept.
+void State::AllInodes( InodeMap& all ) const
+{
+	if ( !m_inode_all && m_file.get() != 0 )
+	{
+		// already sorted by href
+		for ( std::size_t i = 0 ; i < m_file->InodeCount() ; i++ )
+		{
+			StateFile::Inode rec = m_file->GetInode( i ) ;
+			
+			Inode& inode = all.insert( all.end(), std::make_pair( rec.href, Inode() ) )->second ;
+			inode.dev		= rec.dev ;
+			inode.ino		= rec.ino ;
+			inode.md5		= rec.md5 ;
+			inode.path		= rec.path ;
+			inode.deleted	= false ;
+			inode.pending	= rec.pending ;
+		}
+	}
+	
+	for ( InodeMap::const_iterator i = m_inode.begin() ; i != m_inode.end() ; ++i )
+	{
+		if ( i->second.deleted )
+			all.erase( i->first ) ;
+		else
+			all[i->first] = i->second ;
+	}
+}
+
+void State::WriteInodes( std::vector<StateFile::Inode>& out ) const
+{
+	InodeMap all ;
+	AllInodes( all ) ;
+	
+	for ( InodeMap::const_iterator i = all.begin() ; i != all.end() ; ++i )
+	{
+		StateFile::Inode rec ;
+		rec.href	= i->first ;
+		rec.dev		= i->second.dev ;
+		rec.ino		= i->second.ino ;
+		rec.md5		= i->second.md5 ;
+		rec.path	= i->second.path ;
+		rec.pending	= i->second.pending ;
+		out.push_back( rec ) ;
+	}
+}
+
 long State::ChangeStamp() const
 {
 	return m_cstamp ;
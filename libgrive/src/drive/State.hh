@@ -19,12 +19,18 @@
 
 #pragma once
 
+#include "ChecksumCache.hh"
+#include "IgnoreRules.hh"
+#include "Journal.hh"
 #include "ResourceTree.hh"
 
 #include "util/DateTime.hh"
 #include "util/FileSystem.hh"
+#include "util/Types.hh"
 
+#include <map>
 #include <memory>
+#include <set>
 
 namespace gr {
 
@@ -39,6 +45,8 @@ namespace v1 {
 
 class Resource ;
 class Entry ;
+class Snapshot ;
+class SyncPlan ;
 
 class State
 {
@@ -50,16 +58,26 @@ public :
 	~State() ;
 	
 	void FromLocal( const fs::path& p ) ;
+	void Prefetch( const fs::path& p ) ;
+	bool LocalUnchanged( const fs::path& p ) ;
 	void FromRemote( const Entry& e ) ;
 	void ResolveEntry() ;
+	void SetRoot( const Entry& folder ) ;
+	bool IsRoot( const std::string& id ) const ;
+	void UseRoot( const std::string& id ) ;
 	
 	void Read( const fs::path& filename ) ;
-	void Write( const fs::path& filename ) const ;
+	void Write( const fs::path& filename ) ;
+	static Json Dump( const fs::path& filename ) ;
 
 	Resource* FindByHref( const std::string& href ) ;
 	Resource* FindByID( const std::string& id ) ;
 
+	void SyncDecided( http::Agent *http, const Json& options, const std::vector<std::string>& hrefs ) ;
 	void Sync( http::Agent *http, const Json& options ) ;
+	bool SyncChanges( http::Agent *http, const Json& options,
+		const std::set<fs::path>& dirs, const std::vector<Entry>& changes ) ;
+	void OnSynced( const Resource::SyncHook& hook ) ;
 	
 	iterator begin() ;
 	iterator end() ;
@@ -67,20 +85,110 @@ public :
 	long ChangeStamp() const ;
 	void ChangeStamp( long cstamp ) ;
 	
+	static bool IsIgnore( const std::string& filename ) ;
+	
 private :
+	/// The directories read in the last sync, by path.
+	typedef std::map<std::string, StateFile::Dir>	DirMap ;
+	
+	/// Where the local copy of a resource in the last sync was.
+	struct Inode
+	{
+		u64_t		dev ;
+		u64_t		ino ;
+		std::string	md5 ;
+		std::string	path ;
+		bool		deleted ;
+		
+		/// The download failed, so the local copy is not in sync.
+		bool		pending ;
+	} ;
+	typedef std::map<std::string, Inode>	InodeMap ;
+	typedef std::map<std::string, const Inode*>	InodeByPath ;
+	typedef std::map<std::pair<u64_t, u64_t>, std::string>	HrefByInode ;
+	typedef std::map<const Resource*, std::pair<Resource*, fs::path> > LocalCopies ;
+	
 	void FromLocal( const fs::path& p, Resource *folder ) ;
+	void PrefetchDir( const fs::path& dir ) ;
+	void List( const fs::path& dir, std::vector<StateFile::DirEntry>& entries ) ;
+	static bool IsSameDir( const os::FileStat& s1, const os::FileStat& s2 ) ;
+	bool IsSameTree( const fs::path& dir, const InodeByPath& synced, std::size_t& count ) ;
+	bool FindInode( const std::string& href, Inode& inode ) const ;
+	void AllInodes( InodeMap& all ) const ;
+	std::size_t InodeCount() const ;
 	void FromChange( const Entry& e ) ;
 	bool Update( const Entry& e ) ;
+	DateTime LastSync( const Entry& e ) const ;
+	Resource* FindByPath( const fs::path& path ) ;
+	bool FromLocalChange( const fs::path& dir, Resource *folder, std::vector<Resource*>& changed ) ;
+	bool FromRemoteChange( const Entry& e, std::vector<Resource*>& changed ) ;
+	Resource* AddLocal( const fs::path& path, bool is_dir, Resource *parent ) ;
+	void Prune( Resource *folder, bool all ) ;
+	void Erase( Resource *res ) ;
 	std::size_t TryResolveEntry() ;
-
-	static bool IsIgnore( const std::string& filename ) ;
+	
+	void DetectMoves( const InodeMap& all ) ;
+	void ResolveChanges( const InodeMap& all ) ;
+	std::size_t Resolve( const SyncPlan& plan, const InodeMap& base ) ;
+	static void AddCopies( const Resource *res, Snapshot& local, Snapshot& remote ) ;
+	Resource* FindMoved( const HrefByInode& hrefs, const Resource *res ) ;
+	static Resource* FindLocal( const LocalCopies& copies, const Resource *res, fs::path& path ) ;
+	void SkipUnchanged() ;
+	void SkipIfSame( Resource *folder, const std::string& local, const std::string& remote, std::size_t& count ) ;
+	static void RecordDigest( Resource *folder, const std::string& local, const std::string& remote,
+		bool in_sync, std::vector<StateFile::Folder>& folders ) ;
+	void StartJournal() ;
+	void Synced( const Resource *res ) ;
+	void Apply( const Json& rec ) ;
+	void RecordInodes() ;
+	void ReadInodes( const Json& json ) ;
+	void WriteInodes( std::vector<StateFile::Inode>& out ) const ;
 	
 private :
 	ResourceTree		m_res ;
 	DateTime			m_last_sync ;
 	long				m_cstamp ;
+	ChecksumCache		m_cache ;
+	IgnoreRules			m_ignore ;
+	
+	/// The ID of the remote folder synced, and whether the state file read
+	/// is for another one, in which case only its local parts, i.e. the
+	/// checksums and the directories, are used.
+	std::string			m_root_id ;
+	bool				m_other_root ;
+	
+	/// The state file read, which the checksums, the inodes and the digests
+	/// of the folders in the last sync are looked up in
+	std::auto_ptr<StateFile>	m_file ;
+	
+	/// The entries of the local directories read in this run, so that a
+	/// directory that has not changed is not read again in the next one.
+	DirMap				m_dir ;
+	
+	/// The resources synced since the state file was written, so that an
+	/// interrupted sync doesn't need to find them out again.
+	fs::path			m_filename ;
+	long				m_generation ;
+	Journal				m_journal ;
+	bool				m_journal_started ;
+	
+	/// The latest server time of the files transferred by SyncDecided().
+	DateTime			m_decided_sync ;
 	
 	std::vector<Entry>	m_unresolved ;
+	
+	/// The resources in the last sync, by their hrefs. The device and inode
+	/// numbers and the path of their local copies are used to find out where
+	/// they have been moved to. Only the ones changed since the state file was
+	/// read are here, unless \a m_inode_all: the others are in the file.
+	InodeMap			m_inode ;
+	bool				m_inode_all ;
+	
+	/// Some files in \a m_inode are still to be downloaded after this sync.
+	bool				m_download_pending ;
+	
+	/// Called after each resource is transferred or deleted, for the caller.
+	Resource::SyncHook	m_on_synced ;
 } ;
 
 } } // end of namespace gr::v1
@@ -0,0 +1,826 @@
+/*
+	grive: an GPL program to sync a local directory with Google Drive
+	Copyright (C) 2012  Wan Wai Ho
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation version 2
+	of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "StateFile.hh"
+
+#include "protocol/Json.hh"
+#include "util/MemMap.hh"
+
+#include <boost/exception/errinfo_file_name.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <cstddef>
+#include <cstring>
+
+namespace gr { namespace v1 {
+
+namespace
+{
+	const char				magic[8]	= "GRIVEST" ;
+	const boost::uint32_t	version		= 5 ;
+	const boost::uint32_t	byte_order	= 0x01020304 ;
+	
+	/// Convert a checksum in hex to 16 bytes. Returns false if it is not one.
+	bool ToBin( const std::string& md5, unsigned char *bin )
+	{
+		if ( md5.size() != 32 )
+			return false ;
+		
+		for ( std::size_t i = 0 ; i < 32 ; i++ )
+		{
+			char c = md5[i] ;
+			int v = ( c >= '0' && c <= '9' ) ? c - '0' :
+					( c >= 'a' && c <= 'f' ) ? c - 'a' + 10 : -1 ;
+			if ( v < 0 )
+				return false ;
+			
+			if ( i % 2 == 0 )
+				bin[i/2] = static_cast<unsigned char>( v << 4 ) ;
+			else
+				bin[i/2] |= static_cast<unsigned char>( v ) ;
+		}
+		return true ;
+	}
+	
+	/// Whether \a count items of \a item_size bytes at \a offset fit in \a size
+	/// bytes. Nothing is added or multiplied, so nothing overflows.
+	bool Fits( u64_t offset, u64_t count, u64_t item_size, u64_t size )
+	{
+		return offset <= size && count <= ( size - offset ) / item_size ;
+	}
+	
+	std::string ToHex( const unsigned char *bin )
+	{
+		static const char hex[] = "0123456789abcdef" ;
+		
+		std::string result( 32, '0' ) ;
+		for ( std::size_t i = 0 ; i < 16 ; i++ )
+		{
+			result[i*2]		= hex[bin[i] >> 4] ;
+			result[i*2+1]	= hex[bin[i] & 0xf] ;
+		}
+		return result ;
+	}
+	
+	/// Compare the indices of two records by a member. The records are not
+	/// sorted themselves to save copying their strings.
+	template <typename T, typename Key>
+	class IndexLess
+	{
+	public :
+		IndexLess( const std::vector<T>& recs, Key T::*key ) : m_recs( recs ), m_key( key )
+		{
+		}
+		
+		bool operator()( std::size_t i1, std::size_t i2 ) const
+		{
+			return m_recs[i1].*m_key < m_recs[i2].*m_key ;
+		}
+		
+	private :
+		const std::vector<T>&	m_recs ;
+		Key T::*				m_key ;
+	} ;
+	
+	template <typename T, typename Key>
+	std::vector<std::size_t> SortedIndex( const std::vector<T>& recs, Key T::*key )
+	{
+		std::vector<std::size_t> idx( recs.size() ) ;
+		for ( std::size_t i = 0 ; i < idx.size() ; i++ )
+			idx[i] = i ;
+		
+		std::sort( idx.begin(), idx.end(), IndexLess<T, Key>( recs, key ) ) ;
+		return idx ;
+	}
+	
+	/// Compare two records by the binary checksums.
+	template <typename Rec>
+	class MD5Less
+	{
+	public :
+		explicit MD5Less( const Rec *recs ) : m_recs( recs )
+		{
+		}
+		
+		bool operator()( boost::uint32_t i1, boost::uint32_t i2 ) const
+		{
+			return std::memcmp( m_recs[i1].md5, m_recs[i2].md5, sizeof(m_recs[i1].md5) ) < 0 ;
+		}
+		
+	private :
+		const Rec	*m_recs ;
+	} ;
+}
+
+struct StateFile::Header
+{
+	char				magic[8] ;
+	boost::uint32_t		version ;
+	boost::uint32_t		byte_order ;
+	boost::int64_t		last_sync_sec ;
+	boost::int64_t		last_sync_nsec ;
+	boost::int64_t		change_stamp ;
+	boost::int64_t		generation ;
+	boost::uint64_t		checksum_count ;
+	boost::uint64_t		checksum_offset ;
+	boost::uint64_t		md5_index_offset ;
+	boost::uint64_t		inode_count ;
+	boost::uint64_t		inode_offset ;
+	boost::uint64_t		heap_offset ;
+	boost::uint64_t		heap_size ;
+	
+	// since version 2
+	boost::uint64_t		dir_count ;
+	boost::uint64_t		dir_offset ;
+	boost::uint64_t		dir_entry_count ;
+	boost::uint64_t		dir_entry_offset ;
+	
+	// since version 3
+	boost::uint64_t		folder_count ;
+	boost::uint64_t		folder_offset ;
+	
+	// since version 5
+	boost::uint64_t		root_id_offset ;
+	boost::uint64_t		root_id_length ;
+} ;
+
+struct StateFile::ChecksumRec
+{
+	boost::uint64_t		path_offset ;
+	boost::uint32_t		path_length ;
+	boost::uint32_t		mtime_nsec ;
+	boost::int64_t		mtime_sec ;
+	boost::int64_t		ctime_sec ;
+	boost::uint32_t		ctime_nsec ;
+	boost::uint32_t		reserved ;
+	boost::uint64_t		size ;
+	boost::uint64_t		ino ;
+	boost::uint64_t		dev ;
+	unsigned char		md5[16] ;
+} ;
+
+struct StateFile::InodeRec
+{
+	boost::uint64_t		href_offset ;
+	boost::uint32_t		href_length ;
+	boost::uint32_t		path_length ;
+	boost::uint64_t		path_offset ;
+	boost::uint64_t		dev ;
+	boost::uint64_t		ino ;
+	unsigned char		md5[16] ;
+	boost::uint32_t		has_md5 ;
+	boost::uint32_t		pending ;
+} ;
+
+struct StateFile::DirRec
+{
+	boost::uint64_t		path_offset ;
+	boost::uint32_t		path_length ;
+	boost::uint32_t		mtime_nsec ;
+	boost::int64_t		mtime_sec ;
+	boost::int64_t		ctime_sec ;
+	boost::uint32_t		ctime_nsec ;
+	boost::uint32_t		entry_count ;
+	boost::uint64_t		entry_index ;
+	boost::uint64_t		ino ;
+	boost::uint64_t		dev ;
+} ;
+
+struct StateFile::DirEntryRec
+{
+	boost::uint64_t		name_offset ;
+	boost::uint32_t		name_length ;
+	boost::uint32_t		is_dir ;
+} ;
+
+struct StateFile::FolderRec
+{
+	boost::uint64_t		path_offset ;
+	boost::uint32_t		path_length ;
+	boost::uint32_t		reserved ;
+	unsigned char		local[16] ;
+	unsigned char		remote[16] ;
+} ;
+
+/// Open and check a state file.
+/// \throw	Error	if it is not a state file or it is corrupted.
+StateFile::StateFile( const fs::path& file ) :
+	m_file		( file ),
+	m_hdr		( 0 ),
+	m_checksum	( 0 ),
+	m_md5_index	( 0 ),
+	m_inode		( 0 ),
+	m_dir_count	( 0 ),
+	m_dir		( 0 ),
+	m_dir_entry	( 0 ),
+	m_folder_count	( 0 ),
+	m_folder	( 0 ),
+	m_heap		( 0 )
+{
+	// the header of version 1 ends before the directories
+	u64_t size = m_file.Size() ;
+	if ( size < offsetof( Header, dir_count ) )
+		BOOST_THROW_EXCEPTION( Error() << boost::errinfo_file_name( file.string() ) ) ;
+	
+	m_map.reset( new MemMap( m_file, 0, static_cast<std::size_t>(size) ) ) ;
+	const char *base = static_cast<const char*>( m_map->Addr() ) ;
+	m_hdr = reinterpret_cast<const Header*>( base ) ;
+	
+	const Header& h = *m_hdr ;
+	if ( std::memcmp( h.magic, magic, sizeof(magic) ) != 0 ||
+		h.version			== 0			||
+		h.version			> version		||
+		h.byte_order		!= byte_order	||
+		!Fits( h.checksum_offset,	h.checksum_count,	sizeof(ChecksumRec),		size ) ||
+		!Fits( h.md5_index_offset,	h.checksum_count,	sizeof(boost::uint32_t),	size ) ||
+		!Fits( h.inode_offset,		h.inode_count,		sizeof(InodeRec),			size ) ||
+		!Fits( h.heap_offset,		h.heap_size,		1,							size ) )
+	{
+		BOOST_THROW_EXCEPTION( Error() << boost::errinfo_file_name( file.string() ) ) ;
+	}
+	
+	m_checksum	= reinterpret_cast<const ChecksumRec*>( base + h.checksum_offset ) ;
+	m_md5_index	= reinterpret_cast<const boost::uint32_t*>( base + h.md5_index_offset ) ;
+	m_inode		= reinterpret_cast<const InodeRec*>( base + h.inode_offset ) ;
+	m_heap		= base + h.heap_offset ;
+	
+	// version 1 has no directories
+	if ( h.version >= 2 )
+	{
+		if ( size < offsetof( Header, folder_count ) ||
+			!Fits( h.dir_offset,		h.dir_count,		sizeof(DirRec),			size ) ||
+			!Fits( h.dir_entry_offset,	h.dir_entry_count,	sizeof(DirEntryRec),	size ) )
+		{
+			BOOST_THROW_EXCEPTION( Error() << boost::errinfo_file_name( file.string() ) ) ;
+		}
+		
+		m_dir_count	= static_cast<std::size_t>( h.dir_count ) ;
+		m_dir		= reinterpret_cast<const DirRec*>( base + h.dir_offset ) ;
+		m_dir_entry	= reinterpret_cast<const DirEntryRec*>( base + h.dir_entry_offset ) ;
+	}
+	
+	// and version 2 has no folder digests. the ones of version 3 are not
+	// sorted, so they can't be looked up: they are ignored, and the folders
+	// are synced again once.
+	if ( h.version >= 4 )
+	{
+		if ( size < offsetof( Header, root_id_offset ) ||
+			!Fits( h.folder_offset, h.folder_count, sizeof(FolderRec), size ) )
+		{
+			BOOST_THROW_EXCEPTION( Error() << boost::errinfo_file_name( file.string() ) ) ;
+		}
+		
+		m_folder_count	= static_cast<std::size_t>( h.folder_count ) ;
+		m_folder		= reinterpret_cast<const FolderRec*>( base + h.folder_offset ) ;
+	}
+	
+	m_info.last_sync.Assign( h.last_sync_sec, static_cast<unsigned long>(h.last_sync_nsec) ) ;
+	m_info.change_stamp	= static_cast<long>( h.change_stamp ) ;
+	m_info.generation	= static_cast<long>( h.generation ) ;
+	
+	if ( h.version >= 5 )
+	{
+		if ( size < sizeof(Header) )
+			BOOST_THROW_EXCEPTION( Error() << boost::errinfo_file_name( file.string() ) ) ;
+		
+		m_info.root_id = Str( h.root_id_offset, h.root_id_length ) ;
+	}
+}
+
+StateFile::~StateFile( )
+{
+}
+
+/// Whether \a file is a binary state file, as opposed to the JSON state file
+/// of older versions.
+bool StateFile::Is( const fs::path& file )
+{
+	try
+	{
+		File f( file ) ;
+		char buf[sizeof(magic)] ;
+		return f.Read( buf, sizeof(buf) ) == sizeof(buf) &&
+			std::memcmp( buf, magic, sizeof(magic) ) == 0 ;
+	}
+	catch ( File::Error& )
+	{
+		return false ;
+	}
+}
+
+/// Write a state file.
+void StateFile::Write(
+	const fs::path&					file,
+	const Info&						info,
+	const std::vector<Checksum>&	checksums,
+	const std::vector<Inode>&		inodes,
+	const std::vector<Dir>&			dirs,
+	const std::vector<Folder>&		folders )
+{
+	Header h = {} ;
+	std::memcpy( h.magic, magic, sizeof(magic) ) ;
+	h.version			= version ;
+	h.byte_order		= byte_order ;
+	h.last_sync_sec		= info.last_sync.Sec() ;
+	h.last_sync_nsec	= info.last_sync.NanoSec() ;
+	h.change_stamp		= info.change_stamp ;
+	h.generation		= info.generation ;
+	
+	std::string heap = info.root_id ;
+	h.root_id_offset	= 0 ;
+	h.root_id_length	= heap.size() ;
+	
+	// the checksums by path, and the index by checksum
+	std::vector<ChecksumRec> crecs( checksums.size() ) ;
+	std::vector<std::size_t> by_path = SortedIndex( checksums, &Checksum::path ) ;
+	for ( std::size_t i = 0 ; i < by_path.size() ; i++ )
+	{
+		const Checksum& c = checksums[by_path[i]] ;
+		
+		ChecksumRec& r	= crecs[i] ;
+		r.path_offset	= heap.size() ;
+		r.path_length	= c.path.size() ;
+		r.size			= c.stat.size ;
+		r.mtime_sec		= c.stat.mtime.Sec() ;
+		r.mtime_nsec	= c.stat.mtime.NanoSec() ;
+		r.ctime_sec		= c.stat.ctime.Sec() ;
+		r.ctime_nsec	= c.stat.ctime.NanoSec() ;
+		r.ino			= c.stat.ino ;
+		r.dev			= c.stat.dev ;
+		ToBin( c.md5, r.md5 ) ;
+		
+		heap += c.path ;
+	}
+	
+	std::vector<boost::uint32_t> by_md5( crecs.size() ) ;
+	for ( std::size_t i = 0 ; i < by_md5.size() ; i++ )
+		by_md5[i] = static_cast<boost::uint32_t>( i ) ;
+	if ( !crecs.empty() )
+		std::sort( by_md5.begin(), by_md5.end(), MD5Less<ChecksumRec>( &crecs[0] ) ) ;
+	
+	// the inodes by href
+	std::vector<InodeRec> irecs( inodes.size() ) ;
+	std::vector<std::size_t> by_href = SortedIndex( inodes, &Inode::href ) ;
+	for ( std::size_t i = 0 ; i < by_href.size() ; i++ )
+	{
+		const Inode& in = inodes[by_href[i]] ;
+		
+		InodeRec& r		= irecs[i] ;
+		r.href_offset	= heap.size() ;
+		r.href_length	= in.href.size() ;
+		heap += in.href ;
+		r.path_offset	= heap.size() ;
+		r.path_length	= in.path.size() ;
+		heap += in.path ;
+		r.dev			= in.dev ;
+		r.ino			= in.ino ;
+		r.has_md5		= ToBin( in.md5, r.md5 ) ;
+		r.pending		= in.pending ;
+	}
+	
+	// the directories by path, and their entries
+	std::vector<DirRec> drecs( dirs.size() ) ;
+	std::vector<DirEntryRec> erecs ;
+	std::vector<std::size_t> by_dir = SortedIndex( dirs, &Dir::path ) ;
+	for ( std::size_t i = 0 ; i < by_dir.size() ; i++ )
+	{
+		const Dir& d = dirs[by_dir[i]] ;
+		
+		DirRec& r		= drecs[i] ;
+		r.path_offset	= heap.size() ;
+		r.path_length	= d.path.size() ;
+		r.mtime_sec		= d.stat.mtime.Sec() ;
+		r.mtime_nsec	= d.stat.mtime.NanoSec() ;
+		r.ctime_sec		= d.stat.ctime.Sec() ;
+		r.ctime_nsec	= d.stat.ctime.NanoSec() ;
+		r.ino			= d.stat.ino ;
+		r.dev			= d.stat.dev ;
+		r.entry_count	= d.entries.size() ;
+		r.entry_index	= erecs.size() ;
+		heap += d.path ;
+		
+		for ( std::vector<DirEntry>::const_iterator e = d.entries.begin() ; e != d.entries.end() ; ++e )
+		{
+			DirEntryRec er = {} ;
+			er.name_offset	= heap.size() ;
+			er.name_length	= e->name.size() ;
+			er.is_dir		= e->is_dir ;
+			heap += e->name ;
+			erecs.push_back( er ) ;
+		}
+	}
+	
+	// the folders by path
+	std::vector<FolderRec> frecs( folders.size() ) ;
+	std::vector<std::size_t> by_folder = SortedIndex( folders, &Folder::path ) ;
+	for ( std::size_t i = 0 ; i < by_folder.size() ; i++ )
+	{
+		const Folder& f = folders[by_folder[i]] ;
+		
+		FolderRec& r	= frecs[i] ;
+		r.path_offset	= heap.size() ;
+		r.path_length	= f.path.size() ;
+		heap += f.path ;
+		ToBin( f.local, r.local ) ;
+		ToBin( f.remote, r.remote ) ;
+	}
+	
+	std::size_t index_size = ( by_md5.size() * sizeof(boost::uint32_t) + 7 ) / 8 * 8 ;
+	by_md5.resize( index_size / sizeof(boost::uint32_t) ) ;
+	
+	h.checksum_count	= crecs.size() ;
+	h.checksum_offset	= sizeof(h) ;
+	h.md5_index_offset	= h.checksum_offset + crecs.size() * sizeof(ChecksumRec) ;
+	h.inode_count		= irecs.size() ;
+	h.inode_offset		= h.md5_index_offset + index_size ;
+	h.dir_count			= drecs.size() ;
+	h.dir_offset		= h.inode_offset + irecs.size() * sizeof(InodeRec) ;
+	h.dir_entry_count	= erecs.size() ;
+	h.dir_entry_offset	= h.dir_offset + drecs.size() * sizeof(DirRec) ;
+	h.folder_count		= frecs.size() ;
+	h.folder_offset		= h.dir_entry_offset + erecs.size() * sizeof(DirEntryRec) ;
+	h.heap_offset		= h.folder_offset + frecs.size() * sizeof(FolderRec) ;
+	h.heap_size			= heap.size() ;
+	
+	File f( file, 0600 ) ;
+	f.Write( reinterpret_cast<const char*>( &h ), sizeof(h) ) ;
+	if ( !crecs.empty() )
+		f.Write( reinterpret_cast<const char*>( &crecs[0] ), crecs.size() * sizeof(ChecksumRec) ) ;
+	if ( !by_md5.empty() )
+		f.Write( reinterpret_cast<const char*>( &by_md5[0] ), index_size ) ;
+	if ( !irecs.empty() )
+		f.Write( reinterpret_cast<const char*>( &irecs[0] ), irecs.size() * sizeof(InodeRec) ) ;
+	if ( !drecs.empty() )
+		f.Write( reinterpret_cast<const char*>( &drecs[0] ), drecs.size() * sizeof(DirRec) ) ;
+	if ( !erecs.empty() )
+		f.Write( reinterpret_cast<const char*>( &erecs[0] ), erecs.size() * sizeof(DirEntryRec) ) ;
+	if ( !frecs.empty() )
+		f.Write( reinterpret_cast<const char*>( &frecs[0] ), frecs.size() * sizeof(FolderRec) ) ;
+	f.Write( heap.c_str(), heap.size() ) ;
+	f.Sync() ;
+}
+
+const StateFile::Info& StateFile::GetInfo( ) const
+{
+	return m_info ;
+}
+
+/// Look up the checksum of a file by binary search.
+bool StateFile::FindChecksum( const std::string& path, Checksum& result ) const
+{
+	std::size_t first = 0, last = ChecksumCount() ;
+	while ( first < last )
+	{
+		std::size_t mid = first + ( last - first ) / 2 ;
+		const ChecksumRec& r = ChecksumAt( mid ) ;
+		
+		int cmp = path.compare( 0, std::string::npos, m_heap + r.path_offset, r.path_length ) ;
+		if ( cmp == 0 )
+		{
+			result = GetChecksum( mid ) ;
+			return true ;
+		}
+		else if ( cmp < 0 )
+			last = mid ;
+		else
+			first = mid + 1 ;
+	}
+	return false ;
+}
+
+/// Find a file with the checksum, by binary search in the index sorted by
+/// checksum.
+bool StateFile::FindByMD5( const std::string& md5, Checksum& result ) const
+{
+	unsigned char bin[16] ;
+	if ( !ToBin( md5, bin ) )
+		return false ;
+	
+	std::size_t first = 0, last = ChecksumCount() ;
+	while ( first < last )
+	{
+		std::size_t mid = first + ( last - first ) / 2 ;
+		if ( m_md5_index[mid] >= ChecksumCount() )
+			BOOST_THROW_EXCEPTION( Error() ) ;
+		
+		const ChecksumRec& r = ChecksumAt( m_md5_index[mid] ) ;
+		
+		int cmp = std::memcmp( bin, r.md5, sizeof(bin) ) ;
+		if ( cmp == 0 )
+		{
+			result = GetChecksum( m_md5_index[mid] ) ;
+			return true ;
+		}
+		else if ( cmp < 0 )
+			last = mid ;
+		else
+			first = mid + 1 ;
+	}
+	return false ;
+}
+
+std::size_t StateFile::ChecksumCount( ) const
+{
+	return static_cast<std::size_t>( m_hdr->checksum_count ) ;
+}
+
+StateFile::Checksum StateFile::GetChecksum( std::size_t idx ) const
+{
+	const ChecksumRec& r = ChecksumAt( idx ) ;
+	
+	Checksum c ;
+	c.path			= Str( r.path_offset, r.path_length ) ;
+	c.md5			= ToHex( r.md5 ) ;
+	c.stat.size		= r.size ;
+	c.stat.mtime.Assign( r.mtime_sec, r.mtime_nsec ) ;
+	c.stat.ctime.Assign( r.ctime_sec, r.ctime_nsec ) ;
+	c.stat.ino		= r.ino ;
+	c.stat.dev		= r.dev ;
+	c.stat.is_dir	= false ;
+	return c ;
+}
+
+/// Look up the inode of a resource by binary search.
+bool StateFile::FindInode( const std::string& href, Inode& result ) const
+{
+	std::size_t first = 0, last = InodeCount() ;
+	while ( first < last )
+	{
+		std::size_t mid = first + ( last - first ) / 2 ;
+		const InodeRec& r = InodeAt( mid ) ;
+		
+		int cmp = href.compare( 0, std::string::npos, m_heap + r.href_offset, r.href_length ) ;
+		if ( cmp == 0 )
+		{
+			result = GetInode( mid ) ;
+			return true ;
+		}
+		else if ( cmp < 0 )
+			last = mid ;
+		else
+			first = mid + 1 ;
+	}
+	return false ;
+}
+
+std::size_t StateFile::InodeCount( ) const
+{
+	return static_cast<std::size_t>( m_hdr->inode_count ) ;
+}
+
+StateFile::Inode StateFile::GetInode( std::size_t idx ) const
+{
+	const InodeRec& r = InodeAt( idx ) ;
+	
+	Inode i ;
+	i.href	= Str( r.href_offset, r.href_length ) ;
+	i.path	= Str( r.path_offset, r.path_length ) ;
+	i.md5	= r.has_md5 ? ToHex( r.md5 ) : "" ;
+	i.dev	= r.dev ;
+	i.ino	= r.ino ;
+	i.pending	= r.pending != 0 ;
+	return i ;
+}
+
+/// Look up the entries of a directory by binary search.
+bool StateFile::FindDir( const std::string& path, Dir& result ) const
+{
+	std::size_t first = 0, last = DirCount() ;
+	while ( first < last )
+	{
+		std::size_t mid = first + ( last - first ) / 2 ;
+		const DirRec& r = DirAt( mid ) ;
+		
+		int cmp = path.compare( 0, std::string::npos, m_heap + r.path_offset, r.path_length ) ;
+		if ( cmp == 0 )
+		{
+			result = GetDir( mid ) ;
+			return true ;
+		}
+		else if ( cmp < 0 )
+			last = mid ;
+		else
+			first = mid + 1 ;
+	}
+	return false ;
+}
+
+std::size_t StateFile::DirCount( ) const
+{
+	return m_dir_count ;
+}
+
+StateFile::Dir StateFile::GetDir( std::size_t idx ) const
+{
+	const DirRec& r = DirAt( idx ) ;
+	
+	Dir d ;
+	d.path			= Str( r.path_offset, r.path_length ) ;
+	d.stat.size		= 0 ;
+	d.stat.mtime.Assign( r.mtime_sec, r.mtime_nsec ) ;
+	d.stat.ctime.Assign( r.ctime_sec, r.ctime_nsec ) ;
+	d.stat.ino		= r.ino ;
+	d.stat.dev		= r.dev ;
+	d.stat.is_dir	= true ;
+	
+	if ( !Fits( r.entry_index, r.entry_count, 1, m_hdr->dir_entry_count ) )
+		BOOST_THROW_EXCEPTION( Error() ) ;
+	
+	d.entries.resize( r.entry_count ) ;
+	for ( std::size_t i = 0 ; i < r.entry_count ; i++ )
+	{
+		const DirEntryRec& e = m_dir_entry[r.entry_index + i] ;
+		d.entries[i].name	= Str( e.name_offset, e.name_length ) ;
+		d.entries[i].is_dir	= e.is_dir != 0 ;
+	}
+	return d ;
+}
+
+/// Look up the digests of a folder by binary search.
+bool StateFile::FindFolder( const std::string& path, Folder& result ) const
+{
+	std::size_t first = 0, last = FolderCount() ;
+	while ( first < last )
+	{
+		std::size_t mid = first + ( last - first ) / 2 ;
+		const FolderRec& r = FolderAt( mid ) ;
+		
+		int cmp = path.compare( 0, std::string::npos, m_heap + r.path_offset, r.path_length ) ;
+		if ( cmp == 0 )
+		{
+			result = GetFolder( mid ) ;
+			return true ;
+		}
+		else if ( cmp < 0 )
+			last = mid ;
+		else
+			first = mid + 1 ;
+	}
+	return false ;
+}
+
+std::size_t StateFile::FolderCount( ) const
+{
+	return m_folder_count ;
+}
+
+StateFile::Folder StateFile::GetFolder( std::size_t idx ) const
+{
+	const FolderRec& r = FolderAt( idx ) ;
+	
+	Folder f ;
+	f.path		= Str( r.path_offset, r.path_length ) ;
+	f.local		= ToHex( r.local ) ;
+	f.remote	= ToHex( r.remote ) ;
+	return f ;
+}
+
+/// All records in JSON, in the same format as the state file of older
+/// versions. For debugging.
+Json StateFile::Dump( ) const
+{
+	Json last_sync ;
+	last_sync.Add( "sec",	Json( static_cast<boost::int64_t>(m_info.last_sync.Sec()) ) ) ;
+	last_sync.Add( "nsec",	Json( static_cast<boost::int64_t>(m_info.last_sync.NanoSec()) ) ) ;
+	
+	Json checksum ;
+	for ( std::size_t i = 0 ; i < ChecksumCount() ; i++ )
+	{
+		Checksum c = GetChecksum( i ) ;
+		
+		Json rec ;
+		rec.Add( "md5",			Json( c.md5 ) ) ;
+		rec.Add( "size",		Json( static_cast<boost::uint64_t>(c.stat.size) ) ) ;
+		rec.Add( "mtime_sec",	Json( static_cast<boost::int64_t>(c.stat.mtime.Sec()) ) ) ;
+		rec.Add( "mtime_nsec",	Json( static_cast<boost::int64_t>(c.stat.mtime.NanoSec()) ) ) ;
+		rec.Add( "ctime_sec",	Json( static_cast<boost::int64_t>(c.stat.ctime.Sec()) ) ) ;
+		rec.Add( "ctime_nsec",	Json( static_cast<boost::int64_t>(c.stat.ctime.NanoSec()) ) ) ;
+		rec.Add( "ino",			Json( static_cast<boost::uint64_t>(c.stat.ino) ) ) ;
+		rec.Add( "dev",			Json( static_cast<boost::uint64_t>(c.stat.dev) ) ) ;
+		checksum.Add( c.path, rec ) ;
+	}
+	
+	Json inode ;
+	for ( std::size_t i = 0 ; i < InodeCount() ; i++ )
+	{
+		Inode in = GetInode( i ) ;
+		
+		Json rec ;
+		rec.Add( "dev",		Json( static_cast<boost::uint64_t>(in.dev) ) ) ;
+		rec.Add( "ino",		Json( static_cast<boost::uint64_t>(in.ino) ) ) ;
+		rec.Add( "md5",		Json( in.md5 ) ) ;
+		rec.Add( "path",	Json( in.path ) ) ;
+		if ( in.pending )
+			rec.Add( "pending",	Json( true ) ) ;
+		inode.Add( in.href, rec ) ;
+	}
+	
+	Json dir ;
+	for ( std::size_t i = 0 ; i < DirCount() ; i++ )
+	{
+		Dir d = GetDir( i ) ;
+		
+		std::vector<Json> entries ;
+		for ( std::vector<DirEntry>::const_iterator e = d.entries.begin() ; e != d.entries.end() ; ++e )
+			entries.push_back( Json( e->is_dir ? e->name + "/" : e->name ) ) ;
+		
+		Json rec ;
+		rec.Add( "mtime_sec",	Json( static_cast<boost::int64_t>(d.stat.mtime.Sec()) ) ) ;
+		rec.Add( "mtime_nsec",	Json( static_cast<boost::int64_t>(d.stat.mtime.NanoSec()) ) ) ;
+		rec.Add( "ctime_sec",	Json( static_cast<boost::int64_t>(d.stat.ctime.Sec()) ) ) ;
+		rec.Add( "ctime_nsec",	Json( static_cast<boost::int64_t>(d.stat.ctime.NanoSec()) ) ) ;
+		rec.Add( "ino",			Json( static_cast<boost::uint64_t>(d.stat.ino) ) ) ;
+		rec.Add( "dev",			Json( static_cast<boost::uint64_t>(d.stat.dev) ) ) ;
+		rec.Add( "entries",		Json( entries ) ) ;
+		dir.Add( d.path, rec ) ;
+	}
+	
+	Json folder ;
+	for ( std::size_t i = 0 ; i < FolderCount() ; i++ )
+	{
+		Folder f = GetFolder( i ) ;
+		
+		Json rec ;
+		rec.Add( "local",	Json( f.local ) ) ;
+		rec.Add( "remote",	Json( f.remote ) ) ;
+		folder.Add( f.path, rec ) ;
+	}
+	
+	Json result ;
+	result.Add( "last_sync",	last_sync ) ;
+	result.Add( "change_stamp",	Json( static_cast<boost::int64_t>(m_info.change_stamp) ) ) ;
+	result.Add( "generation",	Json( static_cast<boost::int64_t>(m_info.generation) ) ) ;
+	result.Add( "root_id",		Json( m_info.root_id ) ) ;
+	result.Add( "checksum",		checksum ) ;
+	result.Add( "inode",		inode ) ;
+	result.Add( "dir",			dir ) ;
+	result.Add( "folder",		folder ) ;
+	return result ;
+}
+
+std::string StateFile::Str( u64_t offset, u64_t length ) const
+{
+	if ( !Fits( offset, length, 1, m_hdr->heap_size ) )
+		BOOST_THROW_EXCEPTION( Error() ) ;
+	
+	return std::string( m_heap + offset, static_cast<std::size_t>(length) ) ;
+}
+
+const StateFile::DirRec& StateFile::DirAt( std::size_t idx ) const
+{
+	assert( idx < DirCount() ) ;
+	const DirRec& r = m_dir[idx] ;
+	if ( !Fits( r.path_offset, r.path_length, 1, m_hdr->heap_size ) )
+		BOOST_THROW_EXCEPTION( Error() ) ;
+	
+	return r ;
+}
+
+const StateFile::InodeRec& StateFile::InodeAt( std::size_t idx ) const
+{
+	assert( idx < InodeCount() ) ;
+	const InodeRec& r = m_inode[idx] ;
+	if ( !Fits( r.href_offset, r.href_length, 1, m_hdr->heap_size ) )
+		BOOST_THROW_EXCEPTION( Error() ) ;
+	
+	return r ;
+}
+
+const StateFile::FolderRec& StateFile::FolderAt( std::size_t idx ) const
+{
+	assert( idx < FolderCount() ) ;
+	const FolderRec& r = m_folder[idx] ;
+	if ( !Fits( r.path_offset, r.path_length, 1, m_hdr->heap_size ) )
+		BOOST_THROW_EXCEPTION( Error() ) ;
+	
+	return r ;
+}
+
+const StateFile::ChecksumRec& StateFile::ChecksumAt( std::size_t idx ) const
+{
+	assert( idx < ChecksumCount() ) ;
+	const ChecksumRec& r = m_checksum[idx] ;
+	if ( !Fits( r.path_offset, r.path_length, 1, m_hdr->heap_size ) )
+		BOOST_THROW_EXCEPTION( Error() ) ;
+	
+	return r ;
+}
+
+} } // end of namespace gr::v1
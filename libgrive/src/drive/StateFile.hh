@@ -0,0 +1,181 @@
+/*
+	grive: an GPL program to sync a local directory with Google Drive
+	Copyright (C) 2012  Wan Wai Ho
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation version 2
+	of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#pragma once
+
+#include "util/DateTime.hh"
+#include "util/Exception.hh"
+#include "util/File.hh"
+#include "util/FileSystem.hh"
+#include "util/OS.hh"
+#include "util/Types.hh"
+
+#include <boost/cstdint.hpp>
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace gr {
+
+class Json ;
+class MemMap ;
+
+namespace v1 {
+
+/*!	\brief	The binary state file
+
+	The per-file records are kept in tables of fixed size records, sorted
+	by key, with the strings in a heap after them. The file is mapped into
+	memory and the records are searched in place, so opening it takes the
+	same time no matter how many records it has, and only the pages of the
+	records that are looked up are read from the disk.
+	
+	The file is in the byte order of the machine that wrote it. A file from
+	a machine with another byte order is refused, like a corrupted one.
+*/
+class StateFile
+{
+public :
+	struct Error : virtual Exception {} ;
+	
+	struct Info
+	{
+		DateTime	last_sync ;
+		long		change_stamp ;
+		long		generation ;
+		
+		/// The ID of the remote folder synced. Empty in the files of older
+		/// versions.
+		std::string	root_id ;
+	} ;
+	
+	/// Checksum of a local file, by path
+	struct Checksum
+	{
+		std::string		path ;
+		std::string		md5 ;
+		os::FileStat	stat ;
+	} ;
+	
+	/// Entry in a directory
+	struct DirEntry
+	{
+		std::string	name ;
+		bool		is_dir ;
+	} ;
+	
+	/// The entries in a directory, and its stat when they were read
+	struct Dir
+	{
+		std::string				path ;
+		os::FileStat			stat ;
+		std::vector<DirEntry>	entries ;
+	} ;
+	
+	/// Digests of a folder in the last sync, see Resource::Digest()
+	struct Folder
+	{
+		std::string	path ;
+		std::string	local ;
+		std::string	remote ;
+	} ;
+	
+	/// Inode of a resource in sync, by href
+	struct Inode
+	{
+		std::string	href ;
+		std::string	path ;
+		std::string	md5 ;
+		u64_t		dev ;
+		u64_t		ino ;
+		
+		/// The download failed: the local copy is missing or out of date.
+		bool		pending ;
+	} ;
+	
+public :
+	explicit StateFile( const fs::path& file ) ;
+	~StateFile( ) ;
+	
+	static bool Is( const fs::path& file ) ;
+	static void Write(
+		const fs::path&					file,
+		const Info&						info,
+		const std::vector<Checksum>&	checksums,
+		const std::vector<Inode>&		inodes,
+		const std::vector<Dir>&			dirs = std::vector<Dir>(),
+		const std::vector<Folder>&		folders = std::vector<Folder>() ) ;
+	
+	const Info& GetInfo( ) const ;
+	
+	bool FindChecksum( const std::string& path, Checksum& result ) const ;
+	bool FindByMD5( const std::string& md5, Checksum& result ) const ;
+	std::size_t ChecksumCount( ) const ;
+	Checksum GetChecksum( std::size_t idx ) const ;
+	
+	bool FindInode( const std::string& href, Inode& result ) const ;
+	std::size_t InodeCount( ) const ;
+	Inode GetInode( std::size_t idx ) const ;
+	
+	bool FindDir( const std::string& path, Dir& result ) const ;
+	std::size_t DirCount( ) const ;
+	Dir GetDir( std::size_t idx ) const ;
+	
+	bool FindFolder( const std::string& path, Folder& result ) const ;
+	std::size_t FolderCount( ) const ;
+	Folder GetFolder( std::size_t idx ) const ;
+	
+	Json Dump( ) const ;
+	
+private :
+	StateFile( const StateFile& ) ;
+	StateFile& operator=( const StateFile& ) ;
+	
+	struct Header ;
+	struct ChecksumRec ;
+	struct InodeRec ;
+	struct DirRec ;
+	struct DirEntryRec ;
+	struct FolderRec ;
+	
+	std::string Str( u64_t offset, u64_t length ) const ;
+	const ChecksumRec& ChecksumAt( std::size_t idx ) const ;
+	const InodeRec& InodeAt( std::size_t idx ) const ;
+	const DirRec& DirAt( std::size_t idx ) const ;
+	const FolderRec& FolderAt( std::size_t idx ) const ;
+	
+private :
+	File					m_file ;
+	std::auto_ptr<MemMap>	m_map ;
+	Info					m_info ;
+	
+	const Header			*m_hdr ;
+	const ChecksumRec		*m_checksum ;
+	const boost::uint32_t	*m_md5_index ;
+	const InodeRec			*m_inode ;
+	std::size_t				m_dir_count ;
+	const DirRec			*m_dir ;
+	const DirEntryRec		*m_dir_entry ;
+	std::size_t				m_folder_count ;
+	const FolderRec			*m_folder ;
+	const char				*m_heap ;
+} ;
+
+} } // end of namespace gr::v1
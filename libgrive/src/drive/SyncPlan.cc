@@ -0,0 +1,216 @@
+/*
+	grive: an GPL program to sync a local directory with Google Drive
+	Copyright (C) 2012  Wan Wai Ho
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation version 2
+	of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "SyncPlan.hh"
+
+#include <cassert>
+#include <ostream>
+
+namespace gr { namespace v1 {
+
+namespace
+{
+	/// The record at the front of \a r if it is for \a path. It is then
+	/// removed from the range.
+	const Snapshot::Record* Take( Snapshot::Range& r, const std::string& path )
+	{
+		if ( r.first != r.second && r.first->path == path )
+			return &*r.first++ ;
+		else
+			return 0 ;
+	}
+	
+	const std::string* Min( const std::string *path, const Snapshot::Range& r )
+	{
+		if ( r.first == r.second )
+			return path ;
+		
+		return path == 0 || Snapshot::PathLess( r.first->path, *path ) ? &r.first->path : path ;
+	}
+	
+	bool IsDelete( SyncPlan::Action a )
+	{
+		return a == SyncPlan::delete_local || a == SyncPlan::delete_remote ;
+	}
+}
+
+SyncPlan::SyncPlan( )
+{
+}
+
+/// Compare the snapshots, or only the part of them under \a subtree.
+SyncPlan::SyncPlan(
+	const Snapshot&		base,
+	const Snapshot&		local,
+	const Snapshot&		remote,
+	const std::string&	subtree )
+{
+	Diff( base.Subtree( subtree ), local.Subtree( subtree ), remote.Subtree( subtree ) ) ;
+}
+
+/// Merge the ranges of the three snapshots and add the operations needed
+/// to the plan. The ranges must be sorted.
+void SyncPlan::Diff(
+	Snapshot::Range	base,
+	Snapshot::Range	local,
+	Snapshot::Range	remote )
+{
+	std::size_t first = m_ops.size() ;
+	
+	while ( base.first != base.second || local.first != local.second || remote.first != remote.second )
+	{
+		const std::string *path = Min( Min( Min( 0, base ), local ), remote ) ;
+		assert( path != 0 ) ;
+		
+		// "path" points to one of the records, which stays where it is
+		const Snapshot::Record *b = Take( base, *path ) ;
+		const Snapshot::Record *l = Take( local, *path ) ;
+		const Snapshot::Record *r = Take( remote, *path ) ;
+		Decide( b, l, r ) ;
+	}
+	
+	KeepFolders( first ) ;
+}
+
+void SyncPlan::Append( const SyncPlan& plan )
+{
+	m_ops.insert( m_ops.end(), plan.m_ops.begin(), plan.m_ops.end() ) ;
+}
+
+SyncPlan::iterator SyncPlan::begin() const
+{
+	return m_ops.begin() ;
+}
+
+SyncPlan::iterator SyncPlan::end() const
+{
+	return m_ops.end() ;
+}
+
+std::size_t SyncPlan::size() const
+{
+	return m_ops.size() ;
+}
+
+void SyncPlan::Decide(
+	const Snapshot::Record	*base,
+	const Snapshot::Record	*local,
+	const Snapshot::Record	*remote )
+{
+	bool local_changed	= IsChanged( base, local ) ;
+	bool remote_changed	= IsChanged( base, remote ) ;
+	std::string id		= remote != 0 ? remote->id : "" ;
+	
+	if ( local_changed && remote_changed )
+	{
+		// the same change on both sides, including deleted on both sides
+		if ( !IsChanged( local, remote ) )
+			return ;
+		
+		// deleted on one side and changed on the other: keep the changes
+		if ( local == 0 )
+			Add( download, remote, id ) ;
+		else if ( remote == 0 )
+			Add( upload, local, id ) ;
+		else
+			Add( conflict, local, id ) ;
+	}
+	else if ( local_changed )
+	{
+		if ( local != 0 )
+			Add( upload, local, id ) ;
+		else
+			Add( delete_remote, remote, id ) ;
+	}
+	else if ( remote_changed )
+	{
+		if ( remote != 0 )
+			Add( download, remote, id ) ;
+		else
+			Add( delete_local, local, id ) ;
+	}
+}
+
+void SyncPlan::Add( Action action, const Snapshot::Record *rec, const std::string& id )
+{
+	assert( rec != 0 ) ;
+	
+	Op op ;
+	op.action		= action ;
+	op.path			= rec->path ;
+	op.is_folder	= rec->is_folder ;
+	op.id			= id ;
+	m_ops.push_back( op ) ;
+}
+
+/// Fix up the deleted folders in the operations starting from \a first. A
+/// folder deleted on one side is created again if anything inside it is
+/// kept. Otherwise deleting the folder deletes everything inside it, so the
+/// operations for them are dropped.
+void SyncPlan::KeepFolders( std::size_t first )
+{
+	// backward, so the things inside a folder come before the folder
+	std::string kept ;
+	for ( std::size_t i = m_ops.size() ; i > first ; i-- )
+	{
+		Op& op = m_ops[i-1] ;
+		if ( IsDelete( op.action ) && op.is_folder && Snapshot::IsUnder( kept, op.path ) )
+			op.action = ( op.action == delete_local ? upload : download ) ;
+		
+		if ( !IsDelete( op.action ) )
+			kept = op.path ;
+	}
+	
+	std::vector<Op>::iterator out = m_ops.begin() + first ;
+	std::string deleted ;
+	for ( std::vector<Op>::iterator i = out ; i != m_ops.end() ; ++i )
+	{
+		if ( !deleted.empty() && Snapshot::IsUnder( i->path, deleted ) )
+		{
+			assert( IsDelete( i->action ) ) ;
+			continue ;
+		}
+		
+		deleted = IsDelete( i->action ) && i->is_folder ? i->path : "" ;
+		*out++ = *i ;
+	}
+	m_ops.erase( out, m_ops.end() ) ;
+}
+
+/// Whether \a now is different from \a base: added, deleted, a file
+/// replaced by a folder (or the other way round) or different contents.
+bool SyncPlan::IsChanged( const Snapshot::Record *base, const Snapshot::Record *now )
+{
+	if ( base == 0 || now == 0 )
+		return base != now ;
+	
+	return base->is_folder != now->is_folder || base->md5 != now->md5 ;
+}
+
+std::ostream& operator<<( std::ostream& os, SyncPlan::Action a )
+{
+	static const char *str[] =
+	{
+		"upload", "download", "delete_local", "delete_remote", "conflict"
+	} ;
+	assert( a >= SyncPlan::upload && a <= SyncPlan::conflict ) ;
+	return os << str[a] ;
+}
+
+} } // end of namespace gr::v1
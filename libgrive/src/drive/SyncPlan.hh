@@ -0,0 +1,99 @@
+/*
+	grive: an GPL program to sync a local directory with Google Drive
+	Copyright (C) 2012  Wan Wai Ho
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation version 2
+	of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#pragma once
+
+#include "Snapshot.hh"
+
+#include <iosfwd>
+#include <string>
+#include <vector>
+
+namespace gr { namespace v1 {
+
+/*!	\brief	What to do to bring local and remote back in sync
+
+	The plan is made by comparing three snapshots: the base, i.e. the tree
+	when it was last synchronized, the local tree and the remote tree. A
+	side has changed a path if its record differs from the base: added,
+	deleted or with a different checksum. No timestamp is involved.
+	
+	The snapshots are merged in one pass, so the operations come in the
+	order of the paths, with a folder before everything inside it. The
+	subtrees of the top level folder are independent of each other, so
+	they can be compared in different threads and the plans appended in
+	path order.
+*/
+class SyncPlan
+{
+public :
+	enum Action
+	{
+		upload,			///< create or update the remote copy
+		download,		///< create or update the local copy
+		delete_local,
+		delete_remote,
+		conflict		///< changed differently on both sides
+	} ;
+	
+	struct Op
+	{
+		Action		action ;
+		std::string	path ;
+		bool		is_folder ;
+		std::string	id ;		///< resource ID in remote, empty if not there yet
+	} ;
+	
+	typedef std::vector<Op>::const_iterator iterator ;
+	
+public :
+	SyncPlan( ) ;
+	SyncPlan(
+		const Snapshot&		base,
+		const Snapshot&		local,
+		const Snapshot&		remote,
+		const std::string&	subtree = "" ) ;
+	
+	void Diff(
+		Snapshot::Range	base,
+		Snapshot::Range	local,
+		Snapshot::Range	remote ) ;
+	void Append( const SyncPlan& plan ) ;
+	
+	iterator begin() const ;
+	iterator end() const ;
+	std::size_t size() const ;
+	
+private :
+	void Decide(
+		const Snapshot::Record	*base,
+		const Snapshot::Record	*local,
+		const Snapshot::Record	*remote ) ;
+	void Add( Action action, const Snapshot::Record *rec, const std::string& id ) ;
+	void KeepFolders( std::size_t first ) ;
+	
+	static bool IsChanged( const Snapshot::Record *base, const Snapshot::Record *now ) ;
+	
+private :
+	std::vector<Op>	m_ops ;
+} ;
+
+std::ostream& operator<<( std::ostream& os, SyncPlan::Action a ) ;
+
+} } // end of namespace gr::v1
@@ -0,0 +1,53 @@
+/*
+	grive: an GPL program to sync a local directory with Google Drive
+	Copyright (C) 2012  Wan Wai Ho
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation version 2
+	of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#include "Agent.hh"
+
+#include <cassert>
+
+namespace gr { namespace http {
+
+/// Perform the requests one by one. Agents that can send requests at the
+/// same time override this. Only the "Location", "ETag" and "Retry-After"
+/// headers of the responses are kept.
+void Agent::Perform( std::vector<Request>& reqs )
+{
+	static const char *keep[] = { "Location", "ETag", "Retry-After" } ;
+	
+	for ( std::vector<Request>::iterator i = reqs.begin() ; i != reqs.end() ; ++i )
+	{
+		assert( i->dest != 0 ) ;
+		
+		if ( i->method == "GET" )
+			i->response = Get( i->url, i->dest, i->hdr ) ;
+		else if ( i->method == "POST" )
+			i->response = Post( i->url, i->data, i->dest, i->hdr ) ;
+		else if ( i->method == "PUT" )
+			i->response = Put( i->url, i->data, i->dest, i->hdr ) ;
+		else
+			i->response = Custom( i->method, i->url, i->dest, i->hdr ) ;
+		
+		i->error = ErrorResponse() ;
+		for ( std::size_t k = 0 ; k < sizeof(keep)/sizeof(keep[0]) ; k++ )
+			i->ResponseHeader( keep[k], ResponseHeader( keep[k] ) ) ;
+	}
+}
+
+} } // end of namespace
@@ -19,7 +19,10 @@
 
 #pragma once
 
+#include "Request.hh"
+
 #include <string>
+#include <vector>
 
 namespace gr {
 
@@ -28,8 +31,6 @@ class File ;
 
 namespace http {
 
-class Header ;
-
 class Agent
 {
 public :
@@ -66,6 +67,19 @@ public :
 	
 	virtual std::string RedirLocation() const = 0 ;
 	
+	/// Value of a header in the last response, or empty if it was not sent.
+	/// The name is case-insensitive.
+	virtual std::string ResponseHeader( const std::string& name ) const = 0 ;
+	
+	/// Body of the last response if it was an HTTP error (i.e. >= 400). Error
+	/// bodies are not written to the DataStream of the request, so retrying
+	/// a request will not leave garbage in it.
+	virtual std::string ErrorResponse() const = 0 ;
+	
+	/// Perform a number of independent requests, possibly at the same time.
+	/// The results are stored in the requests.
+	virtual void Perform( std::vector<Request>& reqs ) ;
+	
 	virtual std::string Escape( const std::string& str ) = 0 ;
 	virtual std::string Unescape( const std::string& str ) = 0 ;
 } ;
@@ -0,0 +1,316 @@
+/*
+	grive: an GPL program to sync a local directory with Google Drive
+	Copyright (C) 2012  Wan Wai Ho
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation version 2
+	of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "BatchAgent.hh"
+
+#include "Header.hh"
+#include "StringResponse.hh"
+
+#include "util/Exception.hh"
+#include "util/log/Log.hh"
+#include "xml/Node.hh"
+#include "xml/NodeSet.hh"
+#include "xml/String.hh"
+#include "xml/TreeBuilder.hh"
+
+#include <boost/exception/all.hpp>
+
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <sstream>
+
+namespace gr { namespace http {
+
+namespace
+{
+	const std::string if_match = "If-Match: " ;
+	
+	bool IsIfMatch( const std::string& line )
+	{
+		return line.compare( 0, if_match.size(), if_match ) == 0 ;
+	}
+}
+
+BatchAgent::BatchAgent(
+	std::auto_ptr<Agent>	real_agent,
+	const std::string&		feed,
+	std::size_t				max_ops ) :
+	m_agent		( real_agent ),
+	m_feed		( feed ),
+	m_max_ops	( max_ops )
+{
+	assert( m_agent.get() != 0 ) ;
+}
+
+long BatchAgent::Put(
+	const std::string&	url,
+	const std::string&	data,
+	DataStream			*dest,
+	const Header&		hdr )
+{
+	return m_agent->Put( url, data, dest, hdr ) ;
+}
+
+long BatchAgent::Put(
+	const std::string&	url,
+	File				*file,
+	DataStream			*dest,
+	const Header&		hdr )
+{
+	return m_agent->Put( url, file, dest, hdr ) ;
+}
+
+long BatchAgent::Get(
+	const std::string& 	url,
+	DataStream			*dest,
+	const Header&		hdr )
+{
+	return m_agent->Get( url, dest, hdr ) ;
+}
+
+long BatchAgent::Post(
+	const std::string& 	url,
+	const std::string&	data,
+	DataStream			*dest,
+	const Header&		hdr )
+{
+	return m_agent->Post( url, data, dest, hdr ) ;
+}
+
+long BatchAgent::Custom(
+	const std::string&	method,
+	const std::string&	url,
+	DataStream			*dest,
+	const Header&		hdr )
+{
+	return m_agent->Custom( method, url, dest, hdr ) ;
+}
+
+std::string BatchAgent::RedirLocation() const
+{
+	return m_agent->RedirLocation() ;
+}
+
+std::string BatchAgent::ResponseHeader( const std::string& name ) const
+{
+	return m_agent->ResponseHeader( name ) ;
+}
+
+std::string BatchAgent::ErrorResponse() const
+{
+	return m_agent->ErrorResponse() ;
+}
+
+std::string BatchAgent::Escape( const std::string& str )
+{
+	return m_agent->Escape( str ) ;
+}
+
+std::string BatchAgent::Unescape( const std::string& str )
+{
+	return m_agent->Unescape( str ) ;
+}
+
+/// Only deleting the entries of the feed can be batched.
+bool BatchAgent::IsBatchable( const Request& req ) const
+{
+	return req.method == "DELETE" && req.data.empty() &&
+		req.url.compare( 0, m_feed.size() + 1, m_feed + "/" ) == 0 ;
+}
+
+/// Send the DELETE requests in batches, and the others through the real
+/// agent together, in the same order as they are given.
+void BatchAgent::Perform( std::vector<Request>& reqs )
+{
+	std::vector<Request>		batch, others ;
+	std::vector<std::size_t>	batch_idx, others_idx ;
+	for ( std::size_t i = 0 ; i < reqs.size() ; i++ )
+	{
+		bool b = m_max_ops > 1 && IsBatchable( reqs[i] ) ;
+		( b ? batch : others ).push_back( reqs[i] ) ;
+		( b ? batch_idx : others_idx ).push_back( i ) ;
+	}
+	
+	// no need to batch a single request
+	if ( batch.size() < 2 )
+	{
+		m_agent->Perform( reqs ) ;
+		return ;
+	}
+	
+	for ( iterator i = batch.begin() ; i != batch.end() ; )
+	{
+		iterator last = i + std::min<std::size_t>( m_max_ops, batch.end() - i ) ;
+		PerformBatch( i, last ) ;
+		i = last ;
+	}
+	
+	// the ones missing in the batch responses are sent one by one
+	std::vector<std::size_t> missing ;
+	for ( std::size_t i = 0 ; i < batch.size() ; i++ )
+	{
+		if ( batch[i].response == 0 )
+			missing.push_back( i ) ;
+	}
+	if ( !missing.empty() )
+	{
+		Log( "%1% requests are not answered in the batch. sending them again",
+			missing.size(), log::verbose ) ;
+		
+		for ( std::size_t k = 0 ; k < missing.size() ; k++ )
+		{
+			others.push_back( batch[missing[k]] ) ;
+			others_idx.push_back( batch_idx[missing[k]] ) ;
+		}
+	}
+	
+	if ( !others.empty() )
+		m_agent->Perform( others ) ;
+	
+	for ( std::size_t i = 0 ; i < batch.size() ; i++ )
+		reqs[batch_idx[i]] = batch[i] ;
+	for ( std::size_t i = 0 ; i < others.size() ; i++ )
+		reqs[others_idx[i]] = others[i] ;
+}
+
+void BatchAgent::PerformBatch( iterator begin, iterator end )
+{
+	Trace( "HTTP batch of %1% requests", end - begin ) ;
+	
+	for ( iterator i = begin ; i != end ; ++i )
+	{
+		i->response = 0 ;
+		i->error.clear() ;
+		i->headers.clear() ;
+	}
+	
+	Header hdr = CommonHeader( begin, end ) + "Content-Type: application/atom+xml" ;
+	
+	StringResponse str ;
+	long response = m_agent->Post( m_feed + "/batch", Encode( begin, end ), &str, hdr ) ;
+	
+	// the whole batch failed, e.g. rate limited. all requests failed the same way
+	if ( response >= 400 )
+	{
+		for ( iterator i = begin ; i != end ; ++i )
+		{
+			i->response	= response ;
+			i->error	= m_agent->ErrorResponse() ;
+			i->ResponseHeader( "Retry-After", m_agent->ResponseHeader( "Retry-After" ) ) ;
+		}
+		return ;
+	}
+	
+	std::size_t count = 0 ;
+	try
+	{
+		count = Decode( str.Response(), begin, end ) ;
+	}
+	catch ( Exception& e )
+	{
+		Trace( "Exception %1%", boost::diagnostic_information(e) ) ;
+	}
+	
+	if ( count != static_cast<std::size_t>( end - begin ) )
+		Log( "batch response has %1% operations for %2% requests", count, end - begin, log::warning ) ;
+}
+
+/// Headers sent by all requests in the range, except the conditions, which
+/// belong to each entry.
+Header BatchAgent::CommonHeader( const_iterator begin, const_iterator end )
+{
+	Header common ;
+	if ( begin == end )
+		return common ;
+	
+	for ( Header::iterator h = begin->hdr.begin() ; h != begin->hdr.end() ; ++h )
+	{
+		if ( IsIfMatch( *h ) )
+			continue ;
+		
+		const_iterator i = begin + 1 ;
+		while ( i != end && std::find( i->hdr.begin(), i->hdr.end(), *h ) != i->hdr.end() )
+			++i ;
+		
+		if ( i == end )
+			common.Add( *h ) ;
+	}
+	return common ;
+}
+
+/// Build the batch feed of the requests. The batch:id of each entry is its
+/// position in the range, starting from 1.
+std::string BatchAgent::Encode( const_iterator begin, const_iterator end )
+{
+	std::ostringstream os ;
+	os	<< "<feed xmlns='http://www.w3.org/2005/Atom' "
+		<< "xmlns:batch='http://schemas.google.com/gdata/batch' "
+		<< "xmlns:gd='http://schemas.google.com/g/2005'>" ;
+	
+	for ( const_iterator i = begin ; i != end ; ++i )
+	{
+		os << "<entry" ;
+		for ( Header::iterator h = i->hdr.begin() ; h != i->hdr.end() ; ++h )
+		{
+			if ( IsIfMatch( *h ) )
+				os << " gd:etag='" << xml::Escape( h->substr( if_match.size() ) ) << "'" ;
+		}
+		os	<< ">"
+			<< "<batch:id>" << (i - begin + 1) << "</batch:id>"
+			<< "<batch:operation type='delete'/>"
+			<< "<id>" << xml::Escape( i->url ) << "</id>"
+			<< "</entry>" ;
+	}
+	os << "</feed>" ;
+	
+	return os.str() ;
+}
+
+/// Give the status of each operation in the batch response feed back to the
+/// request with its batch:id.
+/// \return	the number of requests that got a response
+std::size_t BatchAgent::Decode( const std::string& body, iterator begin, iterator end )
+{
+	const std::size_t size = end - begin ;
+	std::size_t count = 0 ;
+	
+	// the entries refer to the tree, so it must be kept
+	xml::Node root			= xml::TreeBuilder::Parse( body ) ;
+	xml::NodeSet entries	= root["entry"] ;
+	for ( xml::NodeSet::iterator e = entries.begin() ; e != entries.end() ; ++e )
+	{
+		std::string id		= (*e)["batch:id"] ;
+		std::string code	= (*e)["batch:status"]["@code"] ;
+		
+		std::size_t i = std::strtoul( id.c_str(), 0, 10 ) ;
+		long response = std::strtol( code.c_str(), 0, 10 ) ;
+		if ( i == 0 || i > size || response == 0 || begin[i-1].response != 0 )
+			continue ;
+		
+		Request& req = begin[i-1] ;
+		req.response = response ;
+		if ( response >= 400 )
+			req.error = (*e)["batch:status"]["@reason"] ;
+		count++ ;
+	}
+	return count ;
+}
+
+} } // end of namespace
@@ -0,0 +1,110 @@
+/*
+	grive: an GPL program to sync a local directory with Google Drive
+	Copyright (C) 2012  Wan Wai Ho
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation version 2
+	of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#pragma once
+
+#include "Agent.hh"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace gr { namespace http {
+
+/*!	\brief	agent to send the DELETE requests of Perform() in batches
+
+	The DELETE requests of the entries in a feed that are given to Perform()
+	together are sent in one POST to the batch URL of the feed, up to a
+	number of them at a time. The body is an Atom feed with a "delete" batch
+	operation for each entry, and the etag in "If-Match" is given as the
+	gd:etag of the entry. The server answers with a feed that has the status
+	of each operation, which is given back to the request with the same
+	batch:id. The headers that are the same for all of them, e.g. the
+	authorization header, are sent with the POST.
+	
+	If the whole batch fails, all of its requests get the same response, so
+	AuthAgent sends them again as usual. The ones missing in the response
+	are sent one by one. The other requests and functions are passed to the
+	real agent as they are.
+*/
+class BatchAgent : public Agent
+{
+public :
+	typedef std::vector<Request>::iterator			iterator ;
+	typedef std::vector<Request>::const_iterator	const_iterator ;
+	
+public :
+	BatchAgent(
+		std::auto_ptr<Agent>	real_agent,
+		const std::string&		feed,
+		std::size_t				max_ops ) ;
+	
+	long Put(
+		const std::string&	url,
+		const std::string&	data,
+		DataStream			*dest,
+		const Header&		hdr ) ;
+	
+	long Put(
+		const std::string&	url,
+		File				*file,
+		DataStream			*dest,
+		const Header&		hdr ) ;
+
+	long Get(
+		const std::string& 	url,
+		DataStream			*dest,
+		const Header&		hdr ) ;
+	
+	long Post(
+		const std::string& 	url,
+		const std::string&	data,
+		DataStream			*dest,
+		const Header&		hdr ) ;
+	
+	long Custom(
+		const std::string&	method,
+		const std::string&	url,
+		DataStream			*dest,
+		const Header&		hdr ) ;
+	
+	std::string RedirLocation() const ;
+	std::string ResponseHeader( const std::string& name ) const ;
+	std::string ErrorResponse() const ;
+	
+	void Perform( std::vector<Request>& reqs ) ;
+	
+	std::string Escape( const std::string& str ) ;
+	std::string Unescape( const std::string& str ) ;
+	
+	static Header CommonHeader( const_iterator begin, const_iterator end ) ;
+	static std::string Encode( const_iterator begin, const_iterator end ) ;
+	static std::size_t Decode( const std::string& body, iterator begin, iterator end ) ;
+
+private :
+	bool IsBatchable( const Request& req ) const ;
+	void PerformBatch( iterator begin, iterator end ) ;
+
+private :
+	const std::auto_ptr<Agent>	m_agent ;
+	const std::string			m_feed ;
+	const std::size_t			m_max_ops ;
+} ;
+
+} } // end of namespace
@@ -0,0 +1,367 @@
+/*
+	grive: an GPL program to sync a local directory with Google Drive
+	Copyright (C) 2012  Wan Wai Ho
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation version 2
+	of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "CacheAgent.hh"
+
+#include "Header.hh"
+
+#include "util/Crypt.hh"
+#include "util/DataStream.hh"
+#include "util/File.hh"
+#include "util/OS.hh"
+#include "util/log/Log.hh"
+
+#include <boost/algorithm/string/predicate.hpp>
+
+#include <cassert>
+#include <ctime>
+#include <fstream>
+#include <iterator>
+
+namespace gr { namespace http {
+
+namespace
+{
+	// the files not used for this long are deleted
+	const std::time_t max_age = 7 * 24 * 3600 ;
+}
+
+/// Passes the body of a response to the request, and keeps a copy of it if
+/// it is not too large.
+class CacheAgent::Tee : public DataStream
+{
+public :
+	Tee( ) : m_dest( 0 ), m_max_size( 0 ), m_overflow( false )
+	{
+	}
+	
+	void Reset( DataStream *dest, std::size_t max_size )
+	{
+		m_dest		= dest ;
+		m_max_size	= max_size ;
+		m_overflow	= false ;
+		m_body.clear() ;
+	}
+	
+	std::size_t Write( const char *data, std::size_t size )
+	{
+		if ( !m_overflow && m_body.size() + size <= m_max_size )
+			m_body.append( data, size ) ;
+		else
+		{
+			m_overflow = true ;
+			m_body.clear() ;
+		}
+		return m_dest != 0 ? m_dest->Write( data, size ) : size ;
+	}
+	
+	std::size_t Read( char *, std::size_t )
+	{
+		return 0 ;
+	}
+	
+	/// The whole body, or null if it was too large to keep.
+	const std::string* Body( ) const
+	{
+		return m_overflow ? 0 : &m_body ;
+	}
+	
+private :
+	DataStream	*m_dest ;
+	std::size_t	m_max_size ;
+	bool		m_overflow ;
+	std::string	m_body ;
+} ;
+
+CacheAgent::CacheAgent(
+	std::auto_ptr<Agent>	real_agent,
+	const fs::path&			dir,
+	const std::string&		prefix,
+	std::size_t				max_size ) :
+	m_agent		( real_agent ),
+	m_dir		( dir ),
+	m_prefix	( prefix ),
+	m_max_size	( max_size ),
+	m_hits		( 0 )
+{
+	assert( m_agent.get() != 0 ) ;
+}
+
+CacheAgent::~CacheAgent( )
+{
+	if ( m_hits > 0 )
+		Log( "%1% responses are not modified and read from the cache", m_hits, log::verbose ) ;
+	
+	Prune( ) ;
+}
+
+long CacheAgent::Put(
+	const std::string&	url,
+	const std::string&	data,
+	DataStream			*dest,
+	const Header&		hdr )
+{
+	return m_agent->Put( url, data, dest, hdr ) ;
+}
+
+long CacheAgent::Put(
+	const std::string&	url,
+	File				*file,
+	DataStream			*dest,
+	const Header&		hdr )
+{
+	return m_agent->Put( url, file, dest, hdr ) ;
+}
+
+long CacheAgent::Get(
+	const std::string& 	url,
+	DataStream			*dest,
+	const Header&		hdr )
+{
+	if ( !IsCacheable( url, hdr ) )
+		return m_agent->Get( url, dest, hdr ) ;
+	
+	std::string etag, body ;
+	bool cached = Load( url, etag, body ) ;
+	
+	Tee tee ;
+	tee.Reset( dest, m_max_size ) ;
+	long response = m_agent->Get( url, &tee, cached ? hdr + ( "If-None-Match: " + etag ) : hdr ) ;
+	
+	return Done( url, response, m_agent->ResponseHeader( "ETag" ), tee, body, dest ) ;
+}
+
+long CacheAgent::Post(
+	const std::string& 	url,
+	const std::string&	data,
+	DataStream			*dest,
+	const Header&		hdr )
+{
+	return m_agent->Post( url, data, dest, hdr ) ;
+}
+
+long CacheAgent::Custom(
+	const std::string&	method,
+	const std::string&	url,
+	DataStream			*dest,
+	const Header&		hdr )
+{
+	return m_agent->Custom( method, url, dest, hdr ) ;
+}
+
+std::string CacheAgent::RedirLocation() const
+{
+	return m_agent->RedirLocation() ;
+}
+
+std::string CacheAgent::ResponseHeader( const std::string& name ) const
+{
+	return m_agent->ResponseHeader( name ) ;
+}
+
+std::string CacheAgent::ErrorResponse() const
+{
+	return m_agent->ErrorResponse() ;
+}
+
+std::string CacheAgent::Escape( const std::string& str )
+{
+	return m_agent->Escape( str ) ;
+}
+
+std::string CacheAgent::Unescape( const std::string& str )
+{
+	return m_agent->Unescape( str ) ;
+}
+
+/// The cacheable GET requests are sent with "If-None-Match" together with
+/// the other requests, and the ones not modified are answered from the cache
+/// afterwards.
+void CacheAgent::Perform( std::vector<Request>& reqs )
+{
+	std::vector<Tee> tees( reqs.size() ) ;
+	std::vector<std::string> bodies( reqs.size() ) ;
+	std::vector<DataStream*> dests( reqs.size() ) ;
+	std::vector<bool> cacheable( reqs.size() ) ;
+	
+	for ( std::size_t i = 0 ; i < reqs.size() ; i++ )
+	{
+		Request& req = reqs[i] ;
+		cacheable[i] = ( req.method == "GET" && IsCacheable( req.url, req.hdr ) ) ;
+		if ( !cacheable[i] )
+			continue ;
+		
+		std::string etag ;
+		if ( Load( req.url, etag, bodies[i] ) )
+			req.hdr = req.hdr + ( "If-None-Match: " + etag ) ;
+		
+		dests[i]	= req.dest ;
+		tees[i].Reset( req.dest, m_max_size ) ;
+		req.dest	= &tees[i] ;
+	}
+	
+	try
+	{
+		m_agent->Perform( reqs ) ;
+	}
+	catch ( ... )
+	{
+		for ( std::size_t i = 0 ; i < reqs.size() ; i++ )
+		{
+			if ( cacheable[i] )
+				reqs[i].dest = dests[i] ;
+		}
+		throw ;
+	}
+	
+	for ( std::size_t i = 0 ; i < reqs.size() ; i++ )
+	{
+		if ( cacheable[i] )
+		{
+			Request& req = reqs[i] ;
+			req.dest		= dests[i] ;
+			req.response	= Done( req.url, req.response, req.ResponseHeader( "ETag" ),
+				tees[i], bodies[i], req.dest ) ;
+		}
+	}
+}
+
+std::size_t CacheAgent::Hits( ) const
+{
+	return m_hits ;
+}
+
+bool CacheAgent::IsCacheable( const std::string& url, const Header& hdr ) const
+{
+	if ( !boost::algorithm::starts_with( url, m_prefix ) )
+		return false ;
+	
+	for ( Header::iterator i = hdr.begin() ; i != hdr.end() ; ++i )
+	{
+		if ( boost::algorithm::istarts_with( *i, "If-" ) || boost::algorithm::istarts_with( *i, "Range:" ) )
+			return false ;
+	}
+	return true ;
+}
+
+/// The file of a URL in the cache directory, named by the MD5 of the URL.
+fs::path CacheAgent::CacheFile( const std::string& url ) const
+{
+	crypt::MD5 md5 ;
+	md5.Write( url.c_str(), url.size() ) ;
+	return m_dir / md5.Get() ;
+}
+
+/// Read the ETag and the body cached for \a url. The ETag is on the first
+/// line of the file, and the body follows.
+bool CacheAgent::Load( const std::string& url, std::string& etag, std::string& body ) const
+{
+	std::ifstream file( CacheFile( url ).string().c_str(), std::ios::binary ) ;
+	if ( !file || !std::getline( file, etag ) || etag.empty() )
+		return false ;
+	
+	body.assign( std::istreambuf_iterator<char>( file ), std::istreambuf_iterator<char>() ) ;
+	return !file.bad() ;
+}
+
+/// Write the file with a new name first, so that an interrupted write
+/// doesn't leave a truncated body with a valid ETag. The responses hold the
+/// names of the files in the drive, so only the user can read them.
+void CacheAgent::Store( const std::string& url, const std::string& etag, const std::string& body )
+{
+	try
+	{
+		os::MakeDir( m_dir, 0700 ) ;
+		
+		fs::path path = CacheFile( url ) ;
+		fs::path tmp = path.string() + ".tmp" ;
+		{
+			const std::string line = etag + '\n' ;
+			File file( tmp, 0600 ) ;
+			file.Write( line.c_str(), line.size() ) ;
+			file.Write( body.c_str(), body.size() ) ;
+		}
+		fs::rename( tmp, path ) ;
+	}
+	catch ( Exception& )
+	{
+		Log( "cannot cache %1%", url, log::verbose ) ;
+	}
+	catch ( fs::filesystem_error& e )
+	{
+		Log( "cannot cache %1%: %2%", url, e.what(), log::verbose ) ;
+	}
+}
+
+/// Finish a cacheable GET request. A 304 is answered with the cached body,
+/// and a new body with an ETag is remembered.
+long CacheAgent::Done(
+	const std::string&	url,
+	long				response,
+	const std::string&	etag,
+	const Tee&			tee,
+	const std::string&	body,
+	DataStream			*dest )
+{
+	if ( response == 304 )
+	{
+		Trace( "%1% is not modified", url ) ;
+		if ( dest != 0 )
+			dest->Write( body.c_str(), body.size() ) ;
+		
+		// keep it from being pruned
+		try
+		{
+			fs::last_write_time( CacheFile( url ), std::time( 0 ) ) ;
+		}
+		catch ( fs::filesystem_error& )
+		{
+		}
+		
+		m_hits++ ;
+		return 200 ;
+	}
+	
+	if ( response >= 200 && response < 300 && !etag.empty() && tee.Body() != 0 )
+		Store( url, etag, *tee.Body() ) ;
+	
+	return response ;
+}
+
+void CacheAgent::Prune( )
+{
+	try
+	{
+		if ( !fs::is_directory( m_dir ) )
+			return ;
+		
+		std::time_t now = std::time( 0 ) ;
+		for ( fs::directory_iterator i( m_dir ), end ; i != end ; ++i )
+		{
+			if ( fs::last_write_time( i->path() ) + max_age < now )
+				fs::remove( i->path() ) ;
+		}
+	}
+	catch ( fs::filesystem_error& e )
+	{
+		Log( "cannot clean up %1%: %2%", m_dir, e.what(), log::verbose ) ;
+	}
+}
+
+} } // end of namespace
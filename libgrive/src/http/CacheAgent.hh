@@ -0,0 +1,121 @@
+/*
+	grive: an GPL program to sync a local directory with Google Drive
+	Copyright (C) 2012  Wan Wai Ho
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation version 2
+	of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#pragma once
+
+#include "Agent.hh"
+
+#include "util/FileSystem.hh"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+namespace gr { namespace http {
+
+/*!	\brief	agent to answer GET requests from a cache on disk
+
+	The bodies of the GET responses that come with an ETag are kept in a
+	directory, one file per URL. The next GET of the same URL is sent with
+	"If-None-Match", and when the server answers 304 Not Modified, the body
+	is given to the request from the file instead, as if the server had sent
+	it with 200. So a feed that has not changed is not downloaded again.
+	
+	Only the URLs starting with a prefix, i.e. the feeds, and the responses
+	smaller than a limit are kept, so file contents are never cached. The
+	requests with their own conditions or ranges are passed as they are. The
+	files not used for a week are deleted when the agent is destroyed.
+	
+	Other functions are passed to the real agent as they are.
+*/
+class CacheAgent : public Agent
+{
+public :
+	CacheAgent(
+		std::auto_ptr<Agent>	real_agent,
+		const fs::path&			dir,
+		const std::string&		prefix,
+		std::size_t				max_size ) ;
+	~CacheAgent( ) ;
+	
+	long Put(
+		const std::string&	url,
+		const std::string&	data,
+		DataStream			*dest,
+		const Header&		hdr ) ;
+	
+	long Put(
+		const std::string&	url,
+		File				*file,
+		DataStream			*dest,
+		const Header&		hdr ) ;
+
+	long Get(
+		const std::string& 	url,
+		DataStream			*dest,
+		const Header&		hdr ) ;
+	
+	long Post(
+		const std::string& 	url,
+		const std::string&	data,
+		DataStream			*dest,
+		const Header&		hdr ) ;
+	
+	long Custom(
+		const std::string&	method,
+		const std::string&	url,
+		DataStream			*dest,
+		const Header&		hdr ) ;
+	
+	std::string RedirLocation() const ;
+	std::string ResponseHeader( const std::string& name ) const ;
+	std::string ErrorResponse() const ;
+	
+	void Perform( std::vector<Request>& reqs ) ;
+	
+	std::string Escape( const std::string& str ) ;
+	std::string Unescape( const std::string& str ) ;
+	
+	std::size_t Hits( ) const ;
+
+private :
+	class Tee ;
+	
+	bool IsCacheable( const std::string& url, const Header& hdr ) const ;
+	fs::path CacheFile( const std::string& url ) const ;
+	bool Load( const std::string& url, std::string& etag, std::string& body ) const ;
+	void Store( const std::string& url, const std::string& etag, const std::string& body ) ;
+	long Done(
+		const std::string&	url,
+		long				response,
+		const std::string&	etag,
+		const Tee&			tee,
+		const std::string&	body,
+		DataStream			*dest ) ;
+	void Prune( ) ;
+
+private :
+	const std::auto_ptr<Agent>	m_agent ;
+	const fs::path				m_dir ;
+	const std::string			m_prefix ;
+	const std::size_t			m_max_size ;
+	std::size_t					m_hits ;
+} ;
+
+} } // end of namespace
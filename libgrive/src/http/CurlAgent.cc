@@ -19,6 +19,7 @@
 
 #include "CurlAgent.hh"
 
+#include "CurlPool.hh"
 #include "Error.hh"
 #include "Header.hh"
 
@@ -33,8 +34,12 @@
 
 #include <algorithm>
 #include <cassert>
+#include <cctype>
 #include <cstring>
+#include <iterator>
 #include <limits>
+#include <map>
+#include <vector>
 #include <sstream>
 #include <streambuf>
 #include <iostream>
@@ -77,6 +82,151 @@ std::size_t ReadFileCallback( void *ptr, std::size_t size, std::size_t nmemb, Fi
 	return count ;
 }
 
+std::string ToLower( std::string str )
+{
+	std::transform( str.begin(), str.end(), str.begin(), ::tolower ) ;
+	return str ;
+}
+
+/// Parse a "Name: value" header line into \a headers, keyed by lower case name.
+void ParseHeader( const std::string& line, std::map<std::string, std::string>& headers )
+{
+	std::size_t colon = line.find( ':' ) ;
+	if ( colon != line.npos )
+	{
+		std::size_t begin	= line.find_first_not_of( " \t", colon + 1 ) ;
+		std::size_t end		= line.find_last_not_of( " \t\r\n" ) ;
+		
+		headers[ToLower(line.substr( 0, colon ))] =
+			( begin != line.npos && end != line.npos && end >= begin ) ?
+			line.substr( begin, end - begin + 1 ) : "" ;
+	}
+}
+
+/// Clear the options set by the previous request. Unlike curl_easy_reset(),
+/// the options common to all requests, which are set by CurlPool, are kept.
+void ResetOptions( CURL *curl )
+{
+	::curl_easy_setopt( curl, CURLOPT_CUSTOMREQUEST,	0 ) ;
+	::curl_easy_setopt( curl, CURLOPT_UPLOAD,			0L ) ;
+	::curl_easy_setopt( curl, CURLOPT_READFUNCTION,		0 ) ;
+	::curl_easy_setopt( curl, CURLOPT_READDATA,			0 ) ;
+	::curl_easy_setopt( curl, CURLOPT_INFILESIZE_LARGE,	static_cast<curl_off_t>(-1) ) ;
+	::curl_easy_setopt( curl, CURLOPT_POSTFIELDS,		0 ) ;
+	::curl_easy_setopt( curl, CURLOPT_POSTFIELDSIZE,	-1L ) ;
+	
+	// must be the last one: setting CURLOPT_POSTFIELDS implies POST
+	::curl_easy_setopt( curl, CURLOPT_HTTPGET,			1L ) ;
+}
+
+/// One request of CurlAgent::Perform(), running on its own handle.
+struct Transfer
+{
+	Request				*req ;
+	CURL				*curl ;
+	CURLcode			result ;
+	struct curl_slist	*hdr_list ;
+	std::string			put_data ;
+	char				error[CURL_ERROR_SIZE] ;
+} ;
+
+std::size_t TransferHeader( void *ptr, std::size_t size, std::size_t nmemb, Transfer *xfer )
+{
+	assert( xfer != 0 ) ;
+	
+	char *str = static_cast<char*>(ptr) ;
+	ParseHeader( std::string( str, str + size*nmemb ), xfer->req->headers ) ;
+	return size*nmemb ;
+}
+
+std::size_t TransferReceive( void *ptr, std::size_t size, std::size_t nmemb, Transfer *xfer )
+{
+	assert( xfer != 0 ) ;
+	assert( xfer->req->dest != 0 ) ;
+	
+	long http_code = 0 ;
+	::curl_easy_getinfo( xfer->curl, CURLINFO_RESPONSE_CODE, &http_code ) ;
+	if ( http_code >= 400 )
+	{
+		xfer->req->error.append( static_cast<char*>(ptr), size * nmemb ) ;
+		return size * nmemb ;
+	}
+	
+	return xfer->req->dest->Write( static_cast<char*>(ptr), size * nmemb ) ;
+}
+
+/// Set up \a xfer for \a req on a handle from CurlPool, and give it to the
+/// multi handle.
+void StartTransfer( CURLM *multi, Request& req, Transfer& xfer )
+{
+	assert( req.dest != 0 ) ;
+	
+	Trace( "HTTP %1% \"%2%\" (multiplexed)", req.method, req.url ) ;
+	
+	req.response	= 0 ;
+	req.error.clear() ;
+	req.headers.clear() ;
+	
+	xfer.req		= &req ;
+	xfer.curl		= CurlPool::Inst().Acquire() ;
+	xfer.result		= CURLE_OK ;
+	xfer.hdr_list	= 0 ;
+	xfer.put_data	= req.data ;
+	xfer.error[0]	= '\0' ;
+	
+	CURL *curl = xfer.curl ;
+	ResetOptions( curl ) ;
+	
+	if ( req.method == "POST" )
+	{
+		::curl_easy_setopt( curl, CURLOPT_POST,				1L ) ;
+		::curl_easy_setopt( curl, CURLOPT_POSTFIELDS,		req.data.c_str() ) ;
+		::curl_easy_setopt( curl, CURLOPT_POSTFIELDSIZE,	static_cast<long>(req.data.size()) ) ;
+	}
+	else if ( req.method == "PUT" )
+	{
+		::curl_easy_setopt( curl, CURLOPT_UPLOAD,			1L ) ;
+		::curl_easy_setopt( curl, CURLOPT_READFUNCTION,		&ReadStringCallback ) ;
+		::curl_easy_setopt( curl, CURLOPT_READDATA,			&xfer.put_data ) ;
+		::curl_easy_setopt( curl, CURLOPT_INFILESIZE_LARGE,	static_cast<curl_off_t>(req.data.size()) ) ;
+	}
+	else if ( req.method != "GET" )
+		::curl_easy_setopt( curl, CURLOPT_CUSTOMREQUEST,	req.method.c_str() ) ;
+	
+	for ( Header::iterator h = req.hdr.begin() ; h != req.hdr.end() ; ++h )
+		xfer.hdr_list = ::curl_slist_append( xfer.hdr_list, h->c_str() ) ;
+	
+	::curl_easy_setopt( curl, CURLOPT_URL,				req.url.c_str() ) ;
+	::curl_easy_setopt( curl, CURLOPT_HTTPHEADER,		xfer.hdr_list ) ;
+	::curl_easy_setopt( curl, CURLOPT_ERRORBUFFER,		xfer.error ) ;
+	::curl_easy_setopt( curl, CURLOPT_WRITEFUNCTION,	&TransferReceive ) ;
+	::curl_easy_setopt( curl, CURLOPT_WRITEDATA,		&xfer ) ;
+	::curl_easy_setopt( curl, CURLOPT_HEADERFUNCTION,	&TransferHeader ) ;
+	::curl_easy_setopt( curl, CURLOPT_WRITEHEADER,		&xfer ) ;
+	::curl_easy_setopt( curl, CURLOPT_PRIVATE,			&xfer ) ;
+	
+	::curl_multi_add_handle( multi, curl ) ;
+}
+
+/// Take the response of \a xfer and give its handle back to CurlPool.
+void FinishTransfer( CURLM *multi, Transfer& xfer )
+{
+	CurlPool& pool = CurlPool::Inst() ;
+	
+	::curl_easy_getinfo( xfer.curl, CURLINFO_RESPONSE_CODE, &xfer.req->response ) ;
+	Trace( "HTTP response %1% for \"%2%\"", xfer.req->response, xfer.req->url ) ;
+	pool.Record( xfer.curl ) ;
+	
+	::curl_multi_remove_handle( multi, xfer.curl ) ;
+	::curl_easy_setopt( xfer.curl, CURLOPT_ERRORBUFFER,	0 ) ;
+	::curl_easy_setopt( xfer.curl, CURLOPT_PRIVATE,		0 ) ;
+	pool.Release( xfer.curl ) ;
+	::curl_slist_free_all( xfer.hdr_list ) ;
+	
+	xfer.curl		= 0 ;
+	xfer.hdr_list	= 0 ;
+}
+
 } // end of local namespace
 
 namespace gr { namespace http {
@@ -85,27 +235,42 @@ struct CurlAgent::Impl
 {
 	CURL			*curl ;
 	std::string		location ;
+	
+	// response headers of the last request, keyed by lower case name
+	std::map<std::string, std::string>	headers ;
+	
+	DataStream		*dest ;
+	std::string		error ;
+	
+	// the header list of the last request, reused if the headers are the same
+	struct curl_slist			*hdr_list ;
+	std::vector<std::string>	hdr_lines ;
 } ;
 
 CurlAgent::CurlAgent() :
 	m_pimpl( new Impl )
 {
-	m_pimpl->curl = ::curl_easy_init();
+	m_pimpl->curl		= CurlPool::Inst().Acquire() ;
+	m_pimpl->dest		= 0 ;
+	m_pimpl->hdr_list	= 0 ;
+	
+	::curl_easy_setopt( m_pimpl->curl, CURLOPT_HEADERFUNCTION,	&CurlAgent::HeaderCallback ) ;
+	::curl_easy_setopt( m_pimpl->curl, CURLOPT_WRITEHEADER ,	this ) ;
 }
 
 void CurlAgent::Init()
 {
-	::curl_easy_reset( m_pimpl->curl ) ;
-	::curl_easy_setopt( m_pimpl->curl, CURLOPT_SSL_VERIFYPEER,	0L ) ; 
-	::curl_easy_setopt( m_pimpl->curl, CURLOPT_SSL_VERIFYHOST,	0L ) ;
-	::curl_easy_setopt( m_pimpl->curl, CURLOPT_HEADERFUNCTION,	&CurlAgent::HeaderCallback ) ;
-	::curl_easy_setopt( m_pimpl->curl, CURLOPT_WRITEHEADER ,	this ) ;
-	::curl_easy_setopt( m_pimpl->curl, CURLOPT_HEADER, 			0L ) ;
+	m_pimpl->location.clear() ;
+	m_pimpl->headers.clear() ;
+	m_pimpl->error.clear() ;
+	
+	ResetOptions( m_pimpl->curl ) ;
 }
 
 CurlAgent::~CurlAgent()
 {
-	::curl_easy_cleanup( m_pimpl->curl );
+	CurlPool::Inst().Release( m_pimpl->curl ) ;
+	::curl_slist_free_all( m_pimpl->hdr_list ) ;
 }
 
 std::size_t CurlAgent::HeaderCallback( void *ptr, size_t size, size_t nmemb, CurlAgent *pthis )
@@ -121,13 +286,27 @@ std::size_t CurlAgent::HeaderCallback( void *ptr, size_t size, size_t nmemb, Cur
 		pthis->m_pimpl->location = line.substr( loc.size(), end_pos - loc.size() ) ;
 	}
 	
+	// remember all headers for ResponseHeader()
+	ParseHeader( line, pthis->m_pimpl->headers ) ;
+	
 	return size*nmemb ;
 }
 
-std::size_t CurlAgent::Receive( void* ptr, size_t size, size_t nmemb, DataStream *recv )
+std::size_t CurlAgent::Receive( void* ptr, size_t size, size_t nmemb, CurlAgent *pthis )
 {
-	assert( recv != 0 ) ;
-	return recv->Write( static_cast<char*>(ptr), size * nmemb ) ;
+	assert( pthis != 0 ) ;
+	assert( pthis->m_pimpl->dest != 0 ) ;
+	
+	// keep the body of HTTP errors away from the destination stream
+	long http_code = 0 ;
+	::curl_easy_getinfo( pthis->m_pimpl->curl, CURLINFO_RESPONSE_CODE, &http_code ) ;
+	if ( http_code >= 400 )
+	{
+		pthis->m_pimpl->error.append( static_cast<char*>(ptr), size * nmemb ) ;
+		return size * nmemb ;
+	}
+	
+	return pthis->m_pimpl->dest->Write( static_cast<char*>(ptr), size * nmemb ) ;
 }
 
 long CurlAgent::ExecCurl(
@@ -142,12 +321,14 @@ long CurlAgent::ExecCurl(
 	::curl_easy_setopt(curl, CURLOPT_ERRORBUFFER, 	error ) ;
 	::curl_easy_setopt(curl, CURLOPT_URL, 			url.c_str());
 	::curl_easy_setopt(curl, CURLOPT_WRITEFUNCTION,	&CurlAgent::Receive ) ;
-	::curl_easy_setopt(curl, CURLOPT_WRITEDATA,		dest ) ;
+	::curl_easy_setopt(curl, CURLOPT_WRITEDATA,		this ) ;
+	m_pimpl->dest = dest ;
 
 	SetHeader( hdr ) ;
 
 //	dest->Clear() ;
 	CURLcode curl_code = ::curl_easy_perform(curl);
+	CurlPool::Inst().Record( curl ) ;
 
 	// get the HTTP response code
 	long http_code = 0;
@@ -207,6 +388,9 @@ long CurlAgent::Put(
 	Init() ;
 	CURL *curl = m_pimpl->curl ;
 
+	// the file may have been read by a previous try of the same request
+	file->Seek( 0, SEEK_SET ) ;
+
 	// set common options
 	::curl_easy_setopt(curl, CURLOPT_UPLOAD,			1L ) ;
 	::curl_easy_setopt(curl, CURLOPT_READFUNCTION,		&ReadFileCallback ) ;
@@ -260,6 +444,7 @@ long CurlAgent::Custom(
 {
 	Trace("HTTP %2% \"%1%\"", url, method ) ;
 
+	Init() ;
 	CURL *curl = m_pimpl->curl ;
 
 	::curl_easy_setopt(curl, CURLOPT_CUSTOMREQUEST, method.c_str() );
@@ -268,14 +453,110 @@ long CurlAgent::Custom(
 	return ExecCurl( url, dest, hdr ) ;
 }
 
+/// Run the requests at the same time through the multi handle of CurlPool,
+/// multiplexed over one connection, up to CurlPool::MaxStreams() of them at
+/// a time. Without HTTP/2 they are sent one by one
+/// as usual, because HTTP/1.1 would need a connection for each of them.
+void CurlAgent::Perform( std::vector<Request>& reqs )
+{
+	CurlPool& pool = CurlPool::Inst() ;
+	if ( !pool.IsHttp2() || reqs.size() < 2 )
+	{
+		Agent::Perform( reqs ) ;
+		return ;
+	}
+	
+	CURLM *multi = pool.Multi() ;
+	
+	// the transfers must not move after they are given to libcurl. Only as
+	// many as the streams of the connection run at a time, so thousands of
+	// requests don't take thousands of handles, and the handle of a finished
+	// one is reused for the next.
+	std::vector<Transfer> xfers( reqs.size() ) ;
+	std::size_t next = 0, active = 0 ;
+	for ( ; next < reqs.size() && active < pool.MaxStreams() ; next++, active++ )
+		StartTransfer( multi, reqs[next], xfers[next] ) ;
+	
+	int running = 0 ;
+	CURLMcode multi_code = CURLM_OK ;
+	while ( multi_code == CURLM_OK && active > 0 )
+	{
+		multi_code = ::curl_multi_perform( multi, &running ) ;
+		
+		int left = 0 ;
+		while ( CURLMsg *msg = ::curl_multi_info_read( multi, &left ) )
+		{
+			if ( msg->msg != CURLMSG_DONE )
+				continue ;
+			
+			void *done = 0 ;
+			::curl_easy_getinfo( msg->easy_handle, CURLINFO_PRIVATE, &done ) ;
+			Transfer *xfer = static_cast<Transfer*>(done) ;
+			xfer->result = msg->data.result ;
+			FinishTransfer( multi, *xfer ) ;
+			active-- ;
+			
+			if ( next < reqs.size() )
+			{
+				StartTransfer( multi, reqs[next], xfers[next] ) ;
+				next++ ;
+				active++ ;
+			}
+		}
+		
+		if ( multi_code == CURLM_OK && running > 0 )
+			multi_code = ::curl_multi_wait( multi, 0, 0, 1000, 0 ) ;
+	}
+	
+	// the ones left running by a libcurl error
+	const Transfer *failed = 0 ;
+	for ( std::vector<Transfer>::iterator i = xfers.begin() ; i != xfers.end() ; ++i )
+	{
+		if ( i->curl != 0 )
+			FinishTransfer( multi, *i ) ;
+		if ( i->req != 0 && i->result != CURLE_OK && failed == 0 )
+			failed = &*i ;
+	}
+	
+	// as in ExecCurl(), only throw for libcurl errors
+	if ( multi_code != CURLM_OK )
+	{
+		BOOST_THROW_EXCEPTION(
+			Error()
+				<< CurlCode( multi_code )
+				<< CurlErrMsg( ::curl_multi_strerror( multi_code ) )
+		) ;
+	}
+	if ( failed != 0 )
+	{
+		BOOST_THROW_EXCEPTION(
+			Error()
+				<< CurlCode( failed->result )
+				<< Url( failed->req->url )
+				<< CurlErrMsg( failed->error )
+				<< HttpHeader( failed->req->hdr )
+		) ;
+	}
+}
+
 void CurlAgent::SetHeader( const Header& hdr )
 {
-	// set headers
-	struct curl_slist *curl_hdr = 0 ;
-    for ( Header::iterator i = hdr.begin() ; i != hdr.end() ; ++i )
-		curl_hdr = curl_slist_append( curl_hdr, i->c_str() ) ;
+	// most requests have the same headers as the previous one, e.g. only
+	// the authorization header. no need to build the list again.
+	std::vector<std::string>& lines = m_pimpl->hdr_lines ;
+	if ( m_pimpl->hdr_list == 0 ||
+		static_cast<std::size_t>(std::distance( hdr.begin(), hdr.end() )) != lines.size() ||
+		!std::equal( hdr.begin(), hdr.end(), lines.begin() ) )
+	{
+		::curl_slist_free_all( m_pimpl->hdr_list ) ;
+		m_pimpl->hdr_list = 0 ;
+		lines.assign( hdr.begin(), hdr.end() ) ;
+		
+		for ( Header::iterator i = hdr.begin() ; i != hdr.end() ; ++i )
+			m_pimpl->hdr_list = curl_slist_append( m_pimpl->hdr_list, i->c_str() ) ;
+	}
 	
-	::curl_easy_setopt( m_pimpl->curl, CURLOPT_HTTPHEADER, curl_hdr ) ;
+	::curl_easy_setopt( m_pimpl->curl, CURLOPT_HTTPHEADER, m_pimpl->hdr_list ) ;
 }
 
 std::string CurlAgent::RedirLocation() const
@@ -283,6 +564,17 @@ std::string CurlAgent::RedirLocation() const
 	return m_pimpl->location ;
 }
 
+std::string CurlAgent::ResponseHeader( const std::string& name ) const
+{
+	std::map<std::string, std::string>::const_iterator i = m_pimpl->headers.find( ToLower(name) ) ;
+	return i != m_pimpl->headers.end() ? i->second : "" ;
+}
+
+std::string CurlAgent::ErrorResponse() const
+{
+	return m_pimpl->error ;
+}
+
 std::string CurlAgent::Escape( const std::string& str )
 {
 	CURL *curl = m_pimpl->curl ;
@@ -71,13 +71,17 @@ public :
 		const Header&		hdr ) ;
 	
 	std::string RedirLocation() const ;
+	std::string ResponseHeader( const std::string& name ) const ;
+	std::string ErrorResponse() const ;
+	
+	void Perform( std::vector<Request>& reqs ) ;
 	
 	std::string Escape( const std::string& str ) ;
 	std::string Unescape( const std::string& str ) ;
 
 private :
 	static std::size_t HeaderCallback( void *ptr, size_t size, size_t nmemb, CurlAgent *pthis ) ;
-	static std::size_t Receive( void* ptr, size_t size, size_t nmemb, DataStream *recv ) ;
+	static std::size_t Receive( void* ptr, size_t size, size_t nmemb, CurlAgent *pthis ) ;
 	
 	void SetHeader( const Header& hdr ) ;
 	long ExecCurl(
@@ -0,0 +1,249 @@
+/*
+	grive: an GPL program to sync a local directory with Google Drive
+	Copyright (C) 2012  Wan Wai Ho
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation version 2
+	of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#include "CurlPool.hh"
+
+#include "Request.hh"
+
+#include "util/Stats.hh"
+#include "util/log/Log.hh"
+
+#include <boost/bind.hpp>
+
+#include <algorithm>
+#include <cassert>
+
+namespace gr { namespace http {
+
+CurlPool& CurlPool::Inst()
+{
+	static CurlPool pool ;
+	return pool ;
+}
+
+CurlPool::CurlPool() :
+	m_share		( ::curl_share_init() ),
+	m_multi		( 0 ),
+	m_streams	( 0 )
+{
+	m_stats.requests	= 0 ;
+	m_stats.connects	= 0 ;
+	m_stats.setup_time	= 0 ;
+	
+	::curl_share_setopt( m_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_DNS ) ;
+	::curl_share_setopt( m_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_SSL_SESSION ) ;
+#if LIBCURL_VERSION_NUM >= 0x073900
+	::curl_share_setopt( m_share, CURLSHOPT_SHARE, CURL_LOCK_DATA_CONNECT ) ;
+#endif
+}
+
+CurlPool::~CurlPool()
+{
+	std::for_each( m_free.begin(), m_free.end(), &::curl_easy_cleanup ) ;
+	if ( m_multi != 0 )
+		::curl_multi_cleanup( m_multi ) ;
+	::curl_share_cleanup( m_share ) ;
+}
+
+/// Get a handle from the pool, or create a new one if the pool is empty. The
+/// options common to all requests are already set.
+CURL* CurlPool::Acquire()
+{
+	if ( !m_free.empty() )
+	{
+		CURL *curl = m_free.back() ;
+		m_free.pop_back() ;
+		return curl ;
+	}
+	
+	CURL *curl = ::curl_easy_init() ;
+	::curl_easy_setopt( curl, CURLOPT_SHARE,			m_share ) ;
+	::curl_easy_setopt( curl, CURLOPT_SSL_VERIFYPEER,	0L ) ;
+	::curl_easy_setopt( curl, CURLOPT_SSL_VERIFYHOST,	0L ) ;
+	::curl_easy_setopt( curl, CURLOPT_HEADER,			0L ) ;
+#if LIBCURL_VERSION_NUM >= 0x071900
+	::curl_easy_setopt( curl, CURLOPT_TCP_KEEPALIVE,	1L ) ;
+#endif
+	SetHttpVersion( curl ) ;
+	return curl ;
+}
+
+/// Give the handle back to the pool. The caller must not use it afterwards.
+void CurlPool::Release( CURL *curl )
+{
+	assert( curl != 0 ) ;
+	assert( std::find( m_free.begin(), m_free.end(), curl ) == m_free.end() ) ;
+	
+	// don't leave pointers to the previous owner in the handle
+	::curl_easy_setopt( curl, CURLOPT_HEADERFUNCTION,	0 ) ;
+	::curl_easy_setopt( curl, CURLOPT_WRITEHEADER,		0 ) ;
+	::curl_easy_setopt( curl, CURLOPT_WRITEFUNCTION,	0 ) ;
+	::curl_easy_setopt( curl, CURLOPT_WRITEDATA,		0 ) ;
+	::curl_easy_setopt( curl, CURLOPT_READFUNCTION,		0 ) ;
+	::curl_easy_setopt( curl, CURLOPT_READDATA,			0 ) ;
+	::curl_easy_setopt( curl, CURLOPT_HTTPHEADER,		0 ) ;
+	
+	m_free.push_back( curl ) ;
+}
+
+/// Collect the connection statistics of a finished transfer. The times of
+/// each phase are added to the histograms of its kind of endpoint: the time
+/// the server takes to answer ("wait", from sending the request to the first
+/// byte of the response) is kept apart from the time to connect, so a slow
+/// server can be told from a slow network or a slow client.
+void CurlPool::Record( CURL *curl )
+{
+	long	connects	= 0 ;
+	double	namelookup	= 0 ;
+	double	connect		= 0 ;
+	double	appconnect	= 0 ;
+	double	pretransfer	= 0 ;
+	double	start		= 0 ;
+	double	total		= 0 ;
+	double	down		= 0 ;
+	double	up			= 0 ;
+	char	*url		= 0 ;
+	::curl_easy_getinfo( curl, CURLINFO_NUM_CONNECTS,		&connects ) ;
+	::curl_easy_getinfo( curl, CURLINFO_NAMELOOKUP_TIME,	&namelookup ) ;
+	::curl_easy_getinfo( curl, CURLINFO_CONNECT_TIME,		&connect ) ;
+	::curl_easy_getinfo( curl, CURLINFO_APPCONNECT_TIME,	&appconnect ) ;
+	::curl_easy_getinfo( curl, CURLINFO_PRETRANSFER_TIME,	&pretransfer ) ;
+	::curl_easy_getinfo( curl, CURLINFO_STARTTRANSFER_TIME,	&start ) ;
+	::curl_easy_getinfo( curl, CURLINFO_TOTAL_TIME,			&total ) ;
+	::curl_easy_getinfo( curl, CURLINFO_SIZE_DOWNLOAD,		&down ) ;
+	::curl_easy_getinfo( curl, CURLINFO_SIZE_UPLOAD,		&up ) ;
+	::curl_easy_getinfo( curl, CURLINFO_EFFECTIVE_URL,		&url ) ;
+	
+	m_stats.requests++ ;
+	m_stats.connects	+= connects ;
+	m_stats.setup_time	+= pretransfer ;
+	
+	const std::string kind = "http." +
+		Request::Endpoint( url != 0 ? url : "", up > 0 ) ;
+	
+	gr::Stats& stats = gr::Stats::Inst() ;
+	stats.AddTime( "http.request", total ) ;
+	stats.Add( "http.bytes_down", 0, static_cast<u64_t>( down ) ) ;
+	stats.Add( "http.bytes_up", 0, static_cast<u64_t>( up ) ) ;
+	stats.Add( kind, 1, static_cast<u64_t>( down + up ) ) ;
+	
+	// DNS, TCP and TLS only for new connections. They are the same for all
+	// endpoints, which share the connections.
+	if ( connects > 0 )
+	{
+		stats.AddTime( "http.connect", pretransfer ) ;
+		stats.AddSample( "http.dns", namelookup ) ;
+		stats.AddSample( "http.tcp", connect - namelookup ) ;
+		if ( appconnect > 0 )
+			stats.AddSample( "http.tls", appconnect - connect ) ;
+	}
+	else
+		stats.Add( "http.reused" ) ;
+	
+	if ( start > 0 )
+	{
+		stats.AddSample( kind + ".wait",		start - pretransfer ) ;
+		stats.AddSample( kind + ".transfer",	total - start ) ;
+	}
+	stats.AddSample( kind + ".total", total ) ;
+	
+	Trace( "HTTP connection %1%, setup time %2%s",
+		connects > 0 ? "created" : "reused", pretransfer ) ;
+}
+
+const CurlPool::Stats& CurlPool::GetStats() const
+{
+	return m_stats ;
+}
+
+/// Use HTTP/2 for the following requests if the server supports it, and
+/// allow up to \a max_streams requests in Multi() on one connection.
+/// \return	false if libcurl is too old for HTTP/2 multiplexing
+bool CurlPool::EnableHttp2( unsigned max_streams )
+{
+	assert( max_streams > 0 ) ;
+
+#if LIBCURL_VERSION_NUM >= 0x072f00
+	if ( !(::curl_version_info( CURLVERSION_NOW )->features & CURL_VERSION_HTTP2) )
+		return false ;
+	
+	m_streams = max_streams ;
+	std::for_each( m_free.begin(), m_free.end(),
+		boost::bind( &CurlPool::SetHttpVersion, this, _1 ) ) ;
+	
+	if ( m_multi != 0 )
+	{
+		::curl_multi_cleanup( m_multi ) ;
+		m_multi = 0 ;
+	}
+	return true ;
+#else
+	return false ;
+#endif
+}
+
+bool CurlPool::IsHttp2() const
+{
+	return m_streams > 0 ;
+}
+
+unsigned CurlPool::MaxStreams() const
+{
+	return m_streams ;
+}
+
+/// The multi handle for running requests at the same time. Its transfers
+/// share one connection per host when HTTP/2 is enabled.
+CURLM* CurlPool::Multi()
+{
+	if ( m_multi == 0 )
+	{
+		m_multi = ::curl_multi_init() ;
+
+#if LIBCURL_VERSION_NUM >= 0x072f00
+		if ( m_streams > 0 )
+		{
+			::curl_multi_setopt( m_multi, CURLMOPT_PIPELINING,			CURLPIPE_MULTIPLEX ) ;
+			::curl_multi_setopt( m_multi, CURLMOPT_MAX_HOST_CONNECTIONS,	1L ) ;
+#if LIBCURL_VERSION_NUM >= 0x074300
+			::curl_multi_setopt( m_multi, CURLMOPT_MAX_CONCURRENT_STREAMS,
+				static_cast<long>( m_streams ) ) ;
+#endif
+		}
+#endif
+	}
+	return m_multi ;
+}
+
+void CurlPool::SetHttpVersion( CURL *curl ) const
+{
+#if LIBCURL_VERSION_NUM >= 0x072f00
+	if ( m_streams > 0 )
+	{
+		::curl_easy_setopt( curl, CURLOPT_HTTP_VERSION,	CURL_HTTP_VERSION_2TLS ) ;
+		
+		// wait for an existing connection to be multiplexed on, rather than
+		// opening a new one
+		::curl_easy_setopt( curl, CURLOPT_PIPEWAIT,		1L ) ;
+	}
+#endif
+}
+
+} } // end of namespace
@@ -0,0 +1,92 @@
+/*
+	grive: an GPL program to sync a local directory with Google Drive
+	Copyright (C) 2012  Wan Wai Ho
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation version 2
+	of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#pragma once
+
+// dependent libraries
+#include <curl/curl.h>
+
+#include <vector>
+
+namespace gr { namespace http {
+
+/*!	\brief	process-wide pool of CURL handles
+
+	All handles share the DNS cache, TLS session cache and (if libcurl supports
+	it) the connection cache through one CURLSH object. Short-lived agents, e.g.
+	the ones used for refreshing OAuth2 tokens, get their handles from here and
+	give them back afterwards, so they don't need new TCP and TLS handshakes.
+	
+	The share has no lock callbacks: all handles must be used in the same thread.
+	
+	With EnableHttp2(), new requests prefer HTTP/2 over TLS, and requests that
+	run at the same time through Multi() are multiplexed over one connection
+	instead of each opening their own.
+*/
+class CurlPool
+{
+public :
+	struct Stats
+	{
+		unsigned long	requests ;
+		
+		/// new connections made, i.e. TCP (and TLS) handshakes
+		unsigned long	connects ;
+		
+		/// time spent before the first byte of the request could be sent,
+		/// i.e. DNS lookup, connect and TLS handshake, in seconds
+		double			setup_time ;
+	} ;
+
+public :
+	static CurlPool& Inst() ;
+	~CurlPool() ;
+	
+	CURL* Acquire() ;
+	void Release( CURL *curl ) ;
+	
+	void Record( CURL *curl ) ;
+	const Stats& GetStats() const ;
+	
+	bool EnableHttp2( unsigned max_streams ) ;
+	bool IsHttp2() const ;
+	unsigned MaxStreams() const ;
+	CURLM* Multi() ;
+
+private :
+	CurlPool() ;
+	CurlPool( const CurlPool& ) ;
+	CurlPool& operator=( const CurlPool& ) ;
+
+private :
+	void SetHttpVersion( CURL *curl ) const ;
+
+private :
+	CURLSH				*m_share ;
+	CURLM				*m_multi ;
+	std::vector<CURL*>	m_free ;
+	Stats				m_stats ;
+	
+	/// maximum number of concurrent streams on one connection, or 0 if
+	/// HTTP/2 is not used
+	unsigned			m_streams ;
+} ;
+
+} } // end of namespace
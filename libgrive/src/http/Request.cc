@@ -0,0 +1,97 @@
+/*
+	grive: an GPL program to sync a local directory with Google Drive
+	Copyright (C) 2012  Wan Wai Ho
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation version 2
+	of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#include "Request.hh"
+
+#include <algorithm>
+#include <cctype>
+
+namespace gr { namespace http {
+
+namespace
+{
+	std::string ToLower( std::string str )
+	{
+		std::transform( str.begin(), str.end(), str.begin(), ::tolower ) ;
+		return str ;
+	}
+}
+
+Request::Request( ) :
+	dest		( 0 ),
+	response	( 0 )
+{
+}
+
+Request::Request(
+	const std::string&	method_,
+	const std::string&	url_,
+	DataStream			*dest_,
+	const Header&		hdr_,
+	const std::string&	data_ ) :
+	method		( method_ ),
+	url			( url_ ),
+	data		( data_ ),
+	dest		( dest_ ),
+	hdr			( hdr_ ),
+	response	( 0 )
+{
+}
+
+std::string Request::ResponseHeader( const std::string& name ) const
+{
+	std::map<std::string, std::string>::const_iterator i = headers.find( ToLower(name) ) ;
+	return i != headers.end() ? i->second : "" ;
+}
+
+void Request::ResponseHeader( const std::string& name, const std::string& value )
+{
+	headers[ToLower(name)] = value ;
+}
+
+/// The kind of endpoint a request is sent to, for the latency statistics:
+/// "token" for OAuth2, "upload" for file contents sent, "download" for file
+/// contents received, "feed" for a page of a file list and "entry" for the
+/// metadata of one file or folder, e.g. creating or deleting it.
+std::string Request::Endpoint( const std::string& url, bool has_body )
+{
+	if ( url.find( "/oauth2/" ) != std::string::npos )
+		return "token" ;
+	
+	// resumable upload sessions, and simple uploads to the contents feeds
+	else if ( url.find( "/upload/" ) != std::string::npos ||
+		url.find( "convert=" ) != std::string::npos )
+		return "upload" ;
+	
+	// the contents are not under the feeds
+	else if ( url.find( "/feeds/" ) == std::string::npos )
+		return "download" ;
+	
+	else if ( !has_body && (
+		url.find( '?' )			!= std::string::npos ||
+		url.find( "/contents" )	!= std::string::npos ||
+		url.find( "/metadata/" )	!= std::string::npos ) )
+		return "feed" ;
+	
+	else
+		return "entry" ;
+}
+
+} } // end of namespace
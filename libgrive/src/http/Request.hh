@@ -0,0 +1,71 @@
+/*
+	grive: an GPL program to sync a local directory with Google Drive
+	Copyright (C) 2012  Wan Wai Ho
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation version 2
+	of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#pragma once
+
+#include "Header.hh"
+
+#include <map>
+#include <string>
+
+namespace gr {
+
+class DataStream ;
+
+namespace http {
+
+/*!	\brief	an HTTP request for Agent::Perform()
+
+	Holds everything needed to send a request, and the result after it is
+	performed. Requests given to Agent::Perform() together may be sent at the
+	same time, so they must not depend on each other.
+*/
+struct Request
+{
+	Request( ) ;
+	Request(
+		const std::string&	method,
+		const std::string&	url,
+		DataStream			*dest,
+		const Header&		hdr		= Header(),
+		const std::string&	data	= std::string() ) ;
+	
+	std::string ResponseHeader( const std::string& name ) const ;
+	void ResponseHeader( const std::string& name, const std::string& value ) ;
+	
+	static std::string Endpoint( const std::string& url, bool has_body ) ;
+	
+	std::string		method ;
+	std::string		url ;
+	std::string		data ;
+	DataStream		*dest ;
+	Header			hdr ;
+	
+	/// HTTP response code, or 0 if not yet performed
+	long			response ;
+	
+	/// body of the response if it is an HTTP error
+	std::string		error ;
+	
+	/// response headers, keyed by lower case names
+	std::map<std::string, std::string>	headers ;
+} ;
+
+} } // end of namespace
@@ -0,0 +1,229 @@
+/*
+	grive: an GPL program to sync a local directory with Google Drive
+	Copyright (C) 2012  Wan Wai Ho
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation version 2
+	of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#include "RetryPolicy.hh"
+
+#include "util/OS.hh"
+
+#include <algorithm>
+#include <cassert>
+#include <cstdlib>
+#include <cstring>
+
+#include <time.h>
+#include <unistd.h>
+
+namespace gr { namespace http {
+
+namespace
+{
+	class SystemClockImpl : public RetryPolicy::Clock
+	{
+	public :
+		std::time_t Now()
+		{
+			return std::time( 0 ) ;
+		}
+		
+		void Sleep( double sec )
+		{
+			if ( sec > 0 )
+				os::MilliSleep( static_cast<unsigned long>( sec * 1000 ) ) ;
+		}
+	} ;
+}
+
+RetryPolicy::Clock* RetryPolicy::SystemClock()
+{
+	static SystemClockImpl clock ;
+	return &clock ;
+}
+
+RetryPolicy::RetryPolicy( ) :
+	m_base		( 1 ),
+	m_cap		( 64 ),
+	m_max_retry	( 8 ),
+	m_max_wait	( 600 ),
+	m_clock		( SystemClock() ),
+	m_seed		( static_cast<unsigned>( std::time(0) ^ ::getpid() ) )
+{
+}
+
+RetryPolicy::RetryPolicy(
+	double			base,
+	double			cap,
+	unsigned		max_retry,
+	double			max_wait,
+	Clock			*clock,
+	unsigned		seed ) :
+	m_base		( base ),
+	m_cap		( cap ),
+	m_max_retry	( max_retry ),
+	m_max_wait	( max_wait ),
+	m_clock		( clock ),
+	m_seed		( seed )
+{
+	assert( m_base > 0 && m_cap >= m_base ) ;
+	assert( m_clock != 0 ) ;
+}
+
+/// Temporary errors that are worth retrying: server errors, and quota
+/// errors which come as either 429 or 403 with a "rateLimitExceeded" reason
+/// (including "userRateLimitExceeded") in the error response.
+bool RetryPolicy::IsRetryable( long response, const std::string& error )
+{
+	switch ( response )
+	{
+	case 500 :
+	case 502 :
+	case 503 :
+	case 504 :
+	case 429 :
+		return true ;
+	
+	case 403 :
+		return error.find( "ateLimitExceeded" ) != error.npos ;
+	
+	default :
+		return false ;
+	}
+}
+
+/// Parse the value of a "Retry-After" header, which is either a number of
+/// seconds or an HTTP date. Returns the number of seconds to wait, or a negative
+/// value if the header is missing or malformed.
+double RetryPolicy::ParseRetryAfter( const std::string& value, std::time_t now )
+{
+	if ( value.empty() )
+		return -1 ;
+	
+	char *end = 0 ;
+	double sec = std::strtod( value.c_str(), &end ) ;
+	if ( end != value.c_str() && *end == '\0' )
+		return sec >= 0 ? sec : -1 ;
+	
+	struct tm tp = {} ;
+	const char *r = ::strptime( value.c_str(), "%a, %d %b %Y %H:%M:%S", &tp ) ;
+	if ( r != 0 )
+		return std::max( static_cast<double>( ::timegm( &tp ) - now ), 0.0 ) ;
+	
+	return -1 ;
+}
+
+double RetryPolicy::Base() const
+{
+	return m_base ;
+}
+
+double RetryPolicy::Cap() const
+{
+	return m_cap ;
+}
+
+unsigned RetryPolicy::MaxRetry() const
+{
+	return m_max_retry ;
+}
+
+double RetryPolicy::MaxWait() const
+{
+	return m_max_wait ;
+}
+
+RetryPolicy::Clock* RetryPolicy::GetClock() const
+{
+	return m_clock ;
+}
+
+RetryPolicy::Budget::Budget( const RetryPolicy& policy ) :
+	m_policy	( &policy ),
+	m_retries	( 0 ),
+	m_waited	( 0 ),
+	m_prev		( policy.Base() ),
+	m_rng		( policy.m_seed ^ static_cast<unsigned>( reinterpret_cast<std::size_t>(this) ) )
+{
+}
+
+/// Calculate the delay before the next retry. The delay is at least the
+/// time asked by the "Retry-After" header, if any.
+double RetryPolicy::Budget::NextDelay( const std::string& retry_after )
+{
+	// decorrelated jitter: random between base and 3 times the previous delay
+	double r		= m_rng() / 4294967296.0 ;
+	double upper	= std::min( m_policy->Cap(), m_prev * 3 ) ;
+	double delay	= m_policy->Base() + r * std::max( upper - m_policy->Base(), 0.0 ) ;
+	
+	double server	= ParseRetryAfter( retry_after, m_policy->GetClock()->Now() ) ;
+	return std::max( delay, server ) ;
+}
+
+/// Wait before retrying a request. Returns false without waiting if the
+/// request has used up its budget, i.e. the caller should give up.
+bool RetryPolicy::Budget::Wait( const std::string& retry_after )
+{
+	double delay = Reserve( retry_after ) ;
+	if ( delay < 0 )
+		return false ;
+	
+	m_policy->GetClock()->Sleep( delay ) ;
+	return true ;
+}
+
+/// Like Wait(), but only charge the delay to the budget without sleeping.
+/// Used when a number of requests are retried together after the longest of
+/// their delays.
+/// \return	the delay, or a negative value if the budget is used up
+double RetryPolicy::Budget::Reserve( const std::string& retry_after )
+{
+	if ( m_retries >= m_policy->MaxRetry() )
+		return -1 ;
+	
+	double delay = NextDelay( retry_after ) ;
+	if ( m_waited + delay > m_policy->MaxWait() )
+		return -1 ;
+	
+	m_retries++ ;
+	m_waited	+= delay ;
+	m_prev		= std::max( delay, m_policy->Base() ) ;
+	return delay ;
+}
+
+/// Retry immediately, e.g. after refreshing the access token. Still counts
+/// toward the budget.
+bool RetryPolicy::Budget::Retry( )
+{
+	if ( m_retries >= m_policy->MaxRetry() )
+		return false ;
+	
+	m_retries++ ;
+	return true ;
+}
+
+unsigned RetryPolicy::Budget::Retries() const
+{
+	return m_retries ;
+}
+
+double RetryPolicy::Budget::Waited() const
+{
+	return m_waited ;
+}
+
+} } // end of namespace
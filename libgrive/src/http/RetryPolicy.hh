@@ -0,0 +1,114 @@
+/*
+	grive: an GPL program to sync a local directory with Google Drive
+	Copyright (C) 2012  Wan Wai Ho
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation version 2
+	of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#pragma once
+
+#include <boost/random/mersenne_twister.hpp>
+
+#include <ctime>
+#include <string>
+
+namespace gr { namespace http {
+
+/*!	\brief	decides whether and how long to wait before retrying a request
+
+	The delay between retries grows exponentially with decorrelated jitter,
+	i.e. each delay is a random value between the base delay and three times
+	the previous delay, capped at a maximum. A "Retry-After" header from the
+	server overrides the delay if it asks for a longer one.
+	
+	The policy itself is not changed by retrying. The retry count and previous
+	delay of a request are kept in a Budget, which lives as long as the request.
+	A request waiting for its retry therefore does not hold up other requests.
+*/
+class RetryPolicy
+{
+public :
+	/// Source of time. Tests can use a virtual clock that doesn't really sleep.
+	class Clock
+	{
+	public :
+		virtual ~Clock() {}
+		virtual std::time_t Now() = 0 ;
+		virtual void Sleep( double sec ) = 0 ;
+	} ;
+	
+	static Clock* SystemClock() ;
+	
+	class Budget ;
+	
+public :
+	RetryPolicy( ) ;
+	RetryPolicy(
+		double			base,
+		double			cap,
+		unsigned		max_retry,
+		double			max_wait,
+		Clock			*clock,
+		unsigned		seed = 0 ) ;
+	
+	static bool IsRetryable( long response, const std::string& error ) ;
+	static double ParseRetryAfter( const std::string& value, std::time_t now ) ;
+	
+	double Base() const ;
+	double Cap() const ;
+	unsigned MaxRetry() const ;
+	double MaxWait() const ;
+	Clock* GetClock() const ;
+	
+private :
+	friend class Budget ;
+	
+	double		m_base ;
+	double		m_cap ;
+	unsigned	m_max_retry ;
+	double		m_max_wait ;
+	Clock		*m_clock ;
+	unsigned	m_seed ;
+} ;
+
+/*!	\brief	retry state of a single request
+
+	A request may be retried at most RetryPolicy::MaxRetry() times, and may
+	spend at most RetryPolicy::MaxWait() seconds waiting.
+*/
+class RetryPolicy::Budget
+{
+public :
+	explicit Budget( const RetryPolicy& policy ) ;
+	
+	bool Wait( const std::string& retry_after = std::string() ) ;
+	double Reserve( const std::string& retry_after = std::string() ) ;
+	bool Retry( ) ;
+	
+	double NextDelay( const std::string& retry_after ) ;
+	
+	unsigned Retries() const ;
+	double Waited() const ;
+	
+private :
+	const RetryPolicy	*m_policy ;
+	unsigned			m_retries ;
+	double				m_waited ;
+	double				m_prev ;
+	boost::mt19937		m_rng ;
+} ;
+
+} } // end of namespace
@@ -21,24 +21,50 @@
 
 #include "http/Error.hh"
 #include "http/Header.hh"
+#include "util/Stats.hh"
 #include "util/log/Log.hh"
-#include "util/OS.hh"
 
+#include <algorithm>
 #include <cassert>
 
 namespace gr {
 
 using namespace http ;
 
-AuthAgent::AuthAgent( const OAuth2& auth, std::auto_ptr<Agent> real_agent ) :
+namespace
+{
+	// refresh the access token if it expires within this number of seconds
+	const unsigned refresh_margin = 300 ;
+	
+	/// Count a retry, in total and by the kind of endpoint.
+	void CountRetry( const std::string& url, bool has_body )
+	{
+		Stats::Inst().Add( "http.retry" ) ;
+		Stats::Inst().Add( "http." + Request::Endpoint( url, has_body ) + ".retry" ) ;
+	}
+}
+
+AuthAgent::AuthAgent(
+	const OAuth2&			auth,
+	std::auto_ptr<Agent>	real_agent,
+	const RetryPolicy&		retry ) :
 	m_auth	( auth ),
-	m_agent	( real_agent )
+	m_agent	( real_agent ),
+	m_retry	( retry )
 {
 	assert( m_agent.get() != 0 ) ;
 }
 
-Header AuthAgent::AppendHeader( const Header& hdr ) const
+/// Add the authorization header. The access token is refreshed here if it is
+/// about to expire, so requests don't need to fail with 401 before refreshing.
+Header AuthAgent::AppendHeader( const Header& hdr )
 {
+	if ( m_auth.IsExpired( refresh_margin ) )
+	{
+		Log( "access token expires at %1%. refreshing", m_auth.Expiry(), log::verbose ) ;
+		m_auth.Refresh() ;
+	}
+	
 	Header h(hdr) ;
 	h.Add( "Authorization: Bearer " + m_auth.AccessToken() ) ;
 	h.Add( "GData-Version: 3.0" ) ;
@@ -52,10 +78,11 @@ long AuthAgent::Put(
 	const Header&		hdr )
 {
 	Header auth = AppendHeader(hdr) ;
+	RetryPolicy::Budget budget( m_retry ) ;
 
 	long response ;
 	while ( CheckRetry(
-		response = m_agent->Put(url, data, dest, auth) ) ) ;
+		response = m_agent->Put( url, data, dest, AppendHeader(hdr) ), url, true, budget ) ) ;
 	
 	return CheckHttpResponse(response, url, auth) ;
 }
@@ -67,10 +94,11 @@ long AuthAgent::Put(
 	const Header&		hdr )
 {
 	Header auth = AppendHeader(hdr) ;
-	
+	RetryPolicy::Budget budget( m_retry ) ;
+
 	long response ;
 	while ( CheckRetry(
-		response = m_agent->Put( url, file, dest, AppendHeader(hdr) ) ) ) ;
+		response = m_agent->Put( url, file, dest, AppendHeader(hdr) ), url, true, budget ) ) ;
 	
 	return CheckHttpResponse(response, url, auth) ;
 }
@@ -81,10 +109,11 @@ long AuthAgent::Get(
 	const Header&		hdr )
 {
 	Header auth = AppendHeader(hdr) ;
+	RetryPolicy::Budget budget( m_retry ) ;
 
 	long response ;
 	while ( CheckRetry(
-		response = m_agent->Get( url, dest, AppendHeader(hdr) ) ) ) ;
+		response = m_agent->Get( url, dest, AppendHeader(hdr) ), url, false, budget ) ) ;
 	
 	return CheckHttpResponse(response, url, auth) ;
 }
@@ -96,10 +125,11 @@ long AuthAgent::Post(
 	const Header&		hdr )
 {
 	Header auth = AppendHeader(hdr) ;
-	
+	RetryPolicy::Budget budget( m_retry ) ;
+
 	long response ;
 	while ( CheckRetry(
-		response = m_agent->Post( url, data, dest, AppendHeader(hdr) ) ) ) ;
+		response = m_agent->Post( url, data, dest, AppendHeader(hdr) ), url, true, budget ) ) ;
 	
 	return CheckHttpResponse(response, url, auth) ;
 }
@@ -111,19 +141,85 @@ long AuthAgent::Custom(
 	const Header&		hdr )
 {
 	Header auth = AppendHeader(hdr) ;
+	RetryPolicy::Budget budget( m_retry ) ;
 
 	long response ;
 	while ( CheckRetry(
-		response = m_agent->Custom( method, url, dest, AppendHeader(hdr) ) ) ) ;
+		response = m_agent->Custom( method, url, dest, AppendHeader(hdr) ), url, false, budget ) ) ;
 	
 	return CheckHttpResponse(response, url, auth) ;
 }
 
+/// Perform the requests through the real agent, which may send them at the
+/// same time. Requests that fail with temporary errors are sent again as a
+/// group after the longest of their delays. Unlike the other functions, HTTP
+/// errors are not thrown. Check Request::response instead.
+void AuthAgent::Perform( std::vector<Request>& reqs )
+{
+	std::vector<RetryPolicy::Budget> budgets( reqs.size(), RetryPolicy::Budget( m_retry ) ) ;
+	
+	// indexes of the requests to be sent in this round
+	std::vector<std::size_t> todo ;
+	for ( std::size_t i = 0 ; i < reqs.size() ; i++ )
+		todo.push_back( i ) ;
+	
+	while ( !todo.empty() )
+	{
+		std::vector<Request> round ;
+		for ( std::size_t k = 0 ; k < todo.size() ; k++ )
+		{
+			round.push_back( reqs[todo[k]] ) ;
+			round.back().hdr = AppendHeader( reqs[todo[k]].hdr ) ;
+		}
+		
+		m_agent->Perform( round ) ;
+		
+		std::vector<std::size_t> retry ;
+		double	delay	= 0 ;
+		bool	refresh	= false ;
+		for ( std::size_t k = 0 ; k < todo.size() ; k++ )
+		{
+			Request& req = reqs[todo[k]] ;
+			req.response	= round[k].response ;
+			req.error		= round[k].error ;
+			req.headers		= round[k].headers ;
+			
+			if ( CheckRetry( req, budgets[todo[k]], delay ) )
+			{
+				refresh = refresh || req.response == 401 ;
+				retry.push_back( todo[k] ) ;
+			}
+		}
+		
+		if ( refresh )
+			m_auth.Refresh() ;
+		if ( !retry.empty() && delay > 0 )
+			m_retry.GetClock()->Sleep( delay ) ;
+		
+		todo.swap( retry ) ;
+	}
+}
+
+const OAuth2& AuthAgent::Auth() const
+{
+	return m_auth ;
+}
+
 std::string AuthAgent::RedirLocation() const
 {
 	return m_agent->RedirLocation() ;
 }
 
+std::string AuthAgent::ResponseHeader( const std::string& name ) const
+{
+	return m_agent->ResponseHeader( name ) ;
+}
+
+std::string AuthAgent::ErrorResponse() const
+{
+	return m_agent->ErrorResponse() ;
+}
+
 std::string AuthAgent::Escape( const std::string& str )
 {
 	return m_agent->Escape( str ) ;
@@ -134,25 +230,72 @@ std::string AuthAgent::Unescape( const std::string& str )
 	return m_agent->Unescape( str ) ;
 }
 
-bool AuthAgent::CheckRetry( long response )
+bool AuthAgent::CheckRetry(
+	long					response,
+	const std::string&		url,
+	bool					has_body,
+	RetryPolicy::Budget&	budget )
 {
-	// HTTP 500 and 503 should be temperory. just wait a bit and retry
-	if ( response == 500 || response == 503 )
+	// server errors and rate limiting should be temperory. wait a bit and retry
+	if ( RetryPolicy::IsRetryable( response, m_agent->ErrorResponse() ) )
 	{
-		Log( "resquest failed due to temperory error: %1%. retrying in 5 seconds",
-			response, log::warning ) ;
-			
-		os::Sleep( 5 ) ;
-		return true ;
+		Log( "resquest failed due to temperory error: %1%. retrying (%2% retries so far)",
+			response, budget.Retries(), log::warning ) ;
+		
+		if ( budget.Wait( m_agent->ResponseHeader( "Retry-After" ) ) )
+		{
+			CountRetry( url, has_body ) ;
+			return true ;
+		}
+		
+		Log( "giving up after %1% retries and %2% seconds",
+			budget.Retries(), budget.Waited(), log::error ) ;
+		return false ;
 	}
 	
 	// HTTP 401 Unauthorized. the auth token has been expired. refresh it
-	else if ( response == 401 )
+	else if ( response == 401 && budget.Retry() )
 	{
 		Log( "resquest failed due to auth token expired: %1%. refreshing token",
 			response, log::warning ) ;
 			
 		m_auth.Refresh() ;
+		CountRetry( url, has_body ) ;
+		return true ;
+	}
+	else
+		return false ;
+}
+
+/// Same as above for a request in Perform(), except that it does not wait.
+/// The delay is added to \a delay if it is longer.
+bool AuthAgent::CheckRetry(
+	const Request&			req,
+	RetryPolicy::Budget&	budget,
+	double&					delay )
+{
+	if ( RetryPolicy::IsRetryable( req.response, req.error ) )
+	{
+		double d = budget.Reserve( req.ResponseHeader( "Retry-After" ) ) ;
+		if ( d >= 0 )
+		{
+			Log( "request to %1% failed due to temporary error: %2%. retrying (%3% retries so far)",
+				req.url, req.response, budget.Retries() - 1, log::warning ) ;
+			delay = std::max( delay, d ) ;
+			CountRetry( req.url, !req.data.empty() ) ;
+			return true ;
+		}
+		
+		Log( "giving up %1% after %2% retries and %3% seconds",
+			req.url, budget.Retries(), budget.Waited(), log::error ) ;
+		return false ;
+	}
+	
+	else if ( req.response == 401 && budget.Retry() )
+	{
+		Log( "request to %1% failed due to auth token expired. refreshing token",
+			req.url, log::warning ) ;
+		CountRetry( req.url, !req.data.empty() ) ;
 		return true ;
 	}
 	else
@@ -164,14 +307,16 @@ long AuthAgent::CheckHttpResponse(
 		const std::string&	url,
 		const http::Header&	hdr  )
 {
-	// throw for other HTTP errors
-	if ( response >= 400 && response < 500 )
+	// throw for other HTTP errors, and temperory errors that have been
+	// retried for too many times
+	if ( response >= 400 )
 	{
  		BOOST_THROW_EXCEPTION(
  			Error()
 				<< HttpResponse( response )
  				<< Url( url )
- 				<< HttpHeader( hdr ) ) ;
+ 				<< HttpHeader( hdr )
+				<< HttpResponseText( m_agent->ErrorResponse() ) ) ;
 	}
 	
 	return response ;
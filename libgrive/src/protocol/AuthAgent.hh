@@ -20,6 +20,7 @@
 #pragma once
 
 #include "http/Agent.hh"
+#include "http/RetryPolicy.hh"
 #include "OAuth2.hh"
 
 #include <memory>
@@ -29,12 +30,15 @@ namespace gr {
 /*!	\brief	An HTTP agent with support OAuth2
 	
 	This is a HTTP agent that provide support for OAuth2. It will also perform retries on
-	certain HTTP errors.
+	certain HTTP errors, according to a RetryPolicy.
 */
 class AuthAgent : public http::Agent
 {
 public :
-	AuthAgent( const OAuth2& auth, std::auto_ptr<http::Agent> real_agent ) ;
+	AuthAgent(
+		const OAuth2&				auth,
+		std::auto_ptr<http::Agent>	real_agent,
+		const http::RetryPolicy&	retry = http::RetryPolicy() ) ;
 
 	long Put(
 		const std::string&	url,
@@ -66,21 +70,36 @@ public :
 		const http::Header&	hdr ) ;
 	
 	std::string RedirLocation() const ;
+	std::string ResponseHeader( const std::string& name ) const ;
+	std::string ErrorResponse() const ;
+	
+	void Perform( std::vector<http::Request>& reqs ) ;
 	
 	std::string Escape( const std::string& str ) ;
 	std::string Unescape( const std::string& str ) ;
 
+	const OAuth2& Auth() const ;
+
 private :
-	http::Header AppendHeader( const http::Header& hdr ) const ;
-	bool CheckRetry( long response ) ;
+	http::Header AppendHeader( const http::Header& hdr ) ;
+	bool CheckRetry(
+		long						response,
+		const std::string&			url,
+		bool						has_body,
+		http::RetryPolicy::Budget&	budget ) ;
 	long CheckHttpResponse(
 		long 				response,
 		const std::string&	url,
 		const http::Header&	hdr  ) ;
+	bool CheckRetry(
+		const http::Request&		req,
+		http::RetryPolicy::Budget&	budget,
+		double&						delay ) ;
 	
 private :
 	OAuth2								m_auth ;
 	const std::auto_ptr<http::Agent>	m_agent ;
+	const http::RetryPolicy				m_retry ;
 } ;
 
 } // end of namespace
@@ -366,6 +366,25 @@ boost::uint64_t Json::As<boost::uint64_t>() const
 	return ::json_object_get_int64( m_json ) ;
 }
 
+double Json::Double() const
+{
+	assert( m_json != 0 ) ;
+	return ::json_object_get_double( m_json ) ;
+}
+
+template <>
+bool Json::Is<double>() const
+{
+	assert( m_json != 0 ) ;
+	return ::json_object_is_type( m_json, json_type_double ) == TRUE ;
+}
+
+template <>
+double Json::As<double>() const
+{
+	return Double() ;
+}
+
 std::ostream& operator<<( std::ostream& os, const Json& json )
 {
 	assert( json.m_json != 0 ) ;
@@ -503,8 +522,8 @@ Json Json::Parse( DataStream *in )
 	{
 		json = ::json_tokener_parse_ex( tok, buf, count ) ;
 		
-		// check for parse error
-		if ( ::json_tokener_get_error(tok) == ::json_tokener_continue )
+		// stop unless more input is needed
+		if ( ::json_tokener_get_error(tok) != ::json_tokener_continue )
 			break ;
 	}
 	
@@ -33,6 +33,9 @@ namespace gr {
 
 const std::string token_url		= "https://accounts.google.com/o/oauth2/token" ;
 
+// lifetime of the access token if the server doesn't tell
+const int default_expires_in	= 3600 ;
+
 OAuth2::OAuth2(
 	const std::string& refresh_code,
 	const std::string&	client_id,
@@ -41,7 +44,6 @@ OAuth2::OAuth2(
 	m_client_id( client_id ),
 	m_client_secret( client_secret )
 {
-	Refresh( ) ;
 }
 
 OAuth2::OAuth2(
@@ -68,7 +70,7 @@ void OAuth2::Auth( const std::string&	auth_code )
 	http.Post( token_url, post, &resp, http::Header() ) ;
 
 	Json jresp	= resp.Response() ;
-	m_access	= jresp["access_token"].Str() ;
+	UpdateAccess( jresp ) ;
 	m_refresh	= jresp["refresh_token"].Str() ;
 }
 
@@ -104,7 +106,18 @@ void OAuth2::Refresh( )
 	DisableLog dlog( log::debug ) ;
 	http.Post( token_url, post, &resp, http::Header() ) ;
 
-	m_access	= resp.Response()["access_token"].Str() ;
+	UpdateAccess( resp.Response() ) ;
+}
+
+void OAuth2::UpdateAccess( const Json& resp )
+{
+	Json expires_in ;
+	int sec = resp.Get( "expires_in", expires_in ) ? expires_in.Int() : default_expires_in ;
+	
+	m_access	= resp["access_token"].Str() ;
+	m_expiry	= DateTime( DateTime::Now().Sec() + sec ) ;
+	
+	Log( "access token expires at %1%", m_expiry, log::verbose ) ;
 }
 
 std::string OAuth2::RefreshToken( ) const
@@ -117,6 +130,26 @@ std::string OAuth2::AccessToken( ) const
 	return m_access ;
 }
 
+/// Use an access token obtained earlier, e.g. cached in the config file.
+void OAuth2::AccessToken( const std::string& access, const DateTime& expiry )
+{
+	m_access	= access ;
+	m_expiry	= expiry ;
+}
+
+DateTime OAuth2::Expiry( ) const
+{
+	return m_expiry ;
+}
+
+/// Check if the access token has expired, or will expire within \a margin
+/// seconds. A missing access token is always expired.
+bool OAuth2::IsExpired( unsigned margin ) const
+{
+	return m_access.empty() ||
+		DateTime( DateTime::Now().Sec() + margin ) >= m_expiry ;
+}
+
 std::string OAuth2::HttpHeader( ) const
 {
 	return "Authorization: Bearer " + m_access ;
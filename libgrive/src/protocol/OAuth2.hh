@@ -19,10 +19,21 @@
 
 #pragma once
 
+#include "util/DateTime.hh"
+
 #include <string>
 
 namespace gr {
 
+class Json ;
+
+/*!	\brief	OAuth2 tokens of a grive installation
+
+	The access token is valid for a limited time. Its expiry time is tracked
+	so that it can be refreshed before it expires, instead of after a request
+	failed with HTTP 401. The constructor doesn't refresh the token, so a
+	token cached from a previous run can be used if it is still valid.
+*/
 class OAuth2
 {
 public :
@@ -45,13 +56,21 @@ public :
 		
 	std::string RefreshToken( ) const ;
 	std::string AccessToken( ) const ;
+	void AccessToken( const std::string& access, const DateTime& expiry ) ;
+	
+	DateTime Expiry( ) const ;
+	bool IsExpired( unsigned margin = 0 ) const ;
 	
 	// adding HTTP auth header
 	std::string HttpHeader( ) const ;
 	
+private :
+	void UpdateAccess( const Json& resp ) ;
+
 private :
 	std::string m_access ;
 	std::string m_refresh ;
+	DateTime	m_expiry ;
 	
 	const std::string	m_client_id ;
 	const std::string	m_client_secret ;
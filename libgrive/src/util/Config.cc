@@ -25,6 +25,7 @@
 
 #include <iostream>
 #include <iterator>
+#include <vector>
 
 namespace po = boost::program_options;
 
@@ -42,6 +43,20 @@ Config::Config( const po::variables_map& vm )
 	m_cmd.Add( "path",		Json(vm.count("path") > 0
 		? vm["path"].as<std::string>()
 		: default_root_folder ) ) ;
+	if ( vm.count("seed") )
+	{
+		std::vector<Json> seed ;
+		const std::vector<std::string>& dirs = vm["seed"].as<std::vector<std::string> >() ;
+		for ( std::vector<std::string>::const_iterator i = dirs.begin() ; i != dirs.end() ; ++i )
+			seed.push_back( Json( *i ) ) ;
+		m_cmd.Add( "seed", Json( seed ) ) ;
+	}
+	if ( vm.count("upload-threshold") )
+		m_cmd.Add( "upload-threshold", Json(vm["upload-threshold"].as<unsigned>()) ) ;
+	if ( vm.count("poll") )
+		m_cmd.Add( "poll", Json(vm["poll"].as<unsigned>()) ) ;
+	if ( vm.count("remote-dir") )
+		m_cmd.Add( "remote-dir", Json(vm["remote-dir"].as<std::string>()) ) ;
 	
 	m_path	= GetPath( fs::path(m_cmd["path"].Str()) ) ;
 	m_file	= Read( ) ;
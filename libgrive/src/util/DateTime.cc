@@ -182,4 +182,12 @@ std::string DateTime::ToString() const
 	return ss.str() ;
 }
 
+/// The milliseconds from \a start to now, e.g. for timeouts.
+unsigned long MilliSec( const DateTime& start )
+{
+	DateTime now = DateTime::Now() ;
+	return static_cast<unsigned long>( ( now.Sec() - start.Sec() ) * 1000 +
+		( static_cast<long>(now.NanoSec()) - static_cast<long>(start.NanoSec()) ) / 1000000 ) ;
+}
+
 } // end of namespace
@@ -61,5 +61,6 @@ private :
 } ;
 
 std::ostream& operator<<( std::ostream& os, const DateTime& dt ) ;
+unsigned long MilliSec( const DateTime& start ) ;
 
 } // end of namespace
@@ -147,6 +147,21 @@ void File::OpenForWrite( const fs::path& path, int mode )
 	Open( path, flags, mode ) ;
 }
 
+/**	Opens the file for writing at the end of it. The file is created if it
+	does not exist.
+	\param	path	Path to the file to be opened.
+	\param	mode	Mode of the file to be created.
+	\throw	Error	When the file cannot be opened.
+*/
+void File::OpenForAppend( const fs::path& path, int mode )
+{
+	int flags = O_CREAT|O_WRONLY|O_APPEND ;
+#ifdef WIN32
+	flags |= O_BINARY ;
+#endif
+	Open( path, flags, mode ) ;
+}
+
 void File::Close()
 {
 	if ( IsOpened() )
@@ -267,6 +282,27 @@ void File::UnMap( void *addr, std::size_t length )
 #endif
 }
 
+/**	Write the data of the file to the disk, so it will still be there if the
+	machine crashes.
+	\throw	Error	In case of any error.
+*/
+void File::Sync()
+{
+	assert( IsOpened() ) ;
+#ifdef WIN32
+	if ( ::_commit( m_fd ) != 0 )
+#else
+	if ( ::fsync( m_fd ) != 0 )
+#endif
+	{
+		BOOST_THROW_EXCEPTION(
+			Error()
+				<< boost::errinfo_api_function("fsync")
+				<< boost::errinfo_errno(errno)
+		) ;
+	}
+}
+
 struct stat File::Stat() const
 {
 	struct stat result = {} ;
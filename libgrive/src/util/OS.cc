@@ -31,14 +31,58 @@
 #include <boost/exception/errinfo_file_open_mode.hpp>
 #include <boost/exception/info.hpp>
 
+#include <algorithm>
+
 // OS specific headers
 #include <errno.h>
+#include <fcntl.h>
+#include <sys/ioctl.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 #include <sys/time.h>
 #include <sys/types.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <linux/fs.h>
+#endif
 
 namespace gr { namespace os {
 
+FileStat Stat( const fs::path& filename )
+{
+	return Stat( filename.string() ) ;
+}
+
+FileStat Stat( const std::string& filename )
+{
+	struct stat s = {} ;
+	if ( ::stat( filename.c_str(), &s ) != 0 )
+	{
+		BOOST_THROW_EXCEPTION(
+			Error()
+				<< boost::errinfo_api_function("stat")
+				<< boost::errinfo_errno(errno)
+				<< boost::errinfo_file_name(filename)
+		) ;
+	}
+	
+	FileStat result ;
+	result.size		= static_cast<u64_t>( s.st_size ) ;
+	result.ino		= static_cast<u64_t>( s.st_ino ) ;
+	result.dev		= static_cast<u64_t>( s.st_dev ) ;
+	result.is_dir	= S_ISDIR( s.st_mode ) ;
+
+#if defined __APPLE__ && defined __DARWIN_64_BIT_INO_T
+	result.mtime.Assign( s.st_mtimespec.tv_sec, s.st_mtimespec.tv_nsec ) ;
+	result.ctime.Assign( s.st_ctimespec.tv_sec, s.st_ctimespec.tv_nsec ) ;
+#else
+	result.mtime.Assign( s.st_mtim.tv_sec, s.st_mtim.tv_nsec ) ;
+	result.ctime.Assign( s.st_ctim.tv_sec, s.st_ctim.tv_nsec ) ;
+#endif
+	return result ;
+}
+
 DateTime FileCTime( const fs::path& filename )
 {
 	return FileCTime( filename.string() ) ;
@@ -81,6 +125,105 @@ void SetFileTime( const std::string& filename, const DateTime& t )
 		) ;
 }
 
+/// Create a directory with \a mode, and its parents with the default mode if
+/// they don't exist. Nothing is done if it exists already.
+void MakeDir( const fs::path& dir, int mode )
+{
+	if ( dir.has_parent_path() )
+		fs::create_directories( dir.parent_path() ) ;
+	
+	if ( ::mkdir( dir.string().c_str(), mode ) != 0 && errno != EEXIST )
+		BOOST_THROW_EXCEPTION(
+			Error()
+				<< boost::errinfo_api_function("mkdir")
+				<< boost::errinfo_errno(errno)
+				<< boost::errinfo_file_name(dir.string())
+		) ;
+}
+
+namespace
+{
+	/// Close the file descriptor when going out of scope.
+	class FD
+	{
+	public :
+		explicit FD( int fd ) : m_fd( fd ) {}
+		~FD() { if ( m_fd != -1 ) ::close( m_fd ) ; }
+		int Get() const { return m_fd ; }
+	
+	private :
+		FD( const FD& ) ;
+		FD& operator=( const FD& ) ;
+		
+	private :
+		int m_fd ;
+	} ;
+	
+	void ThrowCopyError( const char *func, const fs::path& file )
+	{
+		BOOST_THROW_EXCEPTION(
+			Error()
+				<< boost::errinfo_api_function(func)
+				<< boost::errinfo_errno(errno)
+				<< boost::errinfo_file_name(file.string())
+		) ;
+	}
+}
+
+/// Copy the content of a file to a new file. It shares the blocks of the file
+/// if the file system supports it (FICLONE), or copies inside the kernel
+/// (copy_file_range) without going through user space. Otherwise it falls back
+/// to read() and write(). The new file is only readable by the user, like the
+/// downloaded ones.
+void CopyFile( const fs::path& from, const fs::path& to )
+{
+	FD src( ::open( from.string().c_str(), O_RDONLY ) ) ;
+	if ( src.Get() == -1 )
+		ThrowCopyError( "open", from ) ;
+	
+	FD dest( ::open( to.string().c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0600 ) ) ;
+	if ( dest.Get() == -1 )
+		ThrowCopyError( "open", to ) ;
+
+#ifdef FICLONE
+	if ( ::ioctl( dest.Get(), FICLONE, src.Get() ) == 0 )
+		return ;
+#endif
+
+	ssize_t n ;
+
+#ifdef SYS_copy_file_range
+	while ( (n = ::syscall( SYS_copy_file_range, src.Get(), 0, dest.Get(), 0, 1024*1024, 0 )) > 0 )
+		;
+	
+	// not supported, e.g. across file systems in older kernels. the file
+	// offsets tell where to continue with read() and write().
+	if ( n == 0 )
+		return ;
+	if ( errno != ENOSYS && errno != EXDEV && errno != EINVAL && errno != EOPNOTSUPP )
+		ThrowCopyError( "copy_file_range", to ) ;
+#endif
+	
+	char buf[64 * 1024] ;
+	while ( (n = ::read( src.Get(), buf, sizeof(buf) )) != 0 )
+	{
+		if ( n == -1 )
+		{
+			if ( errno == EINTR )
+				continue ;
+			ThrowCopyError( "read", from ) ;
+		}
+		
+		for ( ssize_t w = 0 ; w < n ; )
+		{
+			ssize_t r = ::write( dest.Get(), buf + w, n - w ) ;
+			if ( r == -1 && errno != EINTR )
+				ThrowCopyError( "write", to ) ;
+			w += std::max( r, static_cast<ssize_t>(0) ) ;
+		}
+	}
+}
+
 void Sleep( unsigned int sec )
 {
 	struct timespec ts = { sec, 0 } ;
@@ -94,4 +237,13 @@ void Sleep( unsigned int sec )
 	} while ( result == -1 && errno == EINTR ) ;
 }
 
+void MilliSleep( unsigned long msec )
+{
+	struct timespec ts = { static_cast<std::time_t>(msec / 1000), static_cast<long>(msec % 1000) * 1000000 } ;
+	
+	struct timespec rem ;
+	while ( ::nanosleep( &ts, &rem ) == -1 && errno == EINTR )
+		ts = rem ;
+}
+
 } } // end of namespaces
@@ -19,27 +19,47 @@
 
 #pragma once
 
+#include "DateTime.hh"
 #include "Exception.hh"
 #include "FileSystem.hh"
+#include "Types.hh"
 
 #include <string>
 
 namespace gr {
 
-class DateTime ;
 class Path ;
 
 namespace os
 {
 	struct Error : virtual Exception {} ;
 	
+	/// The part of stat(2) that grive uses to tell if a file has changed.
+	struct FileStat
+	{
+		u64_t		size ;
+		DateTime	mtime ;
+		DateTime	ctime ;
+		u64_t		ino ;
+		u64_t		dev ;
+		bool		is_dir ;
+	} ;
+	
+	FileStat Stat( const std::string& filename ) ;
+	FileStat Stat( const fs::path& filename ) ;
+	
 	DateTime FileCTime( const std::string& filename ) ;
 	DateTime FileCTime( const fs::path& filename ) ;
 	
 	void SetFileTime( const std::string& filename, const DateTime& t ) ;
 	void SetFileTime( const fs::path& filename, const DateTime& t ) ;
 	
+	void MakeDir( const fs::path& dir, int mode ) ;
+	
+	void CopyFile( const fs::path& from, const fs::path& to ) ;
+	
 	void Sleep( unsigned int sec ) ;
+	void MilliSleep( unsigned long msec ) ;
 }
 
 } // end of namespaces
@@ -0,0 +1,243 @@
+/*
+	grive: an GPL program to sync a local directory with Google Drive
+	Copyright (C) 2012  Wan Wai Ho
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation version 2
+	of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "Stats.hh"
+
+#include "protocol/Json.hh"
+
+#include <boost/format.hpp>
+
+#include <algorithm>
+#include <cmath>
+#include <ostream>
+
+namespace gr {
+
+Stats::Timer::Timer( const std::string& name ) :
+	m_name	( name ),
+	m_start	( DateTime::Now() )
+{
+}
+
+Stats::Timer::~Timer( )
+{
+	Stats::Inst().AddTime( m_name, Elapsed( m_start ) ) ;
+}
+
+Stats::Histogram::Histogram( ) :
+	m_count	( 0 ),
+	m_max	( 0.0 )
+{
+}
+
+void Stats::Histogram::Add( double seconds )
+{
+	seconds = std::max( seconds, 0.0 ) ;
+	
+	m_buckets[Bucket( static_cast<u64_t>( seconds * 1e6 ) )]++ ;
+	m_count++ ;
+	m_max = std::max( m_max, seconds ) ;
+}
+
+u64_t Stats::Histogram::Count( ) const
+{
+	return m_count ;
+}
+
+double Stats::Histogram::Max( ) const
+{
+	return m_max ;
+}
+
+/// The time below which \a p (0 to 1) of the samples are, in seconds. It is
+/// the upper bound of the bucket, but never more than the largest sample.
+double Stats::Histogram::Percentile( double p ) const
+{
+	u64_t rank = static_cast<u64_t>( std::ceil( p * m_count ) ) ;
+	
+	u64_t sum = 0 ;
+	for ( std::map<std::size_t, u64_t>::const_iterator i = m_buckets.begin() ; i != m_buckets.end() ; ++i )
+	{
+		sum += i->second ;
+		if ( sum >= rank )
+			return std::min( Upper( i->first ) / 1e6, m_max ) ;
+	}
+	return m_max ;
+}
+
+/// Values below 16 have a bucket each. Above that, the bucket is given by
+/// the highest bit and the 4 bits after it.
+std::size_t Stats::Histogram::Bucket( u64_t us )
+{
+	if ( us < 16 )
+		return us ;
+	
+	std::size_t high = 4 ;
+	while ( ( us >> ( high + 1 ) ) != 0 )
+		high++ ;
+	
+	return ( high - 3 ) * 16 + ( ( us >> ( high - 4 ) ) - 16 ) ;
+}
+
+/// The largest value in the bucket, in microseconds.
+u64_t Stats::Histogram::Upper( std::size_t bucket )
+{
+	if ( bucket < 16 )
+		return bucket ;
+	
+	std::size_t	high		= bucket / 16 + 3 ;
+	u64_t		mantissa	= bucket % 16 + 16 ;
+	return ( ( mantissa + 1 ) << ( high - 4 ) ) - 1 ;
+}
+
+Stats& Stats::Inst()
+{
+	static Stats stats ;
+	return stats ;
+}
+
+Stats::Stats( )
+{
+}
+
+Stats::Value& Stats::Find( const std::string& name )
+{
+	Values::iterator i = m_values.find( name ) ;
+	if ( i == m_values.end() )
+	{
+		Value v = { 0, 0, 0.0 } ;
+		i = m_values.insert( std::make_pair( name, v ) ).first ;
+	}
+	return i->second ;
+}
+
+void Stats::Add( const std::string& name, u64_t count, u64_t amount )
+{
+	boost::mutex::scoped_lock lock( m_mutex ) ;
+	
+	Value& v = Find( name ) ;
+	v.count		+= count ;
+	v.amount	+= amount ;
+}
+
+void Stats::AddTime( const std::string& name, double seconds )
+{
+	boost::mutex::scoped_lock lock( m_mutex ) ;
+	
+	Value& v = Find( name ) ;
+	v.count++ ;
+	v.seconds	+= seconds ;
+}
+
+void Stats::AddSample( const std::string& name, double seconds )
+{
+	boost::mutex::scoped_lock lock( m_mutex ) ;
+	m_hists[name].Add( seconds ) ;
+}
+
+Stats::Values Stats::Get( ) const
+{
+	boost::mutex::scoped_lock lock( m_mutex ) ;
+	return m_values ;
+}
+
+Stats::Histograms Stats::GetHistograms( ) const
+{
+	boost::mutex::scoped_lock lock( m_mutex ) ;
+	return m_hists ;
+}
+
+/// Print the values as a table, with a blank line between the groups, and
+/// the percentiles of the histograms in milliseconds after them.
+void Stats::Print( std::ostream& os ) const
+{
+	const Values		values	= Get() ;
+	const Histograms	hists	= GetHistograms() ;
+	
+	os << boost::format( "%-24s %10s %16s %12s\n" ) % "" % "count" % "amount" % "seconds" ;
+	
+	std::string group ;
+	for ( Values::const_iterator i = values.begin() ; i != values.end() ; ++i )
+	{
+		std::string g = i->first.substr( 0, i->first.find( '.' ) ) ;
+		if ( g != group && !group.empty() )
+			os << '\n' ;
+		group = g ;
+		
+		os << boost::format( "%-24s %10u %16s %12s\n" )
+			% i->first
+			% i->second.count
+			% ( i->second.amount > 0 ? ( boost::format( "%u" ) % i->second.amount ).str() : "-" )
+			% ( i->second.seconds > 0 ? ( boost::format( "%.3f" ) % i->second.seconds ).str() : "-" ) ;
+	}
+	
+	if ( hists.empty() )
+		return ;
+	
+	os << '\n' << boost::format( "%-24s %10s %10s %10s %10s %10s\n" )
+		% "(ms)" % "count" % "p50" % "p95" % "p99" % "max" ;
+	for ( Histograms::const_iterator i = hists.begin() ; i != hists.end() ; ++i )
+	{
+		os << boost::format( "%-24s %10u %10.1f %10.1f %10.1f %10.1f\n" )
+			% i->first
+			% i->second.Count()
+			% ( i->second.Percentile( 0.50 ) * 1e3 )
+			% ( i->second.Percentile( 0.95 ) * 1e3 )
+			% ( i->second.Percentile( 0.99 ) * 1e3 )
+			% ( i->second.Max() * 1e3 ) ;
+	}
+}
+
+Json Stats::ToJson( ) const
+{
+	const Values values = Get() ;
+	
+	Json result ;
+	for ( Values::const_iterator i = values.begin() ; i != values.end() ; ++i )
+	{
+		Json v ;
+		v.Add( "count",		Json( static_cast<boost::uint64_t>( i->second.count ) ) ) ;
+		v.Add( "amount",	Json( static_cast<boost::uint64_t>( i->second.amount ) ) ) ;
+		v.Add( "seconds",	Json( i->second.seconds ) ) ;
+		result.Add( i->first, v ) ;
+	}
+	
+	// percentiles in seconds
+	const Histograms hists = GetHistograms() ;
+	for ( Histograms::const_iterator i = hists.begin() ; i != hists.end() ; ++i )
+	{
+		Json v ;
+		v.Add( "count",	Json( static_cast<boost::uint64_t>( i->second.Count() ) ) ) ;
+		v.Add( "p50",	Json( i->second.Percentile( 0.50 ) ) ) ;
+		v.Add( "p95",	Json( i->second.Percentile( 0.95 ) ) ) ;
+		v.Add( "p99",	Json( i->second.Percentile( 0.99 ) ) ) ;
+		v.Add( "max",	Json( i->second.Max() ) ) ;
+		result.Add( i->first, v ) ;
+	}
+	return result ;
+}
+
+/// Seconds from \a start to now.
+double Stats::Elapsed( const DateTime& start )
+{
+	DateTime now = DateTime::Now() ;
+	return ( now.Sec() - start.Sec() ) + ( static_cast<double>(now.NanoSec()) - start.NanoSec() ) / 1e9 ;
+}
+
+} // end of namespace
@@ -0,0 +1,123 @@
+/*
+	grive: an GPL program to sync a local directory with Google Drive
+	Copyright (C) 2012  Wan Wai Ho
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation version 2
+	of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#pragma once
+
+#include "DateTime.hh"
+#include "Types.hh"
+
+#include <boost/thread/mutex.hpp>
+
+#include <iosfwd>
+#include <map>
+#include <string>
+
+namespace gr {
+
+class Json ;
+
+/*!	\brief	Counters and timers of a run, for --stats
+
+	The values are added up by name, e.g. "local.md5", from any thread. Each
+	name has a count, an amount, e.g. the number of bytes, and the time spent,
+	whichever are used. Timer adds the time spent in a scope. The names are
+	grouped by the part before the first ".".
+	
+	Latencies that need percentiles, not only totals, are added as samples to
+	a Histogram by name instead.
+*/
+class Stats
+{
+public :
+	struct Value
+	{
+		u64_t	count ;
+		u64_t	amount ;
+		double	seconds ;
+	} ;
+	typedef std::map<std::string, Value> Values ;
+	
+	/*!	\brief	histogram of times, like an HDR histogram
+	
+		The times are counted in microseconds. Each power of two is split
+		into 16 buckets of the same width, so a percentile is within about 6%
+		of the real value, whether it is 1ms or 1 minute. Only the buckets
+		used are kept.
+	*/
+	class Histogram
+	{
+	public :
+		Histogram( ) ;
+		
+		void Add( double seconds ) ;
+		
+		u64_t Count( ) const ;
+		double Max( ) const ;
+		double Percentile( double p ) const ;
+		
+		static std::size_t Bucket( u64_t us ) ;
+		static u64_t Upper( std::size_t bucket ) ;
+		
+	private :
+		std::map<std::size_t, u64_t>	m_buckets ;
+		u64_t							m_count ;
+		double							m_max ;
+	} ;
+	typedef std::map<std::string, Histogram> Histograms ;
+	
+	/// Adds the time from its construction to its destruction.
+	class Timer
+	{
+	public :
+		explicit Timer( const std::string& name ) ;
+		~Timer( ) ;
+		
+	private :
+		std::string	m_name ;
+		DateTime	m_start ;
+	} ;
+	
+public :
+	static Stats& Inst() ;
+	
+	void Add( const std::string& name, u64_t count = 1, u64_t amount = 0 ) ;
+	void AddTime( const std::string& name, double seconds ) ;
+	void AddSample( const std::string& name, double seconds ) ;
+	
+	Values Get( ) const ;
+	Histograms GetHistograms( ) const ;
+	void Print( std::ostream& os ) const ;
+	Json ToJson( ) const ;
+	
+	static double Elapsed( const DateTime& start ) ;
+	
+private :
+	Stats( ) ;
+	Stats( const Stats& ) ;
+	Stats& operator=( const Stats& ) ;
+	
+	Value& Find( const std::string& name ) ;
+	
+private :
+	mutable boost::mutex	m_mutex ;
+	Values					m_values ;
+	Histograms				m_hists ;
+} ;
+
+} // end of namespace
@@ -0,0 +1,225 @@
+/*
+	grive: an GPL program to sync a local directory with Google Drive
+	Copyright (C) 2012  Wan Wai Ho
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation version 2
+	of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "Watcher.hh"
+
+#include "DateTime.hh"
+#include "OS.hh"
+#include "log/Log.hh"
+
+#include <boost/cstdint.hpp>
+#include <boost/exception/errinfo_api_function.hpp>
+#include <boost/exception/errinfo_errno.hpp>
+
+#include <cerrno>
+#include <cstring>
+
+#ifdef __linux__
+#include <poll.h>
+#include <sys/inotify.h>
+#include <unistd.h>
+#endif
+
+namespace gr {
+
+namespace
+{
+#ifdef __linux__
+	const boost::uint32_t mask =
+		IN_CREATE | IN_DELETE | IN_MODIFY | IN_CLOSE_WRITE | IN_ATTRIB |
+		IN_MOVED_FROM | IN_MOVED_TO | IN_ONLYDIR ;
+#endif
+	
+	// stop waiting for the events to calm down after this many quiet periods
+	const unsigned long max_quiet = 10 ;
+}
+
+/// \a own returns true for the changes made by the caller itself, which are
+/// not reported.
+/// \throw	Error	if inotify is available but cannot be started.
+Watcher::Watcher( const Ignore& ignore, const Ignore& own ) :
+	m_fd		( -1 ),
+	m_ignore	( ignore ),
+	m_own		( own )
+{
+#ifdef __linux__
+	m_fd = ::inotify_init1( IN_NONBLOCK | IN_CLOEXEC ) ;
+	if ( m_fd < 0 )
+	{
+		BOOST_THROW_EXCEPTION(
+			Error()
+				<< boost::errinfo_api_function("inotify_init1")
+				<< boost::errinfo_errno(errno)
+		) ;
+	}
+#endif
+}
+
+Watcher::~Watcher( )
+{
+#ifdef __linux__
+	if ( m_fd >= 0 )
+		::close( m_fd ) ;
+#endif
+}
+
+/// Watch a directory and all directories under it, except the ignored ones.
+void Watcher::Add( const fs::path& dir )
+{
+	AddTree( dir ) ;
+	
+	Log( "watching %1% directories in %2%", m_wd.size(), dir, log::verbose ) ;
+	if ( !m_unwatched.empty() )
+		Log( "%1% directories cannot be watched and will be scanned instead",
+			m_unwatched.size(), log::warning ) ;
+}
+
+void Watcher::AddTree( const fs::path& dir )
+{
+#ifdef __linux__
+	int wd = ::inotify_add_watch( m_fd, dir.string().c_str(), mask ) ;
+	if ( wd < 0 )
+	{
+		// out of watches. the whole subtree is left to the caller
+		if ( errno == ENOSPC || errno == ENOMEM )
+			m_unwatched.insert( dir ) ;
+		
+		// others, e.g. deleted already, don't matter
+		else
+			Log( "cannot watch %1%: %2%", dir, std::strerror(errno), log::verbose ) ;
+		return ;
+	}
+	m_wd[wd] = dir ;
+	
+	try
+	{
+		for ( fs::directory_iterator i( dir ), end ; i != end ; ++i )
+		{
+			if ( fs::is_directory( i->status() ) &&
+				( m_ignore.empty() || !m_ignore( i->path(), true ) ) )
+				AddTree( i->path() ) ;
+		}
+	}
+	catch ( fs::filesystem_error& e )
+	{
+		Log( "cannot watch %1%: %2%", dir, e.what(), log::verbose ) ;
+	}
+#else
+	m_unwatched.insert( dir ) ;
+#endif
+}
+
+/// Wait for changes for at most \a timeout milliseconds. Once something
+/// changes, keep reading the changes until nothing changes for \a quiet
+/// milliseconds, so that a burst of changes, e.g. copying a folder, is
+/// returned in one go. The directories with changes are added to \a dirty.
+/// Only the entries in them have changed, not necessarily the ones in the
+/// directories under them, except the new directories, which are added too.
+void Watcher::Wait( unsigned long timeout, unsigned long quiet, std::set<fs::path>& dirty )
+{
+	if ( !Poll( timeout ) )
+		return ;
+	
+	DateTime start = DateTime::Now() ;
+	do
+	{
+		Read( dirty ) ;
+	} while ( MilliSec( start ) < quiet * max_quiet && Poll( quiet ) ) ;
+}
+
+/// Returns true if there are events to read.
+bool Watcher::Poll( unsigned long msec )
+{
+#ifdef __linux__
+	struct pollfd pfd = { m_fd, POLLIN, 0 } ;
+	return ::poll( &pfd, 1, static_cast<int>(msec) ) > 0 ;
+#else
+	os::MilliSleep( msec ) ;
+	return false ;
+#endif
+}
+
+void Watcher::Read( std::set<fs::path>& dirty )
+{
+#ifdef __linux__
+	char buf[64 * 1024] __attribute__ ((aligned(__alignof__(struct inotify_event)))) ;
+	
+	ssize_t count ;
+	while ( ( count = ::read( m_fd, buf, sizeof(buf) ) ) > 0 )
+	{
+		for ( char *p = buf ; p < buf + count ; )
+		{
+			const struct inotify_event *ev = reinterpret_cast<const struct inotify_event*>( p ) ;
+			p += sizeof(struct inotify_event) + ev->len ;
+			
+			// events are lost. everything may have changed
+			if ( ev->mask & IN_Q_OVERFLOW )
+			{
+				Log( "too many changes to watch, scanning everything", log::verbose ) ;
+				for ( std::map<int, fs::path>::const_iterator w = m_wd.begin() ; w != m_wd.end() ; ++w )
+					dirty.insert( w->second ) ;
+				continue ;
+			}
+			
+			std::map<int, fs::path>::iterator wd = m_wd.find( ev->wd ) ;
+			if ( wd == m_wd.end() )
+				continue ;
+			
+			if ( ev->mask & IN_IGNORED )
+			{
+				m_wd.erase( wd ) ;
+				continue ;
+			}
+			
+			const fs::path	path	= wd->second / ( ev->len > 0 ? ev->name : "" ) ;
+			const bool		is_dir	= ( ev->mask & IN_ISDIR ) != 0 ;
+			if ( ev->len > 0 && !m_ignore.empty() && m_ignore( path, is_dir ) )
+				continue ;
+			
+			// new directories need to be watched as well, even the ones
+			// created by the caller
+			const bool is_new = is_dir && ( ev->mask & ( IN_CREATE | IN_MOVED_TO ) ) ;
+			if ( is_new )
+				AddTree( path ) ;
+			
+			if ( ev->len > 0 && !m_own.empty() && m_own( path, is_dir ) )
+				continue ;
+			
+			Trace( "%1% changed (%2%)", path, ev->mask ) ;
+			dirty.insert( wd->second ) ;
+			if ( is_new )
+				dirty.insert( path ) ;
+		}
+	}
+#endif
+}
+
+/// Directories that cannot be watched because there are not enough watches.
+const std::set<fs::path>& Watcher::Unwatched( ) const
+{
+	return m_unwatched ;
+}
+
+/// Number of directories watched.
+std::size_t Watcher::Size( ) const
+{
+	return m_wd.size() ;
+}
+
+} // end of namespace
@@ -0,0 +1,81 @@
+/*
+	grive: an GPL program to sync a local directory with Google Drive
+	Copyright (C) 2012  Wan Wai Ho
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation version 2
+	of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#pragma once
+
+#include "Exception.hh"
+#include "FileSystem.hh"
+
+#include <boost/function.hpp>
+
+#include <map>
+#include <set>
+#include <string>
+
+namespace gr {
+
+/*!	\brief	Watches directory trees for changes
+
+	Uses inotify on Linux, with one watch for each directory. The number of
+	watches is limited by the system (fs.inotify.max_user_watches), so a
+	very large tree may not be watched completely. The directories that
+	cannot be watched are remembered in Unwatched(), and the caller should
+	scan them from time to time instead. Without inotify, no directory is
+	watched.
+	
+	The changes the caller has made itself, e.g. the files downloaded, can be
+	told apart from the others so that they are not reported.
+*/
+class Watcher
+{
+public :
+	struct Error : virtual Exception {} ;
+	
+	/// Returns true for the files to ignore, given their paths and whether
+	/// they are directories.
+	typedef boost::function<bool (const fs::path&, bool)> Ignore ;
+	
+public :
+	explicit Watcher( const Ignore& ignore = Ignore(), const Ignore& own = Ignore() ) ;
+	~Watcher( ) ;
+	
+	void Add( const fs::path& dir ) ;
+	void Wait( unsigned long timeout, unsigned long quiet, std::set<fs::path>& dirty ) ;
+	
+	const std::set<fs::path>& Unwatched( ) const ;
+	std::size_t Size( ) const ;
+	
+private :
+	Watcher( const Watcher& ) ;
+	Watcher& operator=( const Watcher& ) ;
+	
+	void AddTree( const fs::path& dir ) ;
+	bool Poll( unsigned long msec ) ;
+	void Read( std::set<fs::path>& dirty ) ;
+	
+private :
+	int							m_fd ;
+	Ignore						m_ignore ;
+	Ignore						m_own ;
+	
+	std::map<int, fs::path>		m_wd ;
+	std::set<fs::path>			m_unwatched ;
+} ;
+
+} // end of namespace
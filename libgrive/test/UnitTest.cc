@@ -21,14 +21,25 @@
 
 #include "util/log/DefaultLog.hh"
 
+#include "drive/ChecksumCacheTest.hh"
+#include "drive/DriveTest.hh"
 #include "drive/EntryTest.hh"
+#include "drive/IgnoreRulesTest.hh"
+#include "drive/JournalTest.hh"
 #include "drive/ResourceTest.hh"
 #include "drive/ResourceTreeTest.hh"
+#include "drive/StateFileTest.hh"
 #include "drive/StateTest.hh"
+#include "drive/SyncPlanTest.hh"
+#include "http/BatchAgentTest.hh"
+#include "http/CacheAgentTest.hh"
+#include "http/RetryPolicyTest.hh"
 #include "util/DateTimeTest.hh"
 #include "util/FunctionTest.hh"
 #include "util/ConfigTest.hh"
 #include "util/SignalHandlerTest.hh"
+#include "util/StatsTest.hh"
+#include "util/WatcherTest.hh"
 #include "xml/NodeTest.hh"
 
 int main( int argc, char **argv )
@@ -38,14 +49,25 @@ int main( int argc, char **argv )
 	gr::LogBase::Inst( std::auto_ptr<gr::LogBase>(new gr::log::DefaultLog) ) ;
 	
 	CppUnit::TextUi::TestRunner runner;
+	runner.addTest( ChecksumCacheTest::suite( ) ) ;
+	runner.addTest( DriveTest::suite( ) ) ;
 	runner.addTest( EntryTest::suite( ) ) ;
 	runner.addTest( StateTest::suite( ) ) ;
+	runner.addTest( JournalTest::suite( ) ) ;
+	runner.addTest( StateFileTest::suite( ) ) ;
+	runner.addTest( SyncPlanTest::suite( ) ) ;
+	runner.addTest( IgnoreRulesTest::suite( ) ) ;
 	runner.addTest( ResourceTest::suite( ) ) ;
 	runner.addTest( ResourceTreeTest::suite( ) ) ;
+	runner.addTest( BatchAgentTest::suite( ) ) ;
+	runner.addTest( CacheAgentTest::suite( ) ) ;
+	runner.addTest( RetryPolicyTest::suite( ) ) ;
 	runner.addTest( DateTimeTest::suite( ) ) ;
 	runner.addTest( FunctionTest::suite( ) ) ;
 	runner.addTest( ConfigTest::suite( ) ) ;
 	runner.addTest( SignalHandlerTest::suite( ) ) ;
+	runner.addTest( StatsTest::suite( ) ) ;
+	runner.addTest( WatcherTest::suite( ) ) ;
 	runner.addTest( NodeTest::suite( ) ) ;
 	runner.run();
   
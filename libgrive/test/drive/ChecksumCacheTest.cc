@@ -0,0 +1,89 @@
+/*
+	grive: an GPL program to sync a local directory with Google Drive
+	Copyright (C) 2012  Wan Wai Ho
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation version 2
+	of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "ChecksumCacheTest.hh"
+
+#include "Assert.hh"
+
+#include "drive/ChecksumCache.hh"
+
+#include <fstream>
+
+namespace grut {
+
+using namespace gr ;
+using namespace gr::v1 ;
+
+namespace
+{
+	void Write( const fs::path& file, const std::string& content )
+	{
+		std::ofstream out( file.string().c_str() ) ;
+		out << content ;
+	}
+}
+
+ChecksumCacheTest::ChecksumCacheTest( )
+{
+}
+
+void ChecksumCacheTest::TestHit( )
+{
+	const fs::path file = fs::temp_directory_path() / fs::unique_path() ;
+	Write( file, "moved" ) ;
+	
+	// a recorded checksum is trusted as long as the file is not changed, so
+	// a wrong one shows that the file is not read again
+	ChecksumCache cache ;
+	cache.Record( file, "00000000000000000000000000000000" ) ;
+	
+	std::string md5		= cache.MD5( file ) ;
+	std::string cached	= cache.Cached( file, os::Stat( file ) ) ;
+	fs::path found		= cache.Find( "00000000000000000000000000000000" ) ;
+	fs::remove( file ) ;
+	
+	GRUT_ASSERT_EQUAL( "00000000000000000000000000000000", md5 ) ;
+	GRUT_ASSERT_EQUAL( "00000000000000000000000000000000", cached ) ;
+	GRUT_ASSERT_EQUAL( file, found ) ;
+}
+
+void ChecksumCacheTest::TestMiss( )
+{
+	const fs::path file = fs::temp_directory_path() / fs::unique_path() ;
+	Write( file, "moved" ) ;
+	
+	ChecksumCache cache ;
+	cache.Record( file, "00000000000000000000000000000000" ) ;
+	
+	// changed: hashed again, and the old checksum no longer finds it
+	Write( file, "changed" ) ;
+	std::string cached	= cache.Cached( file, os::Stat( file ) ) ;
+	std::string md5		= cache.MD5( file ) ;
+	fs::path found		= cache.Find( "00000000000000000000000000000000" ) ;
+	fs::remove( file ) ;
+	
+	GRUT_ASSERT_EQUAL( "", cached ) ;
+	GRUT_ASSERT_EQUAL( "8977dfac2f8e04cb96e66882235f5aba", md5 ) ;
+	GRUT_ASSERT_EQUAL( fs::path(), found ) ;
+	
+	// not in the cache at all
+	GRUT_ASSERT_EQUAL( fs::path(), cache.Find( "11dfd868d93bc2b0e4ce0bee5756f8b1" ) ) ;
+}
+
+} // end of namespace grut
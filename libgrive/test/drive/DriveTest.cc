@@ -0,0 +1,583 @@
+/*
+	grive: an GPL program to sync a local directory with Google Drive
+	Copyright (C) 2012  Wan Wai Ho
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation version 2
+	of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "DriveTest.hh"
+
+#include "Assert.hh"
+
+#include "drive/CommonUri.hh"
+#include "drive/Drive.hh"
+#include "drive/Entry.hh"
+#include "drive/Feed.hh"
+#include "http/MockAgent.hh"
+#include "protocol/Json.hh"
+#include "util/FileSystem.hh"
+#include "xml/TreeBuilder.hh"
+
+#include <boost/format.hpp>
+#include <boost/thread/thread.hpp>
+
+#include <fstream>
+#include <iterator>
+#include <set>
+
+namespace grut {
+
+using namespace gr ;
+using namespace gr::v1 ;
+
+namespace
+{
+	const std::string folder_list	= feed_base + "/-/folder?max-results=50&showroot=true" ;
+	const std::string file_list		= feed_base + "?showfolders=true&showroot=true" ;
+	
+	/// Answers the first request after the local files have surely been read,
+	/// so that the remote entries are compared with them page by page.
+	class SlowAgent : public http::MockAgent
+	{
+	public :
+		long Get( const std::string& url, DataStream *dest, const http::Header& hdr )
+		{
+			if ( Requests().empty() )
+				boost::this_thread::sleep( boost::posix_time::milliseconds( 200 ) ) ;
+			return MockAgent::Get( url, dest, hdr ) ;
+		}
+	} ;
+	
+	std::string ContentsUrl( const std::string& id )
+	{
+		return feed_base + "/" + id + "/contents?showfolders=true" ;
+	}
+	
+	/// The metadata feed, with the largest change stamp.
+	std::string StampXml( long stamp )
+	{
+		return ( boost::format(
+			"<feed xmlns='http://www.w3.org/2005/Atom' "
+				"xmlns:docs='http://schemas.google.com/docs/2007'>"
+				"<docs:largestChangestamp value='%1%'/>"
+			"</feed>" ) % stamp ).str() ;
+	}
+	
+	std::string FolderHref( const std::string& name )
+	{
+		return feed_base + "/folder%3A" + name ;
+	}
+	
+	Json Options( const fs::path& dir )
+	{
+		Json options ;
+		options.Add( "path",	Json( dir.string() ) ) ;
+		options.Add( "log-xml",	Json( false ) ) ;
+		options.Add( "new-rev",	Json( false ) ) ;
+		return options ;
+	}
+	
+	/// Drive::NothingChanged() in a new run, with \a stamp in remote.
+	bool NothingChanged( http::MockAgent& agent, const fs::path& dir, long stamp )
+	{
+		agent.Clear() ;
+		agent.Respond( "GET", feed_metadata, 200, StampXml( stamp ) ) ;
+		
+		Drive drive( &agent, Options( dir ) ) ;
+		return drive.NothingChanged() ;
+	}
+}
+
+DriveTest::DriveTest( )
+{
+}
+
+std::string DriveTest::FeedXml( const std::string& entries, const std::string& next )
+{
+	return "<feed xmlns='http://www.w3.org/2005/Atom' "
+		"xmlns:docs='http://schemas.google.com/docs/2007' "
+		"xmlns:gd='http://schemas.google.com/g/2005'>" +
+		( next.empty() ? "" : "<link rel='next' href='" + next + "'/>" ) +
+		entries + "</feed>" ;
+}
+
+/// A file in the folder \a parent, or in the root folder if it is empty.
+std::string DriveTest::EntryXml( const std::string& name, const std::string& md5, const std::string& parent )
+{
+	return ( boost::format(
+		"<entry gd:etag='\"e1\"'>"
+			"<title>%1%</title>"
+			"<updated>2012-05-09T16:13:22.401Z</updated>"
+			"<gd:resourceId>file:%1%</gd:resourceId>"
+			"<docs:suggestedFilename>%1%</docs:suggestedFilename>"
+			"<docs:md5Checksum>%4%</docs:md5Checksum>"
+			"<content src='https://docs.google.com/%1%'/>"
+			"<link rel='self' href='%2%/file%%3A%1%'/>"
+			"<link rel='http://schemas.google.com/docs/2007#parent' href='%3%'/>"
+			"<category scheme='http://schemas.google.com/g/2005#kind' label='file'/>"
+		"</entry>" ) % name % feed_base % ( parent.empty() ? root_href : parent ) % md5 ).str() ;
+}
+
+/// A folder, with the href FolderHref( \a name ).
+std::string DriveTest::FolderXml( const std::string& name, const std::string& parent )
+{
+	return ( boost::format(
+		"<entry gd:etag='\"e1\"'>"
+			"<title>%1%</title>"
+			"<updated>2012-05-09T16:13:22.401Z</updated>"
+			"<gd:resourceId>folder:%1%</gd:resourceId>"
+			"<link rel='self' href='%2%'/>"
+			"<link rel='http://schemas.google.com/docs/2007#parent' href='%3%'/>"
+			"<category scheme='http://schemas.google.com/g/2005#kind' label='folder'/>"
+		"</entry>" ) % name % FolderHref( name ) % parent ).str() ;
+}
+
+/// The entry of the changes feed for a file in the root folder.
+std::string DriveTest::ChangeXml( const std::string& name, const std::string& md5, const std::string& etag )
+{
+	return ( boost::format(
+		"<entry gd:etag='\"%5%\"'>"
+			"<title>%1%</title>"
+			"<updated>2030-05-09T16:13:22.401Z</updated>"
+			"<gd:resourceId>file:%1%</gd:resourceId>"
+			"<docs:suggestedFilename>%1%</docs:suggestedFilename>"
+			"<docs:md5Checksum>%4%</docs:md5Checksum>"
+			"<docs:changestamp value='6'/>"
+			"<content src='https://docs.google.com/%1%'/>"
+			"<link rel='self' href='%2%/change%%3A6'/>"
+			"<link rel='http://schemas.google.com/docs/2007#alt-self' href='%2%/file%%3A%1%'/>"
+			"<link rel='http://schemas.google.com/docs/2007#parent' href='%3%'/>"
+			"<category scheme='http://schemas.google.com/g/2005#kind' label='file'/>"
+		"</entry>" ) % name % feed_base % root_href % md5 % etag ).str() ;
+}
+
+void DriveTest::TestPipeline( )
+{
+	const fs::path dir = fs::temp_directory_path() / fs::unique_path() ;
+	fs::create_directories( dir ) ;
+	{
+		std::ofstream file( ( dir / "local.txt" ).string().c_str() ) ;
+		file << "new" ;
+	}
+	
+	SlowAgent agent ;
+	agent.Respond( "GET", feed_metadata, 200, StampXml( 5 ) ) ;
+	agent.Respond( "GET", folder_list, 200, FeedXml( "" ) ) ;
+	agent.Respond( "GET", file_list, 200,
+		FeedXml( EntryXml( "a.txt", "11dfd868d93bc2b0e4ce0bee5756f8b1" ), feed_base + "?page=2" ) ) ;
+	agent.Respond( "GET", feed_base + "?page=2", 200,
+		FeedXml( EntryXml( "b.txt", "8977dfac2f8e04cb96e66882235f5aba" ) ) ) ;
+	agent.Respond( "GET", "https://docs.google.com/a.txt", 200, "moved" ) ;
+	agent.Respond( "GET", "https://docs.google.com/b.txt", 200, "changed" ) ;
+	
+	{
+		Drive drive( &agent, Options( dir ) ) ;
+		drive.DetectChanges( true ) ;
+	}
+	
+	bool a_exists	= fs::exists( dir / "a.txt" ) ;
+	bool b_exists	= fs::exists( dir / "b.txt" ) ;
+	fs::remove_all( dir ) ;
+	
+	// "a.txt" is downloaded before the second page is listed. "local.txt"
+	// may be a move, so it waits for the whole list.
+	GRUT_ASSERT_EQUAL( 6u, agent.Requests().size() ) ;
+	GRUT_ASSERT_EQUAL( "https://docs.google.com/a.txt", agent.Requests()[3].url ) ;
+	GRUT_ASSERT_EQUAL( feed_base + "?page=2", agent.Requests()[4].url ) ;
+	GRUT_ASSERT_EQUAL( "https://docs.google.com/b.txt", agent.Requests()[5].url ) ;
+	CPPUNIT_ASSERT( a_exists ) ;
+	CPPUNIT_ASSERT( b_exists ) ;
+}
+
+void DriveTest::TestNoTransfer( )
+{
+	const fs::path dir = fs::temp_directory_path() / fs::unique_path() ;
+	fs::create_directories( dir ) ;
+	
+	SlowAgent agent ;
+	agent.Respond( "GET", feed_metadata, 200, StampXml( 5 ) ) ;
+	agent.Respond( "GET", folder_list, 200, FeedXml( "" ) ) ;
+	agent.Respond( "GET", file_list, 200, FeedXml( EntryXml( "a.txt", "11dfd868d93bc2b0e4ce0bee5756f8b1" ) ) ) ;
+	
+	{
+		Drive drive( &agent, Options( dir ) ) ;
+		drive.DetectChanges( false ) ;
+	}
+	
+	bool a_exists = fs::exists( dir / "a.txt" ) ;
+	fs::remove_all( dir ) ;
+	
+	// only listed, e.g. for a dry run
+	GRUT_ASSERT_EQUAL( 3u, agent.Requests().size() ) ;
+	CPPUNIT_ASSERT( !a_exists ) ;
+}
+
+void DriveTest::TestSyncChanges( )
+{
+	const fs::path dir = fs::temp_directory_path() / fs::unique_path() ;
+	fs::create_directories( dir ) ;
+	
+	http::MockAgent agent ;
+	agent.Respond( "GET", folder_list, 200, FeedXml( "" ) ) ;
+	agent.Respond( "GET", file_list, 200, FeedXml(
+		EntryXml( "a.txt", "11dfd868d93bc2b0e4ce0bee5756f8b1" ) +
+		EntryXml( "b.txt", "8977dfac2f8e04cb96e66882235f5aba" ) ) ) ;
+	agent.Respond( "GET", "https://docs.google.com/a.txt", 200, "moved" ) ;
+	agent.Respond( "GET", "https://docs.google.com/b.txt", 200, "changed" ) ;
+	agent.Respond( "GET", feed_metadata, 200, StampXml( 5 ) ) ;
+	
+	Drive drive( &agent, Options( dir ) ) ;
+	drive.DetectChanges() ;
+	drive.Update() ;
+	drive.SaveState() ;
+	CPPUNIT_ASSERT( fs::exists( dir / "a.txt" ) ) ;
+	
+	// deleted in local, changed in remote, and changed by the sync itself
+	fs::remove( dir / "b.txt" ) ;
+	std::set<fs::path> dirs ;
+	dirs.insert( dir ) ;
+	
+	std::vector<Entry> changes ;
+	Feed feed( xml::TreeBuilder::Parse( FeedXml(
+		ChangeXml( "a.txt", "8977dfac2f8e04cb96e66882235f5aba", "e2" ) +
+		ChangeXml( "b.txt", "8977dfac2f8e04cb96e66882235f5aba", "e1" ) ) ) ) ;
+	std::copy( feed.begin(), feed.end(), std::back_inserter( changes ) ) ;
+	
+	agent.Clear() ;
+	agent.Respond( "GET", "https://docs.google.com/a.txt", 200, "changed" ) ;
+	CPPUNIT_ASSERT( drive.SyncChanges( dirs, changes ) ) ;
+	
+	GRUT_ASSERT_EQUAL( 2u, agent.Requests().size() ) ;
+	GRUT_ASSERT_EQUAL( "DELETE", agent.Requests()[0].method ) ;
+	GRUT_ASSERT_EQUAL( feed_base + "/file%3Ab.txt", agent.Requests()[0].url ) ;
+	GRUT_ASSERT_EQUAL( "https://docs.google.com/a.txt", agent.Requests()[1].url ) ;
+	
+	std::string content ;
+	{
+		std::ifstream file( ( dir / "a.txt" ).string().c_str() ) ;
+		std::getline( file, content ) ;
+	}
+	GRUT_ASSERT_EQUAL( "changed", content ) ;
+	
+	// nothing else has changed
+	agent.Clear() ;
+	CPPUNIT_ASSERT( drive.SyncChanges( dirs, std::vector<Entry>() ) ) ;
+	GRUT_ASSERT_EQUAL( 0u, agent.Requests().size() ) ;
+	
+	// the parent of a new file is not known from the changes feed
+	changes.clear() ;
+	Feed added( xml::TreeBuilder::Parse( FeedXml(
+		ChangeXml( "c.txt", "8977dfac2f8e04cb96e66882235f5aba", "e1" ) ) ) ) ;
+	std::copy( added.begin(), added.end(), std::back_inserter( changes ) ) ;
+	CPPUNIT_ASSERT( !drive.SyncChanges( std::set<fs::path>(), changes ) ) ;
+	
+	fs::remove_all( dir ) ;
+}
+
+void DriveTest::TestRemoteDir( )
+{
+	const fs::path dir = fs::temp_directory_path() / fs::unique_path() ;
+	fs::create_directories( dir ) ;
+	
+	http::MockAgent agent ;
+	agent.Respond( "GET", ContentsUrl( "folder:root" ), 200, FeedXml(
+		FolderXml( "Other", root_href ) + FolderXml( "Projects", root_href ) ) ) ;
+	agent.Respond( "GET", ContentsUrl( "folder:Projects" ), 200, FeedXml(
+		FolderXml( "Foo", FolderHref( "Projects" ) ) ) ) ;
+	agent.Respond( "GET", ContentsUrl( "folder:Foo" ), 200, FeedXml(
+		EntryXml( "a.txt", "11dfd868d93bc2b0e4ce0bee5756f8b1", FolderHref( "Foo" ) ) +
+		FolderXml( "Sub", FolderHref( "Foo" ) ) ) ) ;
+	agent.Respond( "GET", ContentsUrl( "folder:Sub" ), 200, FeedXml(
+		EntryXml( "b.txt", "8977dfac2f8e04cb96e66882235f5aba", FolderHref( "Sub" ) ) ) ) ;
+	agent.Respond( "GET", "https://docs.google.com/a.txt", 200, "moved" ) ;
+	agent.Respond( "GET", "https://docs.google.com/b.txt", 200, "changed" ) ;
+	agent.Respond( "GET", feed_metadata, 200, StampXml( 5 ) ) ;
+	
+	Json options = Options( dir ) ;
+	options.Add( "remote-dir", Json( "Projects/Foo" ) ) ;
+	{
+		Drive drive( &agent, options ) ;
+		drive.DetectChanges() ;
+		drive.Update() ;
+		drive.SaveState() ;
+	}
+	
+	// the path is looked up from the root, then only the subtree is listed
+	GRUT_ASSERT_EQUAL( ContentsUrl( "folder:root" ),		agent.Requests()[0].url ) ;
+	GRUT_ASSERT_EQUAL( ContentsUrl( "folder:Projects" ),	agent.Requests()[1].url ) ;
+	GRUT_ASSERT_EQUAL( feed_metadata,					agent.Requests()[2].url ) ;
+	GRUT_ASSERT_EQUAL( ContentsUrl( "folder:Foo" ),		agent.Requests()[3].url ) ;
+	GRUT_ASSERT_EQUAL( ContentsUrl( "folder:Sub" ),		agent.Requests()[4].url ) ;
+	CPPUNIT_ASSERT( fs::exists( dir / "a.txt" ) ) ;
+	CPPUNIT_ASSERT( fs::exists( dir / "Sub" / "b.txt" ) ) ;
+	
+	// another folder, which doesn't have the files synced from the last one:
+	// they are not deleted
+	agent.Clear() ;
+	agent.Respond( "GET", ContentsUrl( "folder:root" ), 200, FeedXml(
+		FolderXml( "Other", root_href ) + FolderXml( "Projects", root_href ) ) ) ;
+	agent.Respond( "GET", ContentsUrl( "folder:Other" ), 200, FeedXml( "" ) ) ;
+	agent.Respond( "POST", feed_base + "/folder:Other/contents", 201, FolderXml( "Sub", FolderHref( "Other" ) ) ) ;
+	agent.Respond( "GET", feed_metadata, 200, StampXml( 6 ) ) ;
+	
+	Json other = Options( dir ) ;
+	other.Add( "remote-dir", Json( "Other" ) ) ;
+	{
+		Drive drive( &agent, other ) ;
+		CPPUNIT_ASSERT( !drive.NothingChanged() ) ;
+		drive.DetectChanges() ;
+		drive.Update() ;
+	}
+	
+	bool a_exists = fs::exists( dir / "a.txt" ) ;
+	bool b_exists = fs::exists( dir / "Sub" / "b.txt" ) ;
+	fs::remove_all( dir ) ;
+	
+	CPPUNIT_ASSERT( a_exists ) ;
+	CPPUNIT_ASSERT( b_exists ) ;
+	GRUT_ASSERT_EQUAL( 0u, agent.Count( "DELETE" ) ) ;
+	GRUT_ASSERT_EQUAL( 1u, agent.Count( "POST" ) ) ;
+}
+
+void DriveTest::TestMissingRemoteDir( )
+{
+	const fs::path dir = fs::temp_directory_path() / fs::unique_path() ;
+	fs::create_directories( dir ) ;
+	{
+		std::ofstream file( ( dir / "local.txt" ).string().c_str() ) ;
+		file << "new" ;
+	}
+	
+	http::MockAgent agent ;
+	agent.Respond( "GET", ContentsUrl( "folder:root" ), 200, FeedXml( FolderXml( "Projects", root_href ) ) ) ;
+	agent.Respond( "GET", ContentsUrl( "folder:Projects" ), 200, FeedXml( "" ) ) ;
+	
+	Json options = Options( dir ) ;
+	options.Add( "remote-dir", Json( "Projects/None" ) ) ;
+	Drive drive( &agent, options ) ;
+	CPPUNIT_ASSERT_THROW( drive.DetectChanges(), Drive::Error ) ;
+	
+	bool exists = fs::exists( dir / "local.txt" ) ;
+	fs::remove_all( dir ) ;
+	
+	// nothing is listed or synced
+	GRUT_ASSERT_EQUAL( 2u, agent.Requests().size() ) ;
+	CPPUNIT_ASSERT( exists ) ;
+}
+
+void DriveTest::TestNothingChanged( )
+{
+	const fs::path dir = fs::temp_directory_path() / fs::unique_path() ;
+	fs::create_directories( dir ) ;
+	
+	// the change stamp goes up to 7 while syncing
+	http::MockAgent agent ;
+	agent.Respond( "GET", feed_metadata, 200, StampXml( 5 ) ) ;
+	agent.Respond( "GET", feed_metadata, 200, StampXml( 7 ) ) ;
+	agent.Respond( "GET", folder_list, 200, FeedXml( FolderXml( "Sub", root_href ) ) ) ;
+	agent.Respond( "GET", file_list, 200, FeedXml(
+		FolderXml( "Sub", root_href ) +
+		EntryXml( "a.txt", "11dfd868d93bc2b0e4ce0bee5756f8b1" ) +
+		EntryXml( "b.txt", "8977dfac2f8e04cb96e66882235f5aba", FolderHref( "Sub" ) ) ) ) ;
+	agent.Respond( "GET", "https://docs.google.com/a.txt", 200, "moved" ) ;
+	agent.Respond( "GET", "https://docs.google.com/b.txt", 200, "changed" ) ;
+	{
+		Drive drive( &agent, Options( dir ) ) ;
+		CPPUNIT_ASSERT( !drive.NothingChanged() ) ;
+		drive.DetectChanges() ;
+		drive.Update() ;
+		drive.SaveState() ;
+		
+		// the one before the files are listed
+		GRUT_ASSERT_EQUAL( 5, drive.ChangeStamp() ) ;
+	}
+	CPPUNIT_ASSERT( fs::exists( dir / "Sub" / "b.txt" ) ) ;
+	
+	// one small request and the stat of the files
+	CPPUNIT_ASSERT( NothingChanged( agent, dir, 5 ) ) ;
+	GRUT_ASSERT_EQUAL( 1u, agent.Requests().size() ) ;
+	GRUT_ASSERT_EQUAL( feed_metadata, agent.Requests()[0].url ) ;
+	
+	// changed in remote
+	CPPUNIT_ASSERT( !NothingChanged( agent, dir, 7 ) ) ;
+	
+	// created in local, and deleted again
+	{
+		std::ofstream file( ( dir / "Sub" / "new.txt" ).string().c_str() ) ;
+		file << "new" ;
+	}
+	CPPUNIT_ASSERT( !NothingChanged( agent, dir, 5 ) ) ;
+	fs::remove( dir / "Sub" / "new.txt" ) ;
+	CPPUNIT_ASSERT( NothingChanged( agent, dir, 5 ) ) ;
+	
+	// changed in local
+	{
+		std::ofstream file( ( dir / "a.txt" ).string().c_str() ) ;
+		file << "changed again" ;
+	}
+	CPPUNIT_ASSERT( !NothingChanged( agent, dir, 5 ) ) ;
+	
+	// deleted in local
+	fs::remove( dir / "a.txt" ) ;
+	bool unchanged = NothingChanged( agent, dir, 5 ) ;
+	fs::remove_all( dir ) ;
+	
+	CPPUNIT_ASSERT( !unchanged ) ;
+}
+
+void DriveTest::TestFailedDownload( )
+{
+	const fs::path dir = fs::temp_directory_path() / fs::unique_path() ;
+	fs::create_directories( dir ) ;
+	
+	// the content never matches the checksum
+	http::MockAgent agent ;
+	agent.Respond( "GET", feed_metadata, 200, StampXml( 5 ) ) ;
+	agent.Respond( "GET", folder_list, 200, FeedXml( "" ) ) ;
+	agent.Respond( "GET", file_list, 200, FeedXml( EntryXml( "a.txt", "11dfd868d93bc2b0e4ce0bee5756f8b1" ) ) ) ;
+	{
+		Drive drive( &agent, Options( dir ) ) ;
+		drive.DetectChanges() ;
+		drive.Update() ;
+		drive.SaveState() ;
+	}
+	CPPUNIT_ASSERT( !fs::exists( dir / "a.txt" ) ) ;
+	
+	// nothing has changed since, but the file is still to be downloaded
+	CPPUNIT_ASSERT( !NothingChanged( agent, dir, 5 ) ) ;
+	
+	agent.Clear() ;
+	agent.Respond( "GET", feed_metadata, 200, StampXml( 5 ) ) ;
+	agent.Respond( "GET", ChangesFeed( 6 ), 200, FeedXml( "" ) ) ;
+	agent.Respond( "GET", folder_list, 200, FeedXml( "" ) ) ;
+	agent.Respond( "GET", file_list, 200, FeedXml( EntryXml( "a.txt", "11dfd868d93bc2b0e4ce0bee5756f8b1" ) ) ) ;
+	agent.Respond( "GET", "https://docs.google.com/a.txt", 200, "moved" ) ;
+	{
+		Drive drive( &agent, Options( dir ) ) ;
+		drive.DetectChanges() ;
+		drive.Update() ;
+		drive.SaveState() ;
+	}
+	
+	bool exists = fs::exists( dir / "a.txt" ) ;
+	fs::remove_all( dir ) ;
+	
+	// downloaded again, not taken as deleted in local
+	GRUT_ASSERT_EQUAL( 0u, agent.Count( "DELETE" ) ) ;
+	CPPUNIT_ASSERT( exists ) ;
+}
+
+void DriveTest::TestChangesFeed( )
+{
+	const fs::path dir = fs::temp_directory_path() / fs::unique_path() ;
+	fs::create_directories( dir ) ;
+	
+	http::MockAgent agent ;
+	agent.Respond( "GET", feed_metadata, 200, StampXml( 5 ) ) ;
+	agent.Respond( "GET", folder_list, 200, FeedXml( "" ) ) ;
+	agent.Respond( "GET", file_list, 200, FeedXml( EntryXml( "a.txt", "11dfd868d93bc2b0e4ce0bee5756f8b1" ) ) ) ;
+	agent.Respond( "GET", "https://docs.google.com/a.txt", 200, "moved" ) ;
+	{
+		Drive drive( &agent, Options( dir ) ) ;
+		drive.DetectChanges() ;
+		drive.Update() ;
+		drive.SaveState() ;
+	}
+	
+	// changed on both sides. Only the change, which is on the second page,
+	// tells the remote copy is the newer one.
+	{
+		std::ofstream file( ( dir / "a.txt" ).string().c_str() ) ;
+		file << "changed again" ;
+	}
+	const std::string next = feed_base + "/changes-2" ;
+	agent.Clear() ;
+	agent.Respond( "GET", feed_metadata, 200, StampXml( 6 ) ) ;
+	agent.Respond( "GET", ChangesFeed( 6 ), 200, FeedXml( "", next ) ) ;
+	agent.Respond( "GET", next, 200, FeedXml( ChangeXml( "a.txt", "8977dfac2f8e04cb96e66882235f5aba", "e2" ) ) ) ;
+	agent.Respond( "GET", folder_list, 200, FeedXml( "" ) ) ;
+	agent.Respond( "GET", file_list, 200, FeedXml( EntryXml( "a.txt", "8977dfac2f8e04cb96e66882235f5aba" ) ) ) ;
+	agent.Respond( "GET", "https://docs.google.com/a.txt", 200, "changed" ) ;
+	
+	std::string content ;
+	{
+		Drive drive( &agent, Options( dir ) ) ;
+		drive.DetectChanges( true ) ;
+		
+		// downloaded while the files are listed
+		std::ifstream file( ( dir / "a.txt" ).string().c_str() ) ;
+		std::getline( file, content ) ;
+	}
+	fs::remove_all( dir ) ;
+	
+	bool paged = false ;
+	for ( std::size_t i = 0 ; i < agent.Requests().size() ; i++ )
+		paged = paged || agent.Requests()[i].url == next ;
+	CPPUNIT_ASSERT( paged ) ;
+	GRUT_ASSERT_EQUAL( "changed", content ) ;
+}
+
+void DriveTest::TestChangedInLocal( )
+{
+	const fs::path dir = fs::temp_directory_path() / fs::unique_path() ;
+	fs::create_directories( dir ) ;
+	
+	http::MockAgent agent ;
+	agent.Respond( "GET", feed_metadata, 200, StampXml( 5 ) ) ;
+	agent.Respond( "GET", folder_list, 200, FeedXml( "" ) ) ;
+	agent.Respond( "GET", file_list, 200, FeedXml( EntryXml( "a.txt", "11dfd868d93bc2b0e4ce0bee5756f8b1" ) ) ) ;
+	agent.Respond( "GET", "https://docs.google.com/a.txt", 200, "moved" ) ;
+	{
+		Drive drive( &agent, Options( dir ) ) ;
+		drive.DetectChanges() ;
+		drive.Update() ;
+		drive.SaveState() ;
+	}
+	
+	// changed in local, and only touched in remote after that
+	{
+		std::ofstream file( ( dir / "a.txt" ).string().c_str() ) ;
+		file << "changed again" ;
+	}
+	std::string touched = EntryXml( "a.txt", "11dfd868d93bc2b0e4ce0bee5756f8b1" ) ;
+	touched.replace( touched.find( "2012" ), 4, "2030" ) ;
+	touched.replace( touched.find( "e1" ), 2, "e2" ) ;
+	
+	agent.Clear() ;
+	agent.Respond( "GET", feed_metadata, 200, StampXml( 5 ) ) ;
+	agent.Respond( "GET", ChangesFeed( 6 ), 200, FeedXml( "" ) ) ;
+	agent.Respond( "GET", folder_list, 200, FeedXml( "" ) ) ;
+	agent.Respond( "GET", file_list, 200, FeedXml( touched ) ) ;
+	agent.Respond( "GET", "https://docs.google.com/a.txt", 200, "moved" ) ;
+	{
+		Drive drive( &agent, Options( dir ) ) ;
+		drive.DetectChanges() ;
+		drive.Update() ;
+	}
+	
+	std::string content ;
+	{
+		std::ifstream file( ( dir / "a.txt" ).string().c_str() ) ;
+		std::getline( file, content ) ;
+	}
+	fs::remove_all( dir ) ;
+	
+	// not overwritten, though the remote copy is newer
+	GRUT_ASSERT_EQUAL( "changed again", content ) ;
+	for ( std::size_t i = 0 ; i < agent.Requests().size() ; i++ )
+		CPPUNIT_ASSERT( agent.Requests()[i].url != "https://docs.google.com/a.txt" ) ;
+}
+
+} // end of namespace grut
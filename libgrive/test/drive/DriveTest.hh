@@ -0,0 +1,65 @@
+/*
+	grive: an GPL program to sync a local directory with Google Drive
+	Copyright (C) 2012  Wan Wai Ho
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation version 2
+	of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#pragma once
+
+#include <cppunit/TestFixture.h>
+#include <cppunit/extensions/HelperMacros.h>
+
+#include <string>
+
+namespace grut {
+
+class DriveTest : public CppUnit::TestFixture
+{
+public :
+	DriveTest( ) ;
+
+	// declare suit function
+	CPPUNIT_TEST_SUITE( DriveTest ) ;
+		CPPUNIT_TEST( TestPipeline ) ;
+		CPPUNIT_TEST( TestNoTransfer ) ;
+		CPPUNIT_TEST( TestSyncChanges ) ;
+		CPPUNIT_TEST( TestRemoteDir ) ;
+		CPPUNIT_TEST( TestMissingRemoteDir ) ;
+		CPPUNIT_TEST( TestNothingChanged ) ;
+		CPPUNIT_TEST( TestFailedDownload ) ;
+		CPPUNIT_TEST( TestChangesFeed ) ;
+		CPPUNIT_TEST( TestChangedInLocal ) ;
+	CPPUNIT_TEST_SUITE_END();
+
+private :
+	void TestPipeline( ) ;
+	void TestNoTransfer( ) ;
+	void TestSyncChanges( ) ;
+	void TestRemoteDir( ) ;
+	void TestMissingRemoteDir( ) ;
+	void TestNothingChanged( ) ;
+	void TestFailedDownload( ) ;
+	void TestChangesFeed( ) ;
+	void TestChangedInLocal( ) ;
+	
+	static std::string FeedXml( const std::string& entries, const std::string& next = std::string() ) ;
+	static std::string EntryXml( const std::string& name, const std::string& md5,
+		const std::string& parent = std::string() ) ;
+	static std::string FolderXml( const std::string& name, const std::string& parent ) ;
+	static std::string ChangeXml( const std::string& name, const std::string& md5, const std::string& etag ) ;
+} ;
+
+} // end of namespace
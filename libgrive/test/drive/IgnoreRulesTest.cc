@@ -0,0 +1,99 @@
+/*
+	grive: an GPL program to sync a local directory with Google Drive
+	Copyright (C) 2012  Wan Wai Ho
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation version 2
+	of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "IgnoreRulesTest.hh"
+
+#include "drive/IgnoreRules.hh"
+
+namespace grut {
+
+using namespace gr ;
+using namespace gr::v1 ;
+
+IgnoreRulesTest::IgnoreRulesTest( )
+{
+}
+
+void IgnoreRulesTest::TestGlob( )
+{
+	CPPUNIT_ASSERT( IgnoreRules::Glob( "*.o", "main.o" ) ) ;
+	CPPUNIT_ASSERT( !IgnoreRules::Glob( "*.o", "main.oo" ) ) ;
+	CPPUNIT_ASSERT( !IgnoreRules::Glob( "*.o", "src/main.o" ) ) ;
+	CPPUNIT_ASSERT( IgnoreRules::Glob( "a?c", "abc" ) ) ;
+	CPPUNIT_ASSERT( !IgnoreRules::Glob( "a?c", "a/c" ) ) ;
+	CPPUNIT_ASSERT( IgnoreRules::Glob( "[a-c]x", "bx" ) ) ;
+	CPPUNIT_ASSERT( !IgnoreRules::Glob( "[!a-c]x", "bx" ) ) ;
+	CPPUNIT_ASSERT( IgnoreRules::Glob( "\\*", "*" ) ) ;
+	CPPUNIT_ASSERT( !IgnoreRules::Glob( "\\*", "a" ) ) ;
+	CPPUNIT_ASSERT( IgnoreRules::Glob( "doc/**/*.pdf", "doc/a.pdf" ) ) ;
+	CPPUNIT_ASSERT( IgnoreRules::Glob( "doc/**/*.pdf", "doc/a/b/c.pdf" ) ) ;
+	CPPUNIT_ASSERT( !IgnoreRules::Glob( "doc/**/*.pdf", "src/a.pdf" ) ) ;
+	CPPUNIT_ASSERT( IgnoreRules::Glob( "doc/**", "doc/a/b" ) ) ;
+	CPPUNIT_ASSERT( IgnoreRules::Glob( "a/**/b", "a/x/y/b" ) ) ;
+	CPPUNIT_ASSERT( !IgnoreRules::Glob( "a/**/b", "a/xb" ) ) ;
+}
+
+void IgnoreRulesTest::TestRules( )
+{
+	IgnoreRules subject ;
+	subject.Add( "# comment" ) ;
+	subject.Add( "" ) ;
+	subject.Add( "*.o" ) ;
+	subject.Add( "!keep.o" ) ;
+	subject.Add( "build/" ) ;
+	subject.Add( "/tmp" ) ;
+	subject.Add( "doc/*.pdf" ) ;
+	subject.Add( "cache*  " ) ;
+	CPPUNIT_ASSERT( subject.Size() == 6 ) ;
+	
+	// "*.o" at any level, but "keep.o" is included again
+	CPPUNIT_ASSERT( subject.Match( "main.o", false ) ) ;
+	CPPUNIT_ASSERT( subject.Match( "src/lib/main.o", false ) ) ;
+	CPPUNIT_ASSERT( !subject.Match( "src/keep.o", false ) ) ;
+	CPPUNIT_ASSERT( !subject.Match( "main.c", false ) ) ;
+	
+	// directories only
+	CPPUNIT_ASSERT( subject.Match( "src/build", true ) ) ;
+	CPPUNIT_ASSERT( !subject.Match( "src/build", false ) ) ;
+	
+	// anchored to the root
+	CPPUNIT_ASSERT( subject.Match( "tmp", true ) ) ;
+	CPPUNIT_ASSERT( !subject.Match( "src/tmp", true ) ) ;
+	CPPUNIT_ASSERT( subject.Match( "doc/a.pdf", false ) ) ;
+	CPPUNIT_ASSERT( !subject.Match( "src/doc/a.pdf", false ) ) ;
+	
+	// trailing spaces are dropped
+	CPPUNIT_ASSERT( subject.Match( "src/cache.db", false ) ) ;
+}
+
+void IgnoreRulesTest::TestPath( )
+{
+	IgnoreRules subject ;
+	subject.Read( "/nonexistent/root" ) ;
+	CPPUNIT_ASSERT( subject.Empty() ) ;
+	subject.Add( "build/" ) ;
+	
+	CPPUNIT_ASSERT( subject.IsIgnored( "/nonexistent/root/src/build", true ) ) ;
+	CPPUNIT_ASSERT( subject.IsIgnored( "/nonexistent/root/.hidden", false ) ) ;
+	CPPUNIT_ASSERT( !subject.IsIgnored( "/nonexistent/root/src", true ) ) ;
+	CPPUNIT_ASSERT( !subject.IsIgnored( "/nonexistent/root", true ) ) ;
+	CPPUNIT_ASSERT( !subject.IsIgnored( "/nonexistent/rootbuild", true ) ) ;
+}
+
+} // end of namespace
@@ -0,0 +1,101 @@
+/*
+	grive: an GPL program to sync a local directory with Google Drive
+	Copyright (C) 2012  Wan Wai Ho
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation version 2
+	of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "JournalTest.hh"
+
+#include "Assert.hh"
+
+#include "drive/Journal.hh"
+#include "protocol/Json.hh"
+#include "util/File.hh"
+
+namespace grut {
+
+using namespace gr ;
+using namespace gr::v1 ;
+
+namespace
+{
+	Json Rec( const std::string& href )
+	{
+		Json rec ;
+		rec.Add( "href", Json( href ) ) ;
+		return rec ;
+	}
+}
+
+JournalTest::JournalTest( )
+{
+}
+
+void JournalTest::TestReplay( )
+{
+	const fs::path file = fs::temp_directory_path() / fs::unique_path() ;
+	{
+		Journal journal( file ) ;
+		journal.Start( 3 ) ;
+		journal.Append( Rec( "a" ) ) ;
+		journal.Append( Rec( "b" ) ) ;
+		GRUT_ASSERT_EQUAL( journal.Size(), 2u ) ;
+		
+		// written to the disk when destroyed
+	}
+	
+	Journal journal( file ) ;
+	std::vector<Json> recs = journal.Read( 3 ) ;
+	GRUT_ASSERT_EQUAL( recs.size(), 2u ) ;
+	GRUT_ASSERT_EQUAL( recs[1]["href"].Str(), "b" ) ;
+	
+	// records of another state file are not replayed
+	CPPUNIT_ASSERT( journal.Read( 4 ).empty() ) ;
+	
+	// started over
+	journal.Start( 4 ) ;
+	CPPUNIT_ASSERT( journal.Read( 4 ).empty() ) ;
+	GRUT_ASSERT_EQUAL( journal.Size(), 0u ) ;
+	
+	fs::remove( file ) ;
+}
+
+void JournalTest::TestCutShort( )
+{
+	const fs::path file = fs::temp_directory_path() / fs::unique_path() ;
+	{
+		Journal journal( file ) ;
+		journal.Start( 1 ) ;
+		journal.Append( Rec( "a" ) ) ;
+		journal.Flush() ;
+	}
+	
+	// a crash in the middle of writing a record
+	{
+		File f ;
+		f.OpenForAppend( file ) ;
+		const std::string part = "{ \"href\": \"b" ;
+		f.Write( part.c_str(), part.size() ) ;
+	}
+	
+	std::vector<Json> recs = Journal( file ).Read( 1 ) ;
+	GRUT_ASSERT_EQUAL( recs.size(), 1u ) ;
+	GRUT_ASSERT_EQUAL( recs[0]["href"].Str(), "a" ) ;
+	
+	fs::remove( file ) ;
+}
+
+} // end of namespace grut
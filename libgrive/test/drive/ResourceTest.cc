@@ -23,9 +23,19 @@
 
 #include "drive/Resource.hh"
 
+#include "drive/ChecksumCache.hh"
+#include "drive/CommonUri.hh"
 #include "drive/Entry.hh"
+#include "http/Header.hh"
+#include "http/MockAgent.hh"
+#include "protocol/Json.hh"
 #include "xml/Node.hh"
+#include "xml/TreeBuilder.hh"
 
+#include <boost/bind.hpp>
+#include <boost/format.hpp>
+
+#include <fstream>
 #include <iostream>
 
 namespace grut {
@@ -37,6 +47,42 @@ ResourceTest::ResourceTest( )
 {
 }
 
+/// A new directory with "a.txt" and "b.txt" in it, which have the same content.
+/// The caller removes it.
+fs::path ResourceTest::TempDir( )
+{
+	const fs::path dir = fs::temp_directory_path() / fs::unique_path() ;
+	fs::create_directories( dir ) ;
+	for ( int i = 0 ; i < 2 ; i++ )
+	{
+		std::ofstream file( ( dir / ( i == 0 ? "a.txt" : "b.txt" ) ).string().c_str() ) ;
+		file << "moved" ;
+	}
+	return dir ;
+}
+
+/// The entry of a resource in remote, with the content of the files in
+/// TempDir(). The ID is the name without the extension, e.g. "file:a" for "a.txt".
+std::string ResourceTest::EntryXml(
+	const std::string&	name,
+	const std::string&	kind,
+	const std::string&	etag )
+{
+	const std::string id = name.substr( 0, name.find( '.' ) ) ;
+	return ( boost::format(
+		"<entry gd:etag='\"%1%\"'>"
+			"<title>%2%</title>"
+			"<updated>2012-05-09T16:13:22.401Z</updated>"
+			"<gd:resourceId>%3%:%4%</gd:resourceId>"
+			"<docs:suggestedFilename>%2%</docs:suggestedFilename>"
+			"<docs:md5Checksum>11dfd868d93bc2b0e4ce0bee5756f8b1</docs:md5Checksum>"
+			"<content src='https://docs.google.com/%2%'/>"
+			"<link rel='self' href='%5%/%3%%%3A%4%'/>"
+			"<link rel='http://schemas.google.com/g/2005#resumable-create-media' href='%5%/upload/%3%%%3A%4%/contents'/>"
+			"<category scheme='http://schemas.google.com/g/2005#kind' label='%3%'/>"
+		"</entry>" ) % etag % name % kind % id % feed_base ).str() ;
+}
+
 void ResourceTest::TestRootPath()
 {
   std::string rootFolder = "/home/usr/grive/grive";
@@ -65,5 +111,471 @@ void ResourceTest::TestNormal( )
 	GRUT_ASSERT_EQUAL( "local_changed", subject.StateStr() ) ;
 }
 
+void ResourceTest::TestDeleteRemote( )
+{
+	const std::string href = "https://docs.google.com/feeds/default/private/full/file%3Agone" ;
+	const std::string entry =
+		"<entry gd:etag='\"%1%\"'>"
+			"<updated>2012-05-09T16:13:22.401Z</updated>"
+			"<link rel='self' href='%2%'/>"
+		"</entry>" ;
+	
+	Resource root( TEST_DATA ) ;
+	Resource subject( "not_exist.txt", "file" ) ;
+	root.AddChild( &subject ) ;
+	
+	// not in local but older than last sync: deleted in local
+	subject.FromRemote( Entry( xml::TreeBuilder::Parse(
+		(boost::format( entry ) % "e1" % href).str() ) ), DateTime::Now() ) ;
+	GRUT_ASSERT_EQUAL( "local_deleted", subject.StateStr() ) ;
+	
+	// the etag from the feed is still valid: one request only
+	http::MockAgent agent ;
+	DateTime sync_time ;
+	root.Sync( &agent, sync_time, Json(), 0 ) ;
+	
+	GRUT_ASSERT_EQUAL( 1u, agent.Requests().size() ) ;
+	GRUT_ASSERT_EQUAL( "DELETE", agent.Requests()[0].method ) ;
+	GRUT_ASSERT_EQUAL( href, agent.Requests()[0].url ) ;
+	GRUT_ASSERT_EQUAL( "If-Match: \"e1\"", *agent.Requests()[0].hdr.begin() ) ;
+	
+	// changed in remote: fetch the new etag and try again
+	agent.Clear() ;
+	agent.Respond( "DELETE", href, 412 ) ;
+	agent.Respond( "GET", href, 200, (boost::format( entry ) % "e2" % href).str() ) ;
+	root.Sync( &agent, sync_time, Json(), 0 ) ;
+	
+	GRUT_ASSERT_EQUAL( 3u, agent.Requests().size() ) ;
+	GRUT_ASSERT_EQUAL( 2u, agent.Count( "DELETE" ) ) ;
+	GRUT_ASSERT_EQUAL( "GET", agent.Requests()[1].method ) ;
+	GRUT_ASSERT_EQUAL( "If-Match: \"e2\"", *agent.Requests()[2].hdr.begin() ) ;
+}
+
+void ResourceTest::TestUploadSimple( )
+{
+	const std::string link = feed_base + "?convert=false" ;
+	const std::string entry =
+		"<entry gd:etag='\"e1\"'>"
+			"<updated>2012-05-09T16:13:22.401Z</updated>"
+			"<link rel='self' href='https://docs.google.com/feeds/default/private/full/file%3Anew'/>"
+		"</entry>" ;
+	
+	Resource root( TEST_DATA ) ;
+	Resource subject( "entry.xml", "file" ) ;
+	root.AddChild( &subject ) ;
+	subject.FromLocal( DateTime() ) ;
+	GRUT_ASSERT_EQUAL( "local_new", subject.StateStr() ) ;
+	
+	Json options ;
+	options.Add( "upload-threshold", Json( 65536 ) ) ;
+	
+	// small file: metadata and content go in one request
+	http::MockAgent agent ;
+	agent.Respond( "POST", link, 201, entry ) ;
+	DateTime sync_time ;
+	root.Sync( &agent, sync_time, options, 0 ) ;
+	
+	GRUT_ASSERT_EQUAL( 1u, agent.Requests().size() ) ;
+	GRUT_ASSERT_EQUAL( "POST", agent.Requests()[0].method ) ;
+	GRUT_ASSERT_EQUAL( link, agent.Requests()[0].url ) ;
+	CPPUNIT_ASSERT( agent.Requests()[0].hdr.begin()->find( "multipart/related" ) != std::string::npos ) ;
+	CPPUNIT_ASSERT( agent.Requests()[0].data.find( "<updated>" ) != std::string::npos ) ;
+	GRUT_ASSERT_EQUAL( "sync", subject.StateStr() ) ;
+}
+
+void ResourceTest::TestUploadBoundary( )
+{
+	const std::string entry =
+		"<entry gd:etag='\"e1\"'>"
+			"<updated>2012-05-09T16:13:22.401Z</updated>"
+			"<link rel='self' href='https://docs.google.com/feeds/default/private/full/file%3Anew'/>"
+		"</entry>" ;
+	
+	const fs::path dir = fs::temp_directory_path() / fs::unique_path() ;
+	fs::create_directories( dir ) ;
+	{
+		std::ofstream file( ( dir / "a.txt" ).string().c_str() ) ;
+		file << "moved" ;
+	}
+	
+	Resource root( dir ) ;
+	Resource subject( "a.txt", "file" ) ;
+	root.AddChild( &subject ) ;
+	subject.FromLocal( DateTime() ) ;
+	
+	// the content now holds the part boundary, which is made of the checksum
+	{
+		std::ofstream file( ( dir / "a.txt" ).string().c_str() ) ;
+		file << "grive_part_" << subject.MD5() ;
+	}
+	
+	Json options ;
+	options.Add( "upload-threshold", Json( 65536 ) ) ;
+	
+	// uploaded through a resumable session from the create link instead
+	http::MockAgent agent ;
+	agent.Respond( "PUT", "", 201, entry ) ;
+	DateTime sync_time ;
+	root.Sync( &agent, sync_time, options, 0 ) ;
+	fs::remove_all( dir ) ;
+	
+	GRUT_ASSERT_EQUAL( 2u, agent.Requests().size() ) ;
+	GRUT_ASSERT_EQUAL( "POST", agent.Requests()[0].method ) ;
+	GRUT_ASSERT_EQUAL( root_create + "?convert=false", agent.Requests()[0].url ) ;
+	GRUT_ASSERT_EQUAL( "PUT", agent.Requests()[1].method ) ;
+	GRUT_ASSERT_EQUAL( "sync", subject.StateStr() ) ;
+}
+
+namespace
+{
+	Resource* Same( Resource *res, const Resource* )
+	{
+		return res ;
+	}
+	
+	Resource* LocalCopy( const Resource *remote, Resource *local, const Resource *res, fs::path& path )
+	{
+		if ( res != remote )
+			return 0 ;
+		
+		path = local->Path() ;
+		return local ;
+	}
+}
+
+void ResourceTest::TestMoveLocal( )
+{
+	const std::string href = "https://docs.google.com/feeds/default/private/full/file%3Amoved" ;
+	const std::string entry =
+		"<entry gd:etag='\"%1%\"'>"
+			"<title>%2%</title>"
+			"<updated>2012-05-09T16:13:22.401Z</updated>"
+			"<gd:resourceId>file:moved</gd:resourceId>"
+			"<docs:suggestedFilename>%2%</docs:suggestedFilename>"
+			"<docs:md5Checksum>11dfd868d93bc2b0e4ce0bee5756f8b1</docs:md5Checksum>"
+			"<content src='https://docs.google.com/file'/>"
+			"<link rel='self' href='%3%'/>"
+			"<link rel='http://schemas.google.com/g/2005#resumable-edit-media' href='https://docs.google.com/edit'/>"
+			"<category scheme='http://schemas.google.com/g/2005#kind' label='file'/>"
+		"</entry>" ;
+	
+	const fs::path dir = fs::temp_directory_path() / fs::unique_path() ;
+	fs::create_directories( dir ) ;
+	{
+		std::ofstream file( ( dir / "new.txt" ).string().c_str() ) ;
+		file << "moved" ;
+	}
+	
+	Resource root( dir ) ;
+	Resource old( "old.txt", "file" ) ;
+	Resource moved( "new.txt", "file" ) ;
+	root.AddChild( &old ) ;
+	root.AddChild( &moved ) ;
+	
+	old.FromRemote( Entry( xml::TreeBuilder::Parse(
+		(boost::format( entry ) % "e1" % "old.txt" % href).str() ) ), DateTime::Now() ) ;
+	moved.FromLocal( DateTime() ) ;
+	GRUT_ASSERT_EQUAL( "local_deleted", old.StateStr() ) ;
+	GRUT_ASSERT_EQUAL( "local_new", moved.StateStr() ) ;
+	
+	// the remote resource takes the place of the local one
+	std::vector<Resource*> discarded ;
+	root.DetectMoves( boost::bind( &Same, &old, _1 ), discarded ) ;
+	
+	GRUT_ASSERT_EQUAL( 1u, discarded.size() ) ;
+	CPPUNIT_ASSERT( discarded[0] == &moved ) ;
+	GRUT_ASSERT_EQUAL( 1u, root.size() ) ;
+	GRUT_ASSERT_EQUAL( "local_moved", old.StateStr() ) ;
+	GRUT_ASSERT_EQUAL( "new.txt", old.Name() ) ;
+	
+	// renaming needs only one request, without the content
+	http::MockAgent agent ;
+	agent.Respond( "PUT", href, 200, (boost::format( entry ) % "e2" % "new.txt" % href).str() ) ;
+	DateTime sync_time ;
+	root.Sync( &agent, sync_time, Json(), 0 ) ;
+	
+	fs::remove_all( dir ) ;
+	
+	GRUT_ASSERT_EQUAL( 1u, agent.Requests().size() ) ;
+	GRUT_ASSERT_EQUAL( "PUT", agent.Requests()[0].method ) ;
+	GRUT_ASSERT_EQUAL( href, agent.Requests()[0].url ) ;
+	CPPUNIT_ASSERT( agent.Requests()[0].data.find( "<title>new.txt</title>" ) != std::string::npos ) ;
+	GRUT_ASSERT_EQUAL( "sync", old.StateStr() ) ;
+}
+
+void ResourceTest::TestMoveRemote( )
+{
+	const std::string entry =
+		"<entry gd:etag='\"e1\"'>"
+			"<title>%1%</title>"
+			"<updated>2012-05-09T16:13:22.401Z</updated>"
+			"<docs:suggestedFilename>%1%</docs:suggestedFilename>"
+			"<docs:md5Checksum>11dfd868d93bc2b0e4ce0bee5756f8b1</docs:md5Checksum>"
+			"<content src='https://docs.google.com/file'/>"
+			"<link rel='self' href='https://docs.google.com/feeds/default/private/full/%2%'/>"
+			"<category scheme='http://schemas.google.com/g/2005#kind' label='%3%'/>"
+		"</entry>" ;
+	
+	const fs::path dir = fs::temp_directory_path() / fs::unique_path() ;
+	fs::create_directories( dir / "a" ) ;
+	{
+		std::ofstream file( ( dir / "a" / "x.txt" ).string().c_str() ) ;
+		file << "moved" ;
+	}
+	
+	// "a" has been synced, and is renamed to "b" in remote
+	DateTime last_sync( DateTime::Now().Sec() + 60 ) ;
+	
+	Resource root( dir ) ;
+	Resource a( "a", "folder" ), ax( "x.txt", "file" ) ;
+	root.AddChild( &a ) ;
+	a.AddChild( &ax ) ;
+	a.FromLocal( last_sync ) ;
+	ax.FromLocal( last_sync ) ;
+	
+	Resource b( "b", "folder" ), bx( "x.txt", "file" ) ;
+	root.AddChild( &b ) ;
+	b.AddChild( &bx ) ;
+	b.FromRemote( Entry( xml::TreeBuilder::Parse(
+		(boost::format( entry ) % "b" % "folder%3Ab" % "folder").str() ) ), last_sync ) ;
+	bx.FromRemote( Entry( xml::TreeBuilder::Parse(
+		(boost::format( entry ) % "x.txt" % "file%3Ax" % "file").str() ) ), last_sync ) ;
+	
+	GRUT_ASSERT_EQUAL( "remote_deleted", ax.StateStr() ) ;
+	GRUT_ASSERT_EQUAL( "local_deleted", bx.StateStr() ) ;
+	
+	// the remote resources take the local copies, children follow by names
+	std::vector<Resource*> discarded ;
+	root.DetectRemoteMoves( boost::bind( &LocalCopy, &b, &a, _1, _2 ), discarded ) ;
+	
+	GRUT_ASSERT_EQUAL( 2u, discarded.size() ) ;
+	GRUT_ASSERT_EQUAL( 1u, root.size() ) ;
+	GRUT_ASSERT_EQUAL( "remote_moved", b.StateStr() ) ;
+	GRUT_ASSERT_EQUAL( "sync", bx.StateStr() ) ;
+	
+	// moved on disk without any requests
+	http::MockAgent agent ;
+	DateTime sync_time ;
+	root.Sync( &agent, sync_time, Json(), 0 ) ;
+	
+	bool moved = fs::exists( dir / "b" / "x.txt" ) && !fs::exists( dir / "a" ) ;
+	fs::remove_all( dir ) ;
+	
+	CPPUNIT_ASSERT( moved ) ;
+	GRUT_ASSERT_EQUAL( 0u, agent.Requests().size() ) ;
+	GRUT_ASSERT_EQUAL( "sync", b.StateStr() ) ;
+}
+
+void ResourceTest::TestRecoverMoves( )
+{
+	// killed after "a" and "a/x.txt" are renamed to temporary names, and "a"
+	// is moved to "b"
+	const fs::path dir = fs::temp_directory_path() / fs::unique_path() ;
+	fs::create_directories( dir / "b" ) ;
+	{
+		std::ofstream file( ( dir / ".grive-moving-0" ).string().c_str() ) ;
+		file << "moved" ;
+	}
+	{
+		std::ofstream list( ( dir / ".grive-moving" ).string().c_str() ) ;
+		list << ( boost::format(
+			"[ { \"tmp\": \"%1%\", \"path\": \"%2%\" }, "
+			"{ \"tmp\": \"%3%\", \"path\": \"%4%\" } ]" )
+			% ( dir / ".grive-moving-0" ).string() % ( dir / "a" / "x.txt" ).string()
+			% ( dir / ".grive-moving-1" ).string() % ( dir / "a" ).string() ) ;
+	}
+	
+	// the file is put back, even though its folder has been moved
+	Resource::RecoverMoves( dir ) ;
+	
+	bool recovered	= fs::exists( dir / "a" / "x.txt" ) ;
+	bool cleaned	= !fs::exists( dir / ".grive-moving" ) && !fs::exists( dir / ".grive-moving-0" ) ;
+	fs::remove_all( dir ) ;
+	
+	CPPUNIT_ASSERT( recovered ) ;
+	CPPUNIT_ASSERT( cleaned ) ;
+}
+
+void ResourceTest::TestDownloadCopy( )
+{
+	const fs::path dir = TempDir() ;
+	
+	ChecksumCache cache ;
+	cache.MD5( dir / "a.txt" ) ;
+	GRUT_ASSERT_EQUAL( dir / "a.txt", cache.Find( "11dfd868d93bc2b0e4ce0bee5756f8b1" ) ) ;
+	
+	Resource root( dir ) ;
+	Resource subject( "copy.txt", "file" ) ;
+	root.AddChild( &subject ) ;
+	subject.FromRemote( Entry( xml::TreeBuilder::Parse( EntryXml( "copy.txt" ) ) ), DateTime() ) ;
+	GRUT_ASSERT_EQUAL( "remote_new", subject.StateStr() ) ;
+	
+	// same content in local: copy instead of download
+	http::MockAgent agent ;
+	DateTime sync_time ;
+	root.Sync( &agent, sync_time, Json(), &cache ) ;
+	
+	std::string content ;
+	{
+		std::ifstream file( ( dir / "copy.txt" ).string().c_str() ) ;
+		std::getline( file, content ) ;
+	}
+	fs::remove_all( dir ) ;
+	
+	GRUT_ASSERT_EQUAL( 0u, agent.Requests().size() ) ;
+	GRUT_ASSERT_EQUAL( "moved", content ) ;
+	GRUT_ASSERT_EQUAL( "sync", subject.StateStr() ) ;
+}
+
+void ResourceTest::TestDownloadMismatch( )
+{
+	const fs::path dir = fs::temp_directory_path() / fs::unique_path() ;
+	fs::create_directories( dir ) ;
+	
+	Resource root( dir ) ;
+	Resource bad( "bad.txt", "file" ), good( "good.txt", "file" ) ;
+	root.AddChild( &bad ) ;
+	root.AddChild( &good ) ;
+	bad.FromRemote( Entry( xml::TreeBuilder::Parse( EntryXml( "bad.txt" ) ) ), DateTime() ) ;
+	good.FromRemote( Entry( xml::TreeBuilder::Parse( EntryXml( "good.txt" ) ) ), DateTime() ) ;
+	
+	// the content of "bad.txt" never matches its checksum
+	http::MockAgent agent ;
+	for ( int i = 0 ; i < 3 ; i++ )
+		agent.Respond( "GET", "https://docs.google.com/bad.txt", 200, "corrupted" ) ;
+	agent.Respond( "GET", "https://docs.google.com/good.txt", 200, "moved" ) ;
+	
+	DateTime sync_time ;
+	root.Sync( &agent, sync_time, Json(), 0 ) ;
+	
+	bool bad_exists		= fs::exists( dir / "bad.txt" ) ;
+	bool good_exists	= fs::exists( dir / "good.txt" ) ;
+	fs::remove_all( dir ) ;
+	
+	// given up after 3 attempts, and tried again in the next sync. the other
+	// file is still downloaded
+	GRUT_ASSERT_EQUAL( 4u, agent.Requests().size() ) ;
+	CPPUNIT_ASSERT( !bad_exists ) ;
+	GRUT_ASSERT_EQUAL( "remote_new", bad.StateStr() ) ;
+	CPPUNIT_ASSERT( good_exists ) ;
+	GRUT_ASSERT_EQUAL( "sync", good.StateStr() ) ;
+}
+
+void ResourceTest::TestCopyRemote( )
+{
+	const fs::path dir = TempDir() ;
+	
+	Resource root( dir ) ;
+	Resource a( "a.txt", "file" ), b( "b.txt", "file" ) ;
+	root.AddChild( &a ) ;
+	root.AddChild( &b ) ;
+	a.FromLocal( DateTime() ) ;
+	b.FromLocal( DateTime() ) ;
+	a.FromRemote( Entry( xml::TreeBuilder::Parse( EntryXml( "a.txt" ) ) ), DateTime() ) ;
+	GRUT_ASSERT_EQUAL( "sync", a.StateStr() ) ;
+	GRUT_ASSERT_EQUAL( "local_new", b.StateStr() ) ;
+	
+	// "b.txt" is a copy of "a.txt": copy it in remote without uploading
+	http::MockAgent agent ;
+	agent.Respond( "POST", feed_base, 201, EntryXml( "b.txt" ) ) ;
+	root.DetectCopies() ;
+	DateTime sync_time ;
+	root.Sync( &agent, sync_time, Json(), 0 ) ;
+	fs::remove_all( dir ) ;
+	
+	GRUT_ASSERT_EQUAL( 1u, agent.Requests().size() ) ;
+	GRUT_ASSERT_EQUAL( "POST", agent.Requests()[0].method ) ;
+	GRUT_ASSERT_EQUAL( feed_base, agent.Requests()[0].url ) ;
+	CPPUNIT_ASSERT( agent.Requests()[0].data.find( "<id>" + a.SelfHref() + "</id>" ) != std::string::npos ) ;
+	GRUT_ASSERT_EQUAL( "sync", b.StateStr() ) ;
+	GRUT_ASSERT_EQUAL( feed_base + "/file%3Ab", b.SelfHref() ) ;
+}
+
+void ResourceTest::TestCopyToFolder( )
+{
+	const fs::path dir = TempDir() ;
+	fs::create_directories( dir / "sub" ) ;
+	fs::rename( dir / "b.txt", dir / "sub" / "b.txt" ) ;
+	
+	Resource root( dir ) ;
+	Resource a( "a.txt", "file" ), sub( "sub", "folder" ), b( "b.txt", "file" ) ;
+	root.AddChild( &a ) ;
+	root.AddChild( &sub ) ;
+	sub.AddChild( &b ) ;
+	a.FromLocal( DateTime() ) ;
+	sub.FromLocal( DateTime() ) ;
+	b.FromLocal( DateTime() ) ;
+	a.FromRemote( Entry( xml::TreeBuilder::Parse( EntryXml( "a.txt" ) ) ), DateTime() ) ;
+	sub.FromRemote( Entry( xml::TreeBuilder::Parse( EntryXml( "sub", "folder" ) ) ), DateTime() ) ;
+	GRUT_ASSERT_EQUAL( "sync", sub.StateStr() ) ;
+	GRUT_ASSERT_EQUAL( "local_new", b.StateStr() ) ;
+	
+	// the copy is created in "sub" directly, not moved there afterwards
+	const std::string contents = feed_base + "/folder:sub/contents" ;
+	http::MockAgent agent ;
+	agent.Respond( "POST", contents, 201, EntryXml( "b.txt" ) ) ;
+	root.DetectCopies() ;
+	DateTime sync_time ;
+	root.Sync( &agent, sync_time, Json(), 0 ) ;
+	fs::remove_all( dir ) ;
+	
+	GRUT_ASSERT_EQUAL( 1u, agent.Requests().size() ) ;
+	GRUT_ASSERT_EQUAL( "POST", agent.Requests()[0].method ) ;
+	GRUT_ASSERT_EQUAL( contents, agent.Requests()[0].url ) ;
+	GRUT_ASSERT_EQUAL( "sync", b.StateStr() ) ;
+}
+
+void ResourceTest::TestDigest( )
+{
+	const fs::path dir = TempDir() ;
+	
+	Resource root( dir ) ;
+	Resource a( "a.txt", "file" ) ;
+	root.AddChild( &a ) ;
+	a.FromLocal( DateTime() ) ;
+	a.FromRemote( Entry( xml::TreeBuilder::Parse( EntryXml( "a.txt" ) ) ), DateTime() ) ;
+	GRUT_ASSERT_EQUAL( "sync", a.StateStr() ) ;
+	
+	std::string local, remote ;
+	CPPUNIT_ASSERT( root.Digest( local, remote, Resource::DigestHook() ) ) ;
+	GRUT_ASSERT_EQUAL( local.size(), 32u ) ;
+	
+	// changed in remote
+	std::string local2, remote2 ;
+	a.FromRemote( Entry( xml::TreeBuilder::Parse( EntryXml( "a.txt", "file", "e2" ) ) ), DateTime() ) ;
+	CPPUNIT_ASSERT( root.Digest( local2, remote2, Resource::DigestHook() ) ) ;
+	GRUT_ASSERT_EQUAL( local2, local ) ;
+	CPPUNIT_ASSERT( remote2 != remote ) ;
+	
+	// created in local
+	Resource b( "b.txt", "file" ) ;
+	root.AddChild( &b ) ;
+	b.FromLocal( DateTime() ) ;
+	CPPUNIT_ASSERT( !root.Digest( local2, remote2, Resource::DigestHook() ) ) ;
+	CPPUNIT_ASSERT( local2 != local ) ;
+	
+	// nothing is synced in a skipped folder
+	http::MockAgent agent ;
+	root.Skip() ;
+	DateTime sync_time ;
+	root.Sync( &agent, sync_time, Json(), 0 ) ;
+	
+	GRUT_ASSERT_EQUAL( 0u, agent.Requests().size() ) ;
+	GRUT_ASSERT_EQUAL( "sync", b.StateStr() ) ;
+	
+	// deleted in local: the checksum from remote must not hide it
+	fs::remove( dir / "a.txt" ) ;
+	Resource root3( dir ) ;
+	Resource deleted( "a.txt", "file" ) ;
+	root3.AddChild( &deleted ) ;
+	deleted.FromRemote( Entry( xml::TreeBuilder::Parse( EntryXml( "a.txt" ) ) ), DateTime::Now() ) ;
+	GRUT_ASSERT_EQUAL( "local_deleted", deleted.StateStr() ) ;
+	
+	std::string local3, remote3 ;
+	CPPUNIT_ASSERT( !root3.Digest( local3, remote3, Resource::DigestHook() ) ) ;
+	CPPUNIT_ASSERT( local3 != local ) ;
+	GRUT_ASSERT_EQUAL( remote3, remote ) ;
+	fs::remove_all( dir ) ;
+}
 
 } // end of namespace grut
@@ -22,6 +22,10 @@
 #include <cppunit/TestFixture.h>
 #include <cppunit/extensions/HelperMacros.h>
 
+#include "util/FileSystem.hh"
+
+#include <string>
+
 namespace grut {
 
 class ResourceTest : public CppUnit::TestFixture
@@ -33,11 +37,39 @@ public :
 	CPPUNIT_TEST_SUITE( ResourceTest ) ;
 		CPPUNIT_TEST( TestNormal ) ;
 		CPPUNIT_TEST( TestRootPath ) ;
+		CPPUNIT_TEST( TestDeleteRemote ) ;
+		CPPUNIT_TEST( TestUploadSimple ) ;
+		CPPUNIT_TEST( TestUploadBoundary ) ;
+		CPPUNIT_TEST( TestMoveLocal ) ;
+		CPPUNIT_TEST( TestMoveRemote ) ;
+		CPPUNIT_TEST( TestRecoverMoves ) ;
+		CPPUNIT_TEST( TestDownloadCopy ) ;
+		CPPUNIT_TEST( TestDownloadMismatch ) ;
+		CPPUNIT_TEST( TestCopyRemote ) ;
+		CPPUNIT_TEST( TestCopyToFolder ) ;
+		CPPUNIT_TEST( TestDigest ) ;
 	CPPUNIT_TEST_SUITE_END();
 
 private :
 	void TestNormal( ) ;
 	void TestRootPath() ;
+	void TestDeleteRemote( ) ;
+	void TestUploadSimple( ) ;
+	void TestUploadBoundary( ) ;
+	void TestMoveLocal( ) ;
+	void TestMoveRemote( ) ;
+	void TestRecoverMoves( ) ;
+	void TestDownloadCopy( ) ;
+	void TestDownloadMismatch( ) ;
+	void TestCopyRemote( ) ;
+	void TestCopyToFolder( ) ;
+	void TestDigest( ) ;
+	
+	static gr::fs::path TempDir( ) ;
+	static std::string EntryXml(
+		const std::string&	name,
+		const std::string&	kind = "file",
+		const std::string&	etag = "e1" ) ;
 } ;
 
 } // end of namespace
@@ -0,0 +1,223 @@
+/*
+	grive: an GPL program to sync a local directory with Google Drive
+	Copyright (C) 2012  Wan Wai Ho
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation version 2
+	of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "StateFileTest.hh"
+
+#include "Assert.hh"
+
+#include "drive/StateFile.hh"
+#include "protocol/Json.hh"
+#include "util/File.hh"
+
+#include <cstring>
+#include <fstream>
+#include <iterator>
+
+namespace grut {
+
+using namespace gr ;
+using namespace gr::v1 ;
+
+namespace
+{
+	StateFile::Checksum Checksum( const std::string& path, const std::string& md5, u64_t ino )
+	{
+		StateFile::Checksum c ;
+		c.path			= path ;
+		c.md5			= md5 ;
+		c.stat.size		= 100 + ino ;
+		c.stat.mtime.Assign( 1350000000, 123 ) ;
+		c.stat.ctime.Assign( 1350000001, 456 ) ;
+		c.stat.ino		= ino ;
+		c.stat.dev		= 2049 ;
+		c.stat.is_dir	= false ;
+		return c ;
+	}
+}
+
+StateFileTest::StateFileTest( )
+{
+}
+
+void StateFileTest::TestLookup( )
+{
+	const fs::path file = fs::temp_directory_path() / fs::unique_path() ;
+	
+	std::vector<StateFile::Checksum> checksums ;
+	checksums.push_back( Checksum( "/b/file2", "ffffffffffffffffffffffffffffffff", 2 ) ) ;
+	checksums.push_back( Checksum( "/a/file1", "d41d8cd98f00b204e9800998ecf8427e", 1 ) ) ;
+	checksums.push_back( Checksum( "/c", "00000000000000000000000000000001", 3 ) ) ;
+	
+	std::vector<StateFile::Inode> inodes( 1 ) ;
+	inodes[0].href	= "https://docs.google.com/feeds/default/private/full/file%3A1" ;
+	inodes[0].path	= "a/file1" ;
+	inodes[0].md5	= "" ;
+	inodes[0].dev	= 2049 ;
+	inodes[0].ino	= 1 ;
+	inodes[0].pending	= false ;
+	
+	StateFile::Info info ;
+	info.last_sync.Assign( 1350000002, 789 ) ;
+	info.change_stamp	= 42 ;
+	info.generation		= 7 ;
+	info.root_id		= "folder:abc" ;
+	
+	std::vector<StateFile::Dir> dirs( 2 ) ;
+	dirs[0].path	= "/b" ;
+	dirs[0].stat	= Checksum( "", "", 5 ).stat ;
+	dirs[1].path	= "/a" ;
+	dirs[1].stat	= Checksum( "", "", 4 ).stat ;
+	dirs[1].entries.resize( 2 ) ;
+	dirs[1].entries[0].name		= "file1" ;
+	dirs[1].entries[0].is_dir	= false ;
+	dirs[1].entries[1].name		= "sub" ;
+	dirs[1].entries[1].is_dir	= true ;
+	
+	std::vector<StateFile::Folder> folders( 2 ) ;
+	folders[0].path		= "/b" ;
+	folders[0].local	= "00000000000000000000000000000001" ;
+	folders[0].remote	= "00000000000000000000000000000002" ;
+	folders[1].path		= "/a" ;
+	folders[1].local	= "d41d8cd98f00b204e9800998ecf8427e" ;
+	folders[1].remote	= "ffffffffffffffffffffffffffffffff" ;
+	
+	StateFile::Write( file, info, checksums, inodes, dirs, folders ) ;
+	CPPUNIT_ASSERT( StateFile::Is( file ) ) ;
+	
+	StateFile subject( file ) ;
+	GRUT_ASSERT_EQUAL( subject.GetInfo().last_sync, info.last_sync ) ;
+	GRUT_ASSERT_EQUAL( subject.GetInfo().change_stamp, 42 ) ;
+	GRUT_ASSERT_EQUAL( subject.GetInfo().generation, 7 ) ;
+	GRUT_ASSERT_EQUAL( subject.GetInfo().root_id, "folder:abc" ) ;
+	GRUT_ASSERT_EQUAL( subject.ChecksumCount(), 3u ) ;
+	
+	StateFile::Checksum c ;
+	CPPUNIT_ASSERT( subject.FindChecksum( "/a/file1", c ) ) ;
+	GRUT_ASSERT_EQUAL( c.md5, "d41d8cd98f00b204e9800998ecf8427e" ) ;
+	GRUT_ASSERT_EQUAL( c.stat.size, 101u ) ;
+	GRUT_ASSERT_EQUAL( c.stat.mtime, checksums[0].stat.mtime ) ;
+	GRUT_ASSERT_EQUAL( c.stat.ctime.NanoSec(), 456u ) ;
+	GRUT_ASSERT_EQUAL( c.stat.dev, 2049u ) ;
+	
+	CPPUNIT_ASSERT( subject.FindChecksum( "/c", c ) ) ;
+	CPPUNIT_ASSERT( !subject.FindChecksum( "/a", c ) ) ;
+	CPPUNIT_ASSERT( !subject.FindChecksum( "/d", c ) ) ;
+	
+	CPPUNIT_ASSERT( subject.FindByMD5( "ffffffffffffffffffffffffffffffff", c ) ) ;
+	GRUT_ASSERT_EQUAL( c.path, "/b/file2" ) ;
+	CPPUNIT_ASSERT( !subject.FindByMD5( "0123456789abcdef0123456789abcdef", c ) ) ;
+	CPPUNIT_ASSERT( !subject.FindByMD5( "not a checksum", c ) ) ;
+	
+	GRUT_ASSERT_EQUAL( subject.InodeCount(), 1u ) ;
+	StateFile::Inode i = subject.GetInode( 0 ) ;
+	GRUT_ASSERT_EQUAL( i.href, inodes[0].href ) ;
+	GRUT_ASSERT_EQUAL( i.path, "a/file1" ) ;
+	GRUT_ASSERT_EQUAL( i.md5, "" ) ;
+	GRUT_ASSERT_EQUAL( i.ino, 1u ) ;
+	CPPUNIT_ASSERT( subject.FindInode( inodes[0].href, i ) ) ;
+	GRUT_ASSERT_EQUAL( i.path, "a/file1" ) ;
+	CPPUNIT_ASSERT( !subject.FindInode( "https://docs.google.com/feeds/default/private/full/file%3A2", i ) ) ;
+	
+	GRUT_ASSERT_EQUAL( subject.DirCount(), 2u ) ;
+	StateFile::Dir d ;
+	CPPUNIT_ASSERT( subject.FindDir( "/a", d ) ) ;
+	GRUT_ASSERT_EQUAL( d.stat.ino, 4u ) ;
+	GRUT_ASSERT_EQUAL( d.stat.mtime, dirs[1].stat.mtime ) ;
+	GRUT_ASSERT_EQUAL( d.entries.size(), 2u ) ;
+	GRUT_ASSERT_EQUAL( d.entries[1].name, "sub" ) ;
+	CPPUNIT_ASSERT( d.entries[1].is_dir ) ;
+	CPPUNIT_ASSERT( subject.FindDir( "/b", d ) ) ;
+	CPPUNIT_ASSERT( d.entries.empty() ) ;
+	CPPUNIT_ASSERT( !subject.FindDir( "/a/sub", d ) ) ;
+	
+	// sorted to be looked up
+	GRUT_ASSERT_EQUAL( subject.FolderCount(), 2u ) ;
+	GRUT_ASSERT_EQUAL( subject.GetFolder( 0 ).path, "/a" ) ;
+	GRUT_ASSERT_EQUAL( subject.GetFolder( 0 ).local, folders[1].local ) ;
+	GRUT_ASSERT_EQUAL( subject.GetFolder( 0 ).remote, folders[1].remote ) ;
+	
+	StateFile::Folder f ;
+	CPPUNIT_ASSERT( subject.FindFolder( "/b", f ) ) ;
+	GRUT_ASSERT_EQUAL( f.local, folders[0].local ) ;
+	CPPUNIT_ASSERT( subject.FindFolder( "/a", f ) ) ;
+	GRUT_ASSERT_EQUAL( f.remote, folders[1].remote ) ;
+	CPPUNIT_ASSERT( !subject.FindFolder( "/a/sub", f ) ) ;
+	
+	Json dump = subject.Dump() ;
+	GRUT_ASSERT_EQUAL( dump["checksum"]["/c"]["md5"].Str(), "00000000000000000000000000000001" ) ;
+	
+	fs::remove( file ) ;
+}
+
+void StateFileTest::TestNotStateFile( )
+{
+	const fs::path file = fs::temp_directory_path() / fs::unique_path() ;
+	
+	// the JSON state file of older versions
+	{
+		File f( file, 0600 ) ;
+		const std::string json = "{ \"change_stamp\": 1 }" ;
+		f.Write( json.c_str(), json.size() ) ;
+	}
+	CPPUNIT_ASSERT( !StateFile::Is( file ) ) ;
+	CPPUNIT_ASSERT_THROW( StateFile subject( file ), StateFile::Error ) ;
+	
+	// cut short
+	{
+		File f( file, 0600 ) ;
+		f.Write( "GRIVEST\0", 8 ) ;
+	}
+	CPPUNIT_ASSERT( StateFile::Is( file ) ) ;
+	CPPUNIT_ASSERT_THROW( StateFile subject( file ), StateFile::Error ) ;
+	
+	CPPUNIT_ASSERT( !StateFile::Is( file.string() + ".none" ) ) ;
+	
+	fs::remove( file ) ;
+}
+
+void StateFileTest::TestOverflow( )
+{
+	const fs::path file = fs::temp_directory_path() / fs::unique_path() ;
+	
+	StateFile::Info info ;
+	info.change_stamp	= 1 ;
+	info.generation		= 1 ;
+	std::vector<StateFile::Checksum> checksums( 1, Checksum( "/a", "d41d8cd98f00b204e9800998ecf8427e", 1 ) ) ;
+	StateFile::Write( file, info, checksums, std::vector<StateFile::Inode>() ) ;
+	
+	std::string content ;
+	{
+		std::ifstream in( file.string().c_str(), std::ios::binary ) ;
+		content.assign( std::istreambuf_iterator<char>( in ), std::istreambuf_iterator<char>() ) ;
+	}
+	
+	// the checksum count follows the magic, the version, the byte order and
+	// four 64-bit integers. the size of the records wraps around with this.
+	const u64_t count = 0x2000000000000001ULL ;
+	std::memcpy( &content[48], &count, sizeof(count) ) ;
+	{
+		File f( file, 0600 ) ;
+		f.Write( content.c_str(), content.size() ) ;
+	}
+	CPPUNIT_ASSERT_THROW( StateFile subject( file ), StateFile::Error ) ;
+	
+	fs::remove( file ) ;
+}
+
+} // end of namespace grut
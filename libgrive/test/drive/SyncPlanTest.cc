@@ -0,0 +1,203 @@
+/*
+	grive: an GPL program to sync a local directory with Google Drive
+	Copyright (C) 2012  Wan Wai Ho
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation version 2
+	of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "SyncPlanTest.hh"
+
+#include "Assert.hh"
+
+#include "drive/Snapshot.hh"
+#include "drive/SyncPlan.hh"
+
+#include <sstream>
+
+namespace grut {
+
+using namespace gr ;
+using namespace gr::v1 ;
+
+namespace
+{
+	typedef Snapshot::Record Rec ;
+	
+	std::string Str( const SyncPlan& plan )
+	{
+		std::ostringstream ss ;
+		for ( SyncPlan::iterator i = plan.begin() ; i != plan.end() ; ++i )
+			ss << ( i == plan.begin() ? "" : ", " ) << i->action << " " << i->path ;
+		return ss.str() ;
+	}
+	
+	Rec Folder( const std::string& path )
+	{
+		return Rec( path, "", true, "folder:" + path ) ;
+	}
+}
+
+SyncPlanTest::SyncPlanTest( )
+{
+}
+
+void SyncPlanTest::TestOrder( )
+{
+	CPPUNIT_ASSERT( Snapshot::PathLess( "a", "a/b" ) ) ;
+	CPPUNIT_ASSERT( Snapshot::PathLess( "a/b", "a.txt" ) ) ;
+	CPPUNIT_ASSERT( Snapshot::PathLess( "a/z", "a0" ) ) ;
+	CPPUNIT_ASSERT( !Snapshot::PathLess( "a", "a" ) ) ;
+	
+	Snapshot s ;
+	s.Add( Rec( "a.txt", "1" ) ) ;
+	s.Add( Rec( "a/b", "2" ) ) ;
+	s.Add( Folder( "a" ) ) ;
+	s.Add( Rec( "b", "3" ) ) ;
+	s.Sort() ;
+	
+	Snapshot::Range r = s.Subtree( "a" ) ;
+	GRUT_ASSERT_EQUAL( r.second - r.first, 2 ) ;
+	GRUT_ASSERT_EQUAL( r.first->path, "a" ) ;
+	GRUT_ASSERT_EQUAL( s.Find( "a/b" )->md5, "2" ) ;
+	CPPUNIT_ASSERT( s.Find( "a/c" ) == 0 ) ;
+	
+	std::vector<std::string> top = s.TopLevel() ;
+	GRUT_ASSERT_EQUAL( top.size(), 3u ) ;
+	GRUT_ASSERT_EQUAL( top[1], "a.txt" ) ;
+}
+
+void SyncPlanTest::TestOneSide( )
+{
+	Snapshot base, local, remote ;
+	base.Add( Rec( "same", "1" ) ) ;
+	local.Add( Rec( "same", "1" ) ) ;
+	remote.Add( Rec( "same", "1", false, "file:same" ) ) ;
+	
+	base.Add( Rec( "edited", "1" ) ) ;
+	local.Add( Rec( "edited", "2" ) ) ;
+	remote.Add( Rec( "edited", "1", false, "file:edited" ) ) ;
+	
+	local.Add( Rec( "new", "1" ) ) ;
+	
+	base.Add( Rec( "gone", "1" ) ) ;
+	remote.Add( Rec( "gone", "1", false, "file:gone" ) ) ;
+	
+	base.Add( Rec( "theirs", "1" ) ) ;
+	local.Add( Rec( "theirs", "1" ) ) ;
+	remote.Add( Rec( "theirs", "2", false, "file:theirs" ) ) ;
+	
+	base.Add( Rec( "removed", "1" ) ) ;
+	local.Add( Rec( "removed", "1" ) ) ;
+	
+	base.Sort() ;
+	local.Sort() ;
+	remote.Sort() ;
+	
+	SyncPlan plan( base, local, remote ) ;
+	GRUT_ASSERT_EQUAL( Str( plan ),
+		"upload edited, delete_remote gone, upload new, delete_local removed, download theirs" ) ;
+	GRUT_ASSERT_EQUAL( plan.begin()->id, "file:edited" ) ;
+	GRUT_ASSERT_EQUAL( (plan.begin()+2)->id, "" ) ;
+}
+
+void SyncPlanTest::TestBothSides( )
+{
+	Snapshot base, local, remote ;
+	
+	// the same change on both sides
+	local.Add( Rec( "both_new", "1" ) ) ;
+	remote.Add( Rec( "both_new", "1" ) ) ;
+	base.Add( Rec( "both_gone", "1" ) ) ;
+	
+	base.Add( Rec( "clash", "1" ) ) ;
+	local.Add( Rec( "clash", "2" ) ) ;
+	remote.Add( Rec( "clash", "3" ) ) ;
+	
+	// changes win over deletes
+	base.Add( Rec( "edit_local", "1" ) ) ;
+	local.Add( Rec( "edit_local", "2" ) ) ;
+	base.Add( Rec( "edit_remote", "1" ) ) ;
+	remote.Add( Rec( "edit_remote", "2" ) ) ;
+	
+	base.Sort() ;
+	local.Sort() ;
+	remote.Sort() ;
+	
+	GRUT_ASSERT_EQUAL( Str( SyncPlan( base, local, remote ) ),
+		"conflict clash, upload edit_local, download edit_remote" ) ;
+}
+
+void SyncPlanTest::TestDeleteFolder( )
+{
+	Snapshot base, local, remote ;
+	const char *paths[] = { "d", "d/e", "d/e/f", "d/g", "x" } ;
+	for ( std::size_t i = 0 ; i < sizeof(paths)/sizeof(paths[0]) ; i++ )
+	{
+		Rec rec = ( i == 0 || i == 1 ? Folder( paths[i] ) : Rec( paths[i], "1" ) ) ;
+		base.Add( rec ) ;
+		local.Add( rec ) ;
+		remote.Add( rec ) ;
+	}
+	base.Sort() ;
+	local.Sort() ;
+	remote.Sort() ;
+	
+	// remote deleted "d", only the folder itself is deleted
+	Snapshot gone ;
+	gone.Add( Rec( "x", "1" ) ) ;
+	GRUT_ASSERT_EQUAL( Str( SyncPlan( base, local, gone ) ), "delete_local d" ) ;
+	
+	// but a file edited locally inside it keeps the folders above it
+	Snapshot edited ;
+	edited.Add( Folder( "d" ) ) ;
+	edited.Add( Folder( "d/e" ) ) ;
+	edited.Add( Rec( "d/e/f", "2" ) ) ;
+	edited.Add( Rec( "d/g", "1" ) ) ;
+	edited.Add( Rec( "x", "1" ) ) ;
+	edited.Sort() ;
+	GRUT_ASSERT_EQUAL( Str( SyncPlan( base, edited, gone ) ),
+		"upload d, upload d/e, upload d/e/f, delete_local d/g" ) ;
+}
+
+void SyncPlanTest::TestSubtree( )
+{
+	Snapshot base, local, remote ;
+	base.Add( Folder( "a" ) ) ;
+	base.Add( Rec( "a/1", "1" ) ) ;
+	base.Add( Rec( "a.txt", "1" ) ) ;
+	local.Add( Folder( "a" ) ) ;
+	local.Add( Rec( "a/1", "2" ) ) ;
+	local.Add( Rec( "a.txt", "1" ) ) ;
+	local.Add( Rec( "b", "1" ) ) ;
+	remote.Add( Folder( "a" ) ) ;
+	remote.Add( Rec( "a/1", "1" ) ) ;
+	remote.Add( Rec( "a/2", "1" ) ) ;
+	base.Sort() ;
+	local.Sort() ;
+	remote.Sort() ;
+	
+	// comparing the top level subtrees one by one gives the same plan
+	SyncPlan whole( base, local, remote ) ;
+	
+	SyncPlan parts ;
+	const char *top[] = { "a", "a.txt", "b" } ;
+	for ( std::size_t i = 0 ; i < sizeof(top)/sizeof(top[0]) ; i++ )
+		parts.Append( SyncPlan( base, local, remote, top[i] ) ) ;
+	
+	GRUT_ASSERT_EQUAL( Str( whole ), "upload a/1, download a/2, delete_local a.txt, upload b" ) ;
+	GRUT_ASSERT_EQUAL( Str( parts ), Str( whole ) ) ;
+}
+
+} // end of namespace grut
@@ -0,0 +1,139 @@
+/*
+	grive: an GPL program to sync a local directory with Google Drive
+	Copyright (C) 2012  Wan Wai Ho
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation version 2
+	of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "BatchAgentTest.hh"
+
+#include "Assert.hh"
+#include "MockAgent.hh"
+
+#include "http/BatchAgent.hh"
+#include "http/Header.hh"
+#include "http/StringResponse.hh"
+
+#include <sstream>
+#include <vector>
+
+namespace grut {
+
+using namespace gr ;
+using namespace gr::http ;
+
+namespace
+{
+	const std::string feed = "https://docs.google.com/feeds/default/private/full" ;
+	
+	std::string StatusXml( int id, long code, const std::string& reason )
+	{
+		std::ostringstream os ;
+		os	<< "<entry><batch:id>" << id << "</batch:id>"
+			<< "<batch:status code='" << code << "' reason='" << reason << "'/>"
+			<< "<batch:operation type='delete'/></entry>" ;
+		return os.str() ;
+	}
+	
+	std::string BatchXml( const std::string& entries )
+	{
+		return "<feed xmlns='http://www.w3.org/2005/Atom' "
+			"xmlns:batch='http://schemas.google.com/gdata/batch'>" + entries + "</feed>" ;
+	}
+}
+
+BatchAgentTest::BatchAgentTest( )
+{
+}
+
+void BatchAgentTest::TestEncode( )
+{
+	Header hdr ;
+	hdr.Add( "Authorization: Bearer abc" ) ;
+	hdr.Add( "If-Match: \"e1\"" ) ;
+	
+	std::vector<Request> reqs ;
+	reqs.push_back( Request( "DELETE", feed + "/file%3Aa", 0, hdr ) ) ;
+	reqs.push_back( Request( "DELETE", feed + "/file%3Ab", 0, Header() + "Authorization: Bearer abc" ) ) ;
+	
+	// the etags go to the entries, not the batch request
+	Header common = BatchAgent::CommonHeader( reqs.begin(), reqs.end() ) ;
+	GRUT_ASSERT_EQUAL( 1, common.end() - common.begin() ) ;
+	GRUT_ASSERT_EQUAL( "Authorization: Bearer abc", *common.begin() ) ;
+	
+	GRUT_ASSERT_EQUAL(
+		"<feed xmlns='http://www.w3.org/2005/Atom' "
+			"xmlns:batch='http://schemas.google.com/gdata/batch' "
+			"xmlns:gd='http://schemas.google.com/g/2005'>"
+		"<entry gd:etag='&quot;e1&quot;'>"
+			"<batch:id>1</batch:id><batch:operation type='delete'/>"
+			"<id>" + feed + "/file%3Aa</id>"
+		"</entry>"
+		"<entry>"
+			"<batch:id>2</batch:id><batch:operation type='delete'/>"
+			"<id>" + feed + "/file%3Ab</id>"
+		"</entry>"
+		"</feed>",
+		BatchAgent::Encode( reqs.begin(), reqs.end() ) ) ;
+}
+
+void BatchAgentTest::TestDecode( )
+{
+	std::vector<Request> reqs ;
+	for ( int i = 0 ; i < 3 ; i++ )
+		reqs.push_back( Request( "DELETE", feed + "/file%3Aa", 0 ) ) ;
+	
+	// out of order, and no answer for the second request
+	GRUT_ASSERT_EQUAL( 2u, BatchAgent::Decode( BatchXml(
+		StatusXml( 3, 200, "Success" ) + StatusXml( 1, 412, "Precondition Failed" ) ),
+		reqs.begin(), reqs.end() ) ) ;
+	
+	GRUT_ASSERT_EQUAL( 412L, reqs[0].response ) ;
+	GRUT_ASSERT_EQUAL( "Precondition Failed", reqs[0].error ) ;
+	GRUT_ASSERT_EQUAL( 0L, reqs[1].response ) ;
+	GRUT_ASSERT_EQUAL( 200L, reqs[2].response ) ;
+	GRUT_ASSERT_EQUAL( "", reqs[2].error ) ;
+}
+
+void BatchAgentTest::TestPerform( )
+{
+	MockAgent *mock = new MockAgent ;
+	BatchAgent agent( std::auto_ptr<Agent>( mock ), feed, 2 ) ;
+	
+	// the second batch is not answered
+	mock->Respond( "POST", feed + "/batch", 200, BatchXml(
+		StatusXml( 1, 200, "Success" ) + StatusXml( 2, 404, "Not Found" ) ) ) ;
+	mock->Respond( "POST", feed + "/batch", 200, BatchXml( "" ) ) ;
+	mock->Respond( "DELETE", feed + "/file%3Ad", 200 ) ;
+	
+	StringResponse resp[4] ;
+	std::vector<Request> reqs ;
+	reqs.push_back( Request( "DELETE", feed + "/file%3Aa", &resp[0] ) ) ;
+	reqs.push_back( Request( "GET", feed + "/file%3Ab", &resp[1] ) ) ;
+	reqs.push_back( Request( "DELETE", feed + "/file%3Ac", &resp[2] ) ) ;
+	reqs.push_back( Request( "DELETE", feed + "/file%3Ad", &resp[3] ) ) ;
+	agent.Perform( reqs ) ;
+	
+	GRUT_ASSERT_EQUAL( 2u, mock->Count( "POST" ) ) ;
+	GRUT_ASSERT_EQUAL( 1u, mock->Count( "GET" ) ) ;
+	GRUT_ASSERT_EQUAL( 1u, mock->Count( "DELETE" ) ) ;
+	
+	GRUT_ASSERT_EQUAL( 200L, reqs[0].response ) ;
+	GRUT_ASSERT_EQUAL( 200L, reqs[1].response ) ;
+	GRUT_ASSERT_EQUAL( 404L, reqs[2].response ) ;
+	GRUT_ASSERT_EQUAL( 200L, reqs[3].response ) ;
+}
+
+} // end of namespace
@@ -0,0 +1,161 @@
+/*
+	grive: an GPL program to sync a local directory with Google Drive
+	Copyright (C) 2012  Wan Wai Ho
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation version 2
+	of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "CacheAgentTest.hh"
+
+#include "Assert.hh"
+
+#include "http/CacheAgent.hh"
+#include "http/Header.hh"
+#include "http/StringResponse.hh"
+#include "util/DataStream.hh"
+
+#include <vector>
+
+namespace grut {
+
+using namespace gr ;
+using namespace gr::http ;
+
+namespace
+{
+	/// Answers every GET with the same body and ETag, or 304 if the request
+	/// has the ETag in "If-None-Match".
+	class FakeAgent : public Agent
+	{
+	public :
+		FakeAgent( std::size_t *count ) : m_count( count ), m_body( "<feed/>" ), m_etag( "\"1\"" )
+		{
+		}
+		
+		long Put( const std::string&, const std::string&, DataStream *, const Header& )	{ return 200 ; }
+		long Put( const std::string&, File *, DataStream *, const Header& )				{ return 200 ; }
+		long Post( const std::string&, const std::string&, DataStream *, const Header& )	{ return 200 ; }
+		long Custom( const std::string&, const std::string&, DataStream *, const Header& )	{ return 200 ; }
+		
+		long Get( const std::string&, DataStream *dest, const Header& hdr )
+		{
+			(*m_count)++ ;
+			for ( Header::iterator i = hdr.begin() ; i != hdr.end() ; ++i )
+			{
+				if ( *i == "If-None-Match: " + m_etag )
+					return 304 ;
+			}
+			dest->Write( m_body.c_str(), m_body.size() ) ;
+			return 200 ;
+		}
+		
+		std::string RedirLocation() const			{ return "" ; }
+		std::string ErrorResponse() const			{ return "" ; }
+		std::string Escape( const std::string& s )	{ return s ; }
+		std::string Unescape( const std::string& s )	{ return s ; }
+		
+		std::string ResponseHeader( const std::string& name ) const
+		{
+			return name == "ETag" ? m_etag : "" ;
+		}
+		
+	private :
+		std::size_t	*m_count ;
+		std::string	m_body ;
+		std::string	m_etag ;
+	} ;
+}
+
+CacheAgentTest::CacheAgentTest( )
+{
+}
+
+void CacheAgentTest::TestGet( )
+{
+	const fs::path dir = fs::temp_directory_path() / fs::unique_path() ;
+	std::size_t count = 0 ;
+	{
+		CacheAgent subject( std::auto_ptr<Agent>( new FakeAgent( &count ) ), dir, "https://feed/", 1024 ) ;
+		
+		StringResponse r1, r2, r3 ;
+		GRUT_ASSERT_EQUAL( 200, subject.Get( "https://feed/a", &r1, Header() ) ) ;
+		GRUT_ASSERT_EQUAL( "<feed/>", r1.Response() ) ;
+		
+		// not modified, so the body comes from the cache
+		GRUT_ASSERT_EQUAL( 200, subject.Get( "https://feed/a", &r2, Header() ) ) ;
+		GRUT_ASSERT_EQUAL( "<feed/>", r2.Response() ) ;
+		GRUT_ASSERT_EQUAL( 1u, subject.Hits() ) ;
+		
+		// other URLs are not cached
+		GRUT_ASSERT_EQUAL( 200, subject.Get( "https://content/a", &r3, Header() ) ) ;
+		GRUT_ASSERT_EQUAL( 200, subject.Get( "https://content/a", &r3, Header() ) ) ;
+		GRUT_ASSERT_EQUAL( 1u, subject.Hits() ) ;
+		GRUT_ASSERT_EQUAL( 4u, count ) ;
+	}
+	
+	// the cache is kept for the next run
+	{
+		CacheAgent subject( std::auto_ptr<Agent>( new FakeAgent( &count ) ), dir, "https://feed/", 1024 ) ;
+		StringResponse r ;
+		GRUT_ASSERT_EQUAL( 200, subject.Get( "https://feed/a", &r, Header() ) ) ;
+		GRUT_ASSERT_EQUAL( "<feed/>", r.Response() ) ;
+		GRUT_ASSERT_EQUAL( 1u, subject.Hits() ) ;
+	}
+	
+	// only readable by the user
+	GRUT_ASSERT_EQUAL( fs::owner_all, fs::status( dir ).permissions() ) ;
+	for ( fs::directory_iterator i( dir ) ; i != fs::directory_iterator() ; ++i )
+		GRUT_ASSERT_EQUAL( fs::owner_read | fs::owner_write, i->status().permissions() ) ;
+	
+	fs::remove_all( dir ) ;
+}
+
+void CacheAgentTest::TestPerform( )
+{
+	const fs::path dir = fs::temp_directory_path() / fs::unique_path() ;
+	std::size_t count = 0 ;
+	
+	// too small to keep anything
+	CacheAgent small( std::auto_ptr<Agent>( new FakeAgent( &count ) ), dir, "https://feed/", 4 ) ;
+	
+	StringResponse r1, r2 ;
+	std::vector<Request> reqs ;
+	reqs.push_back( Request( "GET", "https://feed/a", &r1 ) ) ;
+	reqs.push_back( Request( "GET", "https://feed/b", &r2 ) ) ;
+	small.Perform( reqs ) ;
+	small.Perform( reqs ) ;
+	GRUT_ASSERT_EQUAL( 0u, small.Hits() ) ;
+	
+	CacheAgent subject( std::auto_ptr<Agent>( new FakeAgent( &count ) ), dir, "https://feed/", 1024 ) ;
+	for ( int i = 0 ; i < 2 ; i++ )
+	{
+		StringResponse s1, s2 ;
+		reqs.clear() ;
+		reqs.push_back( Request( "GET", "https://feed/a", &s1 ) ) ;
+		reqs.push_back( Request( "GET", "https://feed/b", &s2 ) ) ;
+		subject.Perform( reqs ) ;
+		
+		GRUT_ASSERT_EQUAL( 200, reqs[0].response ) ;
+		GRUT_ASSERT_EQUAL( 200, reqs[1].response ) ;
+		CPPUNIT_ASSERT( reqs[0].dest == &s1 ) ;
+		GRUT_ASSERT_EQUAL( "<feed/>", s1.Response() ) ;
+		GRUT_ASSERT_EQUAL( "<feed/>", s2.Response() ) ;
+	}
+	GRUT_ASSERT_EQUAL( 2u, subject.Hits() ) ;
+	
+	fs::remove_all( dir ) ;
+}
+
+} // end of namespace
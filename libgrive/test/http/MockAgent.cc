@@ -17,8 +17,11 @@
 	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 */
 
+
 #include "MockAgent.hh"
 
+#include "util/DataStream.hh"
+
 namespace gr { namespace http {
 
 MockAgent::MockAgent()
@@ -26,38 +29,47 @@ MockAgent::MockAgent()
 }
 
 long MockAgent::Put(
-	const std::string&		,
-	const std::string&		,
-	Receivable				*,
-	const Header&			)
+	const std::string&		url,
+	const std::string&		data,
+	DataStream				*dest,
+	const Header&			hdr )
 {
-	return 200 ;
+	return Answer( "PUT", url, data, dest, hdr ) ;
+}
+
+long MockAgent::Put(
+	const std::string&		url,
+	File					*,
+	DataStream				*dest,
+	const Header&			hdr )
+{
+	return Answer( "PUT", url, "", dest, hdr ) ;
 }
 
 long MockAgent::Get(
-	const std::string& 		,
-	Receivable				*,
-	const Header&			 )
+	const std::string& 		url,
+	DataStream				*dest,
+	const Header&			hdr )
 {
-	return 200 ;
+	return Answer( "GET", url, "", dest, hdr ) ;
 }
 
 long MockAgent::Post(
-	const std::string& 		,
-	const std::string&		,
-	Receivable				*,
-	const Header&			 )
+	const std::string& 		url,
+	const std::string&		data,
+	DataStream				*dest,
+	const Header&			hdr )
 {
-	return 200 ;
+	return Answer( "POST", url, data, dest, hdr ) ;
 }
 
 long MockAgent::Custom(
-	const std::string&		,
-	const std::string&		,
-	Receivable				*,
-	const Header&			 )
+	const std::string&		method,
+	const std::string&		url,
+	DataStream				*dest,
+	const Header&			hdr )
 {
-	return 200 ;
+	return Answer( method, url, "", dest, hdr ) ;
 }
 
 std::string MockAgent::RedirLocation() const
@@ -65,6 +77,16 @@ std::string MockAgent::RedirLocation() const
 	return "" ;
 }
 
+std::string MockAgent::ResponseHeader( const std::string& ) const
+{
+	return "" ;
+}
+
+std::string MockAgent::ErrorResponse() const
+{
+	return m_error ;
+}
+
 std::string MockAgent::Escape( const std::string& str )
 {
 	return str ;
@@ -75,4 +97,63 @@ std::string MockAgent::Unescape( const std::string& str )
 	return str ;
 }
 
+/// Answer the next request of \a method to \a url with \a response. Responses
+/// to the same request are used in the order they are given.
+void MockAgent::Respond(
+	const std::string&	method,
+	const std::string&	url,
+	long				response,
+	const std::string&	body )
+{
+	m_resp[Key( method, url )].push_back( Response( response, body ) ) ;
+}
+
+/// All requests made so far.
+const std::vector<Request>& MockAgent::Requests() const
+{
+	return m_reqs ;
+}
+
+/// Number of requests made with \a method.
+std::size_t MockAgent::Count( const std::string& method ) const
+{
+	std::size_t count = 0 ;
+	for ( std::vector<Request>::const_iterator i = m_reqs.begin() ; i != m_reqs.end() ; ++i )
+		count += ( i->method == method ) ;
+	return count ;
+}
+
+void MockAgent::Clear()
+{
+	m_reqs.clear() ;
+	m_resp.clear() ;
+}
+
+long MockAgent::Answer(
+	const std::string&	method,
+	const std::string&	url,
+	const std::string&	data,
+	DataStream			*dest,
+	const Header&		hdr )
+{
+	m_reqs.push_back( Request( method, url, 0, hdr, data ) ) ;
+	m_error.clear() ;
+	
+	Response resp( 200, "" ) ;
+	std::deque<Response>& q = m_resp[Key( method, url )] ;
+	if ( !q.empty() )
+	{
+		resp = q.front() ;
+		q.pop_front() ;
+	}
+	
+	m_reqs.back().response = resp.first ;
+	if ( resp.first >= 400 )
+		m_error = resp.second ;
+	else if ( dest != 0 )
+		dest->Write( resp.second.c_str(), resp.second.size() ) ;
+	
+	return resp.first ;
+}
+
 } } // end of namespace
@@ -17,15 +17,24 @@
 	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
 */
 
+
 #pragma once
 
-#include "Agent.hh"
+#include "http/Agent.hh"
+
+#include <deque>
+#include <map>
+#include <string>
+#include <utility>
+#include <vector>
 
 namespace gr { namespace http {
 
 /*!	\brief	HTTP mock agent
 
-	This HTTP agent does nothing. It is used for unit test and dry runs.
+	This HTTP agent does not send anything. It records the requests, so tests
+	can check which requests were made, and answers them with the responses
+	given by Respond(), or "200 OK" with an empty body if there is none.
 */
 class MockAgent : public Agent
 {
@@ -35,30 +44,64 @@ public :
 	long Put(
 		const std::string&	url,
 		const std::string&	data,
-		Receivable			*dest,
+		DataStream			*dest,
+		const Header&		hdr ) ;
+
+	long Put(
+		const std::string&	url,
+		File				*file,
+		DataStream			*dest,
 		const Header&		hdr ) ;
 
 	long Get(
 		const std::string& 	url,
-		Receivable			*dest,
+		DataStream			*dest,
 		const Header&		hdr ) ;
 	
 	long Post(
 		const std::string& 	url,
 		const std::string&	data,
-		Receivable			*dest,
+		DataStream			*dest,
 		const Header&		hdr ) ;
 	
 	long Custom(
 		const std::string&	method,
 		const std::string&	url,
-		Receivable			*dest,
+		DataStream			*dest,
 		const Header&		hdr ) ;
 	
 	std::string RedirLocation() const ;
+	std::string ResponseHeader( const std::string& name ) const ;
+	std::string ErrorResponse() const ;
 	
 	std::string Escape( const std::string& str ) ;
 	std::string Unescape( const std::string& str ) ;
+	
+	void Respond(
+		const std::string&	method,
+		const std::string&	url,
+		long				response,
+		const std::string&	body = std::string() ) ;
+	
+	const std::vector<Request>& Requests() const ;
+	std::size_t Count( const std::string& method ) const ;
+	void Clear() ;
+
+private :
+	long Answer(
+		const std::string&	method,
+		const std::string&	url,
+		const std::string&	data,
+		DataStream			*dest,
+		const Header&		hdr ) ;
+
+private :
+	typedef std::pair<std::string, std::string>	Key ;
+	typedef std::pair<long, std::string>		Response ;
+	
+	std::map<Key, std::deque<Response> >	m_resp ;
+	std::vector<Request>					m_reqs ;
+	std::string								m_error ;
 } ;
 
 } } // end of namespace
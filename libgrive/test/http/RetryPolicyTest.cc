@@ -0,0 +1,165 @@
+/*
+	grive: an GPL program to sync a local directory with Google Drive
+	Copyright (C) 2012  Wan Wai Ho
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation version 2
+	of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+
+#include "RetryPolicyTest.hh"
+
+#include "Assert.hh"
+
+#include "http/RetryPolicy.hh"
+
+#include <vector>
+
+namespace grut {
+
+using namespace gr ;
+using namespace gr::http ;
+
+namespace
+{
+	/// a clock that never sleeps, but remembers how long it was asked to
+	class VirtualClock : public RetryPolicy::Clock
+	{
+	public :
+		VirtualClock( std::time_t now ) : m_now( now )
+		{
+		}
+		
+		std::time_t Now()
+		{
+			return m_now ;
+		}
+		
+		void Sleep( double sec )
+		{
+			m_sleeps.push_back( sec ) ;
+		}
+		
+		std::time_t			m_now ;
+		std::vector<double>	m_sleeps ;
+	} ;
+}
+
+RetryPolicyTest::RetryPolicyTest( )
+{
+}
+
+void RetryPolicyTest::TestRetryable( )
+{
+	CPPUNIT_ASSERT( RetryPolicy::IsRetryable( 500, "" ) ) ;
+	CPPUNIT_ASSERT( RetryPolicy::IsRetryable( 503, "" ) ) ;
+	CPPUNIT_ASSERT( RetryPolicy::IsRetryable( 429, "" ) ) ;
+	CPPUNIT_ASSERT( RetryPolicy::IsRetryable( 403, "<code>rateLimitExceeded</code>" ) ) ;
+	CPPUNIT_ASSERT( RetryPolicy::IsRetryable( 403, "<code>userRateLimitExceeded</code>" ) ) ;
+	
+	CPPUNIT_ASSERT( !RetryPolicy::IsRetryable( 403, "<code>insufficientPermissions</code>" ) ) ;
+	CPPUNIT_ASSERT( !RetryPolicy::IsRetryable( 404, "" ) ) ;
+	CPPUNIT_ASSERT( !RetryPolicy::IsRetryable( 200, "" ) ) ;
+}
+
+void RetryPolicyTest::TestParseRetryAfter( )
+{
+	// Wed, 21 Oct 2015 07:28:00 GMT
+	std::time_t now = 1445412480 ;
+	
+	GRUT_ASSERT_EQUAL( 120.0,	RetryPolicy::ParseRetryAfter( "120", now ) ) ;
+	GRUT_ASSERT_EQUAL( 30.0,	RetryPolicy::ParseRetryAfter( "Wed, 21 Oct 2015 07:28:30 GMT", now ) ) ;
+	GRUT_ASSERT_EQUAL( 0.0,		RetryPolicy::ParseRetryAfter( "Wed, 21 Oct 2015 07:00:00 GMT", now ) ) ;
+	CPPUNIT_ASSERT( RetryPolicy::ParseRetryAfter( "", now ) < 0 ) ;
+	CPPUNIT_ASSERT( RetryPolicy::ParseRetryAfter( "soon", now ) < 0 ) ;
+}
+
+void RetryPolicyTest::TestBackoff( )
+{
+	VirtualClock clock( 0 ) ;
+	RetryPolicy policy( 1, 10, 20, 1000, &clock, 1234 ) ;
+	
+	RetryPolicy::Budget budget( policy ) ;
+	for ( int i = 0 ; i < 20 ; i++ )
+		CPPUNIT_ASSERT( budget.Wait() ) ;
+	
+	GRUT_ASSERT_EQUAL( 20u, budget.Retries() ) ;
+	GRUT_ASSERT_EQUAL( 20u, clock.m_sleeps.size() ) ;
+	
+	// every delay is between the base and the cap, and at most 3 times
+	// the previous one
+	double prev = 1, total = 0 ;
+	for ( std::size_t i = 0 ; i < clock.m_sleeps.size() ; i++ )
+	{
+		double d = clock.m_sleeps[i] ;
+		CPPUNIT_ASSERT( d >= 1 ) ;
+		CPPUNIT_ASSERT( d <= 10 ) ;
+		CPPUNIT_ASSERT( d <= prev * 3 ) ;
+		
+		prev	= d ;
+		total	+= d ;
+	}
+	GRUT_ASSERT_EQUAL( total, budget.Waited() ) ;
+}
+
+void RetryPolicyTest::TestRetryAfter( )
+{
+	VirtualClock clock( 0 ) ;
+	RetryPolicy policy( 1, 10, 5, 1000, &clock, 1234 ) ;
+	
+	// server asks for longer than the cap
+	RetryPolicy::Budget budget( policy ) ;
+	CPPUNIT_ASSERT( budget.Wait( "60" ) ) ;
+	GRUT_ASSERT_EQUAL( 60.0, clock.m_sleeps.back() ) ;
+	
+	// shorter than our own delay: ours wins
+	CPPUNIT_ASSERT( budget.Wait( "0" ) ) ;
+	CPPUNIT_ASSERT( clock.m_sleeps.back() >= 1 ) ;
+}
+
+void RetryPolicyTest::TestBudget( )
+{
+	VirtualClock clock( 0 ) ;
+	
+	// at most 3 retries
+	RetryPolicy policy( 1, 1, 3, 1000, &clock, 1234 ) ;
+	RetryPolicy::Budget budget( policy ) ;
+	CPPUNIT_ASSERT( budget.Wait() ) ;
+	CPPUNIT_ASSERT( budget.Retry() ) ;
+	CPPUNIT_ASSERT( budget.Wait() ) ;
+	CPPUNIT_ASSERT( !budget.Wait() ) ;
+	CPPUNIT_ASSERT( !budget.Retry() ) ;
+	GRUT_ASSERT_EQUAL( 2u, clock.m_sleeps.size() ) ;
+	
+	// at most 100 seconds of waiting, the server wants more
+	RetryPolicy time_limited( 1, 10, 100, 100, &clock, 1234 ) ;
+	RetryPolicy::Budget b2( time_limited ) ;
+	CPPUNIT_ASSERT( b2.Wait( "90" ) ) ;
+	CPPUNIT_ASSERT( !b2.Wait( "90" ) ) ;
+	GRUT_ASSERT_EQUAL( 90.0, b2.Waited() ) ;
+	
+	// budgets of different requests are independent
+	RetryPolicy::Budget b3( time_limited ) ;
+	CPPUNIT_ASSERT( b3.Wait( "90" ) ) ;
+	
+	// Reserve() charges the budget like Wait(), but doesn't sleep
+	RetryPolicy::Budget b4( time_limited ) ;
+	std::size_t sleeps = clock.m_sleeps.size() ;
+	GRUT_ASSERT_EQUAL( 90.0, b4.Reserve( "90" ) ) ;
+	CPPUNIT_ASSERT( b4.Reserve( "90" ) < 0 ) ;
+	GRUT_ASSERT_EQUAL( 1u, b4.Retries() ) ;
+	GRUT_ASSERT_EQUAL( sleeps, clock.m_sleeps.size() ) ;
+}
+
+} // end of namespace grut
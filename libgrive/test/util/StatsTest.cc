@@ -0,0 +1,100 @@
+/*
+	grive: an GPL program to sync a local directory with Google Drive
+	Copyright (C) 2012  Wan Wai Ho
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation version 2
+	of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "StatsTest.hh"
+
+#include "util/Stats.hh"
+#include "protocol/Json.hh"
+
+#include <sstream>
+
+namespace grut {
+
+using namespace gr ;
+
+StatsTest::StatsTest( )
+{
+}
+
+void StatsTest::TestAdd( )
+{
+	Stats& stats = Stats::Inst() ;
+	stats.Add( "test.add", 1, 100 ) ;
+	stats.Add( "test.add", 2, 50 ) ;
+	stats.AddTime( "test.add", 0.5 ) ;
+	{
+		Stats::Timer timer( "test.timer" ) ;
+	}
+	
+	Stats::Values values = stats.Get() ;
+	CPPUNIT_ASSERT_EQUAL( static_cast<u64_t>( 4 ),	values["test.add"].count ) ;
+	CPPUNIT_ASSERT_EQUAL( static_cast<u64_t>( 150 ),	values["test.add"].amount ) ;
+	CPPUNIT_ASSERT_EQUAL( 0.5,	values["test.add"].seconds ) ;
+	CPPUNIT_ASSERT_EQUAL( static_cast<u64_t>( 1 ),	values["test.timer"].count ) ;
+	
+	Json json = stats.ToJson() ;
+	CPPUNIT_ASSERT_EQUAL( 150, json["test.add"]["amount"].Int() ) ;
+	CPPUNIT_ASSERT_EQUAL( 0.5, json["test.add"]["seconds"].Double() ) ;
+}
+
+void StatsTest::TestPrint( )
+{
+	Stats::Inst().Add( "test.print", 7, 1234 ) ;
+	
+	std::ostringstream ss ;
+	Stats::Inst().Print( ss ) ;
+	
+	std::string out = ss.str() ;
+	std::size_t pos = out.find( "test.print" ) ;
+	CPPUNIT_ASSERT( pos != std::string::npos ) ;
+	
+	std::string line = out.substr( pos, out.find( '\n', pos ) - pos ) ;
+	CPPUNIT_ASSERT( line.find( " 7 " ) != std::string::npos ) ;
+	CPPUNIT_ASSERT( line.find( "1234" ) != std::string::npos ) ;
+}
+
+void StatsTest::TestHistogram( )
+{
+	// every value is in a bucket whose upper bound is within 1/16 of it
+	for ( u64_t us = 1 ; us < 100000000 ; us = us * 3 + 1 )
+	{
+		u64_t upper = Stats::Histogram::Upper( Stats::Histogram::Bucket( us ) ) ;
+		CPPUNIT_ASSERT( upper >= us ) ;
+		CPPUNIT_ASSERT( upper - us <= us / 16 ) ;
+	}
+	
+	// 1ms to 100ms
+	Stats::Histogram h ;
+	for ( unsigned i = 1 ; i <= 100 ; i++ )
+		h.Add( i / 1000.0 ) ;
+	
+	CPPUNIT_ASSERT_EQUAL( static_cast<u64_t>( 100 ), h.Count() ) ;
+	CPPUNIT_ASSERT_DOUBLES_EQUAL( 0.050, h.Percentile( 0.50 ), 0.050 / 16 ) ;
+	CPPUNIT_ASSERT_DOUBLES_EQUAL( 0.095, h.Percentile( 0.95 ), 0.095 / 16 ) ;
+	CPPUNIT_ASSERT_DOUBLES_EQUAL( 0.099, h.Percentile( 0.99 ), 0.099 / 16 ) ;
+	CPPUNIT_ASSERT_EQUAL( 0.1, h.Percentile( 1.0 ) ) ;
+	CPPUNIT_ASSERT_EQUAL( 0.1, h.Max() ) ;
+	
+	Stats::Inst().AddSample( "test.hist", 0.25 ) ;
+	Json json = Stats::Inst().ToJson() ;
+	CPPUNIT_ASSERT_EQUAL( 1, json["test.hist"]["count"].Int() ) ;
+	CPPUNIT_ASSERT_EQUAL( 0.25, json["test.hist"]["p99"].Double() ) ;
+}
+
+} // end of namespace grut
@@ -0,0 +1,127 @@
+/*
+	grive: an GPL program to sync a local directory with Google Drive
+	Copyright (C) 2012  Wan Wai Ho
+
+	This program is free software; you can redistribute it and/or
+	modify it under the terms of the GNU General Public License
+	as published by the Free Software Foundation version 2
+	of the License.
+
+	This program is distributed in the hope that it will be useful,
+	but WITHOUT ANY WARRANTY; without even the implied warranty of
+	MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+	GNU General Public License for more details.
+
+	You should have received a copy of the GNU General Public License
+	along with this program; if not, write to the Free Software
+	Foundation, Inc., 51 Franklin Street, Fifth Floor, Boston, MA  02110-1301, USA.
+*/
+
+#include "WatcherTest.hh"
+
+#include "Assert.hh"
+
+#include "util/File.hh"
+#include "util/Watcher.hh"
+
+namespace grut {
+
+using namespace gr ;
+
+namespace
+{
+	bool IsHidden( const fs::path& path, bool )
+	{
+		return path.filename().string()[0] == '.' ;
+	}
+	
+	void Touch( const fs::path& file )
+	{
+		File f( file, 0600 ) ;
+		f.Write( "x", 1 ) ;
+	}
+	
+	bool IsMine( const fs::path& path, bool )
+	{
+		return path.filename() == "mine" ;
+	}
+}
+
+WatcherTest::WatcherTest( )
+{
+}
+
+void WatcherTest::TestChanges( )
+{
+#ifdef __linux__
+	const fs::path root = fs::temp_directory_path() / fs::unique_path() ;
+	fs::create_directories( root / "sub" ) ;
+	fs::create_directories( root / ".hidden" ) ;
+	
+	Watcher subject( &IsHidden ) ;
+	subject.Add( root ) ;
+	GRUT_ASSERT_EQUAL( subject.Size(), 2u ) ;
+	CPPUNIT_ASSERT( subject.Unwatched().empty() ) ;
+	
+	// nothing changed
+	std::set<fs::path> dirty ;
+	subject.Wait( 10, 10, dirty ) ;
+	CPPUNIT_ASSERT( dirty.empty() ) ;
+	
+	// hidden files are ignored
+	Touch( root / ".state" ) ;
+	Touch( root / ".hidden" / "file" ) ;
+	subject.Wait( 100, 10, dirty ) ;
+	CPPUNIT_ASSERT( dirty.empty() ) ;
+	
+	Touch( root / "sub" / "file" ) ;
+	subject.Wait( 1000, 10, dirty ) ;
+	GRUT_ASSERT_EQUAL( dirty.size(), 1u ) ;
+	GRUT_ASSERT_EQUAL( *dirty.begin(), root / "sub" ) ;
+	
+	// new directories are watched as well
+	dirty.clear() ;
+	fs::create_directories( root / "new" ) ;
+	subject.Wait( 1000, 10, dirty ) ;
+	GRUT_ASSERT_EQUAL( subject.Size(), 3u ) ;
+	
+	dirty.clear() ;
+	Touch( root / "new" / "file" ) ;
+	subject.Wait( 1000, 10, dirty ) ;
+	GRUT_ASSERT_EQUAL( dirty.size(), 1u ) ;
+	GRUT_ASSERT_EQUAL( *dirty.begin(), root / "new" ) ;
+	
+	fs::remove_all( root ) ;
+#endif
+}
+
+void WatcherTest::TestOwnChanges( )
+{
+#ifdef __linux__
+	const fs::path root = fs::temp_directory_path() / fs::unique_path() ;
+	fs::create_directories( root ) ;
+	
+	Watcher subject( &IsHidden, &IsMine ) ;
+	subject.Add( root ) ;
+	
+	std::set<fs::path> dirty ;
+	Touch( root / "mine" ) ;
+	subject.Wait( 100, 10, dirty ) ;
+	CPPUNIT_ASSERT( dirty.empty() ) ;
+	
+	// but the new directories are watched anyway
+	fs::create_directories( root / "sub" / "mine" ) ;
+	subject.Wait( 1000, 10, dirty ) ;
+	GRUT_ASSERT_EQUAL( subject.Size(), 3u ) ;
+	
+	dirty.clear() ;
+	Touch( root / "sub" / "mine" / "file" ) ;
+	subject.Wait( 1000, 10, dirty ) ;
+	GRUT_ASSERT_EQUAL( dirty.size(), 1u ) ;
+	GRUT_ASSERT_EQUAL( *dirty.begin(), root / "sub" / "mine" ) ;
+	
+	fs::remove_all( root ) ;
+#endif
+}
+
+} // end of namespace grut